@@ -214,7 +214,9 @@ HEADERS += src/qt/bitcreditgui.h \
   src/clientversion.h \
   src/coincontrol.h \
   src/coins.h \
+  src/coinsprefetch.h \
   src/compat.h \
+  src/compressdata.h \
   src/compressor.h \
   src/primitives/block.h \
   src/primitives/transaction.h \
@@ -244,6 +246,7 @@ HEADERS += src/qt/bitcreditgui.h \
   src/momentum.h \
   src/mruset.h \
   src/netbase.h \
+  src/netbuffer.h \
   src/net.h \
   src/noui.h \
   src/pow.h \
@@ -470,6 +473,7 @@ SOURCES += src/qt/bitcredit.cpp src/qt/bitcreditgui.cpp \
   src/rpcrawtransaction.cpp \
   src/rpcserver.cpp \
   src/script/sigcache.cpp \
+  src/coinsprefetch.cpp \
   src/smessage.cpp \
   src/timedata.cpp \
   src/txdb.cpp \
@@ -504,6 +508,7 @@ SOURCES += src/qt/bitcredit.cpp src/qt/bitcreditgui.cpp \
   src/bidtracker.cpp \
   src/chainparams.cpp \
   src/coins.cpp \
+  src/compressdata.cpp \
   src/compressor.cpp \
   src/darksend.cpp \
   src/darksend-relay.cpp \
@@ -523,6 +528,7 @@ SOURCES += src/qt/bitcredit.cpp src/qt/bitcreditgui.cpp \
   src/key.cpp \
   src/keystore.cpp \
   src/netbase.cpp \
+  src/netbuffer.cpp \
   src/protocol.cpp \
   src/pubkey.cpp \
   src/script/interpreter.cpp \
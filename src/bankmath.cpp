@@ -40,29 +40,34 @@ double  Bankmath::nettxratio ()
 CAmount Bankmath::stake()
 {
 	
-	CAmount d =data.balance()/data.Getgblmoneysupply();
+	// No money supply until the bank metrics were first refreshed
+	CAmount supply = data.Getgblmoneysupply();
+	if (supply == 0)
+		return 0;
+	CAmount d =data.balance()/supply;
 	return d;
 }
 
 double Bankmath::stage ()
 {
+	int nHeight = data.netheight();
 		
-	if (chainActive.Tip()->nHeight<105000)
+	if (nHeight<105000)
 		return 3;
 		
-	if (chainActive.Tip()->nHeight<210000)
+	if (nHeight<210000)
 		return 4.5;
 		
-	if (chainActive.Tip()->nHeight<315000)
+	if (nHeight<315000)
 		return 6;
 		
-	if (chainActive.Tip()->nHeight<420000)
+	if (nHeight<420000)
 		return 7.5;
 		
-	if (chainActive.Tip()->nHeight<425000)
+	if (nHeight<425000)
 		return 9;
 	
-	if (chainActive.Tip()->nHeight>530000)
+	if (nHeight>530000)
 		return 10.0;		
 		
 	return 0;
@@ -93,11 +98,12 @@ double Bankmath::Gettrust()
 			{//wallet useage up to 15
 				
 									
-				if (pwalletMain->mapWallet.size()>10000){
+				int nWalletTx = data.getNumTransactions();
+				if (nWalletTx>10000){
 					trust+= 15;
 				}
-				else if (pwalletMain->mapWallet.size()>0 && pwalletMain->mapWallet.size()< 10000){
-					trust+= pwalletMain->mapWallet.size()/1000;
+				else if (nWalletTx>0 && nWalletTx< 10000){
+					trust+= nWalletTx/1000;
 				}
 				else 
 					trust+= 0;		
@@ -166,7 +172,8 @@ double Bankmath::Gettrust()
 			
 			{ //network stake 15
 				
-				double stake = data.balance()/data.Getgblmoneysupply();
+				CAmount supply = data.Getgblmoneysupply();
+				double stake = supply == 0 ? 0 : data.balance()/supply;
 				if (stake> 0.01)
 					trust+=15;
 				else if (stake> 0.0001 && stake< 0.01)
@@ -218,17 +225,14 @@ double Bankmath::Getnetinterestrate()
     
 CAmount Bankmath::moneysupply()
 {
-	CCoinsStats ss;
-	FlushStateToDisk();
-	CAmount x =ss.nTotalAmount/COIN;
-
-	return x;
+	return data.Getgblmoneysupply();
 }
 
 double Bankmath::Getinflationrate()
 {
-	CCoinsStats ss;
-	CAmount x =ss.nTotalAmount/COIN;
+	CAmount x = data.Getgblmoneysupply();
+	if (x == 0)
+		return 0;
 	double m = 45000/x;
 	return m;
 }
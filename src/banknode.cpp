@@ -10,16 +10,25 @@
 #include "addrman.h"
 #include <boost/lexical_cast.hpp>
 
+#include <deque>
+
 CCriticalSection cs_banknodepayments;
 
 /** Object for who's going to get paid on which blocks */
 CBanknodePayments banknodePayments;
+/** Spent state of Banknode collaterals */
+CBanknodeCollaterals banknodeCollaterals;
 // keep track of Banknode votes I've seen
 map<uint256, CBanknodePaymentWinner> mapSeenBanknodeVotes;
 // keep track of the scanning errors I've seen
 map<uint256, int> mapSeenBanknodeScanningErrors;
-// cache block hashes as we calculate them
-std::map<int64_t, uint256> mapCacheBlockHashes;
+
+// hashes of the most recent blocks of the active chain, the tip last
+static CCriticalSection cs_blockhashes;
+static std::deque<uint256> dequeBlockHashes;
+static int nBlockHashesTip = -1;
+static uint64_t nBlockHashHits = 0;
+static uint64_t nBlockHashMisses = 0;
 
 void ProcessMessageBanknodePayments(CNode* pfrom, std::string& strCommand, CDataStream& vRecv)
 {
@@ -95,41 +104,90 @@ struct CompareValueOnly
 };
 
 //Get the last hash that matches the modulus given. Processed in reverse order
-bool GetBlockHash(uint256& hash, int nBlockHeight)
+/** Height of the block GetBlockHash() returns, given the height of the tip */
+static bool GetBlockHashHeight(int nTipHeight, int nBlockHeight, int& nHeight)
 {
-    if (chainActive.Tip() == NULL) return false;
+    if (nTipHeight <= 0) return false;
 
     if(nBlockHeight == 0)
-        nBlockHeight = chainActive.Tip()->nHeight;
+        nBlockHeight = nTipHeight;
+    if(nTipHeight+1 < nBlockHeight) return false;
 
-    if(mapCacheBlockHashes.count(nBlockHeight)){
-        hash = mapCacheBlockHashes[nBlockHeight];
-        return true;
+    // the block before nBlockHeight; the genesis block never counts
+    nHeight = nBlockHeight > 0 ? nBlockHeight - 1 : nTipHeight;
+    return nHeight > 0;
+}
+
+bool GetBlockHash(uint256& hash, int nBlockHeight)
+{
+    int nHeight;
+    {
+        LOCK(cs_blockhashes);
+        if (nBlockHashesTip >= 0) {
+            if (!GetBlockHashHeight(nBlockHashesTip, nBlockHeight, nHeight)) return false;
+            int nFirst = nBlockHashesTip - (int)dequeBlockHashes.size() + 1;
+            if (nHeight >= nFirst) {
+                hash = dequeBlockHashes[nHeight - nFirst];
+                nBlockHashHits++;
+                return true;
+            }
+        }
     }
 
-    const CBlockIndex *BlockLastSolved = chainActive.Tip();
-    const CBlockIndex *BlockReading = chainActive.Tip();
+    // older blocks, or no tip seen yet; callers may hold locks that are taken
+    // after cs_main elsewhere, so give up rather than wait for it
+    TRY_LOCK(cs_main, lockMain);
+    if (!lockMain) return false;
+    const CBlockIndex* pindexTip = chainActive.Tip();
+    if (pindexTip == NULL || !GetBlockHashHeight(pindexTip->nHeight, nBlockHeight, nHeight)) return false;
+    const CBlockIndex* pindex = chainActive[nHeight];
+    if (pindex == NULL) return false;
+    hash = pindex->GetBlockHash();
+
+    LOCK(cs_blockhashes);
+    nBlockHashMisses++;
+    return true;
+}
 
-    if (BlockLastSolved == NULL || BlockLastSolved->nHeight == 0 || chainActive.Tip()->nHeight+1 < nBlockHeight) return false;
+void UpdateBlockHashes(const CBlockIndex* pindexTip)
+{
+    LOCK(cs_blockhashes);
 
-    int nBlocksAgo = 0;
-    if(nBlockHeight > 0) nBlocksAgo = (chainActive.Tip()->nHeight+1)-nBlockHeight;
-    assert(nBlocksAgo >= 0);
+    if (pindexTip == NULL) {
+        dequeBlockHashes.clear();
+        nBlockHashesTip = -1;
+        return;
+    }
 
-    int n = 0;
-    for (unsigned int i = 1; BlockReading && BlockReading->nHeight > 0; i++) {
-        if(n >= nBlocksAgo){
-            hash = BlockReading->GetBlockHash();
-            mapCacheBlockHashes[nBlockHeight] = hash;
-            return true;
-        }
-        n++;
+    // blocks disconnected
+    while (nBlockHashesTip > pindexTip->nHeight && !dequeBlockHashes.empty()) {
+        dequeBlockHashes.pop_back();
+        nBlockHashesTip--;
+    }
 
-        if (BlockReading->pprev == NULL) { assert(BlockReading); break; }
-        BlockReading = BlockReading->pprev;
+    if (!dequeBlockHashes.empty() && nBlockHashesTip == pindexTip->nHeight && dequeBlockHashes.back() == pindexTip->GetBlockHash()) {
+        // unchanged
+    } else if (!dequeBlockHashes.empty() && nBlockHashesTip + 1 == pindexTip->nHeight && dequeBlockHashes.back() == *pindexTip->pprev->phashBlock) {
+        // block connected
+        dequeBlockHashes.push_back(pindexTip->GetBlockHash());
+        nBlockHashesTip++;
+    } else {
+        // on startup or after a jump of the tip, copy the recent blocks over
+        dequeBlockHashes.clear();
+        for (const CBlockIndex* pindex = pindexTip; pindex != NULL && dequeBlockHashes.size() < BANKNODE_BLOCK_HASHES; pindex = pindex->pprev)
+            dequeBlockHashes.push_front(pindex->GetBlockHash());
+        nBlockHashesTip = pindexTip->nHeight;
     }
 
-    return false;
+    while (dequeBlockHashes.size() > BANKNODE_BLOCK_HASHES)
+        dequeBlockHashes.pop_front();
+}
+
+void GetBlockHashStats(uint64_t& nHits, uint64_t& nMisses)
+{
+    LOCK(cs_blockhashes);
+    nHits = nBlockHashHits;
+    nMisses = nBlockHashMisses;
 }
 
 CBanknode::CBanknode()
@@ -214,11 +272,17 @@ uint256 CBanknode::CalculateScore(int mod, int64_t nBlockHeight)
     if(chainActive.Tip() == NULL) return 0;
 
     uint256 hash = 0;
-    uint256 aux = vin.prevout.hash + vin.prevout.n;
 
     if(!GetBlockHash(hash, nBlockHeight)) return 0;
 
     uint256 hash2 = Hash(BEGIN(hash), END(hash));
+
+    return CalculateScore(hash, hash2);
+}
+
+uint256 CBanknode::CalculateScore(const uint256& hash, const uint256& hash2) const
+{
+    uint256 aux = vin.prevout.hash + vin.prevout.n;
     uint256 hash3 = Hash(BEGIN(hash), END(hash), BEGIN(aux), END(aux));
 
     uint256 r = (hash3 > hash2 ? hash3 - hash2 : hash2 - hash3);
@@ -228,10 +292,6 @@ uint256 CBanknode::CalculateScore(int mod, int64_t nBlockHeight)
 
 void CBanknode::Check()
 {
-    //TODO: Random segfault with this line removed
-    TRY_LOCK(cs_main, lockRecv);
-    if(!lockRecv) return;
-
     if(nScanningErrorCount >= BANKNODE_SCANNING_ERROR_THESHOLD)
     {
         activeState = BANKNODE_POS_ERROR;
@@ -253,20 +313,12 @@ void CBanknode::Check()
     }
 
     if(!unitTest){
-        CValidationState state;
-        CMutableTransaction tx = CTransaction();
-        if (chainActive.Tip()->nHeight<145000) {
-        CTxOut vout = CTxOut(249999.99*COIN, darkSendPool.collateralPubKey);
-                tx.vin.push_back(vin);
-        tx.vout.push_back(vout);
-		}else {
-        CTxOut vout = CTxOut(49999.99*COIN, darkSendPool.collateralPubKey);
-                tx.vin.push_back(vin);
-        tx.vout.push_back(vout);
-		}
-
-
-        if(!AcceptableInputs(mempool, state, tx)){
+        CBanknodeCollaterals::State collateral = banknodeCollaterals.Check(vin.prevout);
+
+        // not looked up yet, try again on the next check
+        if(collateral == CBanknodeCollaterals::COLLATERAL_UNKNOWN) return;
+
+        if(collateral == CBanknodeCollaterals::COLLATERAL_SPENT){
             activeState = BANKNODE_VIN_SPENT;
             return;
         }
@@ -275,6 +327,94 @@ void CBanknode::Check()
     activeState = BANKNODE_ENABLED; // OK
 }
 
+CBanknodeCollaterals::State CBanknodeCollaterals::Check(const COutPoint& outpoint)
+{
+    CCollateral collateral;
+    int nHeight;
+    {
+        LOCK(cs);
+        std::map<COutPoint, CCollateral>::const_iterator it = mapCollaterals.find(outpoint);
+        if(it != mapCollaterals.end()){
+            collateral = it->second;
+            nHeight = nTipHeight;
+        } else {
+            TRY_LOCK(cs_main, lockMain);
+            if(!lockMain) return COLLATERAL_UNKNOWN;
+
+            const CCoins* coins = pcoinsTip->AccessCoins(outpoint.hash);
+            collateral.fUnspent = coins != NULL && coins->IsAvailable(outpoint.n);
+            collateral.fCoinBase = collateral.fUnspent && coins->IsCoinBase();
+            collateral.nHeight = collateral.fUnspent ? coins->nHeight : 0;
+            collateral.nValue = collateral.fUnspent ? coins->vout[outpoint.n].nValue : 0;
+            mapCollaterals[outpoint] = collateral;
+            nHeight = nTipHeight = chainActive.Height();
+        }
+    }
+
+    if(!collateral.fUnspent) return COLLATERAL_SPENT;
+
+    // the same limits the collateral was held to by a trial spend in the mempool
+    CAmount nMinValue = nHeight < 145000 ? 249999.99*COIN : 49999.99*COIN;
+    if(collateral.nValue < nMinValue) return COLLATERAL_SPENT;
+    if(collateral.fCoinBase && nHeight + 1 - collateral.nHeight < COINBASE_MATURITY) return COLLATERAL_SPENT;
+
+    // spent by a transaction that is not mined yet
+    {
+        LOCK(mempool.cs);
+        if(mempool.mapNextTx.count(outpoint)) return COLLATERAL_SPENT;
+    }
+
+    return COLLATERAL_UNSPENT;
+}
+
+void CBanknodeCollaterals::Forget(const COutPoint& outpoint)
+{
+    LOCK(cs);
+    mapCollaterals.erase(outpoint);
+}
+
+void CBanknodeCollaterals::ConnectBlock(const CBlock& block, int nHeight)
+{
+    LOCK(cs);
+    nTipHeight = nHeight;
+    if(mapCollaterals.empty()) return;
+
+    BOOST_FOREACH(const CTransaction& tx, block.vtx) {
+        if(!tx.IsCoinBase()) {
+            BOOST_FOREACH(const CTxIn& txin, tx.vin) {
+                std::map<COutPoint, CCollateral>::iterator it = mapCollaterals.find(txin.prevout);
+                if(it != mapCollaterals.end())
+                    it->second.fUnspent = false;
+            }
+        }
+        // outputs that come back after a reorg are looked up again
+        uint256 hash = tx.GetHash();
+        for(unsigned int i = 0; i < tx.vout.size(); i++)
+            mapCollaterals.erase(COutPoint(hash, i));
+    }
+}
+
+void CBanknodeCollaterals::DisconnectBlock(const CBlock& block, int nHeight)
+{
+    LOCK(cs);
+    nTipHeight = nHeight;
+    if(mapCollaterals.empty()) return;
+
+    BOOST_FOREACH(const CTransaction& tx, block.vtx) {
+        // the outputs of the block are gone
+        uint256 hash = tx.GetHash();
+        for(unsigned int i = 0; i < tx.vout.size(); i++) {
+            std::map<COutPoint, CCollateral>::iterator it = mapCollaterals.find(COutPoint(hash, i));
+            if(it != mapCollaterals.end())
+                it->second.fUnspent = false;
+        }
+        // and the outputs it spent are back, to be looked up again
+        if(!tx.IsCoinBase())
+            BOOST_FOREACH(const CTxIn& txin, tx.vin)
+                mapCollaterals.erase(txin.prevout);
+    }
+}
+
 bool CBanknodePayments::CheckSignature(CBanknodePaymentWinner& winner)
 {
     //note: need to investigate why this is failing
@@ -36,20 +36,34 @@
 #define BANKNODE_PING_SECONDS                (1*60)
 #define BANKNODE_EXPIRATION_SECONDS          (65*60)
 #define BANKNODE_REMOVAL_SECONDS             (70*60)
+#define BANKNODE_BLOCK_HASHES                2048
 
 using namespace std;
 
+class CBlockIndex;
 class CBanknode;
 class CBanknodePayments;
 class CBanknodePaymentWinner;
+class CBanknodeCollaterals;
 
 extern CCriticalSection cs_banknodepayments;
 extern map<uint256, CBanknodePaymentWinner> mapSeenBanknodeVotes;
-extern map<int64_t, uint256> mapCacheBlockHashes;
 extern CBanknodePayments banknodePayments;
+extern CBanknodeCollaterals banknodeCollaterals;
 
 void ProcessMessageBanknodePayments(CNode* pfrom, std::string& strCommand, CDataStream& vRecv);
+/**
+ * Hash of the block before nBlockHeight in the active chain. nBlockHeight 0
+ * stands for the height of the tip, giving the block before the tip; a
+ * negative nBlockHeight gives the tip itself. Returns false if the block is
+ * unknown, or if it is older than the recent hashes kept here and cs_main is
+ * busy.
+ */
 bool GetBlockHash(uint256& hash, int nBlockHeight);
+/** Follow the active chain after its tip changed */
+void UpdateBlockHashes(const CBlockIndex* pindexTip);
+/** Lookups answered from the recent block hashes, and lookups that fell back to chainActive */
+void GetBlockHashStats(uint64_t& nHits, uint64_t& nMisses);
 
 //
 // The Banknode Class. For managing the Darksend process. It contains the input of the 1000DRK, signature to prove
@@ -137,6 +151,8 @@ public:
     }
 
     uint256 CalculateScore(int mod=1, int64_t nBlockHeight=0);
+    /// Score against a block hash, given the double hash of the block hash
+    uint256 CalculateScore(const uint256& hash, const uint256& hash2) const;
 
     ADD_SERIALIZE_METHODS;
 
@@ -284,6 +300,49 @@ public:
      }
 };
 
+//
+// Banknode Collaterals Class
+// Follows whether the collateral outputs of Banknodes are spent, so that checking a
+// Banknode needs neither cs_main nor a trial run through the mempool acceptance code
+//
+
+class CBanknodeCollaterals
+{
+private:
+    struct CCollateral
+    {
+        bool fUnspent;
+        bool fCoinBase;
+        int nHeight;
+        CAmount nValue;
+    };
+
+    mutable CCriticalSection cs;
+    std::map<COutPoint, CCollateral> mapCollaterals;
+    // height of the chain the collaterals were last brought up to date with
+    int nTipHeight;
+
+public:
+    enum State {
+        COLLATERAL_UNKNOWN,
+        COLLATERAL_UNSPENT,
+        COLLATERAL_SPENT
+    };
+
+    CBanknodeCollaterals() : nTipHeight(0) {}
+
+    /// Whether a collateral can still back a Banknode. An output seen for the first time
+    /// is looked up in the UTXO set, which gives COLLATERAL_UNKNOWN while cs_main is busy.
+    State Check(const COutPoint& outpoint);
+
+    /// Stop following the collateral of a removed Banknode
+    void Forget(const COutPoint& outpoint);
+
+    /// Follow a block connected to or disconnected from the active chain (requires cs_main)
+    void ConnectBlock(const CBlock& block, int nHeight);
+    void DisconnectBlock(const CBlock& block, int nHeight);
+};
+
 //
 // Banknode Payments Class
 // Keeps track of who should get paid for which blocks
@@ -17,20 +17,12 @@ CCriticalSection cs_process_message;
 /** Banknode manager */
 CBanknodeMan mnodeman;
 
-struct CompareValueOnly
+struct CompareScoreDescending
 {
-    bool operator()(const pair<int64_t, CTxIn>& t1,
-                    const pair<int64_t, CTxIn>& t2) const
+    bool operator()(const pair<unsigned int, unsigned int>& t1,
+                    const pair<unsigned int, unsigned int>& t2) const
     {
-        return t1.first < t2.first;
-    }
-};
-struct CompareValueOnlyMN
-{
-    bool operator()(const pair<int64_t, CBanknode>& t1,
-                    const pair<int64_t, CBanknode>& t2) const
-    {
-        return t1.first < t2.first;
+        return t1.first > t2.first;
     }
 };
 
@@ -191,6 +183,7 @@ void DumpBanknodes()
 
 CBanknodeMan::CBanknodeMan() {
     nDsqCount = 0;
+    pindexRankings = NULL;
 }
 
 bool CBanknodeMan::Add(CBanknode &mn)
@@ -206,6 +199,7 @@ bool CBanknodeMan::Add(CBanknode &mn)
     {
         if(fDebug) LogPrintf("CBanknodeMan: Adding new Banknode %s - %i now\n", mn.addr.ToString().c_str(), size() + 1);
         vBanknodes.push_back(mn);
+        InvalidateRankings();
         return true;
     }
 
@@ -217,7 +211,23 @@ void CBanknodeMan::Check()
     LOCK(cs);
 
     BOOST_FOREACH(CBanknode& mn, vBanknodes)
-        mn.Check();
+        CheckBanknode(mn);
+}
+
+bool CBanknodeMan::CheckBanknode(CBanknode& mn)
+{
+    int nState = mn.activeState;
+    mn.Check();
+    if(mn.activeState == nState) return false;
+
+    InvalidateRankings();
+    return true;
+}
+
+void CBanknodeMan::InvalidateRankings()
+{
+    LOCK(cs);
+    mapRankings.clear();
 }
 
 void CBanknodeMan::CheckAndRemove()
@@ -231,7 +241,9 @@ void CBanknodeMan::CheckAndRemove()
     while(it != vBanknodes.end()){
         if((*it).activeState == CBanknode::BANKNODE_REMOVE || (*it).activeState == CBanknode::BANKNODE_VIN_SPENT){
             if(fDebug) LogPrintf("CBanknodeMan: Removing inactive Banknode %s - %i now\n", (*it).addr.ToString().c_str(), size() - 1);
+            banknodeCollaterals.Forget((*it).vin.prevout);
             it = vBanknodes.erase(it);
+            InvalidateRankings();
         } else {
             ++it;
         }
@@ -273,6 +285,7 @@ void CBanknodeMan::Clear()
 {
     LOCK(cs);
     vBanknodes.clear();
+    InvalidateRankings();
     mAskedUsForBanknodeList.clear();
     mWeAskedForBanknodeList.clear();
     mWeAskedForBanknodeListEntry.clear();
@@ -284,7 +297,7 @@ int CBanknodeMan::CountEnabled()
     int i = 0;
 
     BOOST_FOREACH(CBanknode& mn, vBanknodes) {
-        mn.Check();
+        CheckBanknode(mn);
         if(mn.IsEnabled()) i++;
     }
 
@@ -296,7 +309,7 @@ int CBanknodeMan::CountBanknodesAboveProtocol(int protocolVersion)
     int i = 0;
 
     BOOST_FOREACH(CBanknode& mn, vBanknodes) {
-        mn.Check();
+        CheckBanknode(mn);
         if(mn.protocolVersion < protocolVersion || !mn.IsEnabled()) continue;
         i++;
     }
@@ -355,7 +368,7 @@ CBanknode* CBanknodeMan::FindOldestNotInVec(const std::vector<CTxIn> &vVins, int
 
     BOOST_FOREACH(CBanknode &mn, vBanknodes)
     {
-        mn.Check();
+        CheckBanknode(mn);
         if(!mn.IsEnabled()) continue;
 
         
@@ -389,136 +402,132 @@ CBanknode *CBanknodeMan::FindRandom()
     return &vBanknodes[GetRandInt(vBanknodes.size())];
 }
 
-CBanknode* CBanknodeMan::GetCurrentBankNode(int mod, int64_t nBlockHeight, int minProtocol)
+const CBanknodeRanking& CBanknodeMan::GetRanking(int64_t nBlockHeight, int minProtocol, bool fOnlyActive)
 {
-    unsigned int score = 0;
-    CBanknode* winner = NULL;
-
-    // scan for winner
-    BOOST_FOREACH(CBanknode& mn, vBanknodes) {
-        mn.Check();
-        if(mn.protocolVersion < minProtocol || !mn.IsEnabled()) continue;
-
-        // calculate the score for each Banknode
-        uint256 n = mn.CalculateScore(mod, nBlockHeight);
-        unsigned int n2 = 0;
-        memcpy(&n2, &n, sizeof(n2));
-
-        // determine the winner
-        if(n2 > score){
-            score = n2;
-            winner = &mn;
-        }
+    // the block of a height and the enabled Banknodes can change with every new tip
+    if(pindexRankings != chainActive.Tip()){
+        mapRankings.clear();
+        pindexRankings = chainActive.Tip();
     }
 
-    return winner;
-}
+    RankingKey key = make_pair(nBlockHeight, make_pair(minProtocol, fOnlyActive));
+    std::map<RankingKey, CBanknodeRanking>::iterator it = mapRankings.find(key);
+    // without its block, the lookup may just have found cs_main busy; try again
+    if(it != mapRankings.end() && it->second.fBlockKnown) return it->second;
 
-int CBanknodeMan::GetBanknodeRank(const CTxIn& vin, int64_t nBlockHeight, int minProtocol, bool fOnlyActive)
-{
-    std::vector<pair<unsigned int, CTxIn> > vecBanknodeScores;
+    // bring states up to date first, as a change drops the rankings
+    if(fOnlyActive)
+        BOOST_FOREACH(CBanknode& mn, vBanknodes)
+            CheckBanknode(mn);
 
-    //make sure we know about this block
-    uint256 hash = 0;
-    if(!GetBlockHash(hash, nBlockHeight)) return -1;
-
-    // scan for winner
-    BOOST_FOREACH(CBanknode& mn, vBanknodes) {
+    if(mapRankings.size() >= BANKNODE_RANKINGS_MAX)
+        mapRankings.erase(mapRankings.begin());
+    CBanknodeRanking& ranking = mapRankings[key];
+    ranking = CBanknodeRanking();
 
+    // the hash of the block is the same for every Banknode, only hash it once
+    uint256 hash = 0;
+    uint256 hash2 = 0;
+    ranking.fBlockKnown = chainActive.Tip() != NULL && GetBlockHash(hash, nBlockHeight);
+    if(ranking.fBlockKnown)
+        hash2 = Hash(BEGIN(hash), END(hash));
+
+    ranking.vScores.reserve(vBanknodes.size());
+    for(unsigned int i = 0; i < vBanknodes.size(); i++){
+        CBanknode& mn = vBanknodes[i];
         if(mn.protocolVersion < minProtocol) continue;
-        if(fOnlyActive) {
-            mn.Check();
-            if(!mn.IsEnabled()) continue;
-        }
+        if(fOnlyActive && !mn.IsEnabled()) continue;
 
-        uint256 n = mn.CalculateScore(1, nBlockHeight);
         unsigned int n2 = 0;
-        memcpy(&n2, &n, sizeof(n2));
+        if(ranking.fBlockKnown){
+            uint256 n = mn.CalculateScore(hash, hash2);
+            memcpy(&n2, &n, sizeof(n2));
+        }
 
-        vecBanknodeScores.push_back(make_pair(n2, mn.vin));
+        ranking.vScores.push_back(make_pair(n2, i));
     }
 
-    sort(vecBanknodeScores.rbegin(), vecBanknodeScores.rend(), CompareValueOnly());
+    // equal scores keep the order of the list
+    stable_sort(ranking.vScores.begin(), ranking.vScores.end(), CompareScoreDescending());
 
-    int rank = 0;
-    BOOST_FOREACH (PAIRTYPE(unsigned int, CTxIn)& s, vecBanknodeScores){
-        rank++;
-        if(s.second == vin) {
-            return rank;
-        }
-    }
+    for(unsigned int i = 0; i < ranking.vScores.size(); i++)
+        ranking.mapRanks[vBanknodes[ranking.vScores[i].second].vin.prevout] = i + 1;
 
-    return -1;
+    return ranking;
 }
 
-std::vector<pair<int, CBanknode> > CBanknodeMan::GetBanknodeRanks(int64_t nBlockHeight, int minProtocol)
+CBanknode* CBanknodeMan::GetCurrentBankNode(int mod, int64_t nBlockHeight, int minProtocol)
 {
-    std::vector<pair<unsigned int, CBanknode> > vecBanknodeScores;
-    std::vector<pair<int, CBanknode> > vecBanknodeRanks;
+    LOCK(cs);
 
-    //make sure we know about this block
-    uint256 hash = 0;
-    if(!GetBlockHash(hash, nBlockHeight)) return vecBanknodeRanks;
+    const CBanknodeRanking* pranking = &GetRanking(nBlockHeight, minProtocol, true);
 
-    // scan for winner
-    BOOST_FOREACH(CBanknode& mn, vBanknodes) {
+    // the ranking may be older than the winner expiring or losing its collateral
+    if(!pranking->vScores.empty() && CheckBanknode(vBanknodes[pranking->vScores[0].second]))
+        pranking = &GetRanking(nBlockHeight, minProtocol, true);
 
-        mn.Check();
+    // a Banknode without a score never wins
+    if(pranking->vScores.empty() || pranking->vScores[0].first == 0) return NULL;
 
-        if(mn.protocolVersion < minProtocol) continue;
-        if(!mn.IsEnabled()) {
-            continue;
-        }
+    return &vBanknodes[pranking->vScores[0].second];
+}
 
-        uint256 n = mn.CalculateScore(1, nBlockHeight);
-        unsigned int n2 = 0;
-        memcpy(&n2, &n, sizeof(n2));
+int CBanknodeMan::GetBanknodeRank(const CTxIn& vin, int64_t nBlockHeight, int minProtocol, bool fOnlyActive)
+{
+    LOCK(cs);
+
+    const CBanknodeRanking* pranking = &GetRanking(nBlockHeight, minProtocol, fOnlyActive);
 
-        vecBanknodeScores.push_back(make_pair(n2, mn));
+    // the ranking may be older than the Banknode expiring or losing its collateral
+    if(fOnlyActive){
+        std::map<COutPoint, int>::const_iterator it = pranking->mapRanks.find(vin.prevout);
+        if(it != pranking->mapRanks.end() && CheckBanknode(vBanknodes[pranking->vScores[it->second - 1].second]))
+            pranking = &GetRanking(nBlockHeight, minProtocol, fOnlyActive);
     }
 
-    sort(vecBanknodeScores.rbegin(), vecBanknodeScores.rend(), CompareValueOnlyMN());
+    //make sure we know about this block
+    if(!pranking->fBlockKnown) return -1;
 
-    int rank = 0;
-    BOOST_FOREACH (PAIRTYPE(unsigned int, CBanknode)& s, vecBanknodeScores){
-        rank++;
-        vecBanknodeRanks.push_back(make_pair(rank, s.second));
-    }
+    std::map<COutPoint, int>::const_iterator it = pranking->mapRanks.find(vin.prevout);
+    if(it == pranking->mapRanks.end()) return -1;
+    if(!(vBanknodes[pranking->vScores[it->second - 1].second].vin == vin)) return -1;
 
-    return vecBanknodeRanks;
+    return it->second;
 }
 
-CBanknode* CBanknodeMan::GetBanknodeByRank(int nRank, int64_t nBlockHeight, int minProtocol, bool fOnlyActive)
+std::vector<pair<int, CBanknode> > CBanknodeMan::GetBanknodeRanks(int64_t nBlockHeight, int minProtocol)
 {
-    std::vector<pair<unsigned int, CTxIn> > vecBanknodeScores;
+    LOCK(cs);
 
-    // scan for winner
-    BOOST_FOREACH(CBanknode& mn, vBanknodes) {
+    std::vector<pair<int, CBanknode> > vecBanknodeRanks;
 
-        if(mn.protocolVersion < minProtocol) continue;
-        if(fOnlyActive) {
-            mn.Check();
-            if(!mn.IsEnabled()) continue;
-        }
+    const CBanknodeRanking& ranking = GetRanking(nBlockHeight, minProtocol, true);
 
-        uint256 n = mn.CalculateScore(1, nBlockHeight);
-        unsigned int n2 = 0;
-        memcpy(&n2, &n, sizeof(n2));
+    //make sure we know about this block
+    if(!ranking.fBlockKnown) return vecBanknodeRanks;
 
-        vecBanknodeScores.push_back(make_pair(n2, mn.vin));
-    }
+    vecBanknodeRanks.reserve(ranking.vScores.size());
+    for(unsigned int i = 0; i < ranking.vScores.size(); i++)
+        vecBanknodeRanks.push_back(make_pair(i + 1, vBanknodes[ranking.vScores[i].second]));
 
-    sort(vecBanknodeScores.rbegin(), vecBanknodeScores.rend(), CompareValueOnly());
+    return vecBanknodeRanks;
+}
 
-    int rank = 0;
-    BOOST_FOREACH (PAIRTYPE(unsigned int, CTxIn)& s, vecBanknodeScores){
-        rank++;
-        if(rank == nRank) {
-            return Find(s.second);
-        }
+CBanknode* CBanknodeMan::GetBanknodeByRank(int nRank, int64_t nBlockHeight, int minProtocol, bool fOnlyActive)
+{
+    LOCK(cs);
+
+    const CBanknodeRanking* pranking = &GetRanking(nBlockHeight, minProtocol, fOnlyActive);
+
+    if(nRank < 1 || nRank > (int)pranking->vScores.size()) return NULL;
+
+    // the ranking may be older than the Banknode expiring or losing its collateral
+    if(fOnlyActive && CheckBanknode(vBanknodes[pranking->vScores[nRank - 1].second])){
+        pranking = &GetRanking(nBlockHeight, minProtocol, fOnlyActive);
+        if(nRank > (int)pranking->vScores.size()) return NULL;
     }
 
-    return NULL;
+    return &vBanknodes[pranking->vScores[nRank - 1].second];
 }
 
 void CBanknodeMan::ProcessBanknodeConnections()
@@ -632,7 +641,8 @@ void CBanknodeMan::ProcessMessage(CNode* pfrom, std::string& strCommand, CDataSt
                     pmn->sig = vchSig;
                     pmn->protocolVersion = protocolVersion;
                     pmn->addr = addr;
-                    pmn->Check();
+                    InvalidateRankings();
+                    CheckBanknode(*pmn);
                     if(pmn->IsEnabled())
                         mnodeman.RelayBanknodeEntry(vin, addr, vchSig, sigTime, pubkey, pubkey2, count, current, lastUpdated, protocolVersion);
                 }
@@ -768,11 +778,15 @@ void CBanknodeMan::ProcessMessage(CNode* pfrom, std::string& strCommand, CDataSt
 
                 if(!pmn->UpdatedWithin(BANKNODE_MIN_DSEEP_SECONDS))
                 {
-                    if(stop) pmn->Disable();
+                    if(stop)
+                    {
+                        pmn->Disable();
+                        InvalidateRankings();
+                    }
                     else
                     {
                         pmn->UpdateLastSeen();
-                        pmn->Check();
+                        CheckBanknode(*pmn);
                         if(!pmn->IsEnabled()) return;
                     }
                     mnodeman.RelayBanknodeEntryPing(vin, vchSig, sigTime, stop);
@@ -903,9 +917,12 @@ void CBanknodeMan::Remove(CTxIn vin)
     while(it != vBanknodes.end()){
         if((*it).vin == vin){
             if(fDebug) LogPrintf("CBanknodeMan: Removing Banknode %s - %i now\n", (*it).addr.ToString().c_str(), size() - 1);
+            banknodeCollaterals.Forget((*it).vin.prevout);
             vBanknodes.erase(it);
+            InvalidateRankings();
             break;
         }
+        ++it;
     }
 }
 
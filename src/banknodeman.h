@@ -18,6 +18,7 @@
 
 #define BANKNODES_DUMP_SECONDS               (15*60)
 #define BANKNODES_DSEG_SECONDS               (3*60*60)
+#define BANKNODE_RANKINGS_MAX                64
 
 using namespace std;
 
@@ -49,6 +50,21 @@ public:
     ReadResult Read(CBanknodeMan& mnodemanToLoad);
 };
 
+/** Banknodes ordered by their score for one block, see CBanknodeMan::GetRanking()
+ */
+class CBanknodeRanking
+{
+public:
+    // whether the block to score against is in the active chain
+    bool fBlockKnown;
+    // score and position in vBanknodes, best first
+    std::vector<std::pair<unsigned int, unsigned int> > vScores;
+    // rank of every ranked Banknode, starting at 1
+    std::map<COutPoint, int> mapRanks;
+
+    CBanknodeRanking() : fBlockKnown(false) {}
+};
+
 class CBanknodeMan
 {
 private:
@@ -64,6 +80,18 @@ private:
     // which Banknodes we've asked for
     std::map<COutPoint, int64_t> mWeAskedForBanknodeListEntry;
 
+    // rankings by block height, minimum protocol and whether only enabled Banknodes are ranked
+    typedef std::pair<int64_t, std::pair<int, bool> > RankingKey;
+    std::map<RankingKey, CBanknodeRanking> mapRankings;
+    // chain tip the rankings were calculated at
+    const CBlockIndex* pindexRankings;
+
+    /// Ranking for a block, calculated on first use (requires cs)
+    const CBanknodeRanking& GetRanking(int64_t nBlockHeight, int minProtocol, bool fOnlyActive);
+
+    /// Check a Banknode, dropping the rankings if its state changed; returns whether it did
+    bool CheckBanknode(CBanknode& mn);
+
 public:
     // keep track of dsq count to prevent banknodes from gaming darksend queue
     int64_t nDsqCount;
@@ -87,6 +115,8 @@ ADD_SERIALIZE_METHODS;
                 READWRITE(mWeAskedForBanknodeList);
                 READWRITE(mWeAskedForBanknodeListEntry);
                 READWRITE(nDsqCount);
+                if (ser_action.ForRead())
+                    InvalidateRankings();
         }
  	}
 
@@ -105,6 +135,9 @@ ADD_SERIALIZE_METHODS;
     /// Clear Banknode vector
     void Clear();
 
+    /// Forget the cached rankings after the list or the state of a Banknode changed
+    void InvalidateRankings();
+
     int CountEnabled();
 
     int CountBanknodesAboveProtocol(int protocolVersion);
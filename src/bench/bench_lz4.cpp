@@ -0,0 +1,164 @@
+// Copyright (c) 2015 The Bitcredit Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "clientversion.h"
+#include "compressdata.h"
+#include "hash.h"
+#include "ui_interface.h"
+#include "univalue/univalue.h"
+#include "util.h"
+#include "utilstrencodings.h"
+#include "utiltime.h"
+
+#include <stdio.h>
+
+/**
+ * Benchmark of the framed LZ4 compression of off-chain payloads.
+ *
+ * Compresses and decompresses a few kinds of payload in one go and in
+ * network sized pieces, and prints the throughput as a JSON object.
+ */
+
+CClientUIInterface uiInterface;
+
+/** Serialized inventory: message type and hash, half of the hashes repeated */
+static void InventoryPayload(std::vector<char>& vch, size_t nSize)
+{
+    vch.clear();
+    for (uint32_t n = 0; vch.size() < nSize; n++)
+    {
+        uint32_t nType = 1 + n % 2;
+        uint32_t nSeed = n / 2;
+        uint256 hash = Hash(BEGIN(nSeed), END(nSeed));
+        vch.insert(vch.end(), BEGIN(nType), END(nType));
+        vch.insert(vch.end(), hash.begin(), hash.end());
+    }
+    vch.resize(nSize);
+}
+
+/** JSON text such as RPC and market data */
+static void TextPayload(std::vector<char>& vch, size_t nSize)
+{
+    vch.clear();
+    for (uint32_t n = 0; vch.size() < nSize; n++)
+    {
+        std::string str = strprintf("{\"height\":%u,\"time\":%u,\"price\":%.8f,\"volume\":%u},\n", 100000 + n, 1420070400 + n * 60, 0.0025 + (n % 97) * 0.00001, (n * 7919) % 100000);
+        vch.insert(vch.end(), str.begin(), str.end());
+    }
+    vch.resize(nSize);
+}
+
+/** Incompressible data */
+static void RandomPayload(std::vector<char>& vch, size_t nSize)
+{
+    vch.clear();
+    for (uint32_t n = 0; vch.size() < nSize; n++)
+    {
+        uint256 hash = Hash(BEGIN(n), END(n));
+        vch.insert(vch.end(), hash.begin(), hash.end());
+    }
+    vch.resize(nSize);
+}
+
+static double MegabytesPerSecond(uint64_t nBytes, int64_t nMicros)
+{
+    return nMicros > 0 ? nBytes / (double)nMicros : 0;
+}
+
+/** Returns false if a round trip did not give back the payload */
+static bool BenchPayload(const std::vector<char>& vchData, int nIterations, size_t nPiece, UniValue& result)
+{
+    std::vector<unsigned char> vchFrame, vchOut;
+    bool fOk = true;
+
+    int64_t nStart = GetTimeMicros();
+    for (int i = 0; i < nIterations; i++)
+        fOk &= CompressData(&vchData[0], vchData.size(), vchFrame);
+    int64_t nCompressMicros = GetTimeMicros() - nStart;
+
+    nStart = GetTimeMicros();
+    for (int i = 0; i < nIterations; i++)
+        fOk &= UncompressData(&vchFrame[0], vchFrame.size(), vchOut);
+    int64_t nUncompressMicros = GetTimeMicros() - nStart;
+    fOk &= vchOut.size() == vchData.size() && memcmp(&vchOut[0], &vchData[0], vchData.size()) == 0;
+
+    // Streaming, in pieces the size of a network read
+    CLZ4FrameWriter writer;
+    nStart = GetTimeMicros();
+    for (int i = 0; i < nIterations; i++)
+    {
+        vchFrame.clear();
+        writer.Begin(vchFrame);
+        for (size_t nPos = 0; nPos < vchData.size(); nPos += nPiece)
+            fOk &= writer.Write(&vchData[nPos], std::min(nPiece, vchData.size() - nPos));
+        fOk &= writer.End();
+    }
+    int64_t nStreamCompressMicros = GetTimeMicros() - nStart;
+
+    CLZ4FrameReader reader;
+    nStart = GetTimeMicros();
+    for (int i = 0; i < nIterations; i++)
+    {
+        vchOut.clear();
+        reader.Begin();
+        for (size_t nPos = 0; nPos < vchFrame.size(); nPos += nPiece)
+            fOk &= reader.Read(&vchFrame[nPos], std::min(nPiece, vchFrame.size() - nPos), vchOut);
+        fOk &= reader.IsComplete();
+    }
+    int64_t nStreamUncompressMicros = GetTimeMicros() - nStart;
+    fOk &= vchOut.size() == vchData.size() && memcmp(&vchOut[0], &vchData[0], vchData.size()) == 0;
+
+    uint64_t nBytes = (uint64_t)vchData.size() * nIterations;
+    result.pushKV("bytes", (uint64_t)vchData.size());
+    result.pushKV("frame_bytes", (uint64_t)vchFrame.size());
+    result.pushKV("ratio", (double)vchData.size() / vchFrame.size());
+    result.pushKV("compress_mb_per_second", MegabytesPerSecond(nBytes, nCompressMicros));
+    result.pushKV("uncompress_mb_per_second", MegabytesPerSecond(nBytes, nUncompressMicros));
+    result.pushKV("stream_compress_mb_per_second", MegabytesPerSecond(nBytes, nStreamCompressMicros));
+    result.pushKV("stream_uncompress_mb_per_second", MegabytesPerSecond(nBytes, nStreamUncompressMicros));
+    return fOk;
+}
+
+int main(int argc, char* argv[])
+{
+    ParseParameters(argc, argv);
+
+    if (mapArgs.count("-?") || mapArgs.count("-help"))
+    {
+        std::string strUsage = "Bitcredit Core LZ4 benchmark version " + FormatFullVersion() + "\n\n" +
+            "Usage:\n" +
+            "  bench_lz4 [options]\n\n" +
+            "Options:\n" +
+            "  -size=<n>              " + strprintf("Payload size in bytes (default: %u)", 1024 * 1024) + "\n" +
+            "  -iterations=<n>        " + strprintf("Round trips per payload (default: %u)", 50) + "\n" +
+            "  -piece=<n>             " + strprintf("Bytes per streaming write and read (default: %u)", 1400) + "\n";
+        fprintf(stdout, "%s", strUsage.c_str());
+        return 0;
+    }
+
+    size_t nSize = std::max((int64_t)GetArg("-size", 1024 * 1024), (int64_t)1);
+    int nIterations = std::max((int)GetArg("-iterations", 50), 1);
+    size_t nPiece = std::max((int64_t)GetArg("-piece", 1400), (int64_t)1);
+
+    bool fOk = true;
+    std::vector<char> vchData;
+    UniValue inventory(UniValue::VOBJ), text(UniValue::VOBJ), random(UniValue::VOBJ);
+    InventoryPayload(vchData, nSize);
+    fOk &= BenchPayload(vchData, nIterations, nPiece, inventory);
+    TextPayload(vchData, nSize);
+    fOk &= BenchPayload(vchData, nIterations, nPiece, text);
+    RandomPayload(vchData, nSize);
+    fOk &= BenchPayload(vchData, nIterations, nPiece, random);
+
+    UniValue result(UniValue::VOBJ);
+    result.pushKV("version", FormatFullVersion());
+    result.pushKV("iterations", nIterations);
+    result.pushKV("piece", (uint64_t)nPiece);
+    result.pushKV("inventory", inventory);
+    result.pushKV("text", text);
+    result.pushKV("random", random);
+    fprintf(stdout, "%s\n", result.write(4).c_str());
+
+    return fOk ? 0 : 1;
+}
@@ -0,0 +1,183 @@
+// Copyright (c) 2015 The Bitcredit Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "clientversion.h"
+#include "hash.h"
+#include "momentum.h"
+#include "primitives/block.h"
+#include "ui_interface.h"
+#include "univalue/univalue.h"
+#include "util.h"
+#include "utilstrencodings.h"
+#include "utiltime.h"
+
+#include <stdio.h>
+
+#ifndef WIN32
+#include <sys/resource.h>
+#endif
+
+/**
+ * Benchmark of the Momentum proof-of-work.
+ *
+ * Searches a fixed set of block headers and validates the solutions found,
+ * then prints the results as a JSON object so that runs before and after a
+ * change to the birthday table or hash kernel can be compared.
+ */
+
+CClientUIInterface uiInterface;
+
+static const uint32_t MOMENTUM_NONCES = 1 << 26;
+static const uint32_t BIRTHDAYS_PER_HASH = 8;
+
+/** Deterministic header, so every run searches the same mid-hashes */
+static CBlock BenchHeader(int n)
+{
+    CBlock block;
+    block.nVersion = CBlockHeader::CURRENT_VERSION;
+    block.hashPrevBlock = Hash(BEGIN(n), END(n));
+    block.hashMerkleRoot = Hash(block.hashPrevBlock.begin(), block.hashPrevBlock.end());
+    block.nTime = 1420070400 + n;
+    block.nBits = 0x1d00ffff;
+    block.nNonce = n;
+    return block;
+}
+
+/** Peak resident set size of the process in kB, 0 where unknown */
+static int64_t PeakRSS()
+{
+#ifndef WIN32
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+#ifdef MAC_OSX
+    return usage.ru_maxrss / 1024;
+#else
+    return usage.ru_maxrss;
+#endif
+#else
+    return 0;
+#endif
+}
+
+static double PerSecond(uint64_t nCount, int64_t nMicros)
+{
+    return nMicros > 0 ? nCount * 1000000.0 / nMicros : 0;
+}
+
+int main(int argc, char* argv[])
+{
+    ParseParameters(argc, argv);
+
+    if (mapArgs.count("-?") || mapArgs.count("-help"))
+    {
+        std::string strUsage = "Bitcredit Core Momentum benchmark version " + FormatFullVersion() + "\n\n" +
+            "Usage:\n" +
+            "  bench_momentum [options]\n\n" +
+            "Options:\n" +
+            "  -searches=<n>          " + strprintf("Number of headers to search (default: %u)", 4) + "\n" +
+            "  -momentumthreads=<n>   " + strprintf("Threads per search (default: %u)", 1) + "\n" +
+            "  -verifications=<n>     " + strprintf("Header validations per solution (default: %u)", 100000) + "\n";
+        fprintf(stdout, "%s", strUsage.c_str());
+        return 0;
+    }
+
+    int nSearches = std::max((int)GetArg("-searches", 4), 1);
+    int nThreads = std::max((int)GetArg("-momentumthreads", 1), 1);
+    int nVerifications = std::max((int)GetArg("-verifications", 100000), 1);
+
+    // Search
+    std::vector<CBlock> vSolved;
+    uint64_t nCollisions = 0;
+    uint64_t nInvalid = 0;
+    size_t nUsed = 0, nSlots = 0;
+    int64_t nSearchMicros = 0;
+    for (int n = 0; n < nSearches; n++)
+    {
+        CBlock block = BenchHeader(n);
+        uint256 midHash = block.GetMidHash();
+
+        int64_t nStart = GetTimeMicros();
+        std::vector< std::pair<uint32_t,uint32_t> > results = bts::momentum_search(midHash, nThreads);
+        nSearchMicros += GetTimeMicros() - nStart;
+
+        nUsed += bts::momentum_table_usage(nSlots);
+        nCollisions += results.size();
+        for (unsigned int i = 0; i < results.size(); i++)
+            if (!bts::momentum_verify(midHash, results[i].first, results[i].second))
+                nInvalid++;
+        if (!results.empty())
+        {
+            block.nBirthdayA = results[0].first;
+            block.nBirthdayB = results[0].second;
+            vSolved.push_back(block);
+        }
+    }
+
+    UniValue search(UniValue::VOBJ);
+    search.pushKV("searches", nSearches);
+    search.pushKV("threads", nThreads);
+    search.pushKV("seconds", nSearchMicros / 1000000.0);
+    search.pushKV("hashes_per_second", PerSecond((uint64_t)nSearches * MOMENTUM_NONCES / BIRTHDAYS_PER_HASH, nSearchMicros));
+    search.pushKV("nonces_per_second", PerSecond((uint64_t)nSearches * MOMENTUM_NONCES, nSearchMicros));
+    search.pushKV("collisions", nCollisions);
+    search.pushKV("collisions_per_second", PerSecond(nCollisions, nSearchMicros));
+    search.pushKV("invalid_collisions", nInvalid);
+    search.pushKV("table_fill_ratio", nSlots ? (double)nUsed / nSearches / nSlots : 0);
+    search.pushKV("peak_rss_kb", PeakRSS());
+
+    // Birthday hashes, as computed once per nonce by header validation
+    uint256 midHash = BenchHeader(0).GetMidHash();
+    uint64_t nBirthdays = (uint64_t)nVerifications * 2;
+    uint64_t nSink = 0;
+    int64_t nStart = GetTimeMicros();
+    for (uint64_t i = 0; i < nBirthdays; i++)
+        nSink ^= bts::getBirthdayHash(midHash, (uint32_t)(i * 7919) % MOMENTUM_NONCES);
+    int64_t nBirthdayMicros = GetTimeMicros() - nStart;
+
+    UniValue birthday(UniValue::VOBJ);
+    birthday.pushKV("calls", nBirthdays);
+    birthday.pushKV("calls_per_second", PerSecond(nBirthdays, nBirthdayMicros));
+    birthday.pushKV("checksum", strprintf("%016x", nSink));
+
+    // Header validation: the bare proof check, and GetVerifiedHash which
+    // answers repeated checks of a header from the verified proof cache
+    uint64_t nChecked = 0;
+    uint64_t nRejected = 0;
+    int64_t nVerifyMicros = 0;
+    int64_t nCachedMicros = 0;
+    uint256 hashRejected("0xffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffeeee");
+    for (unsigned int i = 0; i < vSolved.size(); i++)
+    {
+        const CBlock& block = vSolved[i];
+        nStart = GetTimeMicros();
+        for (int j = 0; j < nVerifications; j++)
+            if (!bts::momentum_verify(block.GetMidHash(), block.nBirthdayA, block.nBirthdayB))
+                nRejected++;
+        nVerifyMicros += GetTimeMicros() - nStart;
+
+        nStart = GetTimeMicros();
+        for (int j = 0; j < nVerifications; j++)
+            if (block.GetVerifiedHash() == hashRejected)
+                nRejected++;
+        nCachedMicros += GetTimeMicros() - nStart;
+        nChecked += nVerifications;
+    }
+
+    UniValue verify(UniValue::VOBJ);
+    verify.pushKV("headers", (int)vSolved.size());
+    verify.pushKV("verifications", nChecked);
+    verify.pushKV("verifications_per_second", PerSecond(nChecked, nVerifyMicros));
+    verify.pushKV("cached_verifications_per_second", PerSecond(nChecked, nCachedMicros));
+    verify.pushKV("rejected", nRejected);
+
+    UniValue result(UniValue::VOBJ);
+    result.pushKV("version", FormatFullVersion());
+    result.pushKV("momentum_search", search);
+    result.pushKV("birthday_hash", birthday);
+    result.pushKV("header_validation", verify);
+    fprintf(stdout, "%s\n", result.write(4).c_str());
+
+    return (nInvalid || nRejected) ? 1 : 0;
+}
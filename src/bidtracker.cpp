@@ -10,12 +10,36 @@
 #include <fstream>
 #include <boost/algorithm/string.hpp>
 #include <boost/filesystem.hpp>
+#include <boost/foreach.hpp>
+#include <boost/thread.hpp>
 #include <sys/stat.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <map>
 #include <sstream>
 
+/** Addresses receiving the bids on each chain */
+static const std::string BTC_BID_ADDRESS = "16f5dJd4EHRrQwGGRMczA69qbJYs4msBQ5";
+static const std::string LTC_BID_ADDRESS = "Lc7ebfQPz6VJ8qmXYaaFxBYLpDz2XsDu7c";
+static const std::string DASH_BID_ADDRESS = "Xypcx2iE8rCtC3tjw5M8sxpRzn4JuoSaBH";
+
+/** Public sources of the bids and exchange rates, replaced by -bidtrackerurl */
+static const std::string BTC_BID_SOURCE = "https://blockchain.info";
+static const std::string CHAIN_BID_SOURCE = "http://api.blockstrap.com";
+static const std::string TICKER_BID_SOURCE = "https://bittrex.com";
+static const std::string LTC_BALANCE_SOURCE = "http://ltc.blockr.io";
+static const std::string CHAINZ_BALANCE_SOURCE = "http://chainz.cryptoid.info";
+
+/** Addresses holding the reserves of the bank on each chain */
+static const std::string BCR_RESERVE_ADDRESS = "5qH4yHaaaRuX1qKCZdUHXNJdesssNQcUct";
+static const std::string BTC_RESERVE_ADDRESS = "3AsVTW5W5NL8bx1twwR7TabFAYGKstizjt";
+static const std::string LTC_RESERVE_ADDRESS = "35QTtUaMeSNbpKK6A4d4zTygR9s53jqNTH";
+static const std::string DASH_RESERVE_ADDRESS = "7dQpZMWfjKEwNNRCeRG2KkYw98b63PNKGZ";
+
+/** Bids of the last successful refresh */
+static CCriticalSection cs_bidtracker;
+static boost::shared_ptr<const CBidSnapshot> pbidsnapshot(new CBidSnapshot());
+
 static size_t WriteCallback(void *contents, size_t size, size_t nmemb, void *userp)
 {
     ((std::string*)userp)->append((char*)contents, size * nmemb);
@@ -39,7 +63,12 @@ std::string replacestring(std::string subject, const std::string& search,
     return subject;
 }
 
-double Bidtracker::getbalance(std::string url, double balance)
+static std::string BidSourceURL(const std::string& strSource, const std::string& strPath)
+{
+    return GetArg("-bidtrackerurl", strSource) + strPath;
+}
+
+static std::string HTTPGet(const std::string& url)
 {
     const char * c = url.c_str();
     CURL *curl;
@@ -55,191 +84,116 @@ double Bidtracker::getbalance(std::string url, double balance)
         curl_easy_cleanup(curl);
         }
 
-      std::string response = readBuffer;
-      if ( ! (istringstream(response) >> balance) ) balance = 0;
-
-      return balance;
+      return readBuffer;
 }
 
-void btcsortunspent(){
-
-	ifstream myfile ((GetDataDir()/ "bidtracker/btcunspentraw.dat").string().c_str());
-	std::ofstream myfile2;
-	myfile2.open((GetDataDir()/ "bidtracker/btcbids.dat").string().c_str(),fstream::out);
-
-	std::string line, txid, url;
-    try
-    {
-
-	if (myfile.is_open()){
-		while ( myfile.good() ){
-			getline (myfile,line);
-			string temp = line;
-			std::string search;
-			std::string search2;
-			std::string search3;
-			size_t pos;
-			size_t f = line.find("			tx_hash_big_endian:");
-			size_t g = line.find("			value:");
-
-			search = "tx_hash_big_endian";
-			pos = temp.find(search);
-			if (pos != std::string::npos){
-				std::string semp =line;
-				semp = semp.replace(f, std::string("			tx_hash_big_endian:").length(), "");
-				semp = remove(semp, ',');
-				txid = semp;
-				url = "https://blockchain.info/rawtx/"+ txid ;
-				const char * d = url.c_str();
-				CURL *curl;
-				CURLcode res;
-				string readBuffer;
-				curl = curl_easy_init();
-				if(curl) {
-					curl_easy_setopt(curl, CURLOPT_URL, d);
-					curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteCallback);
-					curl_easy_setopt(curl, CURLOPT_WRITEDATA, &readBuffer);
-					res = curl_easy_perform(curl);
-					curl_easy_cleanup(curl);
-				}
-				std::size_t pos1 = readBuffer.find("value");
-				readBuffer = readBuffer.substr(0,pos1);
-				readBuffer = remove(readBuffer, '"');
-				readBuffer = remove(readBuffer, '{');
-				readBuffer = remove(readBuffer,'}');
-				readBuffer = remove(readBuffer, '[');
-				readBuffer = remove(readBuffer, '\n');
-				std::string uemp =readBuffer;
-				std::size_t pos2 = uemp.find("addr:");
-				uemp = uemp.substr(pos2);
-				uemp = replacestring(uemp, "addr:", "");
-				erase_all(uemp, " ");
-				myfile2 << uemp;
-			}
-
-			search2 = "value:";
-			pos = temp.find(search2);
-			if (pos != std::string::npos){
-				std::string semp =line;
-				semp = semp.replace(g, std::string("			value:").length(), "");
-				string value = semp;
-				value = remove(value, ',');
-				long double amount = atof(value.c_str());
-				myfile2 << std::fixed <<  amount << std::endl;
-			}
-		}
-		myfile.close();
-		myfile2.close();
-	}
-	}
+CBidFetcher::CBidFetcher()
+{
+    multi = curl_multi_init();
+}
 
-    catch (std::exception const &exc)
-    {
-        std::cerr << "Exception caught " << exc.what() << "\n";
-    }
-    catch (...)
-    {
-        std::cerr << "Unknown exception caught\n";
+CBidFetcher::~CBidFetcher()
+{
+    BOOST_FOREACH(CURL* handle, vHandles) {
+        if (multi)
+            curl_multi_remove_handle(multi, handle);
+        curl_easy_cleanup(handle);
     }
-
+    if (multi)
+        curl_multi_cleanup(multi);
 }
 
-void Bidtracker::btcgetunspent()
+void CBidFetcher::Fetch(std::vector<CBidRequest>& vRequests)
 {
-    std::string address = "16f5dJd4EHRrQwGGRMczA69qbJYs4msBQ5";
+    BOOST_FOREACH(CBidRequest& request, vRequests) {
+        request.strResponse.clear();
+        request.fOk = false;
+    }
+    if (!multi)
+        return;
 
-    std::string url;
-    url = "https://blockchain.info/unspent?active=" + address;
-    try
+    std::vector<CURL*> vIdle(vHandles);
+    size_t nNext = 0;
+    unsigned int nInFlight = 0;
+    while (nNext < vRequests.size() || nInFlight > 0)
     {
-    const char * c = url.c_str();
-
-      CURLcode res;
-      std::string readBuffer;
-
-      curl = curl_easy_init();
-      if(curl) {
-        curl_easy_setopt(curl, CURLOPT_URL, c);
-        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteCallback);
-        curl_easy_setopt(curl, CURLOPT_WRITEDATA, &readBuffer);
-        res = curl_easy_perform(curl);
-        curl_easy_cleanup(curl);
+        boost::this_thread::interruption_point();
+
+        while (nNext < vRequests.size() && nInFlight < MAX_BID_REQUESTS_IN_FLIGHT)
+        {
+            CURL* handle;
+            if (vIdle.empty()) {
+                handle = curl_easy_init();
+                if (!handle)
+                    break;
+                vHandles.push_back(handle);
+            } else {
+                handle = vIdle.back();
+                vIdle.pop_back();
+            }
+
+            CBidRequest& request = vRequests[nNext++];
+            curl_easy_setopt(handle, CURLOPT_URL, request.strURL.c_str());
+            curl_easy_setopt(handle, CURLOPT_WRITEFUNCTION, WriteCallback);
+            curl_easy_setopt(handle, CURLOPT_WRITEDATA, &request.strResponse);
+            curl_easy_setopt(handle, CURLOPT_PRIVATE, &request);
+            curl_easy_setopt(handle, CURLOPT_NOSIGNAL, 1L);
+            curl_easy_setopt(handle, CURLOPT_TIMEOUT, BID_REQUEST_TIMEOUT);
+            curl_multi_add_handle(multi, handle);
+            nInFlight++;
+        }
+        if (nInFlight == 0) {
+            LogPrintf("CBidFetcher::Fetch : could not create a request handle\n");
+            return;
         }
 
-    boost::filesystem::path biddir = GetDataDir() / "bidtracker";
-
-    if(!(boost::filesystem::exists(biddir))){
-        if(fDebug)LogPrintf("Biddir Doesn't Exists\n");
-
-        if (boost::filesystem::create_directory(biddir))
-            if(fDebug)LogPrintf("Biddir....Successfully Created !\n");
-    }
-
-	const char * d = (GetDataDir().string() + "/bidtracker/btcunspentraw.dat").c_str();
-	std::ofstream myfile;
-	myfile.open(d,fstream::out);
-	readBuffer = remove(readBuffer, ' ');
-	readBuffer = remove(readBuffer, '"');
-	myfile << readBuffer << std::endl;
-	myfile.close();
-	}
+        int nRunning = 0;
+        curl_multi_perform(multi, &nRunning);
+
+        CURLMsg* msg;
+        int nQueued;
+        while ((msg = curl_multi_info_read(multi, &nQueued)))
+        {
+            if (msg->msg != CURLMSG_DONE)
+                continue;
+            CURL* handle = msg->easy_handle;
+            CURLcode result = msg->data.result;
+            CBidRequest* pRequest = NULL;
+            long nStatus = 0;
+            curl_easy_getinfo(handle, CURLINFO_PRIVATE, (char**)&pRequest);
+            curl_easy_getinfo(handle, CURLINFO_RESPONSE_CODE, &nStatus);
+            if (result != CURLE_OK)
+                LogPrint("net", "CBidFetcher::Fetch : %s : %s\n", pRequest->strURL, curl_easy_strerror(result));
+            pRequest->fOk = (result == CURLE_OK && nStatus == 200);
+
+            curl_multi_remove_handle(multi, handle);
+            vIdle.push_back(handle);
+            nInFlight--;
+        }
 
-    catch (std::exception const &exc)
-    {
-        std::cerr << "Exception caught " << exc.what() << "\n";
-    }
-    catch (...)
-    {
-        std::cerr << "Unknown exception caught\n";
+        if (nRunning > 0)
+            curl_multi_wait(multi, NULL, 0, 100, NULL);
     }
-
 }
 
-double btcgetprice()
+/** Balance in a block explorer response, 0 if there is none */
+static double ParseBalance(std::string readBuffer)
 {
-	CAmount price;
-    std::string url;
-    url = "https://blockchain.info/q/24hrprice";
-
-    const char * c = url.c_str();
-    CURL *curl;
-      CURLcode res;
-      std::string readBuffer;
-
-      curl = curl_easy_init();
-      if(curl) {
-        curl_easy_setopt(curl, CURLOPT_URL, c);
-        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteCallback);
-        curl_easy_setopt(curl, CURLOPT_WRITEDATA, &readBuffer);
-        res = curl_easy_perform(curl);
-        curl_easy_cleanup(curl);
-        }
+	double balance;
+	if ( ! (istringstream(readBuffer) >> balance) ) balance = 0;
 
-      price = atof(readBuffer.c_str());
+	return balance;
+}
 
-      return price;
+double Bidtracker::getbalance(std::string url, double balance)
+{
+      return ParseBalance(HTTPGet(url));
 }
 
-double dashgetprice()
+/** Bid price of a bittrex ticker response */
+static double ParseTickerBid(std::string readBuffer)
 {
 	double price;
-    std::string url;
-    url = "https://bittrex.com/api/v1.1/public/getticker?market=BTC-DASH";
-
-    const char * c = url.c_str();
-    CURL *curl;
-      CURLcode res;
-      std::string readBuffer;
-
-      curl = curl_easy_init();
-      if(curl) {
-        curl_easy_setopt(curl, CURLOPT_URL, c);
-        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteCallback);
-        curl_easy_setopt(curl, CURLOPT_WRITEDATA, &readBuffer);
-        res = curl_easy_perform(curl);
-        curl_easy_cleanup(curl);
-        }
-
 	std::size_t pos = readBuffer.find(",\"A");
 	readBuffer = readBuffer.substr(0,pos);
 	readBuffer = replacestring(readBuffer, ",", ",\n");
@@ -251,233 +205,152 @@ double dashgetprice()
 	readBuffer = replacestring(readBuffer, "message", "");
 	readBuffer = replacestring(readBuffer, "resultBid", "");
 	readBuffer = remove(readBuffer, '\n');
-   if ( ! (istringstream(readBuffer) >> price) ) price = 0;
+	if ( ! (istringstream(readBuffer) >> price) ) price = 0;
 
-    return price;
+	return price;
 }
 
-double bcrgetprice()
+/** USD price of a blockchain.info 24 hour price response, whole dollars */
+static double ParseBTCPrice(std::string readBuffer)
 {
-	double price;
-    std::string url;
-    url = "https://bittrex.com/api/v1.1/public/getticker?market=BTC-BCR";
+	CAmount price;
 
-    const char * c = url.c_str();
-    CURL *curl;
-      CURLcode res;
-      std::string readBuffer;
+	price = atof(readBuffer.c_str());
 
-      curl = curl_easy_init();
-      if(curl) {
-        curl_easy_setopt(curl, CURLOPT_URL, c);
-        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteCallback);
-        curl_easy_setopt(curl, CURLOPT_WRITEDATA, &readBuffer);
-        res = curl_easy_perform(curl);
-        curl_easy_cleanup(curl);
-        }
+	return price;
+}
 
-	std::size_t pos = readBuffer.find(",\"A");
-	readBuffer = readBuffer.substr(0,pos);
-	readBuffer = replacestring(readBuffer, ",", ",\n");
-	readBuffer = remove(readBuffer, ',');
-	readBuffer = remove(readBuffer, '"');
-	readBuffer = remove(readBuffer, ':');
-	readBuffer = remove(readBuffer, '{');
-	readBuffer = replacestring(readBuffer, "successtrue", "");
-	readBuffer = replacestring(readBuffer, "message", "");
-	readBuffer = replacestring(readBuffer, "resultBid", "");
-	readBuffer = remove(readBuffer, '\n');
-    if ( ! (istringstream(readBuffer) >> price) ) price = 0;
+double btcgetprice()
+{
+	return ParseBTCPrice(HTTPGet(BidSourceURL(BTC_BID_SOURCE, "/q/24hrprice")));
+}
+
+double dashgetprice()
+{
+	return ParseTickerBid(HTTPGet(BidSourceURL(TICKER_BID_SOURCE, "/api/v1.1/public/getticker?market=BTC-DASH")));
+}
 
-      return price;
+double bcrgetprice()
+{
+	return ParseTickerBid(HTTPGet(BidSourceURL(TICKER_BID_SOURCE, "/api/v1.1/public/getticker?market=BTC-BCR")));
 }
 
 double ltcgetprice()
 {
-	double price;
-    std::string url;
-    url = "https://bittrex.com/api/v1.1/public/getticker?market=BTC-LTC";
+	return ParseTickerBid(HTTPGet(BidSourceURL(TICKER_BID_SOURCE, "/api/v1.1/public/getticker?market=BTC-LTC")));
+}
 
-    const char * c = url.c_str();
-    CURL *curl;
-      CURLcode res;
-      std::string readBuffer;
+double Bidtracker::usdbtc(){
 
-      curl = curl_easy_init();
-      if(curl) {
-        curl_easy_setopt(curl, CURLOPT_URL, c);
-        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteCallback);
-        curl_easy_setopt(curl, CURLOPT_WRITEDATA, &readBuffer);
-        res = curl_easy_perform(curl);
-        curl_easy_cleanup(curl);
-        }
+return btcgetprice();
 
-	std::size_t pos = readBuffer.find(",\"A");
-	readBuffer = readBuffer.substr(0,pos);
-	readBuffer = replacestring(readBuffer, ",", ",\n");
-	readBuffer = remove(readBuffer, ',');
-	readBuffer = remove(readBuffer, '"');
-	readBuffer = remove(readBuffer, ':');
-	readBuffer = remove(readBuffer, '{');
-	readBuffer = replacestring(readBuffer, "successtrue", "");
-	readBuffer = replacestring(readBuffer, "message", "");
-	readBuffer = replacestring(readBuffer, "resultBid", "");
-	readBuffer = remove(readBuffer, '\n');
-	if ( ! (istringstream(readBuffer) >> price) ) price = 0;
+}
+
+long double Bidtracker::ltcbtc(){
+
+return ltcgetprice();
 
-    return price;
 }
 
-void dashsortunspent(){
+long double Bidtracker::dashbtc(){
 
-	ifstream myfile ((GetDataDir() /"bidtracker/dashunspentraw.dat").string().c_str());
-	std::ofstream myfile2;
-	myfile2.open((GetDataDir() /"bidtracker/dashbids.dat").string().c_str(),fstream::out);
+return dashgetprice();
 
-	std::string line;
+}
+
+long double Bidtracker::bcrbtc(){
+
+return bcrgetprice();
+
+}
+
+/**
+ * One line of a bid listing: either text, or the address that funded an
+ * unspent output, extracted from the response of a transaction request.
+ */
+struct CBidItem
+{
+    int nRequest;
+    std::string strText;
+
+    CBidItem(int nRequestIn, const std::string& strTextIn) : nRequest(nRequestIn), strText(strTextIn) {}
+};
+
+/** Unspent outputs of the BTC bid address, as listed by blockchain.info */
+static void ParseBTCUnspent(std::string readBuffer, std::vector<CBidRequest>& vTxRequests, std::vector<CBidItem>& vItems)
+{
+	readBuffer = remove(readBuffer, ' ');
+	readBuffer = remove(readBuffer, '"');
+	istringstream myfile(readBuffer);
+
+	std::string line, txid, url;
     try
     {
-
-	if (myfile.is_open()){
 		while ( myfile.good() ){
 			getline (myfile,line);
 			string temp = line;
 			std::string search;
 			std::string search2;
 			size_t pos;
-			size_t f = line.find("\"id\":");
-			size_t g = line.find("\"tx_address_value\":");
+			size_t f = line.find("			tx_hash_big_endian:");
+			size_t g = line.find("			value:");
 
-			search = "\"id\":";
+			search = "tx_hash_big_endian";
 			pos = temp.find(search);
 			if (pos != std::string::npos){
 				std::string semp =line;
-				semp = semp.replace(f, std::string("\"id\":").length(), "");
-				semp = remove(semp, '"');
+				semp = semp.replace(f, std::string("			tx_hash_big_endian:").length(), "");
 				semp = remove(semp, ',');
-				string txid = semp;
-				string url;
-				url = "http://api.blockstrap.com/v0/drk/transaction/id/"+ txid + "?showtxn=1&showtxnio=1&";
-				const char * d = url.c_str();
-				CURL *curl;
-				CURLcode res;
-				string readBuffer;
-
-				curl = curl_easy_init();
-				if(curl) {
-					curl_easy_setopt(curl, CURLOPT_URL, d);
-					curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteCallback);
-					curl_easy_setopt(curl, CURLOPT_WRITEDATA, &readBuffer);
-					res = curl_easy_perform(curl);
-					curl_easy_cleanup(curl);
-				}
-			std::size_t pos = readBuffer.find(",{");
-			readBuffer = readBuffer.substr(0,pos);
-			string hemp = readBuffer;
-			std::size_t pos1 = hemp.find("\"address\"");
-			hemp = hemp.substr(pos1);
-
-			string lemp = hemp;
-			std::size_t pos2 = lemp.find("\"}");
-			lemp = lemp.substr(0,pos2);
-			lemp = replacestring(lemp, "\"address\":\"", "");
-
-			myfile2 << lemp << ",";
+				txid = semp;
+				url = BidSourceURL(BTC_BID_SOURCE, "/rawtx/"+ txid);
+				vItems.push_back(CBidItem(vTxRequests.size(), ""));
+				vTxRequests.push_back(CBidRequest(url));
 			}
 
-			search2 = "\"tx_address_value\":";
+			search2 = "value:";
 			pos = temp.find(search2);
 			if (pos != std::string::npos){
 				std::string semp =line;
-				semp = semp.replace(g, std::string("\"tx_address_value\":").length(), "");
-				semp = remove(semp, ',');
-				long double amount = atof(semp.c_str());
-				amount = amount * dashgetprice();
-				myfile2 << std::fixed << amount << std::endl;
+				semp = semp.replace(g, std::string("			value:").length(), "");
+				string value = semp;
+				value = remove(value, ',');
+				long double amount = atof(value.c_str());
+				std::ostringstream amountstream;
+				amountstream << std::fixed <<  amount << std::endl;
+				vItems.push_back(CBidItem(-1, amountstream.str()));
 			}
 		}
-		myfile.close();
-		myfile2.close();
-	}
 	}
     catch (std::exception const &exc)
     {
-        std::cerr << "Exception caught " << exc.what() << "\n";
-    }
-    catch (...)
-    {
-        std::cerr << "Unknown exception caught\n";
+        LogPrintf("ParseBTCUnspent : %s\n", exc.what());
     }
-
 }
 
-void Bidtracker::dashgetunspent()
+/** Funding address of a blockchain.info transaction */
+static std::string ParseBTCAddress(std::string readBuffer)
 {
-    std::string address = "Xypcx2iE8rCtC3tjw5M8sxpRzn4JuoSaBH";
-    std::string url;
-    url = "http://api.blockstrap.com/v0/drk/address/unspents/" + address;
-    try
-    {
-    const char * c = url.c_str();
-
-      CURLcode res;
-      std::string readBuffer;
-
-      curl = curl_easy_init();
-      if(curl) {
-        curl_easy_setopt(curl, CURLOPT_URL, c);
-        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteCallback);
-        curl_easy_setopt(curl, CURLOPT_WRITEDATA, &readBuffer);
-        res = curl_easy_perform(curl);
-        curl_easy_cleanup(curl);
-        }
-
-	std::ofstream myfile;
-	myfile.open((GetDataDir() /"bidtracker/dashunspentraw.dat").string().c_str(),fstream::out);
-	std::size_t pos = readBuffer.find("[{");
-    readBuffer = readBuffer.substr (pos);
-	readBuffer = replacestring(readBuffer, "},{", "\n},{");
-	readBuffer = replacestring(readBuffer, ",", ",\n");
-	readBuffer = remove(readBuffer, ' ');
+	std::size_t pos1 = readBuffer.find("value");
+	readBuffer = readBuffer.substr(0,pos1);
+	readBuffer = remove(readBuffer, '"');
 	readBuffer = remove(readBuffer, '{');
-	readBuffer = remove(readBuffer, '}');
+	readBuffer = remove(readBuffer,'}');
 	readBuffer = remove(readBuffer, '[');
-	myfile << readBuffer << std::endl;
-	myfile.close();
-	}
-    catch (std::exception const &exc)
-    {
-        std::cerr << "Exception caught " << exc.what() << "\n";
-    }
-    catch (...)
-    {
-        std::cerr << "Unknown exception caught\n";
-    }
+	readBuffer = remove(readBuffer, '\n');
+	std::string uemp =readBuffer;
+	std::size_t pos2 = uemp.find("addr:");
+	uemp = uemp.substr(pos2);
+	uemp = replacestring(uemp, "addr:", "");
+	erase_all(uemp, " ");
+	return uemp;
 }
 
-void Bidtracker::ltcgetunspent()
+/** Unspent outputs of an LTC or DASH bid address, as listed by blockstrap */
+static void ParseChainUnspent(std::string readBuffer, const std::string& strChain, double price, std::vector<CBidRequest>& vTxRequests, std::vector<CBidItem>& vItems)
 {
-    std::string address = "Lc7ebfQPz6VJ8qmXYaaFxBYLpDz2XsDu7c";
-    std::string url;
-    url = "http://api.blockstrap.com/v0/ltc/address/unspents/" + address;
+	std::string line;
     try
     {
-    const char * c = url.c_str();
-
-      CURLcode res;
-      std::string readBuffer;
-
-      curl = curl_easy_init();
-      if(curl) {
-        curl_easy_setopt(curl, CURLOPT_URL, c);
-        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteCallback);
-        curl_easy_setopt(curl, CURLOPT_WRITEDATA, &readBuffer);
-        res = curl_easy_perform(curl);
-        curl_easy_cleanup(curl);
-        }
-
-	std::ofstream myfile;
-	myfile.open((GetDataDir() / "bidtracker/ltcunspentraw.dat").string().c_str(),fstream::out);
 	std::size_t pos = readBuffer.find("[{");
     readBuffer = readBuffer.substr (pos);
 	readBuffer = replacestring(readBuffer, "},{", "\n},{");
@@ -486,30 +359,8 @@ void Bidtracker::ltcgetunspent()
 	readBuffer = remove(readBuffer, '{');
 	readBuffer = remove(readBuffer, '}');
 	readBuffer = remove(readBuffer, '[');
-	myfile << readBuffer << std::endl;
-	myfile.close();
-	}
-    catch (std::exception const &exc)
-    {
-        std::cerr << "Exception caught " << exc.what() << "\n";
-    }
-    catch (...)
-    {
-        std::cerr << "Unknown exception caught\n";
-    }
-}
-
-void ltcsortunspent(){
-
-	ifstream myfile ((GetDataDir() / "bidtracker/ltcunspentraw.dat").string().c_str());
-	std::ofstream myfile2;
-	myfile2.open((GetDataDir() / "bidtracker/ltcbids.dat").string().c_str(),fstream::out);
+	istringstream myfile(readBuffer);
 
-	std::string line;
-    try
-    {
-
-	if (myfile.is_open()){
 		while ( myfile.good() ){
 			getline (myfile,line);
 			string temp = line;
@@ -528,33 +379,9 @@ void ltcsortunspent(){
 				semp = remove(semp, ',');
 				string txid = semp;
 				string url;
-				url = "http://api.blockstrap.com/v0/ltc/transaction/id/"+ txid + "?showtxn=1&showtxnio=1&";
-				const char * d = url.c_str();
-				CURL *curl;
-				CURLcode res;
-				string readBuffer;
-
-				curl = curl_easy_init();
-				if(curl) {
-					curl_easy_setopt(curl, CURLOPT_URL, d);
-					curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteCallback);
-					curl_easy_setopt(curl, CURLOPT_WRITEDATA, &readBuffer);
-					res = curl_easy_perform(curl);
-					curl_easy_cleanup(curl);
-				}
-			std::size_t pos = readBuffer.find(",{");
-			readBuffer = readBuffer.substr(0,pos);
-			string hemp = readBuffer;
-			std::size_t pos1 = hemp.find("\"address\"");
-			hemp = hemp.substr(pos1);
-
-			string lemp = hemp;
-			std::size_t pos2 = lemp.find("\"}");
-			lemp = lemp.substr(0,pos2);
-
-			lemp = replacestring(lemp, "\"address\":\"", "");
-
-			myfile2 << lemp << ",";
+				url = BidSourceURL(CHAIN_BID_SOURCE, "/v0/" + strChain + "/transaction/id/"+ txid + "?showtxn=1&showtxnio=1&");
+				vItems.push_back(CBidItem(vTxRequests.size(), ""));
+				vTxRequests.push_back(CBidRequest(url));
 			}
 
 			search2 = "\"tx_address_value\":";
@@ -564,126 +391,206 @@ void ltcsortunspent(){
 				semp = semp.replace(g, std::string("\"tx_address_value\":").length(), "");
 				semp = remove(semp, ',');
 				long double amount = atof(semp.c_str());
-				amount = amount *ltcgetprice();
-				myfile2 << std::fixed << amount << std::endl;
+				amount = amount * price;
+				std::ostringstream amountstream;
+				amountstream << std::fixed << amount << std::endl;
+				vItems.push_back(CBidItem(-1, amountstream.str()));
 			}
 		}
-		myfile.close();
-		myfile2.close();
-	}
 	}
-
     catch (std::exception const &exc)
     {
-        std::cerr << "Exception caught " << exc.what() << "\n";
+        LogPrintf("ParseChainUnspent : %s : %s\n", strChain, exc.what());
     }
-    catch (...)
-    {
-        std::cerr << "Unknown exception caught\n";
-    }
-
 }
 
-double Bidtracker::usdbtc(){
+/** Funding address of a blockstrap transaction */
+static std::string ParseChainAddress(std::string readBuffer)
+{
+			std::size_t pos = readBuffer.find(",{");
+			readBuffer = readBuffer.substr(0,pos);
+			string hemp = readBuffer;
+			std::size_t pos1 = hemp.find("\"address\"");
+			hemp = hemp.substr(pos1);
 
-return btcgetprice();
+			string lemp = hemp;
+			std::size_t pos2 = lemp.find("\"}");
+			lemp = lemp.substr(0,pos2);
+			lemp = replacestring(lemp, "\"address\":\"", "");
 
+			return lemp + ",";
 }
 
-long double Bidtracker::ltcbtc(){
+/**
+ * Render a listing into "address,amount" lines once its transactions are
+ * fetched. A transaction without a recognisable address ends the listing.
+ */
+static std::string RenderBids(const std::vector<CBidItem>& vItems, const std::vector<CBidRequest>& vTxRequests, std::string (*ParseAddress)(std::string))
+{
+    std::string strBids;
+    try
+    {
+        BOOST_FOREACH(const CBidItem& item, vItems) {
+            if (item.nRequest < 0)
+                strBids += item.strText;
+            else
+                strBids += ParseAddress(vTxRequests[item.nRequest].strResponse);
+        }
+    }
+    catch (std::exception const &exc)
+    {
+        LogPrintf("RenderBids : %s\n", exc.what());
+    }
+    return strBids;
+}
 
-return ltcgetprice();
+/** Sum the "address,amount" lines of a listing into mapBidsOut */
+static void AggregateBids(const std::string& strBids, std::map<std::string,int>& mapBidsOut)
+{
+	istringstream myfile2(strBids);
 
+	char * pEnd;
+	std::string line;
+	while (getline(myfile2, line)){
+		if (!line.empty()) {
+			std::vector<std::string> strs;
+			boost::split(strs, line, boost::is_any_of(","));
+			if (strs.size() < 2)
+				continue;
+			mapBidsOut[strs[0]]+=strtoll(strs[1].c_str(),&pEnd,10);
+		}
+	}
 }
 
-long double Bidtracker::dashbtc(){
-
-return dashgetprice();
+bool FetchBids(CBidFetcher& fetcher, std::map<std::string,int>& mapBidsOut)
+{
+    // Listings and exchange rates
+    std::vector<CBidRequest> vRequests;
+    vRequests.push_back(CBidRequest(BidSourceURL(BTC_BID_SOURCE, "/unspent?active=" + BTC_BID_ADDRESS)));
+    vRequests.push_back(CBidRequest(BidSourceURL(CHAIN_BID_SOURCE, "/v0/ltc/address/unspents/" + LTC_BID_ADDRESS)));
+    vRequests.push_back(CBidRequest(BidSourceURL(CHAIN_BID_SOURCE, "/v0/drk/address/unspents/" + DASH_BID_ADDRESS)));
+    vRequests.push_back(CBidRequest(BidSourceURL(TICKER_BID_SOURCE, "/api/v1.1/public/getticker?market=BTC-LTC")));
+    vRequests.push_back(CBidRequest(BidSourceURL(TICKER_BID_SOURCE, "/api/v1.1/public/getticker?market=BTC-DASH")));
+    fetcher.Fetch(vRequests);
+    for (unsigned int i = 0; i < 3; i++) {
+        if (!vRequests[i].fOk) {
+            LogPrintf("FetchBids : could not fetch %s\n", vRequests[i].strURL);
+            return false;
+        }
+    }
 
+    // Transactions that funded the unspent outputs, of all chains at once
+    std::vector<CBidRequest> vTxRequests;
+    std::vector<CBidItem> vBTCItems, vLTCItems, vDashItems;
+    ParseBTCUnspent(vRequests[0].strResponse, vTxRequests, vBTCItems);
+    ParseChainUnspent(vRequests[1].strResponse, "ltc", ParseTickerBid(vRequests[3].strResponse), vTxRequests, vLTCItems);
+    ParseChainUnspent(vRequests[2].strResponse, "drk", ParseTickerBid(vRequests[4].strResponse), vTxRequests, vDashItems);
+    fetcher.Fetch(vTxRequests);
+
+    mapBidsOut.clear();
+    AggregateBids(RenderBids(vBTCItems, vTxRequests, ParseBTCAddress), mapBidsOut);
+    AggregateBids(RenderBids(vLTCItems, vTxRequests, ParseChainAddress), mapBidsOut);
+    AggregateBids(RenderBids(vDashItems, vTxRequests, ParseChainAddress), mapBidsOut);
+    return true;
 }
 
-long double Bidtracker::bcrbtc(){
+bool FetchMarketData(CBidFetcher& fetcher, CMarketData& data)
+{
+    // Where each value comes from and how it is read
+    struct
+    {
+        const std::string& strSource;
+        std::string strPath;
+        double (*Parse)(std::string);
+        double* pValue;
+    } sources[] = {
+        { BTC_BID_SOURCE, "/q/addressbalance/" + BTC_BID_ADDRESS, ParseBalance, &data.btcbids },
+        { LTC_BALANCE_SOURCE, "/api/v1/address/balance/" + LTC_BID_ADDRESS, ParseBalance, &data.ltcbids },
+        { CHAINZ_BALANCE_SOURCE, "/dash/api.dws?q=getbalance&a=" + DASH_BID_ADDRESS, ParseBalance, &data.dashbids },
+        { CHAINZ_BALANCE_SOURCE, "/bcr/api.dws?q=getbalance&a=" + BCR_RESERVE_ADDRESS, ParseBalance, &data.bcrreserves },
+        { BTC_BID_SOURCE, "/q/addressbalance/" + BTC_RESERVE_ADDRESS, ParseBalance, &data.btcreserves },
+        { LTC_BALANCE_SOURCE, "/api/v1/address/balance/" + LTC_RESERVE_ADDRESS, ParseBalance, &data.ltcreserves },
+        { CHAINZ_BALANCE_SOURCE, "/dash/api.dws?q=getbalance&a=" + DASH_RESERVE_ADDRESS, ParseBalance, &data.dashreserves },
+        { BTC_BID_SOURCE, "/q/24hrprice", ParseBTCPrice, &data.usdbtc },
+        { TICKER_BID_SOURCE, "/api/v1.1/public/getticker?market=BTC-LTC", ParseTickerBid, &data.ltcbtc },
+        { TICKER_BID_SOURCE, "/api/v1.1/public/getticker?market=BTC-DASH", ParseTickerBid, &data.dashbtc },
+        { TICKER_BID_SOURCE, "/api/v1.1/public/getticker?market=BTC-BCR", ParseTickerBid, &data.bcrbtc },
+    };
+    const unsigned int nSources = sizeof(sources) / sizeof(sources[0]);
+
+    std::vector<CBidRequest> vRequests;
+    for (unsigned int i = 0; i < nSources; i++)
+        vRequests.push_back(CBidRequest(BidSourceURL(sources[i].strSource, sources[i].strPath)));
+    fetcher.Fetch(vRequests);
+
+    bool fOk = true;
+    for (unsigned int i = 0; i < nSources; i++) {
+        if (!vRequests[i].fOk) {
+            LogPrintf("FetchMarketData : could not fetch %s\n", vRequests[i].strURL);
+            fOk = false;
+            continue;
+        }
+        *sources[i].pValue = sources[i].Parse(vRequests[i].strResponse);
+    }
+    return fOk;
+}
 
-return bcrgetprice();
+/** Replace the latest bid snapshot */
+static void PublishBids(std::map<std::string,int>& mapBidsIn)
+{
+    LOCK(cs_bidtracker);
+    pbidsnapshot.reset(new CBidSnapshot(pbidsnapshot->nVersion + 1, mapBidsIn));
+}
 
+void LoadBids()
+{
+    ifstream myfile((GetDataDir() / "bidtracker/final.dat").string().c_str());
+    if (!myfile.is_open())
+        return;
+    std::string strBids((std::istreambuf_iterator<char>(myfile)), std::istreambuf_iterator<char>());
+    std::map<std::string,int> mapBidsLoaded;
+    AggregateBids(strBids, mapBidsLoaded);
+    LogPrintf("Loaded %u bids from final.dat\n", mapBidsLoaded.size());
+    PublishBids(mapBidsLoaded);
 }
 
-void Bidtracker::combine()
+/** Write the bids to a new file and move it over the previous one */
+static bool WriteBids(const std::map<std::string,int>& mapBidsIn)
 {
-	std::ofstream myfile;
-	myfile.open((GetDataDir() /"bidtracker/prefinal.dat").string().c_str(),fstream::out);
-	ifstream myfile2((GetDataDir() /"bidtracker/btcbids.dat").string().c_str());
-	ifstream myfile3((GetDataDir() /"bidtracker/ltcbids.dat").string().c_str());
-	ifstream myfile4((GetDataDir() /"bidtracker/dashbids.dat").string().c_str());
-
-	if (myfile2.is_open()){
-		std::string line;
-		while ( myfile2.good() ){
-			getline (myfile2,line);
-	myfile<<line<<endl;
-	}	}
-	if (myfile3.is_open()){
-		std::string line;
-		while ( myfile3.good() ){
-			getline (myfile3,line);
-	myfile<<line<<endl;
-	}	}
-	if (myfile4.is_open()){
-		std::string line;
-		while ( myfile4.good() ){
-			getline (myfile4,line);
-	myfile<<line<<endl;
-	}	}
-
-	myfile.close();
-	myfile2.close();
-	myfile3.close();
-	myfile4.close();
-	remove((GetDataDir() /"bidtracker/btcbids.dat").string().c_str());
-	remove((GetDataDir() /"bidtracker/ltcbids.dat").string().c_str());
-	remove((GetDataDir() /"bidtracker/dashbids.dat").string().c_str());
-	remove((GetDataDir() /"bidtracker/btcunspentraw.dat").string().c_str());
-	remove((GetDataDir() /"bidtracker/ltcunspentraw.dat").string().c_str());
-	remove((GetDataDir() /"bidtracker/dashunspentraw.dat").string().c_str());
-}
-
-std::map<std::string,int>::iterator brit;
-std::map<std::string,int> getbidtracker(){
-	std::map<std::string,int> finalbids;	
-	fstream myfile2((GetDataDir() /"bidtracker/prefinal.dat").string().c_str());
-
-	char * pEnd;	
-	std::string line;
-	while (getline(myfile2, line)){
-		if (!line.empty()) {
-			std::vector<std::string> strs;
-			boost::split(strs, line, boost::is_any_of(","));
-			finalbids[strs[0]]+=strtoll(strs[1].c_str(),&pEnd,10);
-		}
-	}
-	myfile2.close();
-	ofstream myfile;
-	myfile.open((GetDataDir() /"bidtracker/final.dat").string().c_str(), std::ofstream::trunc);
-	for(brit = finalbids.begin();brit != finalbids.end(); ++brit){
-		myfile << brit->first << "," << brit->second << endl;
-	}
-	myfile.close();
-	remove((GetDataDir() /"bidtracker/prefinal.dat").string().c_str());	
-	return finalbids;
+    boost::filesystem::path biddir = GetDataDir() / "bidtracker";
+    boost::filesystem::path pathTmp = biddir / "final.dat.new";
+    try {
+        boost::filesystem::create_directories(biddir);
+    } catch (const boost::filesystem::filesystem_error& e) {
+        return error("WriteBids : %s", e.what());
+    }
+
+    FILE *file = fopen(pathTmp.string().c_str(), "w");
+    if (!file)
+        return error("WriteBids : could not open %s", pathTmp.string());
+    for (std::map<std::string,int>::const_iterator it = mapBidsIn.begin(); it != mapBidsIn.end(); ++it)
+        fprintf(file, "%s,%d\n", it->first.c_str(), it->second);
+    FileCommit(file);
+    bool fOk = !ferror(file);
+    fclose(file);
+    if (!fOk || !RenameOver(pathTmp, biddir / "final.dat"))
+        return error("WriteBids : could not write %s", (biddir / "final.dat").string());
+    return true;
 }
 
-void getbids(){
-	
+boost::shared_ptr<const CBidSnapshot> getbidtracker(){
+    LOCK(cs_bidtracker);
+    return pbidsnapshot;
+}
+
+void getbids(CBidFetcher& fetcher){
+
 	int64_t nStart = GetTimeMillis();
-	Bidtracker h;
-	h.btcgetunspent();
-	h.ltcgetunspent();
-	h.dashgetunspent();
-	ltcsortunspent();
-	btcsortunspent();
-	dashsortunspent();
-	h.combine();
-	getbidtracker();
+	std::map<std::string,int> mapBidsNew;
+	if (!FetchBids(fetcher, mapBidsNew))
+		return;
+	WriteBids(mapBidsNew);
+	PublishBids(mapBidsNew);
 
 	if(fDebug)LogPrintf("Bids dump finished  %dms\n", GetTimeMillis() - nStart);
 
@@ -7,28 +7,117 @@
 #include <string>
 #include "json/json_spirit.h"
 
+#include <boost/shared_ptr.hpp>
+
 #ifndef BOOST_SPIRIT_THREADSAFE
 #define BOOST_SPIRIT_THREADSAFE
 #endif
-void getbids();
-extern std::map<std::string,int> getbidtracker();
-class Bidtracker 
-{ 
+
+/** Number of bid source requests in flight at the same time */
+static const unsigned int MAX_BID_REQUESTS_IN_FLIGHT = 8;
+/** Seconds allowed for a single bid source request */
+static const long BID_REQUEST_TIMEOUT = 30;
+
+/**
+ * Bids per address, as aggregated by one refresh of the bid sources. A
+ * snapshot is not modified once published; every refresh publishes a new
+ * one with the next version, so readers keep a consistent set of bids for
+ * as long as they hold on to it.
+ */
+class CBidSnapshot
+{
+public:
+    uint64_t nVersion;
+    std::map<std::string,int> mapBids;
+
+    CBidSnapshot() : nVersion(0) {}
+    CBidSnapshot(uint64_t nVersionIn, std::map<std::string,int>& mapBidsIn) : nVersion(nVersionIn) { mapBids.swap(mapBidsIn); }
+};
+
+class CBidFetcher;
+
+/** Refresh the bids from their sources and persist them */
+void getbids(CBidFetcher& fetcher);
+/** Publish the bids persisted by an earlier run */
+void LoadBids();
+/** The latest bid snapshot, never NULL */
+extern boost::shared_ptr<const CBidSnapshot> getbidtracker();
+
+/** One HTTP GET performed by CBidFetcher */
+struct CBidRequest
+{
+    std::string strURL;
+    std::string strResponse;
+    bool fOk;
+
+    CBidRequest(const std::string& strURLIn) : strURL(strURLIn), fOk(false) {}
+};
+
+/**
+ * Performs batches of HTTP GETs concurrently on one curl multi handle. The
+ * easy handles are kept from batch to batch, so connections to the bid
+ * sources are reused by later refreshes.
+ */
+class CBidFetcher
+{
+private:
+    CURLM* multi;
+    std::vector<CURL*> vHandles;
+
+    CBidFetcher(const CBidFetcher&);
+    CBidFetcher& operator=(const CBidFetcher&);
+
+public:
+    CBidFetcher();
+    ~CBidFetcher();
+
+    //! Perform all requests, at most MAX_BID_REQUESTS_IN_FLIGHT at a time
+    void Fetch(std::vector<CBidRequest>& vRequests);
+};
+
+/**
+ * Fetch the unspent outputs of the bid addresses, the transactions that
+ * funded them and the exchange rates, and aggregate the bids per address.
+ * The sources are read from -bidtrackerurl when it is set. Returns false if
+ * a source could not be reached.
+ */
+bool FetchBids(CBidFetcher& fetcher, std::map<std::string,int>& mapBidsOut);
+
+/**
+ * Balances of the bid and reserve addresses of the bank on other chains, in
+ * the units their block explorers report, and the exchange rates: USD per
+ * BTC, and BTC per LTC, DASH and BCR.
+ */
+struct CMarketData
+{
+    double btcbids, ltcbids, dashbids;
+    double bcrreserves, btcreserves, ltcreserves, dashreserves;
+    double usdbtc, ltcbtc, dashbtc, bcrbtc;
+
+    CMarketData() : btcbids(0), ltcbids(0), dashbids(0),
+        bcrreserves(0), btcreserves(0), ltcreserves(0), dashreserves(0),
+        usdbtc(0), ltcbtc(0), dashbtc(0), bcrbtc(0) {}
+};
+
+/**
+ * Fetch all balances and exchange rates at once. A value whose source cannot
+ * be reached is left as it was in data; returns false if any could not be.
+ * The sources are read from -bidtrackerurl when it is set.
+ */
+bool FetchMarketData(CBidFetcher& fetcher, CMarketData& data);
+
+class Bidtracker
+{
 public:
 
-    CURL *curl; 
-	void btcgetunspent();
-	void ltcgetunspent();
-	void dashgetunspent();
 	double getbalance(std::string url, double balance);
-	double usdbtc(); 
+	double usdbtc();
 	long double ltcbtc();
 	long double dashbtc();
 	long double bcrbtc();
-	double credit(); 
+	double credit();
 	double newcredit;
 	double totalcredit;
-	void combine();    	
 };
 
 #endif // BIDTRACKER_H
@@ -5,9 +5,15 @@
 #ifndef BITCREDIT_CHECKQUEUE_H
 #define BITCREDIT_CHECKQUEUE_H
 
+#include "util.h"
+#include "utiltime.h"
+
 #include <algorithm>
+#include <deque>
+#include <limits>
 #include <vector>
 
+#include <boost/atomic.hpp>
 #include <boost/foreach.hpp>
 #include <boost/thread/condition_variable.hpp>
 #include <boost/thread/locks.hpp>
@@ -16,7 +22,7 @@
 template <typename T>
 class CCheckQueueControl;
 
-/** 
+/**
  * Queue for verifications that have to be performed.
   * The verifications are represented by a type T, which must provide an
   * operator(), returning a bool.
@@ -25,12 +31,40 @@ class CCheckQueueControl;
   * onto the queue, where they are processed by N-1 worker threads. When
   * the master is done adding work, it temporarily joins the worker pool
   * as an N'th worker, until all jobs are done.
+  *
+  * Every worker, and the master, has a queue of its own. Added checks are
+  * spread over those queues; a worker takes batches from the back of its
+  * own queue and, once that is empty, steals from the front of the others.
+  * The shared mutex is only taken to go to sleep or to wake somebody up.
+  * Batches are sized so that one takes about BATCH_TARGET_MICROS to run,
+  * judging by how long recent checks took, and shrink as the queues drain
+  * so all workers finish approximately simultaneously.
   */
 template <typename T>
 class CCheckQueue
 {
 private:
-    //! Mutex to protect the inner state
+    //! Worker threads that get a queue of their own; any more share them
+    static const unsigned int MAX_WORKERS = 64;
+
+    //! How long one batch should take to run
+    static const int64_t BATCH_TARGET_MICROS = 250;
+
+    struct WorkerQueue
+    {
+        boost::mutex mutex;
+        //! As the order of booleans doesn't matter, the owner uses it as a LIFO (stack)
+        std::deque<T> queue;
+        //! When the owner started waiting for work, or 0 while it isn't
+        boost::atomic<int64_t> nIdleSince;
+
+        WorkerQueue() : nIdleSince(0) {}
+    };
+
+    //! Queue 0 is the master's, the others belong to worker threads
+    WorkerQueue vWorkerQueue[MAX_WORKERS + 1];
+
+    //! Mutex to protect sleeping and waking up
     boost::mutex mutex;
 
     //! Worker threads block on this when out of work
@@ -39,25 +73,22 @@ private:
     //! Master thread blocks on this when out of work
     boost::condition_variable condMaster;
 
-    //! The queue of elements to be processed.
-    //! As the order of booleans doesn't matter, it is used as a LIFO (stack)
-    std::vector<T> queue;
-
-    //! The number of workers (including the master) that are idle.
-    int nIdle;
+    //! The number of worker threads that have started.
+    boost::atomic<unsigned int> nWorkers;
 
-    //! The total number of workers (including the master).
-    int nTotal;
-
-    //! The temporary evaluation result.
-    bool fAllOk;
+    //! The number of verifications waiting in any of the queues.
+    //! May briefly go negative while a batch is being added.
+    boost::atomic<int> nQueued;
 
     /**
      * Number of verifications that haven't completed yet.
      * This includes elements that are no longer queued, but still in the
      * worker's own batches.
      */
-    unsigned int nTodo;
+    boost::atomic<unsigned int> nTodo;
+
+    //! The temporary evaluation result.
+    boost::atomic<bool> fAllOk;
 
     //! Whether we're shutting down.
     bool fQuit;
@@ -65,95 +96,197 @@ private:
     //! The maximum number of elements to be processed in one batch
     unsigned int nBatchSize;
 
+    //! Moving average of the time one verification takes, in nanoseconds
+    boost::atomic<unsigned int> nCheckCost;
+
+    //! Queue the master adds to next
+    unsigned int nNextQueue;
+
+    //! Name of the verifications, for logging
+    const char* pszName;
+
+    //! Statistics of the current CCheckQueueControl session
+    boost::atomic<int64_t> nSessionStart;
+    unsigned int nSessionChecks;
+    boost::atomic<unsigned int> nSessionBatches;
+    boost::atomic<unsigned int> nSessionStolen;
+    boost::atomic<int64_t> nSessionIdle;
+
+    unsigned int NumQueues() const
+    {
+        return std::min((unsigned int)nWorkers, (unsigned int)MAX_WORKERS) + 1;
+    }
+
+    //! Decide how many work units to process now.
+    unsigned int GetBatchSize() const
+    {
+        // Enough verifications to take BATCH_TARGET_MICROS, but not more than
+        // a fair share of what is left, and at least 1.
+        unsigned int nCost = nCheckCost.load(boost::memory_order_relaxed);
+        unsigned int nNow = nCost == 0 ? nBatchSize : std::min((int64_t)nBatchSize, BATCH_TARGET_MICROS * 1000 / nCost);
+        int nShare = nQueued.load(boost::memory_order_relaxed) / (int)NumQueues();
+        return std::max(1, std::min((int)nNow, nShare));
+    }
+
+    void UpdateCheckCost(int64_t nMicros, unsigned int nChecks)
+    {
+        uint64_t nCost = std::min((uint64_t)nMicros * 1000 / nChecks, (uint64_t)std::numeric_limits<unsigned int>::max());
+        uint64_t nOld = nCheckCost.load(boost::memory_order_relaxed);
+        nCheckCost.store(nOld == 0 ? nCost : (nOld * 7 + nCost) / 8, boost::memory_order_relaxed);
+    }
+
+    //! Move up to nMax verifications to vChecks, from queue nQueue or else stolen from another.
+    unsigned int TakeChecks(unsigned int nQueue, std::vector<T>& vChecks, unsigned int nMax)
+    {
+        unsigned int nQueues = NumQueues();
+        for (unsigned int i = 0; i < nQueues; i++) {
+            WorkerQueue& q = vWorkerQueue[(nQueue + i) % nQueues];
+            boost::unique_lock<boost::mutex> lock(q.mutex);
+            if (q.queue.empty())
+                continue;
+            // Take our own newest, or the oldest half of someone else's
+            unsigned int nNow = std::min(nMax, i == 0 ? (unsigned int)q.queue.size() : (unsigned int)(q.queue.size() + 1) / 2);
+            vChecks.resize(nNow);
+            for (unsigned int j = 0; j < nNow; j++) {
+                // We want the lock on the mutex to be as short as possible, so swap jobs from the
+                // queue to the local batch vector instead of copying.
+                if (i == 0) {
+                    vChecks[j].swap(q.queue.back());
+                    q.queue.pop_back();
+                } else {
+                    vChecks[j].swap(q.queue.front());
+                    q.queue.pop_front();
+                }
+            }
+            nQueued -= nNow;
+            if (i != 0)
+                nSessionStolen += nNow;
+            return nNow;
+        }
+        return 0;
+    }
+
+    //! Account for time spent waiting for work since nSince
+    void AddIdleTime(int64_t nSince, int64_t nNow)
+    {
+        int64_t nStart = nSessionStart;
+        if (nStart != 0 && nSince != 0)
+            nSessionIdle += nNow - std::max(nSince, nStart);
+    }
+
     /** Internal function that does bulk of the verification work. */
-    bool Loop(bool fMaster = false)
+    bool Loop(unsigned int nQueue, bool fMaster = false)
     {
         boost::condition_variable& cond = fMaster ? condMaster : condWorker;
+        WorkerQueue& own = vWorkerQueue[nQueue];
         std::vector<T> vChecks;
         vChecks.reserve(nBatchSize);
-        unsigned int nNow = 0;
-        bool fOk = true;
         do {
-            {
+            unsigned int nNow = TakeChecks(nQueue, vChecks, GetBatchSize());
+            if (nNow == 0) {
                 boost::unique_lock<boost::mutex> lock(mutex);
-                // first do the clean-up of the previous loop run (allowing us to do it in the same critsect)
-                if (nNow) {
-                    fAllOk &= fOk;
-                    nTodo -= nNow;
-                    if (nTodo == 0 && !fMaster)
-                        // We processed the last element; inform the master it can exit and return the result
-                        condMaster.notify_one();
-                } else {
-                    // first iteration
-                    nTotal++;
-                }
-                // logically, the do loop starts here
-                while (queue.empty()) {
-                    if ((fMaster || fQuit) && nTodo == 0) {
-                        nTotal--;
-                        bool fRet = fAllOk;
-                        // reset the status for new work later
-                        if (fMaster)
-                            fAllOk = true;
-                        // return the current status
-                        return fRet;
-                    }
-                    nIdle++;
-                    cond.wait(lock); // wait
-                    nIdle--;
-                }
-                // Decide how many work units to process now.
-                // * Do not try to do everything at once, but aim for increasingly smaller batches so
-                //   all workers finish approximately simultaneously.
-                // * Try to account for idle jobs which will instantly start helping.
-                // * Don't do batches smaller than 1 (duh), or larger than nBatchSize.
-                nNow = std::max(1U, std::min(nBatchSize, (unsigned int)queue.size() / (nTotal + nIdle + 1)));
-                vChecks.resize(nNow);
-                for (unsigned int i = 0; i < nNow; i++) {
-                    // We want the lock on the mutex to be as short as possible, so swap jobs from the global
-                    // queue to the local batch vector instead of copying.
-                    vChecks[i].swap(queue.back());
-                    queue.pop_back();
+                if (nQueued > 0)
+                    continue;
+                if (fMaster && nTodo == 0) {
+                    bool fRet = fAllOk;
+                    // reset the status for new work later
+                    fAllOk = true;
+                    // return the current status
+                    return fRet;
                 }
-                // Check whether we need to do work at all
-                fOk = fAllOk;
+                if (!fMaster && fQuit)
+                    return false;
+                own.nIdleSince = GetTimeMicros();
+                cond.wait(lock); // wait
+                AddIdleTime(own.nIdleSince.exchange(0), GetTimeMicros());
+                continue;
             }
+            // Check whether we need to do work at all
+            bool fOk = fAllOk;
             // execute work
+            int64_t nStart = GetTimeMicros();
             BOOST_FOREACH (T& check, vChecks)
                 if (fOk)
                     fOk = check();
+            UpdateCheckCost(GetTimeMicros() - nStart, nNow);
             vChecks.clear();
+            if (!fOk)
+                fAllOk = false;
+            nSessionBatches++;
+            if (nTodo.fetch_sub(nNow) == nNow && !fMaster) {
+                // We processed the last element; inform the master it can exit and return the result
+                boost::unique_lock<boost::mutex> lock(mutex);
+                condMaster.notify_one();
+            }
         } while (true);
     }
 
+    void StartSession()
+    {
+        nSessionChecks = 0;
+        nSessionBatches = 0;
+        nSessionStolen = 0;
+        nSessionIdle = 0;
+        nSessionStart = GetTimeMicros();
+    }
+
+    void EndSession()
+    {
+        int64_t nEnd = GetTimeMicros();
+        // Workers still waiting have been idle since they last ran out of work
+        for (unsigned int i = 1; i < NumQueues(); i++)
+            AddIdleTime(vWorkerQueue[i].nIdleSince, nEnd);
+        int64_t nStart = nSessionStart.exchange(0);
+        if (nSessionChecks > 0)
+            LogPrint("bench", "    - %s checks: %u in %u batches (%u stolen), %.2fms wall, %.2fms idle over %u threads\n",
+                pszName, nSessionChecks, (unsigned int)nSessionBatches, (unsigned int)nSessionStolen,
+                0.001 * (nEnd - nStart), 0.001 * nSessionIdle, NumQueues());
+    }
+
 public:
     //! Create a new check queue
-    CCheckQueue(unsigned int nBatchSizeIn) : nIdle(0), nTotal(0), fAllOk(true), nTodo(0), fQuit(false), nBatchSize(nBatchSizeIn) {}
+    CCheckQueue(unsigned int nBatchSizeIn, const char* pszNameIn) : nWorkers(0), nQueued(0), nTodo(0), fAllOk(true), fQuit(false), nBatchSize(nBatchSizeIn), nCheckCost(0), nNextQueue(0), pszName(pszNameIn),
+        nSessionStart(0), nSessionChecks(0), nSessionBatches(0), nSessionStolen(0), nSessionIdle(0) {}
 
     //! Worker thread
     void Thread()
     {
-        Loop();
+        Loop(1 + nWorkers.fetch_add(1) % MAX_WORKERS);
     }
 
     //! Wait until execution finishes, and return whether all evaluations were successful.
     bool Wait()
     {
-        return Loop(true);
+        return Loop(0, true);
     }
 
     //! Add a batch of checks to the queue
     void Add(std::vector<T>& vChecks)
     {
-        boost::unique_lock<boost::mutex> lock(mutex);
-        BOOST_FOREACH (T& check, vChecks) {
-            queue.push_back(T());
-            check.swap(queue.back());
-        }
+        if (vChecks.empty())
+            return;
+
+        // Count the checks before any worker can get to them
         nTodo += vChecks.size();
+        nSessionChecks += vChecks.size();
+
+        // Spread them in runs over the queues, starting where the last batch ended
+        unsigned int nQueues = NumQueues();
+        unsigned int nRun = (vChecks.size() + nQueues - 1) / nQueues;
+        for (unsigned int i = 0; i < vChecks.size(); ) {
+            WorkerQueue& q = vWorkerQueue[nNextQueue++ % nQueues];
+            boost::unique_lock<boost::mutex> lock(q.mutex);
+            for (unsigned int j = 0; j < nRun && i < vChecks.size(); j++, i++) {
+                q.queue.push_back(T());
+                vChecks[i].swap(q.queue.back());
+            }
+        }
+        nQueued += vChecks.size();
+
+        boost::unique_lock<boost::mutex> lock(mutex);
         if (vChecks.size() == 1)
             condWorker.notify_one();
-        else if (vChecks.size() > 1)
+        else
             condWorker.notify_all();
     }
 
@@ -164,7 +297,7 @@ public:
     friend class CCheckQueueControl<T>;
 };
 
-/** 
+/**
  * RAII-style controller object for a CCheckQueue that guarantees the passed
  * queue is finished before continuing.
  */
@@ -180,9 +313,10 @@ public:
     {
         // passed queue is supposed to be unused, or NULL
         if (pqueue != NULL) {
-            assert(pqueue->nTotal == pqueue->nIdle);
+            assert(pqueue->nQueued == 0);
             assert(pqueue->nTodo == 0);
             assert(pqueue->fAllOk == true);
+            pqueue->StartSession();
         }
     }
 
@@ -191,6 +325,7 @@ public:
         if (pqueue == NULL)
             return true;
         bool fRet = pqueue->Wait();
+        pqueue->EndSession();
         fDone = true;
         return fRet;
     }
@@ -4,6 +4,7 @@
 
 #include "coins.h"
 
+#include "hash.h"
 #include "random.h"
 
 #include <assert.h>
@@ -57,7 +58,48 @@ bool CCoins::Spend(int nPos) {
 bool CCoinsView::GetCoins(const uint256 &txid, CCoins &coins) const { return false; }
 bool CCoinsView::HaveCoins(const uint256 &txid) const { return false; }
 uint256 CCoinsView::GetBestBlock() const { return uint256(0); }
-bool CCoinsView::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) { return false; }
+bool CCoinsView::GetAddressBalance(const std::string &address, CAddressBalance &balance) const { return false; }
+void CCoinsTotals::Update(const uint256 &txid, const CCoins &coins, int nSign) {
+    if (coins.IsPruned())
+        return;
+    CHashWriter ss(SER_GETHASH, 0);
+    ss << txid << coins;
+    int64_t nOutputs = 0;
+    CAmount nAmount = 0;
+    BOOST_FOREACH(const CTxOut &out, coins.vout) {
+        if (!out.IsNull()) {
+            nOutputs++;
+            nAmount += out.nValue;
+        }
+    }
+    nTransactions += nSign;
+    nTransactionOutputs += nSign * nOutputs;
+    nSerializedSize += nSign * (int64_t)(32 + ::GetSerializeSize(coins, SER_DISK, 0));
+    nTotalAmount += nSign * nAmount;
+    if (nSign > 0)
+        hashSerialized += ss.GetHash();
+    else
+        hashSerialized -= ss.GetHash();
+}
+
+CCoinsTotals& CCoinsTotals::operator+=(const CCoinsTotals &other) {
+    nTransactions += other.nTransactions;
+    nTransactionOutputs += other.nTransactionOutputs;
+    nSerializedSize += other.nSerializedSize;
+    nTotalAmount += other.nTotalAmount;
+    hashSerialized += other.hashSerialized;
+    return *this;
+}
+
+void CCoinsTotals::GetStats(CCoinsStats &stats) const {
+    stats.nTransactions = nTransactions;
+    stats.nTransactionOutputs = nTransactionOutputs;
+    stats.nSerializedSize = nSerializedSize;
+    stats.nTotalAmount = nTotalAmount;
+    stats.hashSerialized = hashSerialized;
+}
+
+bool CCoinsView::BatchWrite(CCoinsMap &mapCoins, CAddressBalanceMap &mapBalances, CCoinsTotals &totals, const uint256 &hashBlock) { return false; }
 bool CCoinsView::GetStats(CCoinsStats &stats) const { return false; }
 
 
@@ -65,8 +107,9 @@ CCoinsViewBacked::CCoinsViewBacked(CCoinsView *viewIn) : base(viewIn) { }
 bool CCoinsViewBacked::GetCoins(const uint256 &txid, CCoins &coins) const { return base->GetCoins(txid, coins); }
 bool CCoinsViewBacked::HaveCoins(const uint256 &txid) const { return base->HaveCoins(txid); }
 uint256 CCoinsViewBacked::GetBestBlock() const { return base->GetBestBlock(); }
+bool CCoinsViewBacked::GetAddressBalance(const std::string &address, CAddressBalance &balance) const { return base->GetAddressBalance(address, balance); }
 void CCoinsViewBacked::SetBackend(CCoinsView &viewIn) { base = &viewIn; }
-bool CCoinsViewBacked::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) { return base->BatchWrite(mapCoins, hashBlock); }
+bool CCoinsViewBacked::BatchWrite(CCoinsMap &mapCoins, CAddressBalanceMap &mapBalances, CCoinsTotals &totals, const uint256 &hashBlock) { return base->BatchWrite(mapCoins, mapBalances, totals, hashBlock); }
 bool CCoinsViewBacked::GetStats(CCoinsStats &stats) const { return base->GetStats(stats); }
 
 CCoinsKeyHasher::CCoinsKeyHasher() : salt(GetRandHash()) {}
@@ -132,6 +175,10 @@ const CCoins* CCoinsViewCache::AccessCoins(const uint256 &txid) const {
     }
 }
 
+bool CCoinsViewCache::HaveCoinsInCache(const uint256 &txid) const {
+    return cacheCoins.count(txid) != 0;
+}
+
 bool CCoinsViewCache::HaveCoins(const uint256 &txid) const {
     CCoinsMap::const_iterator it = FetchCoins(txid);
     // We're using vtx.empty() instead of IsPruned here for performance reasons,
@@ -141,6 +188,26 @@ bool CCoinsViewCache::HaveCoins(const uint256 &txid) const {
     return (it != cacheCoins.end() && !it->second.coins.vout.empty());
 }
 
+bool CCoinsViewCache::GetAddressBalance(const std::string &address, CAddressBalance &balance) const {
+    CAddressBalanceMap::const_iterator it = cacheBalances.find(address);
+    if (it != cacheBalances.end()) {
+        balance = it->second;
+        return !balance.IsNull();
+    }
+    return base->GetAddressBalance(address, balance);
+}
+
+CAddressBalance& CCoinsViewCache::ModifyAddressBalance(const std::string &address) {
+    std::pair<CAddressBalanceMap::iterator, bool> ret = cacheBalances.insert(std::make_pair(address, CAddressBalance()));
+    if (ret.second && !base->GetAddressBalance(address, ret.first->second))
+        ret.first->second = CAddressBalance();
+    return ret.first->second;
+}
+
+void CCoinsViewCache::UpdateTotals(const uint256 &txid, const CCoins &coins, int nSign) {
+    cacheTotals.Update(txid, coins, nSign);
+}
+
 uint256 CCoinsViewCache::GetBestBlock() const {
     if (hashBlock == uint256(0))
         hashBlock = base->GetBestBlock();
@@ -151,7 +218,7 @@ void CCoinsViewCache::SetBestBlock(const uint256 &hashBlockIn) {
     hashBlock = hashBlockIn;
 }
 
-bool CCoinsViewCache::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlockIn) {
+bool CCoinsViewCache::BatchWrite(CCoinsMap &mapCoins, CAddressBalanceMap &mapBalances, CCoinsTotals &totals, const uint256 &hashBlockIn) {
     assert(!hasModifier);
     for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end();) {
         if (it->second.flags & CCoinsCacheEntry::DIRTY) { // Ignore non-dirty entries (optimization).
@@ -183,18 +250,38 @@ bool CCoinsViewCache::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlockIn
         CCoinsMap::iterator itOld = it++;
         mapCoins.erase(itOld);
     }
+    // Balance entries in the child always hold the full value, so they simply replace ours.
+    for (CAddressBalanceMap::const_iterator it = mapBalances.begin(); it != mapBalances.end(); it++)
+        cacheBalances[it->first] = it->second;
+    mapBalances.clear();
+    cacheTotals += totals;
+    totals.SetNull();
     hashBlock = hashBlockIn;
     return true;
 }
 
 bool CCoinsViewCache::Flush() {
-    bool fOk = base->BatchWrite(cacheCoins, hashBlock);
+    bool fOk = base->BatchWrite(cacheCoins, cacheBalances, cacheTotals, hashBlock);
     cacheCoins.clear();
+    cacheBalances.clear();
+    cacheTotals.SetNull();
     return fOk;
 }
 
+bool CCoinsViewCache::GetStats(CCoinsStats &stats) const {
+    if (!base->GetStats(stats))
+        return false;
+    stats.nTransactions += cacheTotals.nTransactions;
+    stats.nTransactionOutputs += cacheTotals.nTransactionOutputs;
+    stats.nSerializedSize += cacheTotals.nSerializedSize;
+    stats.nTotalAmount += cacheTotals.nTotalAmount;
+    stats.hashSerialized += cacheTotals.hashSerialized;
+    stats.hashBlock = GetBestBlock();
+    return true;
+}
+
 unsigned int CCoinsViewCache::GetCacheSize() const {
-    return cacheCoins.size();
+    return cacheCoins.size() + cacheBalances.size();
 }
 
 const CTxOut &CCoinsViewCache::GetOutputFor(const CTxIn& input) const
@@ -14,6 +14,9 @@
 #include <assert.h>
 #include <stdint.h>
 
+#include <map>
+#include <string>
+
 #include <boost/foreach.hpp>
 #include <boost/unordered_map.hpp>
 
@@ -291,6 +294,32 @@ struct CCoinsCacheEntry
 
 typedef boost::unordered_map<uint256, CCoinsCacheEntry, CCoinsKeyHasher> CCoinsMap;
 
+/**
+ * Running balance of one address in the address balance index.
+ * nRefs counts the block outputs and inputs that touched the address, so that
+ * disconnecting the block that created an entry removes it again.
+ */
+struct CAddressBalance
+{
+    CAmount nBalance;
+    uint32_t nRefs;
+
+    CAddressBalance() : nBalance(0), nRefs(0) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        READWRITE(nBalance);
+        READWRITE(VARINT(nRefs));
+    }
+
+    bool IsNull() const { return nRefs == 0; }
+};
+
+//! Address balance entries keyed by encoded address
+typedef std::map<std::string, CAddressBalance> CAddressBalanceMap;
+
 struct CCoinsStats
 {
     int nHeight;
@@ -304,6 +333,50 @@ struct CCoinsStats
     CCoinsStats() : nHeight(0), hashBlock(0), nTransactions(0), nTransactionOutputs(0), nSerializedSize(0), hashSerialized(0), nTotalAmount(0) {}
 };
 
+/**
+ * Running totals over the unspent transaction output set, or a change to
+ * them. hashSerialized is the sum (modulo 2^256) of a hash of the unspent
+ * outputs of every transaction, so that it follows the set as coins are
+ * added and removed, without visiting the rest of it.
+ */
+struct CCoinsTotals
+{
+    int64_t nTransactions;
+    int64_t nTransactionOutputs;
+    int64_t nSerializedSize;
+    CAmount nTotalAmount;
+    uint256 hashSerialized;
+
+    CCoinsTotals() { SetNull(); }
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        READWRITE(nTransactions);
+        READWRITE(nTransactionOutputs);
+        READWRITE(nSerializedSize);
+        READWRITE(nTotalAmount);
+        READWRITE(hashSerialized);
+    }
+
+    void SetNull() {
+        nTransactions = 0;
+        nTransactionOutputs = 0;
+        nSerializedSize = 0;
+        nTotalAmount = 0;
+        hashSerialized = 0;
+    }
+
+    //! Add (nSign=1) or remove (nSign=-1) the unspent outputs of a transaction
+    void Update(const uint256 &txid, const CCoins &coins, int nSign);
+
+    CCoinsTotals& operator+=(const CCoinsTotals &other);
+
+    //! Fill in the set statistics (all but the block) from these totals
+    void GetStats(CCoinsStats &stats) const;
+};
+
 
 /** Abstract view on the open txout dataset. */
 class CCoinsView
@@ -319,11 +392,15 @@ public:
     //! Retrieve the block hash whose state this CCoinsView currently represents
     virtual uint256 GetBestBlock() const;
 
-    //! Do a bulk modification (multiple CCoins changes + BestBlock change).
-    //! The passed mapCoins can be modified.
-    virtual bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock);
+    //! Retrieve the balance entry for an address; false if no block ever touched it
+    virtual bool GetAddressBalance(const std::string &address, CAddressBalance &balance) const;
+
+    //! Do a bulk modification (multiple CCoins and address balance changes, the
+    //! change to the set totals + BestBlock change).
+    //! The passed mapCoins, mapBalances and totals can be modified.
+    virtual bool BatchWrite(CCoinsMap &mapCoins, CAddressBalanceMap &mapBalances, CCoinsTotals &totals, const uint256 &hashBlock);
 
-    //! Calculate statistics about the unspent transaction output set
+    //! Statistics about the unspent transaction output set, from its running totals
     virtual bool GetStats(CCoinsStats &stats) const;
 
     //! As we use CCoinsViews polymorphically, have a virtual destructor
@@ -342,8 +419,9 @@ public:
     bool GetCoins(const uint256 &txid, CCoins &coins) const;
     bool HaveCoins(const uint256 &txid) const;
     uint256 GetBestBlock() const;
+    bool GetAddressBalance(const std::string &address, CAddressBalance &balance) const;
     void SetBackend(CCoinsView &viewIn);
-    bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock);
+    bool BatchWrite(CCoinsMap &mapCoins, CAddressBalanceMap &mapBalances, CCoinsTotals &totals, const uint256 &hashBlock);
     bool GetStats(CCoinsStats &stats) const;
 };
 
@@ -382,6 +460,9 @@ protected:
      */
     mutable uint256 hashBlock;
     mutable CCoinsMap cacheCoins;
+    CAddressBalanceMap cacheBalances;
+    //! Change to the set totals of the base view made through this cache
+    CCoinsTotals cacheTotals;
 
 public:
     CCoinsViewCache(CCoinsView *baseIn);
@@ -391,8 +472,10 @@ public:
     bool GetCoins(const uint256 &txid, CCoins &coins) const;
     bool HaveCoins(const uint256 &txid) const;
     uint256 GetBestBlock() const;
+    bool GetAddressBalance(const std::string &address, CAddressBalance &balance) const;
     void SetBestBlock(const uint256 &hashBlock);
-    bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock);
+    bool BatchWrite(CCoinsMap &mapCoins, CAddressBalanceMap &mapBalances, CCoinsTotals &totals, const uint256 &hashBlock);
+    bool GetStats(CCoinsStats &stats) const;
 
     /**
      * Return a pointer to CCoins in the cache, or NULL if not found. This is
@@ -401,6 +484,9 @@ public:
      */
     const CCoins* AccessCoins(const uint256 &txid) const;
 
+    //! Whether this cache holds an entry for txid, without fetching it from the base
+    bool HaveCoinsInCache(const uint256 &txid) const;
+
     /**
      * Return a modifiable reference to a CCoins. If no entry with the given
      * txid exists, a new one is created. Simultaneous modifications are not
@@ -408,6 +494,21 @@ public:
      */
     CCoinsModifier ModifyCoins(const uint256 &txid);
 
+    /**
+     * Return a modifiable reference to the balance entry of an address, pulling
+     * it in from the base view (or creating an empty one) if necessary. The
+     * entry is written back on Flush; entries left with no references are erased.
+     */
+    CAddressBalance& ModifyAddressBalance(const std::string &address);
+
+    /**
+     * Add (nSign=1) or remove (nSign=-1) the unspent outputs of a transaction
+     * from the set totals. Whoever changes coins removes their old state
+     * before and adds the new one after, so the totals never need a scan of
+     * the set. The change is passed on to the base view on Flush.
+     */
+    void UpdateTotals(const uint256 &txid, const CCoins &coins, int nSign);
+
     /**
      * Push the modifications applied to this cache to its base.
      * Failure to call this method before destruction will cause the changes to be forgotten.
@@ -415,7 +516,7 @@ public:
      */
     bool Flush();
 
-    //! Calculate the size of the cache (in number of transactions)
+    //! Calculate the size of the cache (in number of transactions and address balances)
     unsigned int GetCacheSize() const;
 
     /** 
@@ -0,0 +1,148 @@
+// Copyright (c) 2015 The Bitcredit Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "coinsprefetch.h"
+
+#include "util.h"
+#include "utiltime.h"
+
+#include <boost/bind.hpp>
+#include <boost/thread/reverse_lock.hpp>
+
+CCoinsViewPrefetch::CCoinsViewPrefetch(CCoinsView* baseIn, int nThreads) : CCoinsViewBacked(baseIn), nReading(0), fQuit(false),
+    nRequested(0), nHits(0), nWaits(0), nLate(0), nMisses(0), nDropped(0), nDiscarded(0), nReads(0), nReadLatency(0)
+{
+    for (int i = 0; i < nThreads; i++)
+        threadGroup.create_thread(boost::bind(&CCoinsViewPrefetch::Thread, this));
+}
+
+CCoinsViewPrefetch::~CCoinsViewPrefetch()
+{
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        fQuit = true;
+        condWork.notify_all();
+    }
+    threadGroup.join_all();
+}
+
+void CCoinsViewPrefetch::Thread()
+{
+    RenameThread("bitcredit-prefetch");
+    boost::unique_lock<boost::mutex> lock(mutex);
+    while (true) {
+        while (queue.empty() && !fQuit)
+            condWork.wait(lock);
+        if (fQuit)
+            return;
+
+        uint256 txid = queue.front();
+        queue.pop_front();
+        // Skip entries GetCoins has taken over, or that were dropped
+        CPrefetchMap::iterator it = mapEntries.find(txid);
+        if (it == mapEntries.end() || it->second.state != QUEUED)
+            continue;
+        it->second.state = READING;
+        nReading++;
+
+        CCoins coins;
+        bool fFound;
+        {
+            boost::reverse_lock<boost::unique_lock<boost::mutex> > unlock(lock);
+            fFound = base->GetCoins(txid, coins);
+        }
+
+        // Nothing removes an entry while it is being read
+        nReading--;
+        it = mapEntries.find(txid);
+        assert(it != mapEntries.end() && it->second.state == READING);
+        it->second.fFound = fFound;
+        it->second.coins.swap(coins);
+        it->second.state = DONE;
+        nReads++;
+        nReadLatency += GetTimeMicros() - it->second.nTimeQueued;
+        condRead.notify_all();
+    }
+}
+
+void CCoinsViewPrefetch::Prefetch(const std::vector<uint256>& vTxid)
+{
+    int64_t nNow = GetTimeMicros();
+    boost::unique_lock<boost::mutex> lock(mutex);
+    if (threadGroup.size() == 0)
+        return;
+    for (unsigned int i = 0; i < vTxid.size(); i++) {
+        if (mapEntries.size() >= MAX_PREFETCH_ENTRIES) {
+            nDropped += vTxid.size() - i;
+            break;
+        }
+        std::pair<CPrefetchMap::iterator, bool> ret = mapEntries.insert(std::make_pair(vTxid[i], CPrefetchEntry()));
+        if (!ret.second)
+            continue;
+        ret.first->second.nTimeQueued = nNow;
+        queue.push_back(vTxid[i]);
+        nRequested++;
+    }
+    condWork.notify_all();
+}
+
+bool CCoinsViewPrefetch::GetCoins(const uint256 &txid, CCoins &coins) const
+{
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        CPrefetchMap::iterator it = mapEntries.find(txid);
+        if (it != mapEntries.end() && it->second.state == READING) {
+            nWaits++;
+            do {
+                condRead.wait(lock);
+                it = mapEntries.find(txid);
+            } while (it != mapEntries.end() && it->second.state == READING);
+        }
+        if (it == mapEntries.end()) {
+            nMisses++;
+        } else if (it->second.state == QUEUED) {
+            // Not started yet; reading it here is quicker than waiting
+            nLate++;
+            mapEntries.erase(it);
+        } else {
+            nHits++;
+            bool fFound = it->second.fFound;
+            coins.swap(it->second.coins);
+            mapEntries.erase(it);
+            return fFound;
+        }
+    }
+    return base->GetCoins(txid, coins);
+}
+
+bool CCoinsViewPrefetch::BatchWrite(CCoinsMap &mapCoins, CAddressBalanceMap &mapBalances, CCoinsTotals &totals, const uint256 &hashBlock)
+{
+    // Let the reads under way finish, and hold the lock so no new ones start
+    // while the base changes
+    boost::unique_lock<boost::mutex> lock(mutex);
+    queue.clear();
+    while (nReading > 0)
+        condRead.wait(lock);
+    bool fOk = base->BatchWrite(mapCoins, mapBalances, totals, hashBlock);
+
+    // Everything read so far predates the write
+    nDiscarded += mapEntries.size();
+    mapEntries.clear();
+    return fOk;
+}
+
+void CCoinsViewPrefetch::GetInternalStats(std::map<std::string, size_t>& mapResults) const
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    mapResults["coinsprefetch.threads"] = threadGroup.size();
+    mapResults["coinsprefetch.requested"] = nRequested;
+    mapResults["coinsprefetch.hits"] = nHits;
+    mapResults["coinsprefetch.waits"] = nWaits;
+    mapResults["coinsprefetch.late"] = nLate;
+    mapResults["coinsprefetch.misses"] = nMisses;
+    mapResults["coinsprefetch.dropped"] = nDropped;
+    mapResults["coinsprefetch.discarded"] = nDiscarded;
+    mapResults["coinsprefetch.pending"] = mapEntries.size();
+    mapResults["coinsprefetch.latency_avg_us"] = nReads > 0 ? nReadLatency / nReads : 0;
+}
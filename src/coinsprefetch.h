@@ -0,0 +1,99 @@
+// Copyright (c) 2015 The Bitcredit Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCREDIT_COINSPREFETCH_H
+#define BITCREDIT_COINSPREFETCH_H
+
+#include "coins.h"
+#include "uint256.h"
+
+#include <deque>
+#include <map>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/unordered_map.hpp>
+
+/** Default for -prefetchthreads */
+static const int DEFAULT_PREFETCH_THREADS = 4;
+/** Maximum number of prefetched entries waiting to be used */
+static const unsigned int MAX_PREFETCH_ENTRIES = 100000;
+
+/**
+ * CCoinsView that reads coins from its base ahead of time, in parallel.
+ *
+ * It sits between the coins tip cache and the database. Prefetch() queues
+ * txids for a few threads that each read one from the base at a time; a
+ * later GetCoins for such a txid is answered from what was read, waiting
+ * for the read if it is under way. Results reflect the base as it was when
+ * read, so BatchWrite waits for the reads under way, writes the base
+ * while no others can start, and drops them all; the base must not be
+ * changed any other way.
+ */
+class CCoinsViewPrefetch : public CCoinsViewBacked
+{
+private:
+    enum EntryState {
+        QUEUED,
+        READING,
+        DONE
+    };
+
+    struct CPrefetchEntry {
+        EntryState state;
+        bool fFound;
+        CCoins coins;
+        int64_t nTimeQueued;
+
+        CPrefetchEntry() : state(QUEUED), fFound(false), nTimeQueued(0) {}
+    };
+
+    typedef boost::unordered_map<uint256, CPrefetchEntry, CCoinsKeyHasher> CPrefetchMap;
+
+    mutable boost::mutex mutex;
+    //! Prefetch threads block on this when out of work
+    mutable boost::condition_variable condWork;
+    //! GetCoins blocks on this while the entry it needs is being read
+    mutable boost::condition_variable condRead;
+    mutable CPrefetchMap mapEntries;
+    std::deque<uint256> queue;
+    //! Number of reads from the base under way
+    unsigned int nReading;
+    bool fQuit;
+    boost::thread_group threadGroup;
+
+    // Statistics
+    uint64_t nRequested;
+    mutable uint64_t nHits;
+    mutable uint64_t nWaits;
+    mutable uint64_t nLate;
+    mutable uint64_t nMisses;
+    uint64_t nDropped;
+    uint64_t nDiscarded;
+    uint64_t nReads;
+    int64_t nReadLatency;
+
+    void Thread();
+
+    CCoinsViewPrefetch(const CCoinsViewPrefetch&);
+    CCoinsViewPrefetch& operator=(const CCoinsViewPrefetch&);
+
+public:
+    CCoinsViewPrefetch(CCoinsView* baseIn, int nThreads);
+    ~CCoinsViewPrefetch();
+
+    //! Start reading the coins of these txids
+    void Prefetch(const std::vector<uint256>& vTxid);
+
+    bool GetCoins(const uint256 &txid, CCoins &coins) const;
+    bool BatchWrite(CCoinsMap &mapCoins, CAddressBalanceMap &mapBalances, CCoinsTotals &totals, const uint256 &hashBlock);
+
+    void GetInternalStats(std::map<std::string, size_t>& mapResults) const;
+};
+
+#endif // BITCREDIT_COINSPREFETCH_H
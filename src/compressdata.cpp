@@ -0,0 +1,314 @@
+// Copyright (c) 2015 The Bitcredit Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "compressdata.h"
+
+#include "crypto/common.h"
+#include "lz4/lz4.h"
+#include "util.h"
+
+#include <assert.h>
+#include <string.h>
+
+#include <algorithm>
+#include <limits>
+
+size_t LZ4FrameBound(size_t nSize)
+{
+    // A chunk that does not compress is stored, so never exceeds its length
+    size_t nChunks = (nSize + LZ4_FRAME_CHUNK_SIZE - 1) / LZ4_FRAME_CHUNK_SIZE;
+    return LZ4_FRAME_HEADER_SIZE + nChunks * 4 + nSize + LZ4_FRAME_TRAILER_SIZE;
+}
+
+static void AppendHeader(std::vector<unsigned char>& vOut, uint32_t nSize)
+{
+    size_t nPos = vOut.size();
+    vOut.resize(nPos + LZ4_FRAME_HEADER_SIZE);
+    memcpy(&vOut[nPos], LZ4_FRAME_MAGIC, sizeof(LZ4_FRAME_MAGIC));
+    WriteLE32(&vOut[nPos + 4], nSize);
+}
+
+static void AppendTrailer(std::vector<unsigned char>& vOut, XXH32_stateSpace_t& checksum)
+{
+    size_t nPos = vOut.size();
+    vOut.resize(nPos + LZ4_FRAME_TRAILER_SIZE);
+    WriteLE32(&vOut[nPos], XXH32_intermediateDigest(&checksum));
+}
+
+static void AppendChunk(std::vector<unsigned char>& vOut, XXH32_stateSpace_t& checksum, const char* pch, unsigned int nSize)
+{
+    assert(nSize > 0 && nSize <= LZ4_FRAME_CHUNK_SIZE);
+
+    size_t nPos = vOut.size();
+    vOut.resize(nPos + 4 + nSize);
+    int nCompressed = LZ4_compress_limitedOutput(pch, (char*)&vOut[nPos + 4], nSize, nSize - 1);
+    if (nCompressed > 0)
+    {
+        WriteLE32(&vOut[nPos], nCompressed);
+        vOut.resize(nPos + 4 + nCompressed);
+    }
+    else
+    {
+        WriteLE32(&vOut[nPos], nSize | LZ4_FRAME_CHUNK_STORED);
+        memcpy(&vOut[nPos + 4], pch, nSize);
+    }
+    XXH32_update(&checksum, pch, nSize);
+}
+
+void CLZ4FrameWriter::Begin(std::vector<unsigned char>& vOut)
+{
+    pvOut = &vOut;
+    nFrameStart = vOut.size();
+    nFrameSize = 0;
+    vchChunk.clear();
+    XXH32_resetState(&checksum, 0);
+    AppendHeader(vOut, 0);
+}
+
+bool CLZ4FrameWriter::Write(const char* pch, size_t nSize)
+{
+    assert(pvOut);
+    if (nFrameSize + nSize > std::numeric_limits<uint32_t>::max())
+        return error("CLZ4FrameWriter::Write : frame too large");
+    nFrameSize += nSize;
+
+    while (nSize > 0)
+    {
+        // Whole chunks are compressed from the caller's data
+        if (vchChunk.empty() && nSize >= LZ4_FRAME_CHUNK_SIZE)
+        {
+            AppendChunk(*pvOut, checksum, pch, LZ4_FRAME_CHUNK_SIZE);
+            pch += LZ4_FRAME_CHUNK_SIZE;
+            nSize -= LZ4_FRAME_CHUNK_SIZE;
+            continue;
+        }
+
+        size_t nCopy = std::min((size_t)LZ4_FRAME_CHUNK_SIZE - vchChunk.size(), nSize);
+        vchChunk.insert(vchChunk.end(), pch, pch + nCopy);
+        pch += nCopy;
+        nSize -= nCopy;
+        if (vchChunk.size() == LZ4_FRAME_CHUNK_SIZE)
+        {
+            AppendChunk(*pvOut, checksum, &vchChunk[0], LZ4_FRAME_CHUNK_SIZE);
+            vchChunk.clear();
+        }
+    }
+    return true;
+}
+
+bool CLZ4FrameWriter::End()
+{
+    assert(pvOut);
+    std::vector<unsigned char>& vOut = *pvOut;
+    if (!vchChunk.empty())
+        AppendChunk(vOut, checksum, &vchChunk[0], vchChunk.size());
+    vchChunk.clear();
+    WriteLE32(&vOut[nFrameStart + 4], nFrameSize);
+    AppendTrailer(vOut, checksum);
+    pvOut = NULL;
+    return true;
+}
+
+void CLZ4FrameReader::Begin()
+{
+    nState = STATE_HEADER;
+    nFrameSize = 0;
+    nDecoded = 0;
+    vchPending.clear();
+    XXH32_resetState(&checksum, 0);
+}
+
+bool CLZ4FrameReader::Fail(const char* pszReason)
+{
+    LogPrint("net", "CLZ4FrameReader : %s\n", pszReason);
+    nState = STATE_FAILED;
+    vchPending.clear();
+    return false;
+}
+
+bool CLZ4FrameReader::Process(const unsigned char* pch, size_t nSize, std::vector<unsigned char>& vOut)
+{
+    switch (nState)
+    {
+    case STATE_HEADER:
+        if (memcmp(pch, LZ4_FRAME_MAGIC, sizeof(LZ4_FRAME_MAGIC)) != 0)
+            return Fail("bad magic");
+        nFrameSize = ReadLE32(pch + 4);
+        if (nFrameSize > nMaxSize)
+            return Fail("frame too large");
+        vOut.reserve(vOut.size() + nFrameSize);
+        nState = nFrameSize > 0 ? STATE_CHUNK : STATE_TRAILER;
+        return true;
+
+    case STATE_CHUNK:
+    {
+        // Chunk length was checked against the expected size by Read()
+        uint32_t nLength = ReadLE32(pch);
+        uint32_t nExpected = std::min((uint32_t)LZ4_FRAME_CHUNK_SIZE, nFrameSize - nDecoded);
+        size_t nPos = vOut.size();
+        vOut.resize(nPos + nExpected);
+        char* pchOut = (char*)&vOut[nPos];
+        if (nLength & LZ4_FRAME_CHUNK_STORED)
+            memcpy(pchOut, pch + 4, nExpected);
+        else if (LZ4_decompress_safe((const char*)pch + 4, pchOut, nSize - 4, nExpected) != (int)nExpected)
+        {
+            vOut.resize(nPos);
+            return Fail("corrupt chunk");
+        }
+        XXH32_update(&checksum, pchOut, nExpected);
+        nDecoded += nExpected;
+        if (nDecoded == nFrameSize)
+            nState = STATE_TRAILER;
+        return true;
+    }
+
+    case STATE_TRAILER:
+        if (ReadLE32(pch) != XXH32_intermediateDigest(&checksum))
+            return Fail("checksum mismatch");
+        nState = STATE_DONE;
+        return true;
+
+    default:
+        return false;
+    }
+}
+
+bool CLZ4FrameReader::Read(const unsigned char* pch, size_t nSize, std::vector<unsigned char>& vOut)
+{
+    while (nSize > 0)
+    {
+        if (nState == STATE_FAILED)
+            return false;
+        if (nState == STATE_DONE)
+            return Fail("data after end of frame");
+
+        // Length of the next header, chunk or trailer
+        size_t nElement = nState == STATE_HEADER ? LZ4_FRAME_HEADER_SIZE : LZ4_FRAME_TRAILER_SIZE;
+        if (nState == STATE_CHUNK)
+        {
+            size_t nPending = vchPending.size();
+            if (nPending + nSize < 4)
+            {
+                vchPending.insert(vchPending.end(), pch, pch + nSize);
+                return true;
+            }
+            unsigned char vchLength[4];
+            for (size_t i = 0; i < 4; i++)
+                vchLength[i] = i < nPending ? vchPending[i] : pch[i - nPending];
+            uint32_t nLength = ReadLE32(vchLength);
+            uint32_t nExpected = std::min((uint32_t)LZ4_FRAME_CHUNK_SIZE, nFrameSize - nDecoded);
+            if (nLength & LZ4_FRAME_CHUNK_STORED)
+            {
+                if ((nLength & ~LZ4_FRAME_CHUNK_STORED) != nExpected)
+                    return Fail("bad stored chunk length");
+                nElement = 4 + nExpected;
+            }
+            else
+            {
+                if (nLength == 0 || nLength >= nExpected)
+                    return Fail("bad chunk length");
+                nElement = 4 + nLength;
+            }
+        }
+
+        // Decode straight from the input unless the element was split
+        if (vchPending.empty() && nSize >= nElement)
+        {
+            if (!Process(pch, nElement, vOut))
+                return false;
+            pch += nElement;
+            nSize -= nElement;
+            continue;
+        }
+
+        size_t nCopy = std::min(nElement - vchPending.size(), nSize);
+        vchPending.insert(vchPending.end(), pch, pch + nCopy);
+        pch += nCopy;
+        nSize -= nCopy;
+        if (vchPending.size() == nElement)
+        {
+            bool fOk = Process(&vchPending[0], nElement, vOut);
+            vchPending.clear();
+            if (!fOk)
+                return false;
+        }
+    }
+    return nState != STATE_FAILED;
+}
+
+bool CompressData(const char* pch, size_t nSize, std::vector<unsigned char>& vOut)
+{
+    vOut.clear();
+    if (nSize > std::numeric_limits<uint32_t>::max())
+        return error("CompressData : %u bytes is too large for a frame", nSize);
+    vOut.reserve(LZ4FrameBound(nSize));
+
+    XXH32_stateSpace_t checksum;
+    XXH32_resetState(&checksum, 0);
+    AppendHeader(vOut, nSize);
+    for (size_t nPos = 0; nPos < nSize; nPos += LZ4_FRAME_CHUNK_SIZE)
+        AppendChunk(vOut, checksum, pch + nPos, std::min((size_t)LZ4_FRAME_CHUNK_SIZE, nSize - nPos));
+    AppendTrailer(vOut, checksum);
+    return true;
+}
+
+/** Bare LZ4 block of unknown original size, as sent before frames were used */
+static bool UncompressBlock(const unsigned char* pch, size_t nSize, std::vector<unsigned char>& vOut, size_t nMaxSize)
+{
+    if (nSize == 0 || nSize > (size_t)std::numeric_limits<int>::max() || nMaxSize == 0)
+        return false;
+    nMaxSize = std::min(nMaxSize, (size_t)std::numeric_limits<int>::max());
+
+    size_t nCapacity = std::min(std::max(nSize * 4, (size_t)LZ4_FRAME_CHUNK_SIZE), nMaxSize);
+    while (true)
+    {
+        vOut.resize(nCapacity);
+        int nOut = LZ4_decompress_safe((const char*)pch, (char*)&vOut[0], nSize, nCapacity);
+        if (nOut >= 0)
+        {
+            vOut.resize(nOut);
+            return true;
+        }
+        if (nCapacity >= nMaxSize)
+        {
+            vOut.clear();
+            return false;
+        }
+        nCapacity = std::min(nCapacity * 2, nMaxSize);
+    }
+}
+
+bool UncompressData(const unsigned char* pch, size_t nSize, std::vector<unsigned char>& vOut, size_t nMaxSize)
+{
+    vOut.clear();
+    if (nSize < sizeof(LZ4_FRAME_MAGIC) || memcmp(pch, LZ4_FRAME_MAGIC, sizeof(LZ4_FRAME_MAGIC)) != 0)
+        return UncompressBlock(pch, nSize, vOut, nMaxSize);
+
+    CLZ4FrameReader reader(nMaxSize);
+    if (!reader.Read(pch, nSize, vOut) || !reader.IsComplete())
+    {
+        vOut.clear();
+        return false;
+    }
+    return true;
+}
+
+std::string CompressData(const std::string& uncompressed)
+{
+    std::vector<unsigned char> vchCompressed;
+    if (!CompressData(uncompressed.data(), uncompressed.size(), vchCompressed))
+        return "";
+    return std::string(vchCompressed.begin(), vchCompressed.end());
+}
+
+std::string UncompressData(const std::string& compressed)
+{
+    std::vector<unsigned char> vchUncompressed;
+    if (!UncompressData((const unsigned char*)compressed.data(), compressed.size(), vchUncompressed))
+    {
+        LogPrint("net", "UncompressData : could not uncompress %u bytes\n", compressed.size());
+        return "";
+    }
+    return std::string(vchUncompressed.begin(), vchUncompressed.end());
+}
@@ -0,0 +1,112 @@
+// Copyright (c) 2015 The Bitcredit Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCREDIT_COMPRESSDATA_H
+#define BITCREDIT_COMPRESSDATA_H
+
+#include "xxhash/xxhash.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+/**
+ * Framed LZ4 compression of off-chain payloads.
+ *
+ * A frame is an 8 byte header (magic, original size), the original data cut
+ * into chunks of at most LZ4_FRAME_CHUNK_SIZE bytes and a 4 byte trailer
+ * holding the XXH32 of the original data. Every chunk is compressed on its
+ * own and starts with its little endian 32-bit length; the top bit of the
+ * length marks a chunk stored as is because LZ4 could not shrink it. Since
+ * the original size of every chunk follows from the header, a reader can
+ * decompress and verify a frame as it arrives, straight into its output.
+ */
+
+static const unsigned char LZ4_FRAME_MAGIC[4] = { 'B', 'C', 'Z', 0x01 };
+static const unsigned int LZ4_FRAME_HEADER_SIZE = 8;
+static const unsigned int LZ4_FRAME_TRAILER_SIZE = 4;
+static const unsigned int LZ4_FRAME_CHUNK_SIZE = 64 * 1024;
+static const uint32_t LZ4_FRAME_CHUNK_STORED = 0x80000000;
+/** Default limit on the original size of a frame accepted by a reader */
+static const unsigned int MAX_LZ4_FRAME_SIZE = 32 * 1024 * 1024;
+
+/** Upper bound of the frame size of nSize bytes of original data */
+size_t LZ4FrameBound(size_t nSize);
+
+/**
+ * Streaming compression of a frame into a caller supplied buffer. Full
+ * chunks are compressed as soon as they are written, straight from the
+ * caller's data where possible; only the tail of a chunk is buffered.
+ */
+class CLZ4FrameWriter
+{
+private:
+    std::vector<unsigned char>* pvOut;
+    size_t nFrameStart;
+    uint64_t nFrameSize;
+    std::vector<char> vchChunk;
+    XXH32_stateSpace_t checksum;
+
+    bool WriteChunk(const char* pch, unsigned int nSize);
+
+public:
+    CLZ4FrameWriter() : pvOut(NULL), nFrameStart(0), nFrameSize(0) {}
+
+    //! Start a new frame at the end of vOut
+    void Begin(std::vector<unsigned char>& vOut);
+    //! Add original data to the frame
+    bool Write(const char* pch, size_t nSize);
+    //! Flush the last chunk and complete the frame
+    bool End();
+};
+
+/**
+ * Streaming decompression of a frame. Compressed data may be fed in pieces
+ * of any size; each chunk is decoded and checked as soon as it is complete.
+ * Only a chunk split between two pieces is buffered.
+ */
+class CLZ4FrameReader
+{
+private:
+    enum State { STATE_HEADER, STATE_CHUNK, STATE_TRAILER, STATE_DONE, STATE_FAILED };
+
+    State nState;
+    size_t nMaxSize;
+    uint32_t nFrameSize;
+    uint32_t nDecoded;
+    std::vector<unsigned char> vchPending;
+    XXH32_stateSpace_t checksum;
+
+    bool Fail(const char* pszReason);
+    bool Process(const unsigned char* pch, size_t nSize, std::vector<unsigned char>& vOut);
+
+public:
+    CLZ4FrameReader(size_t nMaxSizeIn = MAX_LZ4_FRAME_SIZE) : nMaxSize(nMaxSizeIn) { Begin(); }
+
+    //! Prepare for a new frame
+    void Begin();
+    /**
+     * Decode compressed data, appending the original data to vOut. Returns
+     * false if the frame is corrupt, exceeds the size limit or is followed
+     * by extra data.
+     */
+    bool Read(const unsigned char* pch, size_t nSize, std::vector<unsigned char>& vOut);
+    //! Whether the whole frame was read and its checksum matched
+    bool IsComplete() const { return nState == STATE_DONE; }
+};
+
+/** Compress into a frame, replacing the contents of vOut but reusing its capacity */
+bool CompressData(const char* pch, size_t nSize, std::vector<unsigned char>& vOut);
+/**
+ * Decompress a frame, replacing the contents of vOut but reusing its
+ * capacity. Data without the frame magic is decoded as a bare LZ4 block,
+ * as sent by older peers.
+ */
+bool UncompressData(const unsigned char* pch, size_t nSize, std::vector<unsigned char>& vOut, size_t nMaxSize = MAX_LZ4_FRAME_SIZE);
+
+std::string CompressData(const std::string& uncompressed);
+std::string UncompressData(const std::string& compressed);
+
+#endif // BITCREDIT_COMPRESSDATA_H
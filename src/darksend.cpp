@@ -2229,13 +2229,10 @@ void ThreadCheckDarkSendPool()
 
         if(c % 60 == 0)
         {
-            LOCK(cs_main);
-            /*
-                cs_main is required for doing CBanknode.Check because something
-                is modifying the coins view without a mempool lock. It causes
-                segfaults from this code without the cs_main lock.
-            */
+            // collaterals are followed by banknodeCollaterals, checking needs no cs_main
             mnodeman.CheckAndRemove();
+
+            LOCK(cs_main);
             mnodeman.ProcessBanknodeConnections();
             banknodePayments.CleanPaymentList();
             CleanTransactionLocksList();
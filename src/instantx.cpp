@@ -479,7 +479,7 @@ void CleanTransactionLocksList()
                 mapTxLockReq.erase(it->second.txHash);
                 mapTxLockReqRejected.erase(it->second.txHash);
 
-                BOOST_FOREACH(CConsensusVote& v, it->second.vecConsensusVotes)
+                BOOST_FOREACH(const CConsensusVote& v, it->second.vecConsensusVotes)
                     mapTxLockVote.erase(v.GetHash());
             }
 
@@ -569,8 +569,7 @@ bool CConsensusVote::Sign()
 
 bool CTransactionLock::SignaturesValid()
 {
-
-    BOOST_FOREACH(CConsensusVote vote, vecConsensusVotes)
+    BOOST_FOREACH(CConsensusVote& vote, vecConsensusVotes)
     {
         int n = mnodeman.GetBanknodeRank(vote.vinBanknode, vote.nBlockHeight, MIN_INSTANTX_PROTO_VERSION);
 
@@ -595,12 +594,13 @@ bool CTransactionLock::SignaturesValid()
     return true;
 }
 
-void CTransactionLock::AddSignature(CConsensusVote& cv)
+void CTransactionLock::AddSignature(const CConsensusVote& cv)
 {
     vecConsensusVotes.push_back(cv);
+    mapVoteHeights[cv.nBlockHeight]++;
 }
 
-int CTransactionLock::CountSignatures()
+int CTransactionLock::CountSignatures() const
 {
     /*
         Only count signatures where the BlockHeight matches the transaction's blockheight.
@@ -609,11 +609,6 @@ int CTransactionLock::CountSignatures()
 
     if(nBlockHeight == 0) return -1;
 
-    int n = 0;
-    BOOST_FOREACH(CConsensusVote v, vecConsensusVotes){
-        if(v.nBlockHeight == nBlockHeight){
-            n++;
-        }
-    }
-    return n;
+    std::map<int, int>::const_iterator it = mapVoteHeights.find(nBlockHeight);
+    return it != mapVoteHeights.end() ? it->second : 0;
 }
@@ -76,6 +76,10 @@ public:
 
 class CTransactionLock
 {
+private:
+    //! Number of votes in vecConsensusVotes per vote block height
+    std::map<int, int> mapVoteHeights;
+
 public:
     int nBlockHeight;
     uint256 txHash;
@@ -84,8 +88,8 @@ public:
     int nTimeout;
 
     bool SignaturesValid();
-    int CountSignatures();
-    void AddSignature(CConsensusVote& cv);
+    int CountSignatures() const;
+    void AddSignature(const CConsensusVote& cv);
 
     uint256 GetHash()
     {
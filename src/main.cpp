@@ -11,6 +11,8 @@
 #include "chainparams.h"
 #include "checkpoints.h"
 #include "checkqueue.h"
+#include "coinsprefetch.h"
+#include "compressdata.h"
 #include "init.h"
 #include "instantx.h"
 #include "darksend.h"
@@ -212,6 +214,8 @@ void MainGetInternalStats(std::map<std::string, size_t>& mapResults)
         mapResults["mapOrphanTransactions.size"] = mapOrphanTransactions.size();
         mapResults["mapOrphanTransactionsByPrev.size"] = mapOrphanTransactionsByPrev.size();
         mapResults["pcoinsTip.GetCacheSize"] = pcoinsTip->GetCacheSize();
+        if (pcoinsPrefetch)
+            pcoinsPrefetch->GetInternalStats(mapResults);
     }
     {
         LOCK(cs_mapAlerts);
@@ -569,8 +573,42 @@ CBlockIndex* FindForkInGlobalIndex(const CChain& chain, const CBlockLocator& loc
 }
 
 CCoinsViewCache *pcoinsTip = NULL;
+CCoinsViewPrefetch *pcoinsPrefetch = NULL;
 CBlockTreeDB *pblocktree = NULL;
 
+/**
+ * Start reading the coins ConnectBlock is going to look up for this block
+ * from the database: those of every transaction it spends from, and those
+ * of its own transactions (the BIP30 check). Coins the tip cache already
+ * holds, and outputs created in the block itself, are skipped.
+ */
+static void PrefetchBlockInputs(const CBlock& block)
+{
+    AssertLockHeld(cs_main);
+    if (pcoinsPrefetch == NULL)
+        return;
+
+    std::set<uint256> setBlockTxid;
+    std::vector<uint256> vTxid;
+    BOOST_FOREACH(const CTransaction& tx, block.vtx) {
+        const uint256& txid = tx.GetHash();
+        setBlockTxid.insert(txid);
+        if (!pcoinsTip->HaveCoinsInCache(txid))
+            vTxid.push_back(txid);
+    }
+    std::set<uint256> setSeen;
+    BOOST_FOREACH(const CTransaction& tx, block.vtx) {
+        if (tx.IsCoinBase())
+            continue;
+        BOOST_FOREACH(const CTxIn& txin, tx.vin) {
+            const uint256& txid = txin.prevout.hash;
+            if (!setBlockTxid.count(txid) && setSeen.insert(txid).second && !pcoinsTip->HaveCoinsInCache(txid))
+                vTxid.push_back(txid);
+        }
+    }
+    pcoinsPrefetch->Prefetch(vTxid);
+}
+
 //////////////////////////////////////////////////////////////////////////////
 //
 // mapOrphanTransactions
@@ -1330,7 +1368,21 @@ bool ReadTransaction(CTransaction& tx, const CDiskTxPos &pos, uint256 &hashBlock
     return true;
 }
 
-bool FindTransactionsByDestination(const CTxDestination &dest, std::set<CExtDiskTxPos> &setpos) {
+/**
+ * Address index entries of connected blocks that are not yet written. They
+ * are written together with the block index in FlushStateToDisk, as the
+ * chainstate flushed there determines which blocks get connected again
+ * after a crash.
+ */
+static std::vector<std::pair<uint64_t, CExtDiskTxPos> > vAddrIndexPending;
+
+/** Whether the pending address index entries use up the memory budget of the coins cache (~300 bytes per coin) */
+static bool AddrIndexPendingFull() {
+    return vAddrIndexPending.size() * sizeof(vAddrIndexPending[0]) > (size_t)nCoinCacheSize * 300;
+}
+
+bool FindTransactionsByDestination(const CTxDestination &dest, std::vector<CExtDiskTxPos> &vpos,
+                                   unsigned int nMinHeight, unsigned int nMaxHeight, size_t nSkip, size_t nLimit, bool fReverse) {
     uint160 addrid = 0;
     const CKeyID *pkeyid = boost::get<CKeyID>(&dest);
     if (pkeyid)
@@ -1343,13 +1395,53 @@ bool FindTransactionsByDestination(const CTxDestination &dest, std::set<CExtDisk
     if (!addrid)
         return false;
 
-    LOCK(cs_main);
-    if (!fAddrIndex)
-        return false;
-    std::vector<CExtDiskTxPos> vPos;
-    if (!pblocktree->ReadAddrIndex(addrid, vPos))
-        return false;
-    setpos.insert(vPos.begin(), vPos.end());
+    // Entries of recently connected blocks may not be written yet. Collect
+    // them and open the cursor under cs_main, so that no entry is moved from
+    // one to the other in between; iterate without the lock.
+    std::set<CExtDiskTxPos> setPending;
+    boost::scoped_ptr<CAddrIndexCursor> pcursor;
+    {
+        LOCK(cs_main);
+        if (!fAddrIndex)
+            return false;
+        uint64_t lookupid = pblocktree->GetAddrIndexKey(addrid);
+        for (std::vector<std::pair<uint64_t, CExtDiskTxPos> >::const_iterator it = vAddrIndexPending.begin(); it != vAddrIndexPending.end(); it++)
+            if (it->first == lookupid && it->second.nHeight >= nMinHeight && it->second.nHeight <= nMaxHeight)
+                setPending.insert(it->second);
+        pcursor.reset(pblocktree->GetAddrIndexCursor(lookupid, nMinHeight, nMaxHeight, fReverse));
+    }
+
+    std::vector<CExtDiskTxPos> vPending(setPending.begin(), setPending.end());
+    if (fReverse)
+        std::reverse(vPending.begin(), vPending.end());
+
+    // Merge both ordered sequences, dropping entries present in both
+    size_t nPending = 0;
+    while (vpos.size() < nLimit) {
+        bool fFromCursor;
+        if (!pcursor->Valid() && nPending == vPending.size())
+            break;
+        else if (!pcursor->Valid())
+            fFromCursor = false;
+        else if (nPending == vPending.size())
+            fFromCursor = true;
+        else if (pcursor->GetPos() == vPending[nPending]) {
+            nPending++;
+            continue;
+        } else
+            fFromCursor = fReverse ? vPending[nPending] < pcursor->GetPos() : pcursor->GetPos() < vPending[nPending];
+
+        CExtDiskTxPos pos = fFromCursor ? pcursor->GetPos() : vPending[nPending];
+        if (fFromCursor)
+            pcursor->Next();
+        else
+            nPending++;
+
+        if (nSkip > 0)
+            nSkip--;
+        else
+            vpos.push_back(pos);
+    }
     return true;
 }
 
@@ -1693,6 +1785,8 @@ void UpdateCoins(const CTransaction& tx, CValidationState &state, CCoinsViewCach
 }
 
 bool CScriptCheck::operator()() {
+    if (pAddrIndexCheck)
+        return (*pAddrIndexCheck)();
     const CScript &scriptSig = ptxTo->vin[nIn].scriptSig;
     if (!VerifyScript(scriptSig, scriptPubKey, nFlags, CachingSignatureChecker(*ptxTo, nIn, cacheStore), &error)) {
         return ::error("CScriptCheck(): %s:%d VerifySignature failed: %s", ptxTo->GetHash().ToString(), nIn, ScriptErrorString(error));
@@ -1804,6 +1898,86 @@ bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsVi
 
 
 
+/** Key of a script's owner in the address balance index. */
+static std::string AddressBalanceKey(const CScript &scriptPubKey)
+{
+    CTxDestination address;
+    ExtractDestination(scriptPubKey, address);
+    return CBitcreditAddress(address).ToString();
+}
+
+/** Number of 33-byte (compressed pubkey) pushes in a scriptSig; each one debits the spent output. */
+static unsigned int CountPubKeyPushes(const CScript &scriptSig)
+{
+    unsigned int nPushes = 0;
+    opcodetype opcode;
+    std::vector<unsigned char> vch;
+    for (CScript::const_iterator pc = scriptSig.begin(); scriptSig.GetOp(pc, opcode, vch); )
+        if (opcode == 33)
+            nPushes++;
+    return nPushes;
+}
+
+/** Apply (nSign = 1) or revert (nSign = -1) one balance change in the address balance index. */
+static void UpdateAddressBalance(CCoinsViewCache &view, const std::string &address, CAmount nValue, int nSign)
+{
+    CAddressBalance &balance = view.ModifyAddressBalance(address);
+    balance.nBalance += nSign * nValue;
+    balance.nRefs += nSign;
+}
+
+/**
+ * Apply (nSign = 1) or revert (nSign = -1) the address balance changes of a block.
+ * Outputs credit their address; inputs debit the spent output, whose script and
+ * value are taken from the block's undo data instead of being looked up on disk.
+ */
+static void UpdateAddressBalances(const CBlock &block, const CBlockUndo &blockundo, CCoinsViewCache &view, int nSign)
+{
+    for (unsigned int i = 0; i < block.vtx.size(); i++) {
+        const CTransaction &tx = block.vtx[i];
+        BOOST_FOREACH(const CTxOut &txout, tx.vout)
+            UpdateAddressBalance(view, AddressBalanceKey(txout.scriptPubKey), txout.nValue, nSign);
+        if (i == 0)
+            continue;
+        const CTxUndo &txundo = blockundo.vtxundo[i-1];
+        for (unsigned int j = 0; j < tx.vin.size(); j++) {
+            unsigned int nPushes = CountPubKeyPushes(tx.vin[j].scriptSig);
+            if (nPushes == 0)
+                continue;
+            const CTxOut &txout = txundo.vprevout[j].txout;
+            CTxDestination address;
+            if (!ExtractDestination(txout.scriptPubKey, address))
+                continue;
+            std::string strAddress = CBitcreditAddress(address).ToString();
+            for (; nPushes > 0; nPushes--)
+                UpdateAddressBalance(view, strAddress, -txout.nValue, nSign);
+        }
+    }
+}
+
+/**
+ * Add (nSign = 1) or remove (nSign = -1) the current coins of every transaction
+ * a block creates or spends from the set totals of the view. Called with -1
+ * before the block's coin changes are applied and with 1 after, the totals
+ * move by exactly what the block changed.
+ */
+static void UpdateCoinsTotals(const CBlock &block, CCoinsViewCache &view, int nSign)
+{
+    std::set<uint256> setTouched;
+    BOOST_FOREACH(const CTransaction &tx, block.vtx) {
+        setTouched.insert(tx.GetHash());
+        if (tx.IsCoinBase())
+            continue;
+        BOOST_FOREACH(const CTxIn &txin, tx.vin)
+            setTouched.insert(txin.prevout.hash);
+    }
+    BOOST_FOREACH(const uint256 &txid, setTouched) {
+        const CCoins *coins = view.AccessCoins(txid);
+        if (coins)
+            view.UpdateTotals(txid, *coins, nSign);
+    }
+}
+
 bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& view, bool* pfClean)
 {
     assert(pindex->GetBlockHash() == view.GetBestBlock());
@@ -1823,6 +1997,8 @@ bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex
     if (blockUndo.vtxundo.size() + 1 != block.vtx.size())
         return error("DisconnectBlock(): block and undo data inconsistent");
 
+    UpdateCoinsTotals(block, view, -1);
+
     // undo transactions in reverse order
     for (int i = block.vtx.size() - 1; i >= 0; i--) {
         const CTransaction &tx = block.vtx[i];
@@ -1880,6 +2056,11 @@ bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex
         }
     }
 
+    UpdateCoinsTotals(block, view, 1);
+
+    // revert the address balance changes made by ConnectBlock
+    UpdateAddressBalances(block, blockUndo, view, -1);
+
     // move best block pointer to prevout block
     view.SetBestBlock(pindex->pprev->GetBlockHash());
 
@@ -1916,7 +2097,7 @@ void static FlushBlockFile(bool fFinalize = false)
 
 bool FindUndoPos(CValidationState &state, int nFile, CDiskBlockPos &pos, unsigned int nAddSize);
 
-static CCheckQueue<CScriptCheck> scriptcheckqueue(128);
+static CCheckQueue<CScriptCheck> scriptcheckqueue(128, "Script");
 
 void ThreadScriptCheck() {
     RenameThread("bitcredit-scriptch");
@@ -1925,12 +2106,13 @@ void ThreadScriptCheck() {
 
 static int64_t nTimeVerify = 0;
 static int64_t nTimeConnect = 0;
+static int64_t nTimeUndo = 0;
 static int64_t nTimeIndex = 0;
 static int64_t nTimeCallbacks = 0;
 static int64_t nTimeTotal = 0;
 
 // Index either: a) every data push >=8 bytes,  b) if no such pushes, the entire script
-void static BuildAddrIndex(const CScript &script, const CExtDiskTxPos &pos, std::vector<std::pair<uint160, CExtDiskTxPos> > &out) {
+void static BuildAddrIndex(const CScript &script, const CExtDiskTxPos &pos, std::vector<std::pair<uint64_t, CExtDiskTxPos> > &out) {
     CScript::const_iterator pc = script.begin();
     CScript::const_iterator pend = script.end();
     std::vector<unsigned char> data;
@@ -1945,39 +2127,27 @@ void static BuildAddrIndex(const CScript &script, const CExtDiskTxPos &pos, std:
             } else {
                 addrid = Hash160(data);
             }
-            out.push_back(std::make_pair(addrid, pos));
+            out.push_back(std::make_pair(pblocktree->GetAddrIndexKey(addrid), pos));
             fHaveData = true;
         }
     }
     if (!fHaveData) {
         uint160 addrid = Hash160(script);
-        out.push_back(std::make_pair(addrid, pos));
+        out.push_back(std::make_pair(pblocktree->GetAddrIndexKey(addrid), pos));
     }
 }
 
-std::map<std::string,int64_t> getbalances(){
-std::map<std::string,int64_t> addressvalue;
-	fstream myfile ((GetDataDir()/ "balances.dat").string().c_str());
-	char * pEnd;
-	std::string line;
-	if (myfile.is_open()){
-		while ( myfile.good() ){
-			getline (myfile,line);
-			if (line.empty()) continue;
-			std::vector<std::string> strs;
-			boost::split(strs, line, boost::is_any_of(","));
-			addressvalue[strs[0]]=strtoll(strs[1].c_str(),&pEnd,10);
-		}
-		myfile.close();
-	}
-	return addressvalue;
+bool CAddrIndexCheck::operator()() {
+    BOOST_FOREACH(const CScript &script, vSpent)
+        BuildAddrIndex(script, pos, *pvOut);
+    BOOST_FOREACH(const CTxOut &txout, ptx->vout)
+        BuildAddrIndex(txout.scriptPubKey, pos, *pvOut);
+    return true;
 }
 
 bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& view, bool fJustCheck)
 {
     AssertLockHeld(cs_main);
-    std::map<std::string,int64_t>::iterator addrvalit;
-	std::map<std::string,int64_t> addressvalue = getbalances();
     // Check it again in case a previous version let a bad block in
     if (!CheckBlock(block, state, !fJustCheck, !fJustCheck))
         return false;
@@ -2024,9 +2194,20 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
 
     unsigned int flags = fStrictPayToScriptHash ? SCRIPT_VERIFY_P2SH : SCRIPT_VERIFY_NONE;
 
+    // Keep the set totals in step with the coin changes below
+    UpdateCoinsTotals(block, view, -1);
+
     CBlockUndo blockundo;
 
-    CCheckQueueControl<CScriptCheck> control(fScriptChecks && nScriptCheckThreads ? &scriptcheckqueue : NULL);
+    // Address index entries are extracted and hashed per transaction on the
+    // script check threads. Their closures and output are declared before the
+    // control, so that it waits for the workers before they go away.
+    bool fBuildAddrIndex = fAddrIndex && !fJustCheck;
+    std::vector<std::vector<std::pair<uint64_t, CExtDiskTxPos> > > vTxAddrIndex(fBuildAddrIndex ? block.vtx.size() : 0);
+    std::vector<CAddrIndexCheck> vAddrIndexChecks;
+    vAddrIndexChecks.reserve(vTxAddrIndex.size());
+
+    CCheckQueueControl<CScriptCheck> control((fScriptChecks || fBuildAddrIndex) && nScriptCheckThreads ? &scriptcheckqueue : NULL);
 
     int64_t nTimeStart = GetTimeMicros();
     CAmount nFees = 0;
@@ -2034,13 +2215,10 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     unsigned int nSigOps = 0;
     CExtDiskTxPos pos(CDiskTxPos(pindex->GetBlockPos(), GetSizeOfCompactSize(block.vtx.size())), pindex->nHeight);
     std::vector<std::pair<uint256, CDiskTxPos> > vPosTxid;
-    std::vector<std::pair<uint160, CExtDiskTxPos> > vPosAddrid;
     blockundo.vtxundo.reserve(block.vtx.size() - 1);
 
     if (fTxIndex)
         vPosTxid.reserve(block.vtx.size());
-    if (fAddrIndex)
-        vPosAddrid.reserve(4*block.vtx.size());
     for (unsigned int i=0; i<block.vtx.size(); i++){
         const CTransaction &tx = block.vtx[i];
 
@@ -2075,16 +2253,22 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
 
 		if (fTxIndex)
           vPosTxid.push_back(std::make_pair(tx.GetHash(), pos));
-        if (fAddrIndex) {
+        if (fBuildAddrIndex) {
+            std::vector<CScript> vSpent;
             if (!tx.IsCoinBase()) {
-                BOOST_FOREACH(const CTxIn &txin, tx.vin) {
-                    CCoins coins;
-                    view.GetCoins(txin.prevout.hash, coins);
-                    BuildAddrIndex(coins.vout[txin.prevout.n].scriptPubKey, pos, vPosAddrid);
-                }
+                vSpent.reserve(tx.vin.size());
+                BOOST_FOREACH(const CTxIn &txin, tx.vin)
+                    vSpent.push_back(view.GetOutputFor(txin).scriptPubKey);
+            }
+            // Reserved above, so earlier closures handed to the queue stay put
+            vAddrIndexChecks.push_back(CAddrIndexCheck());
+            CAddrIndexCheck(vSpent, tx, pos, &vTxAddrIndex[i]).swap(vAddrIndexChecks.back());
+            if (nScriptCheckThreads) {
+                std::vector<CScriptCheck> vChecks(1, CScriptCheck(&vAddrIndexChecks.back()));
+                control.Add(vChecks);
+            } else {
+                vAddrIndexChecks.back()();
             }
-            BOOST_FOREACH(const CTxOut &txout, tx.vout)
-            BuildAddrIndex(txout.scriptPubKey, pos, vPosAddrid);
         }
 
         CTxUndo undoDummy;
@@ -2095,8 +2279,7 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
 
         pos.nTxOffset += ::GetSerializeSize(tx, SER_DISK, CLIENT_VERSION);
     }
-    int64_t nTime1 = GetTimeMicros(); nTimeConnect += nTime1 - nTimeStart;
-    LogPrint("bench", "      - Connect %u transactions: %.2fms (%.3fms/tx, %.3fms/txin) [%.2fs]\n", (unsigned)block.vtx.size(), 0.001 * (nTime1 - nTimeStart), 0.001 * (nTime1 - nTimeStart) / block.vtx.size(), nInputs <= 1 ? 0 : 0.001 * (nTime1 - nTimeStart) / (nInputs-1), nTimeConnect * 0.000001);
+    UpdateCoinsTotals(block, view, 1);
 
 	if (block.vtx[0].GetValueOut() > GetBlockValue(pindex->nHeight, nFees))
         return state.DoS(100, error("ConnectBlock(): coinbase pays too much (actual=%d vs limit=%d)",
@@ -2139,11 +2322,9 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
         return state.DoS(100, error("ConnectBlock(): consecutive coinbase key detected"), REJECT_INVALID, "consecutive-coinbase");
 		}
 		
-		addrvalit = addressvalue.find(newAddressString);
-		if(addrvalit != addressvalue.end()){
-			if (!(addrvalit->second > 50000*COIN))
-				return state.DoS(100, error("ConnectBlock(): banknode miningkey invalid"), REJECT_INVALID, "invalid-bnminingkey");
-		}  		 
+		CAddressBalance balance;
+		if (view.GetAddressBalance(newAddressString, balance) && !(balance.nBalance > 50000*COIN))
+			return state.DoS(100, error("ConnectBlock(): banknode miningkey invalid"), REJECT_INVALID, "invalid-bnminingkey");
 	}
 	
 		LOCK(grantdb);
@@ -2200,7 +2381,7 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
 
 			//NOTE: This is an error in the Grant DB.
 			if (awardFound != grantAwards.size()){
-				return state.DoS(100, error("ConnectBlock() : Bitcredit DB Corruption detected. Grant Awards not being paid or paying too much. \n Please restore a previous version of grantdb.dat and/or delete the old grantdb database."));
+				return state.DoS(100, error("ConnectBlock() : Bitcredit DB Corruption detected. Grant Awards not being paid or paying too much. \n Please restart with -reindex to rebuild the grant database."));
 			}
 		}
 
@@ -2213,70 +2394,25 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
 		mdb << miner<< ","<<pindex->nHeight<< endl;
 		}
 
-	{
-    BOOST_FOREACH(const CTransaction& tx, block.vtx){
-
+    // Update the address balance index; DisconnectBlock reverts these changes
+    UpdateAddressBalances(block, blockundo, view, 1);
 
-		for (unsigned int j = 0; j < tx.vout.size();j++){
-			CTxDestination address;
-			ExtractDestination(tx.vout[j].scriptPubKey, address);
-			string receiveAddress = CBitcreditAddress( address ).ToString().c_str();
-			int64_t theAmount = tx.vout[ j ].nValue;
-			addressvalue[receiveAddress] = addressvalue[receiveAddress] + theAmount;
-			
-			if (fDebug)LogPrintf("New vout  address:- %s , amount :-%d\n",receiveAddress, theAmount);
-		}
-
-        for (size_t i = 0; i < tx.vin.size(); i++){
-			if (tx.IsCoinBase())
-				continue; 			
-            const CScript &script = tx.vin[i].scriptSig;
-            opcodetype opcode;
-            std::vector<unsigned char> vch;
-            uint256 prevoutHash, blockHash;
-            string spendAddress;
-            int64_t theAmount;
-            for (CScript::const_iterator pc = script.begin(); script.GetOp(pc, opcode, vch); ){
-                if (opcode == 33){
-                    CPubKey pubKey(vch);
-                    prevoutHash = tx.vin[i].prevout.hash;
-                    CTransaction txOfPrevOutput;
-                    if (!GetTransaction(prevoutHash, txOfPrevOutput, blockHash, true)){
-                        if (fDebug)LogPrintf("AddrDB error Could not get transaction %s (output %d) referenced by input #%d of transaction %s in block %s\n", prevoutHash.ToString().c_str(), tx.vin[i].prevout.n, (int) i, tx.GetHash().ToString().c_str(), block.GetHash().ToString().c_str());
-                        continue;
-                    }                               
-                    unsigned int nOut = tx.vin[i].prevout.n;
-                    if (nOut >= txOfPrevOutput.vout.size()){
-                        if (fDebug)LogPrintf("Output %u, not in transaction: %s\n", nOut, prevoutHash.ToString().c_str());
-                        continue;
-                    }
-                    const CTxOut &txOut = txOfPrevOutput.vout[nOut];
-                    CTxDestination addressRet;
-                    if (!ExtractDestination(txOut.scriptPubKey, addressRet)){
-                        if (fDebug)LogPrintf("ExtractDestination failed: %s\n", prevoutHash.ToString().c_str());
-                        continue;
-                    }                    
-                    spendAddress = CBitcreditAddress(addressRet).ToString().c_str();
-					theAmount =  txOut.nValue;
-					addressvalue[spendAddress] = addressvalue[spendAddress] - theAmount;
-                }
-            }
-         if (fDebug)LogPrintf("New vin address:-%s , amount%d\n",spendAddress, theAmount);
-        }
-    }
-		ofstream addrdb;
-		addrdb.open ((GetDataDir() / "balances.dat" ).string().c_str(), std::ofstream::trunc);
+    int64_t nTime1 = GetTimeMicros(); nTimeConnect += nTime1 - nTimeStart;
+    LogPrint("bench", "      - Connect %u transactions: %.2fms (%.3fms/tx, %.3fms/txin) [%.2fs]\n", (unsigned)block.vtx.size(), 0.001 * (nTime1 - nTimeStart), 0.001 * (nTime1 - nTimeStart) / block.vtx.size(), nInputs <= 1 ? 0 : 0.001 * (nTime1 - nTimeStart) / (nInputs-1), nTimeConnect * 0.000001);
 
-		for(addrvalit = addressvalue.begin();addrvalit != addressvalue.end();++addrvalit){
-			addrdb << addrvalit->first << "," << addrvalit->second << endl;
-		}
-		addrdb.close();
-	}
+    // Serialize the undo data while the script checks are still running;
+    // it is only written once they have all passed
+    CSerializedBlockUndo serializedUndo;
+    bool fWriteUndo = !fJustCheck && pindex->GetUndoPos().IsNull();
+    if (fWriteUndo)
+        serializedUndo.Set(blockundo, pindex->pprev->GetBlockHash());
+    int64_t nTime2 = GetTimeMicros(); nTimeUndo += nTime2 - nTime1;
+    LogPrint("bench", "    - Undo serialization: %.2fms [%.2fs]\n", 0.001 * (nTime2 - nTime1), nTimeUndo * 0.000001);
 
     if (!control.Wait())
         return state.DoS(100, false);
-    int64_t nTime2 = GetTimeMicros(); nTimeVerify += nTime2 - nTimeStart;
-    LogPrint("bench", "    - Verify %u txins: %.2fms (%.3fms/txin) [%.2fs]\n", nInputs - 1, 0.001 * (nTime2 - nTimeStart), nInputs <= 1 ? 0 : 0.001 * (nTime2 - nTimeStart) / (nInputs-1), nTimeVerify * 0.000001);
+    int64_t nTime3 = GetTimeMicros(); nTimeVerify += nTime3 - nTime2;
+    LogPrint("bench", "    - Verify %u txins: %.2fms waiting, %.2fms since connect started (%.3fms/txin) [%.2fs]\n", nInputs - 1, 0.001 * (nTime3 - nTime2), 0.001 * (nTime3 - nTimeStart), nInputs <= 1 ? 0 : 0.001 * (nTime3 - nTimeStart) / (nInputs-1), nTimeVerify * 0.000001);
 
     if (fJustCheck)
         return true;
@@ -2284,11 +2420,11 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     // Write undo information to disk
     if (pindex->GetUndoPos().IsNull() || !pindex->IsValid(BLOCK_VALID_SCRIPTS))
     {
-        if (pindex->GetUndoPos().IsNull()) {
+        if (fWriteUndo) {
             CDiskBlockPos pos;
-            if (!FindUndoPos(state, pindex->nFile, pos, ::GetSerializeSize(blockundo, SER_DISK, CLIENT_VERSION) + 40))
+            if (!FindUndoPos(state, pindex->nFile, pos, serializedUndo.ssUndo.size() + 40))
                 return error("ConnectBlock(): FindUndoPos failed");
-            if (!blockundo.WriteToDisk(pos, pindex->pprev->GetBlockHash()))
+            if (!serializedUndo.WriteToDisk(pos))
                 return state.Abort("Failed to write undo data");
 
             // update nUndoPos in block index
@@ -2304,23 +2440,24 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
         if (!pblocktree->WriteTxIndex(vPosTxid))
 				return state.Abort("Failed to write transaction index");
 
-        if (fAddrIndex)
-			if (!pblocktree->AddAddrIndex(vPosAddrid))
-				return state.Abort(_("Failed to write address index"));
+    if (fBuildAddrIndex) {
+        for (unsigned int i = 0; i < vTxAddrIndex.size(); i++)
+            vAddrIndexPending.insert(vAddrIndexPending.end(), vTxAddrIndex[i].begin(), vTxAddrIndex[i].end());
+    }
 
     // add this block to the view's block chain
     view.SetBestBlock(pindex->GetBlockHash());
 
-    int64_t nTime3 = GetTimeMicros(); nTimeIndex += nTime3 - nTime2;
-    LogPrint("bench", "    - Index writing: %.2fms [%.2fs]\n", 0.001 * (nTime3 - nTime2), nTimeIndex * 0.000001);
+    int64_t nTime4 = GetTimeMicros(); nTimeIndex += nTime4 - nTime3;
+    LogPrint("bench", "    - Index writing: %.2fms [%.2fs]\n", 0.001 * (nTime4 - nTime3), nTimeIndex * 0.000001);
 
     // Watch for changes to the previous coinbase transaction.
     static uint256 hashPrevBestCoinBase;
     g_signals.UpdatedTransaction(hashPrevBestCoinBase);
     hashPrevBestCoinBase = block.vtx[0].GetHash();
 
-    int64_t nTime4 = GetTimeMicros(); nTimeCallbacks += nTime4 - nTime3;
-    LogPrint("bench", "    - Callbacks: %.2fms [%.2fs]\n", 0.001 * (nTime4 - nTime3), nTimeCallbacks * 0.000001);
+    int64_t nTime5 = GetTimeMicros(); nTimeCallbacks += nTime5 - nTime4;
+    LogPrint("bench", "    - Callbacks: %.2fms [%.2fs]\n", 0.001 * (nTime5 - nTime4), nTimeCallbacks * 0.000001);
 
     return true;
 }
@@ -2340,7 +2477,7 @@ bool static FlushStateToDisk(CValidationState &state, FlushStateMode mode) {
     LOCK(cs_main);
     static int64_t nLastWrite = 0;
     if ((mode == FLUSH_STATE_ALWAYS) ||
-        ((mode == FLUSH_STATE_PERIODIC || mode == FLUSH_STATE_IF_NEEDED) && pcoinsTip->GetCacheSize() > nCoinCacheSize) ||
+        ((mode == FLUSH_STATE_PERIODIC || mode == FLUSH_STATE_IF_NEEDED) && (pcoinsTip->GetCacheSize() > nCoinCacheSize || AddrIndexPendingFull())) ||
         (mode == FLUSH_STATE_PERIODIC && GetTimeMicros() > nLastWrite + DATABASE_WRITE_INTERVAL * 1000000)) {
         // Typical CCoins structures on disk are around 100 bytes in size.
         // Pushing a new one to the database can cause it to be written
@@ -2351,8 +2488,15 @@ bool static FlushStateToDisk(CValidationState &state, FlushStateMode mode) {
             return state.Error("out of disk space");
         // First make sure all block and undo data is flushed to disk.
         FlushBlockFile();
-        // Then update all block file information (which may refer to block and undo files).
+        // Then update all block file information (which may refer to block and undo files),
+        // preceded by the address index, which is synced along with it.
         {
+            if (!vAddrIndexPending.empty()) {
+                if (!pblocktree->WriteAddrIndex(vAddrIndexPending))
+                    return state.Abort("Failed to write address index");
+                std::vector<std::pair<uint64_t, CExtDiskTxPos> >().swap(vAddrIndexPending);
+            }
+
             std::vector<std::pair<int, const CBlockFileInfo*> > vFiles;
             vFiles.reserve(setDirtyFileInfo.size());
             for (set<int>::iterator it = setDirtyFileInfo.begin(); it != setDirtyFileInfo.end(); ) {
@@ -2389,6 +2533,7 @@ void FlushStateToDisk() {
 /** Update chainActive and related internal data structures. */
 void static UpdateTip(CBlockIndex *pindexNew) {
     chainActive.SetTip(pindexNew);
+    UpdateBlockHashes(pindexNew);
 
     // New best block
     nTimeBestReceived = GetTime();
@@ -2441,8 +2586,11 @@ bool static DisconnectTip(CValidationState &state) {
         if (!DisconnectBlock(block, state, pindexDelete, view))
             return error("DisconnectTip(): DisconnectBlock %s failed", pindexDelete->GetBlockHash().ToString());
         assert(view.Flush());
+        banknodeCollaterals.DisconnectBlock(block, pindexDelete->nHeight - 1);
     }
     LogPrint("bench", "- Disconnect block: %.2fms\n", (GetTimeMicros() - nStart) * 0.001);
+    if (!disconnectGrantDatabase(pindexDelete))
+        return state.Abort("Failed to roll back grant database");
     // Write the chain state to disk, if necessary.
     if (!FlushStateToDisk(state, FLUSH_STATE_IF_NEEDED))
         return false;
@@ -2508,6 +2656,7 @@ bool static ConnectTip(CValidationState &state, CBlockIndex *pindexNew, CBlock *
         nTime3 = GetTimeMicros(); nTimeConnectTotal += nTime3 - nTime2;
         LogPrint("bench", "  - Connect total: %.2fms [%.2fs]\n", (nTime3 - nTime2) * 0.001, nTimeConnectTotal * 0.000001);
         assert(view.Flush());
+        banknodeCollaterals.ConnectBlock(*pblock, pindexNew->nHeight);
     }
     int64_t nTime4 = GetTimeMicros(); nTimeFlush += nTime4 - nTime3;
     LogPrint("bench", "  - Flush: %.2fms [%.2fs]\n", (nTime4 - nTime3) * 0.001, nTimeFlush * 0.000001);
@@ -3360,6 +3509,12 @@ bool ProcessNewBlock(CValidationState &state, CNode* pfrom, CBlock* pblock, CDis
         }
         if (!ret)
             return error("%s: AcceptBlock FAILED", __func__);
+
+        // Warm the coins cache until the block is connected. Only blocks
+        // that can become the tip now are worth it; anything else would
+        // just take up prefetch entries until the next flush.
+        if (pindex->nChainTx && (chainActive.Tip() == NULL || pindex->nChainWork > chainActive.Tip()->nChainWork))
+            PrefetchBlockInputs(*pblock);
     }
 
     if (!ActivateBestChain(state, pblock))
@@ -3558,11 +3713,22 @@ bool static LoadBlockIndexDB()
 	pblocktree->ReadFlag("addrindex", fAddrIndex);
     LogPrintf("LoadBlockIndexDB(): address index %s\n", fAddrIndex ? "enabled" : "disabled");
 
+    // Check whether the chainstate carries the address balance index
+    bool fAddrBalances = false;
+    pblocktree->ReadFlag("addrbalances", fAddrBalances);
+    bool fAddrIndexByHeight = false;
+    pblocktree->ReadFlag("addrindexbyheight", fAddrIndexByHeight);
+
     // Load pointer to end of best chain
     BlockMap::iterator it = mapBlockIndex.find(pcoinsTip->GetBestBlock());
     if (it == mapBlockIndex.end())
         return true;
+    if (!fAddrBalances)
+        return error("LoadBlockIndexDB(): chainstate has no address balance index, a -reindex is required");
+    if (fAddrIndex && !fAddrIndexByHeight)
+        return error("LoadBlockIndexDB(): address index uses an old key layout, a -reindex is required");
     chainActive.SetTip(it->second);
+    UpdateBlockHashes(it->second);
 
     PruneBlockIndexCandidates();
 
@@ -3665,6 +3831,7 @@ void UnloadBlockIndex()
     mapBlockIndex.clear();
     setBlockIndexCandidates.clear();
     chainActive.SetTip(NULL);
+    UpdateBlockHashes(NULL);
     pindexBestInvalid = NULL;
 }
 
@@ -3692,6 +3859,8 @@ bool InitBlockIndex() {
     pblocktree->WriteFlag("txindex", fTxIndex);
     fAddrIndex = GetBoolArg("-addrindex", false);
     pblocktree->WriteFlag("addrindex", fAddrIndex);
+    pblocktree->WriteFlag("addrbalances", true);
+    pblocktree->WriteFlag("addrindexbyheight", true);
     LogPrintf("Initializing databases...\n");
 
     // Only add the genesis block if not reindexing (in which case we reuse the one already on disk)
@@ -5365,6 +5534,30 @@ bool SendMessages(CNode* pto, bool fSendTrickle)
 
 
 bool CBlockUndo::WriteToDisk(CDiskBlockPos &pos, const uint256 &hashBlock)
+{
+    CSerializedBlockUndo serialized;
+    serialized.Set(*this, hashBlock);
+    return serialized.WriteToDisk(pos);
+}
+
+CSerializedBlockUndo::CSerializedBlockUndo() : ssUndo(SER_DISK, CLIENT_VERSION)
+{
+}
+
+void CSerializedBlockUndo::Set(const CBlockUndo& blockundo, const uint256& hashBlock)
+{
+    ssUndo.clear();
+    ssUndo << blockundo;
+
+    // calculate checksum over the bytes just serialized; undo serialization
+    // does not depend on type or version, so this matches ReadFromDisk
+    CHashWriter hasher(SER_GETHASH, PROTOCOL_VERSION);
+    hasher << hashBlock;
+    hasher.write(&ssUndo[0], ssUndo.size());
+    hashChecksum = hasher.GetHash();
+}
+
+bool CSerializedBlockUndo::WriteToDisk(CDiskBlockPos &pos) const
 {
     // Open history file to append
     CAutoFile fileout(OpenUndoFile(pos), SER_DISK, CLIENT_VERSION);
@@ -5372,7 +5565,7 @@ bool CBlockUndo::WriteToDisk(CDiskBlockPos &pos, const uint256 &hashBlock)
         return error("CBlockUndo::WriteToDisk : OpenUndoFile failed");
 
     // Write index header
-    unsigned int nSize = fileout.GetSerializeSize(*this);
+    unsigned int nSize = ssUndo.size();
     fileout << FLATDATA(Params().MessageStart()) << nSize;
 
     // Write undo data
@@ -5380,13 +5573,10 @@ bool CBlockUndo::WriteToDisk(CDiskBlockPos &pos, const uint256 &hashBlock)
     if (fileOutPos < 0)
         return error("CBlockUndo::WriteToDisk : ftell failed");
     pos.nPos = (unsigned int)fileOutPos;
-    fileout << *this;
+    fileout.write(&ssUndo[0], nSize);
 
-    // calculate & write checksum
-    CHashWriter hasher(SER_GETHASH, PROTOCOL_VERSION);
-    hasher << hashBlock;
-    hasher << *this;
-    fileout << hasher.GetHash();
+    // write checksum
+    fileout << hashChecksum;
 
     return true;
 }
@@ -5422,59 +5612,6 @@ bool CBlockUndo::ReadFromDisk(const CDiskBlockPos &pos, const uint256 &hashBlock
      return strprintf("CBlockFileInfo(blocks=%u, size=%u, heights=%u...%u, time=%s...%s)", nBlocks, nSize, nHeightFirst, nHeightLast, DateTimeStrFormat("%Y-%m-%d", nTimeFirst), DateTimeStrFormat("%Y-%m-%d", nTimeLast));
  }
 
-std::string CompressData(std::string uncompressed)
-{
-    std::vector<unsigned char> vchCompressed;
-    uint32_t lenMsg = uncompressed.size();
-    int worstCase = LZ4_compressBound(uncompressed.size());
-    try
-    {
-        vchCompressed.resize(worstCase);
-    }
-    catch (std::exception& e)
-    {
-        LogPrintf("vchCompressed.resize %u threw: %s.\n", worstCase, e.what());
-        return "";
-    };
-
-    int lenComp = LZ4_compress((char*)uncompressed.c_str(), (char*)&vchCompressed[0], lenMsg);
-    if (lenComp < 1)
-    {
-        LogPrintf("Could not compress message data.\n");
-        return "";
-    };
-
-    std::string cmp(vchCompressed[0], vchCompressed.size());
-    return cmp;
-}
-
-std::string UncompressData(std::string scompressed)
-{
-    std::vector<unsigned char> compressed(scompressed.begin(), scompressed.end());
-    uint32_t lenComp = compressed.size();
-    std::vector<unsigned char> uncompressed;
-    uint32_t maxosize = 10 * lenComp;
-    uncompressed.resize(maxosize);
-    try
-    {
-        int osize = LZ4_uncompress_unknownOutputSize((char*)&compressed[0], (char*)&uncompressed[0], lenComp, maxosize);
-        if(osize < 0)
-        {
-            LogPrintf("Error uncompressing data len comp: %d maxosize: %d actual: %d\n", lenComp, maxosize, osize);
-            return "";
-        }
-
-        uncompressed.resize(osize);
-        std::string uncomp(uncompressed[0], uncompressed.size());
-        return uncomp;
-    }
-    catch(std::exception& e)
-    {
-        LogPrintf("Error uncompressing data len comp: %d maxosize: %d error: %s\n", lenComp, maxosize, e.what());
-        return "";
-    }
-}
-
 class CMainCleanup
 {
 public:
@@ -32,6 +32,7 @@
 
 #include <algorithm>
 #include <exception>
+#include <limits>
 #include <map>
 #include <set>
 #include <stdint.h>
@@ -45,8 +46,10 @@ using namespace std;
 class CBlockIndex;
 class CBlockTreeDB;
 class CBloomFilter;
+class CCoinsViewPrefetch;
 class CInv;
 class CScriptCheck;
+class CAddrIndexCheck;
 class CValidationInterface;
 class CValidationState;
 
@@ -220,8 +223,6 @@ bool GetNodeStateStats(NodeId nodeid, CNodeStateStats &stats);
 void Misbehaving(NodeId nodeid, int howmuch);
 /** Flush all state, indexes and buffers to disk. */
 void FlushStateToDisk();
-std::string CompressData(std::string uncompressed);
-std::string UncompressData(std::string compressed);
 /** (try to) add transaction to memory pool **/
 bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransaction &tx, bool fLimitFree,
                         bool* pfMissingInputs, bool fRejectInsaneFee=false);
@@ -399,10 +400,30 @@ public:
     bool ReadFromDisk(const CDiskBlockPos &pos, const uint256 &hashBlock);
 };
 
+/**
+ * Block undo data serialized, and checksummed for the block whose parent is
+ * hashBlock, ahead of being written. This lets ConnectBlock do that work
+ * while the script checks are running.
+ */
+class CSerializedBlockUndo
+{
+public:
+    CDataStream ssUndo;
+    uint256 hashChecksum;
+
+    CSerializedBlockUndo();
+
+    void Set(const CBlockUndo& blockundo, const uint256& hashBlock);
+    bool WriteToDisk(CDiskBlockPos &pos) const;
+};
+
 
 /** 
  * Closure representing one script verification
  * Note that this stores references to the spending transaction 
+ *
+ * A check can instead run the address index extraction of a transaction,
+ * so that ConnectBlock spreads that work over the script check threads too.
  */
 class CScriptCheck
 {
@@ -413,12 +434,16 @@ private:
     unsigned int nFlags;
     bool cacheStore;
     ScriptError error;
+    CAddrIndexCheck *pAddrIndexCheck;
 
 public:
-    CScriptCheck(): ptxTo(0), nIn(0), nFlags(0), cacheStore(false), error(SCRIPT_ERR_UNKNOWN_ERROR) {}
+    CScriptCheck(): ptxTo(0), nIn(0), nFlags(0), cacheStore(false), error(SCRIPT_ERR_UNKNOWN_ERROR), pAddrIndexCheck(0) {}
     CScriptCheck(const CCoins& txFromIn, const CTransaction& txToIn, unsigned int nInIn, unsigned int nFlagsIn, bool cacheIn) :
         scriptPubKey(txFromIn.vout[txToIn.vin[nInIn].prevout.n].scriptPubKey),
-        ptxTo(&txToIn), nIn(nInIn), nFlags(nFlagsIn), cacheStore(cacheIn), error(SCRIPT_ERR_UNKNOWN_ERROR) { }
+        ptxTo(&txToIn), nIn(nInIn), nFlags(nFlagsIn), cacheStore(cacheIn), error(SCRIPT_ERR_UNKNOWN_ERROR), pAddrIndexCheck(0) { }
+    //! Run *pAddrIndexCheckIn, which must outlive the check
+    explicit CScriptCheck(CAddrIndexCheck *pAddrIndexCheckIn) :
+        ptxTo(0), nIn(0), nFlags(0), cacheStore(false), error(SCRIPT_ERR_UNKNOWN_ERROR), pAddrIndexCheck(pAddrIndexCheckIn) { }
 
     bool operator()();
 
@@ -429,11 +454,40 @@ public:
         std::swap(nFlags, check.nFlags);
         std::swap(cacheStore, check.cacheStore);
         std::swap(error, check.error);
+        std::swap(pAddrIndexCheck, check.pAddrIndexCheck);
     }
 
     ScriptError GetScriptError() const { return error; }
 };
 
+/**
+ * Closure extracting the address index entries of one transaction: those of
+ * the outputs it spends and of the outputs it creates, keyed by their salted
+ * index key. Stores a reference to the transaction.
+ */
+class CAddrIndexCheck
+{
+private:
+    std::vector<CScript> vSpent;
+    const CTransaction *ptx;
+    CExtDiskTxPos pos;
+    std::vector<std::pair<uint64_t, CExtDiskTxPos> > *pvOut;
+
+public:
+    CAddrIndexCheck(): ptx(0), pvOut(0) {}
+    CAddrIndexCheck(std::vector<CScript>& vSpentIn, const CTransaction& txIn, const CExtDiskTxPos& posIn, std::vector<std::pair<uint64_t, CExtDiskTxPos> >* pvOutIn) :
+        ptx(&txIn), pos(posIn), pvOut(pvOutIn) { vSpent.swap(vSpentIn); }
+
+    bool operator()();
+
+    void swap(CAddrIndexCheck &check) {
+        vSpent.swap(check.vSpent);
+        std::swap(ptx, check.ptx);
+        std::swap(pos, check.pos);
+        std::swap(pvOut, check.pvOut);
+    }
+};
+
 
 
 /** Functions for disk access for blocks */
@@ -441,7 +495,14 @@ bool WriteBlockToDisk(CBlock& block, CDiskBlockPos& pos);
 bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos);
 bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex);
 bool ReadTransaction(CTransaction& tx, const CDiskTxPos &pos, uint256 &hashBlock);
-bool FindTransactionsByDestination(const CTxDestination &dest, std::set<CExtDiskTxPos> &setpos);
+/**
+ * Look up the transactions of a destination in the address index, in
+ * position order (newest first with fReverse), restricted to a height range
+ * and paged by nSkip and nLimit. The index is read without holding cs_main.
+ */
+bool FindTransactionsByDestination(const CTxDestination &dest, std::vector<CExtDiskTxPos> &vpos,
+                                   unsigned int nMinHeight = 0, unsigned int nMaxHeight = std::numeric_limits<unsigned int>::max(),
+                                   size_t nSkip = 0, size_t nLimit = std::numeric_limits<size_t>::max(), bool fReverse = false);
 
 /** Functions for validating blocks and updating the block tree */
 
@@ -617,6 +678,9 @@ extern CChain chainActive;
 /** Global variable that points to the active CCoinsView (protected by cs_main) */
 extern CCoinsViewCache *pcoinsTip;
 
+/** Global variable that points to the prefetching view between pcoinsTip and the database */
+extern CCoinsViewPrefetch *pcoinsPrefetch;
+
 /** Global variable that points to the active block tree (protected by cs_main) */
 extern CBlockTreeDB *pblocktree;
 
@@ -625,6 +689,8 @@ struct CBlockTemplate
     CBlock block;
     std::vector<CAmount> vTxFees;
     std::vector<int64_t> vTxSigOps;
+    //! Version of the bid snapshot the coinbase pays out
+    uint64_t nBidsVersion;
 };
 
 
@@ -9,6 +9,7 @@
 #include "amount.h"
 #include "base58.h"
 #include "bidtracker.h"
+#include "momentum.h"
 #include "primitives/block.h"
 #include "primitives/transaction.h"
 #include "hash.h"
@@ -124,8 +125,10 @@ CBlockTemplate* CreateNewBlock(const CScript& scriptPubKeyIn)
     bool hasPayment = false;
     bool isgrantblock = false;
     bool ispayoutblock = false;
-	std::map<std::string,int> bidtracker = getbidtracker();
-	std::map<std::string,int>::iterator balit;
+	boost::shared_ptr<const CBidSnapshot> bids = getbidtracker();
+	const std::map<std::string,int>& bidtracker = bids->mapBids;
+	std::map<std::string,int>::const_iterator balit;
+	pblocktemplate->nBidsVersion = bids->nVersion;
     // Create coinbase tx
     CMutableTransaction txNew;
     txNew.vin.resize(1);
@@ -669,14 +672,14 @@ bool ProcessBlockFound(CBlock* pblock, CWallet& wallet)
     return true;
 }
 
-void static BitcreditMiner(CWallet *pwallet)
+void static BitcreditMiner(CWallet *pwallet, int nMomentumThreads)
 {
     LogPrintf("BitcreditMiner started\n");
     SetThreadPriority(THREAD_PRIORITY_LOWEST);
     RenameThread("bitcredit-miner");
 
     unsigned int nExtraNonce = 0;
-    
+
     // get the address used for the last block, don't bother checking address validity,
     // that will be done in TestBlockValidity
     
@@ -728,10 +731,10 @@ void static BitcreditMiner(CWallet *pwallet)
 
         for(int i=0;i<1;i++){
             pblock->nNonce=pblock->nNonce+1;
-            testHash=pblock->CalculateBestBirthdayHash();
+            testHash=pblock->CalculateBestBirthdayHash(nMomentumThreads);
             nHashesDone++;
-            LogPrintf("testHash %s\n", testHash.ToString().c_str());
-            LogPrintf("Hash Target %s\n", hashTarget.ToString().c_str());
+            LogPrint("miner", "testHash %s\n", testHash.ToString().c_str());
+            LogPrint("miner", "Hash Target %s\n", hashTarget.ToString().c_str());
 
             if(testHash<hashTarget){
                 nNonceFound=pblock->nNonce;
@@ -844,9 +847,20 @@ void GenerateBitcredits(bool fGenerate, CWallet* pwallet, int nThreads)
     if (nThreads == 0 || !fGenerate)
         return;
 
+    // Every concurrent Momentum search needs a 512 MiB birthday table. Run one
+    // miner per table and spread the threads over their searches, unless
+    // -momentumthreads says how many each search gets.
+    int nMiners = std::max(1, std::min(nThreads, (int)GetArg("-momentumtables", bts::DEFAULT_MOMENTUM_TABLES)));
+    bts::momentum_set_max_tables(nMiners);
+    int nMomentumThreads = GetArg("-momentumthreads", 0);
+    if (mapArgs.count("-momentumthreads") && nMomentumThreads <= 0)
+        nMomentumThreads = boost::thread::hardware_concurrency();
+
     minerThreads = new boost::thread_group();
-    for (int i = 0; i < nThreads; i++)
-        minerThreads->create_thread(boost::bind(&BitcreditMiner, pwallet));
+    for (int i = 0; i < nMiners; i++) {
+        int nSearchThreads = nMomentumThreads > 0 ? nMomentumThreads : nThreads / nMiners + (i < nThreads % nMiners ? 1 : 0);
+        minerThreads->create_thread(boost::bind(&BitcreditMiner, pwallet, nSearchThreads));
+    }
 }
 
 #endif // ENABLE_WALLET
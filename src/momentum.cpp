@@ -1,49 +1,619 @@
 #include <iostream>
 #include <openssl/sha.h>
 #include "momentum.h"
+#include "crypto/common.h"
+#include "random.h"
+#include "util.h"
+#include <boost/atomic.hpp>
+#include <boost/bind.hpp>
 #include <boost/thread.hpp>
+#include <boost/thread/tss.hpp>
+#include <algorithm>
+#include <deque>
+#include <stdexcept>
+#include <string.h>
+#ifndef WIN32
+#include <sys/mman.h>
+#endif
+#if defined(__x86_64__) && (defined(__clang__) || __GNUC__ >= 5)
+#define ENABLE_MOMENTUM_SIMD
+#include <immintrin.h>
+#endif
+
+semiOrderedMap::~semiOrderedMap()
+{
+#ifndef WIN32
+    if (fMapped)
+    {
+        munmap(slots, nAllocated);
+        return;
+    }
+#endif
+    delete [] slots;
+}
+
+void semiOrderedMap::allocate()
+{
+    if (slots)
+        return;
+    nAllocated = size() * sizeof(uint64_t);
+#ifndef WIN32
+    // Anonymous mappings are zeroed, i.e. every slot starts out in the unused epoch 0
+    void *p = mmap(NULL, nAllocated, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p != MAP_FAILED)
+    {
+#ifdef MADV_HUGEPAGE
+        madvise(p, nAllocated, MADV_HUGEPAGE);
+#endif
+        slots = (uint64_t*)p;
+        fMapped = true;
+        return;
+    }
+#endif
+    slots = new uint64_t[size()]();
+}
+
+void semiOrderedMap::reset()
+{
+    if (++nEpoch >= (1ULL << EPOCH_BITS))
+    {
+        memset(slots, 0, nAllocated);
+        nEpoch = 1;
+    }
+}
+
+size_t semiOrderedMap::countUsed() const
+{
+    size_t nUsed = 0;
+    for (size_t i = 0; i < size(); i++)
+        if ((slots[i] >> (TAG_BITS + NONCE_BITS)) == nEpoch)
+            nUsed++;
+    return nUsed;
+}
+
 namespace bts 
 {
     #define MAX_MOMENTUM_NONCE  (1<<26)
     #define SEARCH_SPACE_BITS 50
     #define BIRTHDAYS_PER_HASH 8
-   
-    std::vector< std::pair<uint32_t,uint32_t> > momentum_search( uint256 midHash )
+    #define MAX_MOMENTUM_THREADS 64
+
+    namespace
     {
-       semiOrderedMap somap;
-       somap.allocate(4);
-       std::vector< std::pair<uint32_t,uint32_t> > results;
-       char  hash_tmp[sizeof(midHash)+4];
-       memcpy((char*)&hash_tmp[4], (char*)&midHash, sizeof(midHash) );
-       uint32_t* index = (uint32_t*)hash_tmp;
+    /**
+     * The momentum message is the nonce index followed by the mid hash, 36 bytes
+     * that fit a single padded SHA-512 block. Only the first message word depends
+     * on the nonce, so the other fifteen are computed once per search.
+     */
+    class CBirthdayMessage
+    {
+    public:
+        unsigned char data[36];
+        uint64_t w[16];
+
+        CBirthdayMessage(const uint256& midHash)
+        {
+            memset(data, 0, 4);
+            memcpy(&data[4], (const char*)&midHash, sizeof(midHash));
+            w[0] = 0;
+            for (int i = 1; i < 4; i++)
+                w[i] = ReadBE64(&data[8 * i]);
+            w[4] = ((uint64_t)ReadBE32(&data[32]) << 32) | 0x80000000ull;
+            for (int i = 5; i < 15; i++)
+                w[i] = 0;
+            w[15] = sizeof(data) * 8;
+        }
+
+        uint64_t FirstWord(uint32_t nonce) const
+        {
+            unsigned char index[4];
+            memcpy(index, (const char*)&nonce, sizeof(nonce));
+            return ((uint64_t)ReadBE32(index) << 32) | ReadBE32(&data[4]);
+        }
+    };
+
+    /** Nonces covered by one call of a birthday generator: eight hashes of eight birthdays. */
+    static const uint32_t BIRTHDAYS_PER_BATCH = 8 * BIRTHDAYS_PER_HASH;
+
+    /**
+     * Computes the hashes for nonces nBase, nBase+8, ..., nBase+56 into
+     * out[64], laid out as consecutive SHA512() results so that out[k] holds
+     * the birthday source of nonce nBase+k.
+     */
+    typedef void (*BirthdayHashesFn)(const CBirthdayMessage& msg, uint32_t nBase, uint64_t* out);
+
+    void BirthdayHashesGeneric(const CBirthdayMessage& msg, uint32_t nBase, uint64_t* out)
+    {
+        unsigned char hash_tmp[sizeof(msg.data)];
+        memcpy(hash_tmp, msg.data, sizeof(hash_tmp));
+        for (uint32_t j = 0; j < 8; j++)
+        {
+            uint32_t index = nBase + j * BIRTHDAYS_PER_HASH;
+            memcpy(hash_tmp, (const char*)&index, sizeof(index));
+            SHA512(hash_tmp, sizeof(hash_tmp), (unsigned char*)&out[j * BIRTHDAYS_PER_HASH]);
+        }
+    }
+
+#ifdef ENABLE_MOMENTUM_SIMD
+    const uint64_t K[80] = {
+        0x428a2f98d728ae22ull, 0x7137449123ef65cdull, 0xb5c0fbcfec4d3b2full, 0xe9b5dba58189dbbcull,
+        0x3956c25bf348b538ull, 0x59f111f1b605d019ull, 0x923f82a4af194f9bull, 0xab1c5ed5da6d8118ull,
+        0xd807aa98a3030242ull, 0x12835b0145706fbeull, 0x243185be4ee4b28cull, 0x550c7dc3d5ffb4e2ull,
+        0x72be5d74f27b896full, 0x80deb1fe3b1696b1ull, 0x9bdc06a725c71235ull, 0xc19bf174cf692694ull,
+        0xe49b69c19ef14ad2ull, 0xefbe4786384f25e3ull, 0x0fc19dc68b8cd5b5ull, 0x240ca1cc77ac9c65ull,
+        0x2de92c6f592b0275ull, 0x4a7484aa6ea6e483ull, 0x5cb0a9dcbd41fbd4ull, 0x76f988da831153b5ull,
+        0x983e5152ee66dfabull, 0xa831c66d2db43210ull, 0xb00327c898fb213full, 0xbf597fc7beef0ee4ull,
+        0xc6e00bf33da88fc2ull, 0xd5a79147930aa725ull, 0x06ca6351e003826full, 0x142929670a0e6e70ull,
+        0x27b70a8546d22ffcull, 0x2e1b21385c26c926ull, 0x4d2c6dfc5ac42aedull, 0x53380d139d95b3dfull,
+        0x650a73548baf63deull, 0x766a0abb3c77b2a8ull, 0x81c2c92e47edaee6ull, 0x92722c851482353bull,
+        0xa2bfe8a14cf10364ull, 0xa81a664bbc423001ull, 0xc24b8b70d0f89791ull, 0xc76c51a30654be30ull,
+        0xd192e819d6ef5218ull, 0xd69906245565a910ull, 0xf40e35855771202aull, 0x106aa07032bbd1b8ull,
+        0x19a4c116b8d2d0c8ull, 0x1e376c085141ab53ull, 0x2748774cdf8eeb99ull, 0x34b0bcb5e19b48a8ull,
+        0x391c0cb3c5c95a63ull, 0x4ed8aa4ae3418acbull, 0x5b9cca4f7763e373ull, 0x682e6ff3d6b2b8a3ull,
+        0x748f82ee5defb2fcull, 0x78a5636f43172f60ull, 0x84c87814a1f0ab72ull, 0x8cc702081a6439ecull,
+        0x90befffa23631e28ull, 0xa4506cebde82bde9ull, 0xbef9a3f7b2c67915ull, 0xc67178f2e372532bull,
+        0xca273eceea26619cull, 0xd186b8c721c0c207ull, 0xeada7dd6cde0eb1eull, 0xf57d4f7fee6ed178ull,
+        0x06f067aa72176fbaull, 0x0a637dc5a2c898a6ull, 0x113f9804bef90daeull, 0x1b710b35131c471bull,
+        0x28db77f523047d84ull, 0x32caab7b40c72493ull, 0x3c9ebe0a15c9bebcull, 0x431d67c49c100d4cull,
+        0x4cc5d4becb3e42b6ull, 0x597f299cfc657e2aull, 0x5fcb6fab3ad6faecull, 0x6c44198c4a475817ull
+    };
+
+    const uint64_t H0[8] = {
+        0x6a09e667f3bcc908ull, 0xbb67ae8584caa73bull, 0x3c6ef372fe94f82bull, 0xa54ff53a5f1d36f1ull,
+        0x510e527fade682d1ull, 0x9b05688c2b3e6c1full, 0x1f83d9abfb41bd6bull, 0x5be0cd19137e2179ull
+    };
+
+    /** Store the digest words of one lane the way SHA512() writes them. */
+    void inline StoreDigest(const uint64_t* s, size_t nStride, uint64_t* out)
+    {
+        for (int x = 0; x < 8; x++)
+        {
+            unsigned char digest[8];
+            WriteBE64(digest, s[x * nStride]);
+            memcpy(&out[x], digest, sizeof(digest));
+        }
+    }
+
+    // Four lanes of SHA-512 in AVX2 registers
+#define AVX2_TARGET __attribute__((target("avx2")))
+#define ROR4(x, n) _mm256_or_si256(_mm256_srli_epi64(x, n), _mm256_slli_epi64(x, 64 - (n)))
+#define XOR4(x, y, z) _mm256_xor_si256(_mm256_xor_si256(x, y), z)
+#define ADD4(x, y) _mm256_add_epi64(x, y)
+
+    AVX2_TARGET void BirthdayHashesAVX2(const CBirthdayMessage& msg, uint32_t nBase, uint64_t* out)
+    {
+        for (uint32_t nHalf = 0; nHalf < 2; nHalf++)
+        {
+            uint32_t n0 = nBase + nHalf * 4 * BIRTHDAYS_PER_HASH;
+            __m256i w[16];
+            w[0] = _mm256_set_epi64x(msg.FirstWord(n0 + 24), msg.FirstWord(n0 + 16), msg.FirstWord(n0 + 8), msg.FirstWord(n0));
+            for (int i = 1; i < 16; i++)
+                w[i] = _mm256_set1_epi64x(msg.w[i]);
+
+            __m256i a = _mm256_set1_epi64x(H0[0]), b = _mm256_set1_epi64x(H0[1]);
+            __m256i c = _mm256_set1_epi64x(H0[2]), d = _mm256_set1_epi64x(H0[3]);
+            __m256i e = _mm256_set1_epi64x(H0[4]), f = _mm256_set1_epi64x(H0[5]);
+            __m256i g = _mm256_set1_epi64x(H0[6]), h = _mm256_set1_epi64x(H0[7]);
+            for (int i = 0; i < 80; i++)
+            {
+                if (i >= 16)
+                {
+                    __m256i w2 = w[(i - 2) & 15], w15 = w[(i - 15) & 15];
+                    __m256i s1 = XOR4(ROR4(w2, 19), ROR4(w2, 61), _mm256_srli_epi64(w2, 6));
+                    __m256i s0 = XOR4(ROR4(w15, 1), ROR4(w15, 8), _mm256_srli_epi64(w15, 7));
+                    w[i & 15] = ADD4(ADD4(w[i & 15], s0), ADD4(w[(i - 7) & 15], s1));
+                }
+                __m256i ch = _mm256_xor_si256(g, _mm256_and_si256(e, _mm256_xor_si256(f, g)));
+                __m256i maj = _mm256_or_si256(_mm256_and_si256(a, b), _mm256_and_si256(c, _mm256_or_si256(a, b)));
+                __m256i t1 = ADD4(ADD4(h, XOR4(ROR4(e, 14), ROR4(e, 18), ROR4(e, 41))),
+                                  ADD4(ADD4(ch, _mm256_set1_epi64x(K[i])), w[i & 15]));
+                __m256i t2 = ADD4(XOR4(ROR4(a, 28), ROR4(a, 34), ROR4(a, 39)), maj);
+                h = g; g = f; f = e; e = ADD4(d, t1);
+                d = c; c = b; b = a; a = ADD4(t1, t2);
+            }
+
+            uint64_t s[8][4];
+            _mm256_storeu_si256((__m256i*)s[0], ADD4(a, _mm256_set1_epi64x(H0[0])));
+            _mm256_storeu_si256((__m256i*)s[1], ADD4(b, _mm256_set1_epi64x(H0[1])));
+            _mm256_storeu_si256((__m256i*)s[2], ADD4(c, _mm256_set1_epi64x(H0[2])));
+            _mm256_storeu_si256((__m256i*)s[3], ADD4(d, _mm256_set1_epi64x(H0[3])));
+            _mm256_storeu_si256((__m256i*)s[4], ADD4(e, _mm256_set1_epi64x(H0[4])));
+            _mm256_storeu_si256((__m256i*)s[5], ADD4(f, _mm256_set1_epi64x(H0[5])));
+            _mm256_storeu_si256((__m256i*)s[6], ADD4(g, _mm256_set1_epi64x(H0[6])));
+            _mm256_storeu_si256((__m256i*)s[7], ADD4(h, _mm256_set1_epi64x(H0[7])));
+            for (int l = 0; l < 4; l++)
+                StoreDigest(&s[0][l], 4, &out[(nHalf * 4 + l) * BIRTHDAYS_PER_HASH]);
+        }
+    }
+
+    // Eight lanes of SHA-512 in AVX-512 registers, using the native rotate and
+    // three-input logic instructions
+#define AVX512_TARGET __attribute__((target("avx512f")))
+#define XOR8(x, y, z) _mm512_ternarylogic_epi64(x, y, z, 0x96)
+#define ADD8(x, y) _mm512_add_epi64(x, y)
+
+    AVX512_TARGET void BirthdayHashesAVX512(const CBirthdayMessage& msg, uint32_t nBase, uint64_t* out)
+    {
+        __m512i w[16];
+        w[0] = _mm512_set_epi64(msg.FirstWord(nBase + 56), msg.FirstWord(nBase + 48), msg.FirstWord(nBase + 40), msg.FirstWord(nBase + 32),
+                                msg.FirstWord(nBase + 24), msg.FirstWord(nBase + 16), msg.FirstWord(nBase + 8), msg.FirstWord(nBase));
+        for (int i = 1; i < 16; i++)
+            w[i] = _mm512_set1_epi64(msg.w[i]);
+
+        __m512i a = _mm512_set1_epi64(H0[0]), b = _mm512_set1_epi64(H0[1]);
+        __m512i c = _mm512_set1_epi64(H0[2]), d = _mm512_set1_epi64(H0[3]);
+        __m512i e = _mm512_set1_epi64(H0[4]), f = _mm512_set1_epi64(H0[5]);
+        __m512i g = _mm512_set1_epi64(H0[6]), h = _mm512_set1_epi64(H0[7]);
+        for (int i = 0; i < 80; i++)
+        {
+            if (i >= 16)
+            {
+                __m512i w2 = w[(i - 2) & 15], w15 = w[(i - 15) & 15];
+                __m512i s1 = XOR8(_mm512_ror_epi64(w2, 19), _mm512_ror_epi64(w2, 61), _mm512_srli_epi64(w2, 6));
+                __m512i s0 = XOR8(_mm512_ror_epi64(w15, 1), _mm512_ror_epi64(w15, 8), _mm512_srli_epi64(w15, 7));
+                w[i & 15] = ADD8(ADD8(w[i & 15], s0), ADD8(w[(i - 7) & 15], s1));
+            }
+            __m512i ch = _mm512_ternarylogic_epi64(e, f, g, 0xca);
+            __m512i maj = _mm512_ternarylogic_epi64(a, b, c, 0xe8);
+            __m512i t1 = ADD8(ADD8(h, XOR8(_mm512_ror_epi64(e, 14), _mm512_ror_epi64(e, 18), _mm512_ror_epi64(e, 41))),
+                              ADD8(ADD8(ch, _mm512_set1_epi64(K[i])), w[i & 15]));
+            __m512i t2 = ADD8(XOR8(_mm512_ror_epi64(a, 28), _mm512_ror_epi64(a, 34), _mm512_ror_epi64(a, 39)), maj);
+            h = g; g = f; f = e; e = ADD8(d, t1);
+            d = c; c = b; b = a; a = ADD8(t1, t2);
+        }
+
+        uint64_t s[8][8];
+        _mm512_storeu_si512(s[0], ADD8(a, _mm512_set1_epi64(H0[0])));
+        _mm512_storeu_si512(s[1], ADD8(b, _mm512_set1_epi64(H0[1])));
+        _mm512_storeu_si512(s[2], ADD8(c, _mm512_set1_epi64(H0[2])));
+        _mm512_storeu_si512(s[3], ADD8(d, _mm512_set1_epi64(H0[3])));
+        _mm512_storeu_si512(s[4], ADD8(e, _mm512_set1_epi64(H0[4])));
+        _mm512_storeu_si512(s[5], ADD8(f, _mm512_set1_epi64(H0[5])));
+        _mm512_storeu_si512(s[6], ADD8(g, _mm512_set1_epi64(H0[6])));
+        _mm512_storeu_si512(s[7], ADD8(h, _mm512_set1_epi64(H0[7])));
+        for (int l = 0; l < 8; l++)
+            StoreDigest(&s[0][l], 8, &out[l * BIRTHDAYS_PER_HASH]);
+    }
+#endif
+
+    BirthdayHashesFn SelectBirthdayHashes()
+    {
+#ifdef ENABLE_MOMENTUM_SIMD
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx512f"))
+            return BirthdayHashesAVX512;
+        if (__builtin_cpu_supports("avx2"))
+            return BirthdayHashesAVX2;
+#endif
+        return BirthdayHashesGeneric;
+    }
+
+    /** Insert the birthdays of nonces [nBegin, nEnd) into the table, until pfAbort is set */
+    void SearchRange(const CBirthdayMessage& msg, semiOrderedMap* somap, bool fShared, uint32_t nBegin, uint32_t nEnd,
+                     std::vector< std::pair<uint32_t,uint32_t> >* results, const boost::atomic<bool>* pfAbort)
+    {
+        static const BirthdayHashesFn birthdayHashes = SelectBirthdayHashes();
+        uint64_t result_hash[BIRTHDAYS_PER_BATCH];
+
+        for( uint32_t i = nBegin; i < nEnd; i += BIRTHDAYS_PER_BATCH )
+        {
+            if(i%1048576==0)
+            {
+                if (pfAbort && *pfAbort)
+                    return;
+                boost::this_thread::interruption_point();
+            }
+
+            birthdayHashes(msg, i, result_hash);
+
+            // Buckets are spread over the whole table; fetch them all before
+            // inserting so that the cache misses overlap.
+            for( uint32_t x = 0; x < BIRTHDAYS_PER_BATCH; ++x )
+            {
+                result_hash[x] >>= 64-SEARCH_SPACE_BITS;
+                somap->prefetch( result_hash[x] );
+            }
+
+            for( uint32_t x = 0; x < BIRTHDAYS_PER_BATCH; ++x )
+            {
+                uint64_t birthday = result_hash[x];
+                uint32_t nonce = i+x;
+                uint32_t foundMatch;
+                bool fFound = fShared ? somap->checkAddConcurrent( birthday, nonce, foundMatch )
+                                      : somap->checkAdd( birthday, nonce, foundMatch );
+                if( fFound )
+                {
+                    results->push_back( std::make_pair( foundMatch, nonce ) );
+                }
+            }
+        }
+    }
+
+    /**
+     * Birthday tables shared by all searches. A table is 512 MiB, so at most
+     * nMaxTables exist; a search that finds none free waits for one.
+     */
+    class CBirthdayTablePool
+    {
+    private:
+        boost::mutex mutex;
+        boost::condition_variable cond;
+        std::vector<semiOrderedMap*> vFree;
+        int nTables;
+        int nMaxTables;
+
+    public:
+        CBirthdayTablePool() : nTables(0), nMaxTables(DEFAULT_MOMENTUM_TABLES) {}
+
+        semiOrderedMap* Acquire()
+        {
+            {
+                boost::unique_lock<boost::mutex> lock(mutex);
+                while (vFree.empty() && nTables >= nMaxTables)
+                    cond.wait(lock);
+                if (!vFree.empty())
+                {
+                    semiOrderedMap* somap = vFree.back();
+                    vFree.pop_back();
+                    return somap;
+                }
+                nTables++;
+            }
+            semiOrderedMap* somap = new semiOrderedMap();
+            somap->allocate();
+            return somap;
+        }
+
+        void Release(semiOrderedMap* somap)
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            if (nTables > nMaxTables)
+            {
+                nTables--;
+                delete somap;
+                return;
+            }
+            vFree.push_back(somap);
+            cond.notify_one();
+        }
+
+        void SetMax(int n)
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            nMaxTables = std::max(n, 1);
+            while (nTables > nMaxTables && !vFree.empty())
+            {
+                delete vFree.back();
+                vFree.pop_back();
+                nTables--;
+            }
+            cond.notify_all();
+        }
+    };
+
+    /** Tasks of one search handed to the helper threads */
+    class CSearchGroup
+    {
+    private:
+        boost::mutex mutex;
+        boost::condition_variable cond;
+        int nPending;
+
+    public:
+        boost::atomic<bool> fAbort;
+
+        CSearchGroup(int nTasks) : nPending(nTasks), fAbort(false) {}
+
+        void Done()
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            if (--nPending == 0)
+                cond.notify_all();
+        }
+
+        void Wait()
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            while (nPending > 0)
+                cond.wait(lock);
+        }
+    };
+
+    struct CSearchTask
+    {
+        const CBirthdayMessage* pmsg;
+        semiOrderedMap* somap;
+        uint32_t nBegin;
+        uint32_t nEnd;
+        std::vector< std::pair<uint32_t,uint32_t> >* results;
+        CSearchGroup* group;
+    };
+
+    /**
+     * Helper threads for multi-threaded searches. They are started on first use,
+     * as many as the largest search asked for, and kept for the lifetime of the
+     * process instead of being created for every search.
+     */
+    class CSearchWorkers
+    {
+    private:
+        boost::mutex mutex;
+        boost::condition_variable cond;
+        std::deque<CSearchTask> queue;
+        int nThreads;
+
+        void Thread()
+        {
+            RenameThread("bitcredit-momentum");
+            while (true)
+            {
+                CSearchTask task;
+                {
+                    boost::unique_lock<boost::mutex> lock(mutex);
+                    while (queue.empty())
+                        cond.wait(lock);
+                    task = queue.front();
+                    queue.pop_front();
+                }
+                try
+                {
+                    SearchRange(*task.pmsg, task.somap, true, task.nBegin, task.nEnd, task.results, &task.group->fAbort);
+                }
+                catch (...)
+                {
+                    task.group->fAbort = true;
+                }
+                task.group->Done();
+            }
+        }
+
+    public:
+        CSearchWorkers() : nThreads(0) {}
+
+        void Post(const std::vector<CSearchTask>& vTasks)
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            for (; nThreads < (int)vTasks.size(); nThreads++)
+                boost::thread(boost::bind(&CSearchWorkers::Thread, this)).detach();
+            queue.insert(queue.end(), vTasks.begin(), vTasks.end());
+            cond.notify_all();
+        }
+    };
+
+    CBirthdayTablePool tablePool;
+
+    // Helpers block on the queue forever, so the pool is never destroyed
+    CSearchWorkers* searchWorkers = new CSearchWorkers();
+
+    // Table of the last search of each thread, for momentum_table_usage
+    void NoCleanup(semiOrderedMap*) {}
+    boost::thread_specific_ptr<semiOrderedMap> lastTable(NoCleanup);
+
+    /** Returns the table to the pool when the search leaves */
+    class CBirthdayTableLease
+    {
+    public:
+        semiOrderedMap* somap;
+
+        CBirthdayTableLease() : somap(tablePool.Acquire()) {}
+        ~CBirthdayTableLease() { tablePool.Release(somap); }
+    };
+    }
+
+    std::vector< std::pair<uint32_t,uint32_t> > momentum_search( uint256 midHash, int nThreads )
+    {
+       CBirthdayTableLease lease;
+       semiOrderedMap *somap = lease.somap;
+       somap->reset();
+       lastTable.reset(somap);
+
+       CBirthdayMessage msg(midHash);
+       nThreads = std::max(1, std::min(nThreads, MAX_MOMENTUM_THREADS));
+       if (nThreads == 1)
+       {
+          std::vector< std::pair<uint32_t,uint32_t> > results;
+          SearchRange(msg, somap, false, 0, MAX_MOMENTUM_NONCE, &results, NULL);
+          return results;
+       }
 
-       for( uint32_t i = 0; i < MAX_MOMENTUM_NONCE;  )
+       // Split the nonce space over the helper threads, which share the
+       // table; the caller searches the first part itself.
+       uint32_t nChunk = (MAX_MOMENTUM_NONCE / nThreads) & ~(BIRTHDAYS_PER_BATCH - 1);
+       std::vector< std::vector< std::pair<uint32_t,uint32_t> > > vResults(nThreads);
+       CSearchGroup group(nThreads - 1);
+       std::vector<CSearchTask> vTasks(nThreads - 1);
+       for (int t = 1; t < nThreads; t++)
+       {
+          CSearchTask& task = vTasks[t - 1];
+          task.pmsg = &msg;
+          task.somap = somap;
+          task.nBegin = t * nChunk;
+          task.nEnd = (t == nThreads - 1) ? MAX_MOMENTUM_NONCE : (t + 1) * nChunk;
+          task.results = &vResults[t];
+          task.group = &group;
+       }
+       searchWorkers->Post(vTasks);
+       try
        {
-         if(i%1048576==0)
-         {
-            boost::this_thread::interruption_point();
-         }
-         
-         *index = i;
-         uint64_t  result_hash[8];
-         
-         SHA512((unsigned char*)hash_tmp, sizeof(hash_tmp), (unsigned char*)&result_hash);
-             
-         for( uint32_t x = 0; x < BIRTHDAYS_PER_HASH; ++x )
-         { 
-            uint64_t birthday = result_hash[x] >> (64-SEARCH_SPACE_BITS);           
-            uint32_t nonce = i+x;   
-            uint64_t foundMatch=somap.checkAdd( birthday, nonce );
-              if( foundMatch != 0 )
-              {
-                   results.push_back( std::make_pair( foundMatch, nonce ) );
-              }
-         }
-         i += BIRTHDAYS_PER_HASH;
-       }        
-           return results;
+          SearchRange(msg, somap, true, 0, nChunk, &vResults[0], &group.fAbort);
+          group.Wait();
+       }
+       catch (...)
+       {
+          // Helpers reference the table and this frame, stop them before unwinding
+          boost::this_thread::disable_interruption di;
+          group.fAbort = true;
+          group.Wait();
+          throw;
+       }
+       if (group.fAbort)
+          throw std::runtime_error("momentum_search: search helper failed");
+
+       std::vector< std::pair<uint32_t,uint32_t> > results;
+       for (int t = 0; t < nThreads; t++)
+          results.insert(results.end(), vResults[t].begin(), vResults[t].end());
+       return results;
     }   
-     
+
+    void momentum_set_max_tables( int nMaxTables )
+    {
+       tablePool.SetMax(nMaxTables);
+    }
+
+    size_t momentum_table_usage( size_t& nSlots )
+    {
+       nSlots = semiOrderedMap::size();
+       const semiOrderedMap *somap = lastTable.get();
+       return somap ? somap->countUsed() : 0;
+    }
+
+    bool momentum_birthday_hashes( const std::string& strImpl, const uint256& midHash, uint32_t nBase, uint64_t* out )
+    {
+       BirthdayHashesFn fn = NULL;
+       if (strImpl == "generic")
+          fn = BirthdayHashesGeneric;
+#ifdef ENABLE_MOMENTUM_SIMD
+       __builtin_cpu_init();
+       if (strImpl == "avx2" && __builtin_cpu_supports("avx2"))
+          fn = BirthdayHashesAVX2;
+       if (strImpl == "avx512" && __builtin_cpu_supports("avx512f"))
+          fn = BirthdayHashesAVX512;
+#endif
+       if (!fn)
+          return false;
+       fn(CBirthdayMessage(midHash), nBase, out);
+       return true;
+    }
+
+    bool CMomentumCache::Get(const uint256& hash) const
+    {
+       boost::shared_lock<boost::shared_mutex> lock(cs_momentumcache);
+       return setValid.count(hash) != 0;
+    }
+
+    void CMomentumCache::Set(const uint256& hash)
+    {
+       if (nMaxEntries == 0)
+          return;
+
+       boost::unique_lock<boost::shared_mutex> lock(cs_momentumcache);
+       while (setValid.size() >= nMaxEntries)
+       {
+          // Evict a random entry, as the vote signature cache does
+          std::set<uint256>::iterator it = setValid.lower_bound(GetRandHash());
+          if (it == setValid.end())
+             it = setValid.begin();
+          setValid.erase(it);
+       }
+       setValid.insert(hash);
+    }
+
+    size_t CMomentumCache::GetSize() const
+    {
+       boost::shared_lock<boost::shared_mutex> lock(cs_momentumcache);
+       return setValid.size();
+    }
+
     uint64_t getBirthdayHash(const uint256& midHash, uint32_t a)
     {
        uint32_t index = a - (a%8);
@@ -1,9 +1,66 @@
+#ifndef BITCREDIT_MOMENTUM_H
+#define BITCREDIT_MOMENTUM_H
+
 #include "uint256.h"
 #include "semiOrderedMap.h"
 
+#include <set>
+#include <string>
+
+#include <boost/thread/shared_mutex.hpp>
+
 namespace bts 
 {
-    std::vector< std::pair<uint32_t,uint32_t> > momentum_search( uint256 midHash );
+    //! Default number of birthday tables (512 MiB each) searches may use at once
+    static const int DEFAULT_MOMENTUM_TABLES = 1;
+
+    /**
+     * Search with the calling thread and nThreads-1 helpers from a pool that
+     * lives as long as the process. The birthday table is borrowed from a
+     * shared pool; if all tables are in use, the search waits for one.
+     */
+    std::vector< std::pair<uint32_t,uint32_t> > momentum_search( uint256 midHash, int nThreads = 1 );
     bool momentum_verify( uint256 midHash, uint32_t a, uint32_t b );
+    uint64_t getBirthdayHash( const uint256& midHash, uint32_t a );
+
+    //! Limit the number of birthday tables; further concurrent searches wait for a table
+    void momentum_set_max_tables( int nMaxTables );
+
+    //! Slots used by the last search of the calling thread, out of nSlots (until another search reuses its table)
+    size_t momentum_table_usage( size_t& nSlots );
+
+    /**
+     * SHA-512 birthday hashes of nonces nBase, nBase+8, ..., nBase+56 into out[64],
+     * as momentum_search computes them with the named implementation ("generic",
+     * "avx2" or "avx512"). Returns false if the build or the CPU lacks it.
+     */
+    bool momentum_birthday_hashes( const std::string& strImpl, const uint256& midHash, uint32_t nBase, uint64_t* out );
+
+    //! Default for -maxpowcachesize; entries take about 100 bytes
+    static const int64_t DEFAULT_MAX_POW_CACHE_SIZE = 100000;
+
+    /**
+     * Cache of header hashes whose Momentum proof has been verified, so that a
+     * header checked more than once only recomputes the SHA-256 header hash and
+     * not the two SHA-512 birthdays. The header hash commits to the birthdays,
+     * so a hit stands for exactly the proof that was verified. The limit is
+     * fixed at construction; once it is reached, random entries are evicted.
+     */
+    class CMomentumCache
+    {
+    private:
+        std::set<uint256> setValid;
+        mutable boost::shared_mutex cs_momentumcache;
+        size_t nMaxEntries;
+
+    public:
+        //! Cache holding at most nMaxEntriesIn headers; 0 disables it
+        explicit CMomentumCache(size_t nMaxEntriesIn) : nMaxEntries(nMaxEntriesIn) {}
+
+        bool Get(const uint256& hash) const;
+        void Set(const uint256& hash);
+        size_t GetSize() const;
+    };
 }
- 
+
+#endif // BITCREDIT_MOMENTUM_H
@@ -12,10 +12,11 @@
 #include "addrman.h"
 #include "chainparams.h"
 #include "clientversion.h"
+#include "crypto/common.h"
 #include "ui_interface.h"
 #include "darksend.h"
 #include "wallet.h"
-#include "bidtracker.h"
+#include "rawdata.h"
 
 #ifdef WIN32
 #include <string.h>
@@ -23,6 +24,10 @@
 #include <fcntl.h>
 #endif
 
+#ifdef HAVE_SYS_EPOLL_H
+#include <sys/epoll.h>
+#endif
+
 #ifdef USE_UPNP
 #include <miniupnpc/miniupnpc.h>
 #include <miniupnpc/miniwget.h>
@@ -36,7 +41,6 @@
 // Dump addresses to peers.dat every 15 minutes (900s)
 #define DUMP_ADDRESSES_INTERVAL 900
 #define DUMP_BN_INTERVAL 300
-#define UPDATE_BID_INTERVAL 600
 #if !defined(HAVE_MSG_NOSIGNAL) && !defined(MSG_NOSIGNAL)
 #define MSG_NOSIGNAL 0
 #endif
@@ -82,6 +86,7 @@ static CNode* pnodeLocalHost = NULL;
 uint64_t nLocalHostNonce = 0;
 static std::vector<ListenSocket> vhListenSocket;
 CAddrMan addrman;
+CNetBufferPool netBufferPool;
 int nMaxConnections = 125;
 bool fAddressesInitialized = false;
 
@@ -106,12 +111,33 @@ CCriticalSection cs_nLastNodeId;
 
 static CSemaphore *semOutbound = NULL;
 
+/** epoll instance the sockets are registered with, -1 when select() is used */
+static int hEpoll = -1;
+
+/** Timing of the socket handler loop */
+static CCriticalSection cs_socketLoopStats;
+static uint64_t nSocketLoops = 0;
+static uint64_t nSocketLoopEvents = 0;
+static int64_t nSocketLoopWaitMicros = 0;
+static int64_t nSocketLoopServiceMicros = 0;
+static int64_t nSocketLoopServiceMaxMicros = 0;
+
 void NetGetInternalStats(std::map<std::string, size_t>& mapResults)
 {
     {
         LOCK(cs_vNodes);
         mapResults["vNodes.size"] = vNodes.size();
     }
+    {
+        LOCK(cs_socketLoopStats);
+        mapResults["socketloop.epoll"] = hEpoll != -1;
+        mapResults["socketloop.count"] = nSocketLoops;
+        mapResults["socketloop.events"] = nSocketLoopEvents;
+        mapResults["socketloop.wait_us"] = nSocketLoopWaitMicros;
+        mapResults["socketloop.service_us"] = nSocketLoopServiceMicros;
+        mapResults["socketloop.service_max_us"] = nSocketLoopServiceMaxMicros;
+    }
+    netBufferPool.GetStats(mapResults);
     {
         LOCK(cs_mapRelay);
         mapResults["mapRelay.size"] = mapRelay.size();
@@ -619,26 +645,41 @@ bool CNode::ReceiveMsgBytes(const char *pch, unsigned int nBytes)
     return true;
 }
 
+CNetMessage::~CNetMessage()
+{
+    netBufferPool.Release(vchData);
+    CSerializeData vch;
+    vRecv.swap(vch);
+    netBufferPool.Release(vch);
+}
+
 int CNetMessage::readHeader(const char *pch, unsigned int nBytes)
 {
-    // copy data to temporary parsing buffer
-    unsigned int nRemaining = 24 - nHdrPos;
-    unsigned int nCopy = std::min(nRemaining, nBytes);
+    // A header received in one piece is parsed where it is
+    const char *pchHeader = pch;
+    unsigned int nCopy = CMessageHeader::HEADER_SIZE;
+    if (nHdrPos > 0 || nBytes < CMessageHeader::HEADER_SIZE)
+    {
+        // copy data to temporary parsing buffer
+        unsigned int nRemaining = CMessageHeader::HEADER_SIZE - nHdrPos;
+        nCopy = std::min(nRemaining, nBytes);
 
-    memcpy(&hdrbuf[nHdrPos], pch, nCopy);
-    nHdrPos += nCopy;
+        memcpy(&hdrbuf[nHdrPos], pch, nCopy);
+        nHdrPos += nCopy;
 
-    // if header incomplete, exit
-    if (nHdrPos < 24)
-        return nCopy;
+        // if header incomplete, exit
+        if (nHdrPos < CMessageHeader::HEADER_SIZE)
+            return nCopy;
+        pchHeader = hdrbuf;
+    }
+    nHdrPos = CMessageHeader::HEADER_SIZE;
 
     // deserialize to CMessageHeader
-    try {
-        hdrbuf >> hdr;
-    }
-    catch (const std::exception&) {
-        return -1;
-    }
+    const unsigned char *pchField = (const unsigned char*)pchHeader;
+    memcpy(hdr.pchMessageStart, pchField, MESSAGE_START_SIZE);
+    memcpy(hdr.pchCommand, pchField + MESSAGE_START_SIZE, CMessageHeader::COMMAND_SIZE);
+    hdr.nMessageSize = ReadLE32(pchField + CMessageHeader::MESSAGE_SIZE_OFFSET);
+    hdr.nChecksum = ReadLE32(pchField + CMessageHeader::CHECKSUM_OFFSET);
 
     // reject messages larger than MAX_SIZE
     if (hdr.nMessageSize > MAX_SIZE)
@@ -655,14 +696,25 @@ int CNetMessage::readData(const char *pch, unsigned int nBytes)
     unsigned int nRemaining = hdr.nMessageSize - nDataPos;
     unsigned int nCopy = std::min(nRemaining, nBytes);
 
-    if (vRecv.size() < nDataPos + nCopy) {
+    if (vchData.capacity() < nDataPos + nCopy) {
         // Allocate up to 256 KiB ahead, but never more than the total message size.
-        vRecv.resize(std::min(hdr.nMessageSize, nDataPos + nCopy + 256 * 1024));
+        // Beyond the pooled sizes the buffer at least doubles, as a vector would.
+        size_t nSize = std::min(hdr.nMessageSize, nDataPos + nCopy + 256 * 1024);
+        nSize = std::min(std::max(nSize, 2 * vchData.capacity()), (size_t)hdr.nMessageSize);
+        CSerializeData vchNew;
+        netBufferPool.Acquire(vchNew, nSize);
+        vchNew.insert(vchNew.end(), vchData.begin(), vchData.end());
+        netBufferPool.Release(vchData);
+        vchData.swap(vchNew);
     }
 
-    memcpy(&vRecv[nDataPos], pch, nCopy);
+    vchData.insert(vchData.end(), pch, pch + nCopy);
     nDataPos += nCopy;
 
+    // The complete message is read in place by ProcessMessage
+    if (nDataPos == hdr.nMessageSize)
+        vRecv.swap(vchData);
+
     return nCopy;
 }
 
@@ -674,6 +726,87 @@ int CNetMessage::readData(const char *pch, unsigned int nBytes)
 
 
 
+#ifdef HAVE_SYS_EPOLL_H
+/** Most events taken from the epoll instance per wakeup */
+static const int MAX_EPOLL_EVENTS = 256;
+
+/**
+ * Nodes are registered edge triggered with the node as event data. Listen
+ * sockets are registered level triggered, so a backlog of connections is
+ * accepted one per wakeup as with select(), and are told apart from nodes by
+ * the low bit of their event data.
+ */
+static uint32_t EpollNodeEvents(bool fSend)
+{
+    return EPOLLIN | EPOLLRDHUP | EPOLLET | (fSend ? EPOLLOUT : 0);
+}
+#endif
+
+/** Start reporting readiness of the socket of a new node */
+static void PollAddNode(CNode* pnode)
+{
+#ifdef HAVE_SYS_EPOLL_H
+    if (hEpoll == -1)
+        return;
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = EpollNodeEvents(false);
+    event.data.ptr = pnode;
+    if (epoll_ctl(hEpoll, EPOLL_CTL_ADD, pnode->hSocket, &event) != 0)
+    {
+        LogPrintf("epoll_ctl add failed: %s\n", NetworkErrorString(errno));
+        pnode->fDisconnect = true;
+    }
+#endif
+}
+
+/** Ask for write readiness while the send queue is non-empty, requires LOCK(cs_vSend) */
+static void PollSetSendInterest(CNode* pnode, bool fSend)
+{
+#ifdef HAVE_SYS_EPOLL_H
+    if (hEpoll == -1 || pnode->hSocket == INVALID_SOCKET || pnode->fPollSendInterest == fSend)
+        return;
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = EpollNodeEvents(fSend);
+    event.data.ptr = pnode;
+    if (epoll_ctl(hEpoll, EPOLL_CTL_MOD, pnode->hSocket, &event) == 0)
+        pnode->fPollSendInterest = fSend;
+    else
+        LogPrint("net", "epoll_ctl mod failed: %s\n", NetworkErrorString(errno));
+#endif
+}
+
+/** Create the epoll instance and register the listen sockets, select() is used if this fails */
+static void PollStart()
+{
+#ifdef HAVE_SYS_EPOLL_H
+    if (!GetBoolArg("-epoll", true))
+        return;
+    hEpoll = epoll_create1(EPOLL_CLOEXEC);
+    if (hEpoll == -1)
+    {
+        LogPrintf("epoll_create1 failed, using select: %s\n", NetworkErrorString(errno));
+        return;
+    }
+    for (unsigned int i = 0; i < vhListenSocket.size(); i++)
+    {
+        struct epoll_event event;
+        memset(&event, 0, sizeof(event));
+        event.events = EPOLLIN;
+        event.data.u64 = ((uint64_t)i << 1) | 1;
+        if (epoll_ctl(hEpoll, EPOLL_CTL_ADD, vhListenSocket[i].socket, &event) != 0)
+        {
+            LogPrintf("epoll_ctl add of listen socket failed, using select: %s\n", NetworkErrorString(errno));
+            close(hEpoll);
+            hEpoll = -1;
+            return;
+        }
+    }
+    LogPrintf("Using epoll for socket events\n");
+#endif
+}
+
 // requires LOCK(cs_vSend)
 void SocketSendData(CNode *pnode)
 {
@@ -716,15 +849,166 @@ void SocketSendData(CNode *pnode)
         assert(pnode->nSendSize == 0);
     }
     pnode->vSendMsg.erase(pnode->vSendMsg.begin(), it);
+    PollSetSendInterest(pnode, !pnode->vSendMsg.empty());
 }
 
 static list<CNode*> vNodesDisconnected;
 
+/** Whether there is room to receive more data, requires LOCK(cs_vRecvMsg) */
+static bool ShouldReceive(CNode* pnode)
+{
+    return pnode->vRecvMsg.empty() || !pnode->vRecvMsg.front().complete() ||
+        pnode->GetTotalRecvSize() <= ReceiveFloodSize();
+}
+
+/** Wait for socket readiness with select(), returns the number of ready sockets */
+static int SocketWaitSelect(std::vector<const ListenSocket*>& vListenReady)
+{
+    struct timeval timeout;
+    timeout.tv_sec  = 0;
+    timeout.tv_usec = 50000; // frequency to poll pnode->vSend
+
+    fd_set fdsetRecv;
+    fd_set fdsetSend;
+    fd_set fdsetError;
+    FD_ZERO(&fdsetRecv);
+    FD_ZERO(&fdsetSend);
+    FD_ZERO(&fdsetError);
+    SOCKET hSocketMax = 0;
+    bool have_fds = false;
+
+    BOOST_FOREACH(const ListenSocket& hListenSocket, vhListenSocket) {
+        FD_SET(hListenSocket.socket, &fdsetRecv);
+        hSocketMax = max(hSocketMax, hListenSocket.socket);
+        have_fds = true;
+    }
+
+    {
+        LOCK(cs_vNodes);
+        BOOST_FOREACH(CNode* pnode, vNodes)
+        {
+            if (pnode->hSocket == INVALID_SOCKET)
+                continue;
+            FD_SET(pnode->hSocket, &fdsetError);
+            hSocketMax = max(hSocketMax, pnode->hSocket);
+            have_fds = true;
+
+            // Implement the following logic:
+            // * If there is data to send, select() for sending data. As this only
+            //   happens when optimistic write failed, we choose to first drain the
+            //   write buffer in this case before receiving more. This avoids
+            //   needlessly queueing received data, if the remote peer is not themselves
+            //   receiving data. This means properly utilizing TCP flow control signalling.
+            // * Otherwise, if there is no (complete) message in the receive buffer,
+            //   or there is space left in the buffer, select() for receiving data.
+            // * (if neither of the above applies, there is certainly one message
+            //   in the receiver buffer ready to be processed).
+            // Together, that means that at least one of the following is always possible,
+            // so we don't deadlock:
+            // * We send some data.
+            // * We wait for data to be received (and disconnect after timeout).
+            // * We process a message in the buffer (message handler thread).
+            {
+                TRY_LOCK(pnode->cs_vSend, lockSend);
+                if (lockSend && !pnode->vSendMsg.empty()) {
+                    FD_SET(pnode->hSocket, &fdsetSend);
+                    continue;
+                }
+            }
+            {
+                TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
+                if (lockRecv && ShouldReceive(pnode))
+                    FD_SET(pnode->hSocket, &fdsetRecv);
+            }
+        }
+    }
+
+    int nSelect = select(have_fds ? hSocketMax + 1 : 0,
+                         &fdsetRecv, &fdsetSend, &fdsetError, &timeout);
+
+    if (nSelect == SOCKET_ERROR)
+    {
+        if (have_fds)
+        {
+            int nErr = WSAGetLastError();
+            LogPrintf("socket select error %s\n", NetworkErrorString(nErr));
+            for (unsigned int i = 0; i <= hSocketMax; i++)
+                FD_SET(i, &fdsetRecv);
+        }
+        FD_ZERO(&fdsetSend);
+        FD_ZERO(&fdsetError);
+        MilliSleep(timeout.tv_usec/1000);
+    }
+
+    BOOST_FOREACH(const ListenSocket& hListenSocket, vhListenSocket)
+        if (hListenSocket.socket != INVALID_SOCKET && FD_ISSET(hListenSocket.socket, &fdsetRecv))
+            vListenReady.push_back(&hListenSocket);
+    {
+        LOCK(cs_vNodes);
+        BOOST_FOREACH(CNode* pnode, vNodes)
+        {
+            if (pnode->hSocket == INVALID_SOCKET)
+            {
+                pnode->fPollRecv = pnode->fPollSend = false;
+                continue;
+            }
+            pnode->fPollRecv = FD_ISSET(pnode->hSocket, &fdsetRecv) || FD_ISSET(pnode->hSocket, &fdsetError);
+            pnode->fPollSend = FD_ISSET(pnode->hSocket, &fdsetSend);
+        }
+    }
+    return nSelect == SOCKET_ERROR ? 0 : nSelect;
+}
+
+/**
+ * Wait for socket events with epoll, returns the number of events. The flow
+ * control of the select() loop is applied when servicing the sockets, since
+ * with edge triggered events the readiness is remembered until it is acted on.
+ * fMoreWork is set when a node is still known to be ready, so the wait does
+ * not block.
+ */
+static int SocketWaitEpoll(std::vector<const ListenSocket*>& vListenReady, bool fMoreWork)
+{
+#ifdef HAVE_SYS_EPOLL_H
+    struct epoll_event events[MAX_EPOLL_EVENTS];
+    int nEvents = epoll_wait(hEpoll, events, MAX_EPOLL_EVENTS, fMoreWork ? 0 : 50);
+    if (nEvents < 0)
+    {
+        if (errno != EINTR)
+        {
+            LogPrintf("socket epoll_wait error %s\n", NetworkErrorString(errno));
+            MilliSleep(50);
+        }
+        return 0;
+    }
+
+    for (int i = 0; i < nEvents; i++)
+    {
+        if (events[i].data.u64 & 1)
+        {
+            vListenReady.push_back(&vhListenSocket[events[i].data.u64 >> 1]);
+            continue;
+        }
+        CNode* pnode = (CNode*)events[i].data.ptr;
+        if (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))
+            pnode->fPollRecv = true;
+        if (events[i].events & EPOLLOUT)
+            pnode->fPollSend = true;
+    }
+    return nEvents;
+#else
+    return 0;
+#endif
+}
+
 void ThreadSocketHandler()
 {
     unsigned int nPrevNodeCount = 0;
+    int64_t nLastInactivityCheck = 0;
+    bool fMoreWork = false;
     while (true)
     {
+        int64_t nLoopStart = GetTimeMicros();
+
         //
         // Disconnect nodes
         //
@@ -791,91 +1075,19 @@ void ThreadSocketHandler()
         //
         // Find which sockets have data to receive
         //
-        struct timeval timeout;
-        timeout.tv_sec  = 0;
-        timeout.tv_usec = 50000; // frequency to poll pnode->vSend
-
-        fd_set fdsetRecv;
-        fd_set fdsetSend;
-        fd_set fdsetError;
-        FD_ZERO(&fdsetRecv);
-        FD_ZERO(&fdsetSend);
-        FD_ZERO(&fdsetError);
-        SOCKET hSocketMax = 0;
-        bool have_fds = false;
-
-        BOOST_FOREACH(const ListenSocket& hListenSocket, vhListenSocket) {
-            FD_SET(hListenSocket.socket, &fdsetRecv);
-            hSocketMax = max(hSocketMax, hListenSocket.socket);
-            have_fds = true;
-        }
-
-        {
-            LOCK(cs_vNodes);
-            BOOST_FOREACH(CNode* pnode, vNodes)
-            {
-                if (pnode->hSocket == INVALID_SOCKET)
-                    continue;
-                FD_SET(pnode->hSocket, &fdsetError);
-                hSocketMax = max(hSocketMax, pnode->hSocket);
-                have_fds = true;
-
-                // Implement the following logic:
-                // * If there is data to send, select() for sending data. As this only
-                //   happens when optimistic write failed, we choose to first drain the
-                //   write buffer in this case before receiving more. This avoids
-                //   needlessly queueing received data, if the remote peer is not themselves
-                //   receiving data. This means properly utilizing TCP flow control signalling.
-                // * Otherwise, if there is no (complete) message in the receive buffer,
-                //   or there is space left in the buffer, select() for receiving data.
-                // * (if neither of the above applies, there is certainly one message
-                //   in the receiver buffer ready to be processed).
-                // Together, that means that at least one of the following is always possible,
-                // so we don't deadlock:
-                // * We send some data.
-                // * We wait for data to be received (and disconnect after timeout).
-                // * We process a message in the buffer (message handler thread).
-                {
-                    TRY_LOCK(pnode->cs_vSend, lockSend);
-                    if (lockSend && !pnode->vSendMsg.empty()) {
-                        FD_SET(pnode->hSocket, &fdsetSend);
-                        continue;
-                    }
-                }
-                {
-                    TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
-                    if (lockRecv && (
-                        pnode->vRecvMsg.empty() || !pnode->vRecvMsg.front().complete() ||
-                        pnode->GetTotalRecvSize() <= ReceiveFloodSize()))
-                        FD_SET(pnode->hSocket, &fdsetRecv);
-                }
-            }
-        }
-
-        int nSelect = select(have_fds ? hSocketMax + 1 : 0,
-                             &fdsetRecv, &fdsetSend, &fdsetError, &timeout);
+        std::vector<const ListenSocket*> vListenReady;
+        int64_t nWaitStart = GetTimeMicros();
+        int nEvents = hEpoll != -1 ? SocketWaitEpoll(vListenReady, fMoreWork) : SocketWaitSelect(vListenReady);
+        int64_t nWaitEnd = GetTimeMicros();
         boost::this_thread::interruption_point();
 
-        if (nSelect == SOCKET_ERROR)
-        {
-            if (have_fds)
-            {
-                int nErr = WSAGetLastError();
-                LogPrintf("socket select error %s\n", NetworkErrorString(nErr));
-                for (unsigned int i = 0; i <= hSocketMax; i++)
-                    FD_SET(i, &fdsetRecv);
-            }
-            FD_ZERO(&fdsetSend);
-            FD_ZERO(&fdsetError);
-            MilliSleep(timeout.tv_usec/1000);
-        }
-
         //
         // Accept new connections
         //
-        BOOST_FOREACH(const ListenSocket& hListenSocket, vhListenSocket)
+        BOOST_FOREACH(const ListenSocket* pListenSocket, vListenReady)
         {
-            if (hListenSocket.socket != INVALID_SOCKET && FD_ISSET(hListenSocket.socket, &fdsetRecv))
+            const ListenSocket& hListenSocket = *pListenSocket;
+            if (hListenSocket.socket != INVALID_SOCKET)
             {
                 struct sockaddr_storage sockaddr;
                 socklen_t len = sizeof(sockaddr);
@@ -934,6 +1146,10 @@ void ThreadSocketHandler()
             BOOST_FOREACH(CNode* pnode, vNodesCopy)
                 pnode->AddRef();
         }
+        fMoreWork = false;
+        int64_t nTime = GetTime();
+        bool fCheckInactivity = nTime != nLastInactivityCheck;
+        nLastInactivityCheck = nTime;
         BOOST_FOREACH(CNode* pnode, vNodesCopy)
         {
             boost::this_thread::interruption_point();
@@ -943,10 +1159,13 @@ void ThreadSocketHandler()
             //
             if (pnode->hSocket == INVALID_SOCKET)
                 continue;
-            if (FD_ISSET(pnode->hSocket, &fdsetRecv) || FD_ISSET(pnode->hSocket, &fdsetError))
+            bool fRecvFlood = false;
+            if (pnode->fPollRecv)
             {
                 TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
-                if (lockRecv)
+                if (lockRecv && hEpoll != -1 && !ShouldReceive(pnode))
+                    fRecvFlood = true;
+                else if (lockRecv && (hEpoll == -1 || pnode->nSendSize == 0))
                 {
                     {
                         // typical socket buffer is 8K-64K
@@ -959,6 +1178,9 @@ void ThreadSocketHandler()
                             pnode->nLastRecv = GetTime();
                             pnode->nRecvBytes += nBytes;
                             pnode->RecordBytesRecv(nBytes);
+                            // A full buffer may have left data in the socket
+                            if (nBytes < (int)sizeof(pchBuf))
+                                pnode->fPollRecv = false;
                         }
                         else if (nBytes == 0)
                         {
@@ -966,6 +1188,7 @@ void ThreadSocketHandler()
                             if (!pnode->fDisconnect)
                                 LogPrint("net", "socket closed\n");
                             pnode->CloseSocketDisconnect();
+                            pnode->fPollRecv = false;
                         }
                         else if (nBytes < 0)
                         {
@@ -977,6 +1200,8 @@ void ThreadSocketHandler()
                                     LogPrintf("socket recv error %s\n", NetworkErrorString(nErr));
                                 pnode->CloseSocketDisconnect();
                             }
+                            if (nErr != WSAEINTR)
+                                pnode->fPollRecv = false;
                         }
                     }
                 }
@@ -987,18 +1212,26 @@ void ThreadSocketHandler()
             //
             if (pnode->hSocket == INVALID_SOCKET)
                 continue;
-            if (FD_ISSET(pnode->hSocket, &fdsetSend))
+            if (pnode->fPollSend)
             {
                 TRY_LOCK(pnode->cs_vSend, lockSend);
                 if (lockSend)
+                {
+                    pnode->fPollSend = false;
                     SocketSendData(pnode);
+                }
             }
 
+            // Readiness that was not acted on is not reported again by an edge
+            // triggered event, so don't block in the next wait. A node held back
+            // by a full receive buffer is looked at again after the timeout.
+            if ((pnode->fPollRecv && !fRecvFlood && pnode->nSendSize == 0) || pnode->fPollSend)
+                fMoreWork = true;
+
             //
             // Inactivity checking
             //
-            int64_t nTime = GetTime();
-            if (nTime - pnode->nTimeConnected > 60)
+            if (fCheckInactivity && nTime - pnode->nTimeConnected > 60)
             {
                 if (pnode->nLastRecv == 0 || pnode->nLastSend == 0)
                 {
@@ -1027,6 +1260,17 @@ void ThreadSocketHandler()
             BOOST_FOREACH(CNode* pnode, vNodesCopy)
                 pnode->Release();
         }
+
+        int64_t nLoopEnd = GetTimeMicros();
+        {
+            LOCK(cs_socketLoopStats);
+            int64_t nServiceMicros = (nWaitStart - nLoopStart) + (nLoopEnd - nWaitEnd);
+            nSocketLoops++;
+            nSocketLoopEvents += nEvents;
+            nSocketLoopWaitMicros += nWaitEnd - nWaitStart;
+            nSocketLoopServiceMicros += nServiceMicros;
+            nSocketLoopServiceMaxMicros = std::max(nSocketLoopServiceMaxMicros, nServiceMicros);
+        }
     }
 }
 
@@ -1742,6 +1986,7 @@ void StartNode(boost::thread_group& threadGroup)
     MapPort(GetBoolArg("-upnp", DEFAULT_UPNP));
 
     // Send and receive from sockets, accept connections
+    PollStart();
     threadGroup.create_thread(boost::bind(&TraceThread<void (*)()>, "net", &ThreadSocketHandler));
 
     // Initiate outbound connections from -addnode
@@ -1759,8 +2004,8 @@ void StartNode(boost::thread_group& threadGroup)
     // Dump Banknodes 
     threadGroup.create_thread(boost::bind(&LoopForever<void (*)()>, "banknodedump", &DumpBanknodes, DUMP_BN_INTERVAL * 1000));
 
-    // Update Bids 
-    threadGroup.create_thread(boost::bind(&LoopForever<void (*)()>, "updatebids", &getbids, UPDATE_BID_INTERVAL * 1000));
+    // Refresh the bids and the bank metrics
+    threadGroup.create_thread(boost::bind(&TraceThread<void (*)()>, "bankmetrics", &ThreadBankMetrics));
 }
 
 bool StopNode()
@@ -1795,6 +2040,9 @@ public:
             if (hListenSocket.socket != INVALID_SOCKET)
                 if (!CloseSocket(hListenSocket.socket))
                     LogPrintf("CloseSocket(hListenSocket) failed with error %s\n", NetworkErrorString(WSAGetLastError()));
+        if (hEpoll != -1)
+            close(hEpoll);
+        hEpoll = -1;
 
         // clean up some globals (to help leak detection)
         BOOST_FOREACH(CNode *pnode, vNodes)
@@ -1808,6 +2056,7 @@ public:
         semOutbound = NULL;
         delete pnodeLocalHost;
         pnodeLocalHost = NULL;
+        netBufferPool.Clear();
 
 #ifdef WIN32
         // Shutdown Windows Sockets
@@ -2066,6 +2315,9 @@ CNode::CNode(SOCKET hSocketIn, CAddress addrIn, std::string addrNameIn, bool fIn
     nRefCount = 0;
     nSendSize = 0;
     nSendOffset = 0;
+    fPollSendInterest = false;
+    fPollRecv = false;
+    fPollSend = false;
     hashContinue = 0;
     nStartingHeight = -1;
     fGetAddr = false;
@@ -2089,6 +2341,9 @@ CNode::CNode(SOCKET hSocketIn, CAddress addrIn, std::string addrNameIn, bool fIn
     else
         LogPrint("net", "Added connection peer=%d\n", id);
 
+    if (hSocket != INVALID_SOCKET)
+        PollAddNode(this);
+
     // Be shy and don't send version until we hear
     if (hSocket != INVALID_SOCKET && !fInbound)
         PushVersion();
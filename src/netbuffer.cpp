@@ -0,0 +1,100 @@
+// Copyright (c) 2015 The Bitcredit Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "netbuffer.h"
+
+#include "tinyformat.h"
+
+#include <assert.h>
+
+// Most messages are inventory, transactions and pings; blocks take the largest class
+const size_t CNetBufferPool::CLASS_SIZE[CNetBufferPool::NUM_CLASSES] = { 1024, 16 * 1024, 256 * 1024, 2 * 1024 * 1024 };
+const unsigned int CNetBufferPool::CLASS_MAX_FREE[CNetBufferPool::NUM_CLASSES] = { 256, 64, 8, 2 };
+
+CNetBufferPool::CNetBufferPool() : nFreeBytes(0), nHits(0), nMisses(0), nOversize(0), nDropped(0)
+{
+    // Growing a free list must not copy the buffers it holds
+    for (unsigned int i = 0; i < NUM_CLASSES; i++)
+        vFree[i].reserve(CLASS_MAX_FREE[i]);
+}
+
+void CNetBufferPool::Acquire(CSerializeData& vch, size_t nSize)
+{
+    assert(vch.empty());
+
+    unsigned int nClass = 0;
+    while (nClass < NUM_CLASSES && CLASS_SIZE[nClass] < nSize)
+        nClass++;
+
+    {
+        LOCK(cs);
+        if (nClass == NUM_CLASSES)
+            nOversize++;
+        else if (!vFree[nClass].empty())
+        {
+            vch.swap(vFree[nClass].back());
+            vFree[nClass].pop_back();
+            nFreeBytes -= vch.capacity();
+            nHits++;
+            return;
+        }
+        else
+            nMisses++;
+    }
+    vch.reserve(nClass == NUM_CLASSES ? nSize : CLASS_SIZE[nClass]);
+}
+
+void CNetBufferPool::Release(CSerializeData& vch)
+{
+    size_t nCapacity = vch.capacity();
+    if (nCapacity == 0)
+        return;
+
+    // Largest class the buffer can serve, buffers far above it are not kept
+    int nClass = NUM_CLASSES - 1;
+    while (nClass >= 0 && CLASS_SIZE[nClass] > nCapacity)
+        nClass--;
+
+    {
+        LOCK(cs);
+        if (nClass >= 0 && nCapacity < 2 * CLASS_SIZE[nClass] && vFree[nClass].size() < CLASS_MAX_FREE[nClass])
+        {
+            vch.clear();
+            vFree[nClass].push_back(CSerializeData());
+            vFree[nClass].back().swap(vch);
+            nFreeBytes += nCapacity;
+            return;
+        }
+        nDropped++;
+    }
+    CSerializeData().swap(vch);
+}
+
+void CNetBufferPool::Clear()
+{
+    std::vector<CSerializeData> vDelete[NUM_CLASSES];
+    {
+        LOCK(cs);
+        for (unsigned int i = 0; i < NUM_CLASSES; i++)
+        {
+            vDelete[i].swap(vFree[i]);
+            vFree[i].reserve(CLASS_MAX_FREE[i]);
+        }
+        nFreeBytes = 0;
+    }
+}
+
+void CNetBufferPool::GetStats(std::map<std::string, size_t>& mapResults) const
+{
+    LOCK(cs);
+    uint64_t nRequests = nHits + nMisses + nOversize;
+    mapResults["netbuffer.hits"] = nHits;
+    mapResults["netbuffer.misses"] = nMisses;
+    mapResults["netbuffer.oversize"] = nOversize;
+    mapResults["netbuffer.dropped"] = nDropped;
+    mapResults["netbuffer.hit_rate_pct"] = nRequests > 0 ? nHits * 100 / nRequests : 0;
+    mapResults["netbuffer.free_bytes"] = nFreeBytes;
+    for (unsigned int i = 0; i < NUM_CLASSES; i++)
+        mapResults[strprintf("netbuffer.free.%u", CLASS_SIZE[i])] = vFree[i].size();
+}
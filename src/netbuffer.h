@@ -0,0 +1,58 @@
+// Copyright (c) 2015 The Bitcredit Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCREDIT_NETBUFFER_H
+#define BITCREDIT_NETBUFFER_H
+
+#include "allocators.h"
+#include "sync.h"
+
+#include <map>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+/**
+ * Free lists of message receive buffers in a few size classes.
+ *
+ * A buffer taken from the pool has the capacity of the smallest class that
+ * fits the requested size, so a message is received without reallocating
+ * while it grows, and a buffer given back is kept for the next message of
+ * that class instead of being freed. Each class keeps a bounded number of
+ * buffers; requests above the largest class are allocated and freed as
+ * usual.
+ */
+class CNetBufferPool
+{
+public:
+    static const unsigned int NUM_CLASSES = 4;
+    static const size_t CLASS_SIZE[NUM_CLASSES];
+    static const unsigned int CLASS_MAX_FREE[NUM_CLASSES];
+
+    CNetBufferPool();
+
+    //! Give vch, which must be empty, the capacity for at least nSize bytes
+    void Acquire(CSerializeData& vch, size_t nSize);
+    //! Take back the storage of vch, leaving it empty
+    void Release(CSerializeData& vch);
+    //! Free all buffers that are kept
+    void Clear();
+
+    void GetStats(std::map<std::string, size_t>& mapResults) const;
+
+private:
+    mutable CCriticalSection cs;
+    std::vector<CSerializeData> vFree[NUM_CLASSES];
+    size_t nFreeBytes;
+    uint64_t nHits;
+    uint64_t nMisses;
+    uint64_t nOversize;
+    uint64_t nDropped;
+
+    CNetBufferPool(const CNetBufferPool&);
+    CNetBufferPool& operator=(const CNetBufferPool&);
+};
+
+#endif // BITCREDIT_NETBUFFER_H
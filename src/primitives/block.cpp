@@ -8,8 +8,11 @@
 #include "hash.h"
 #include "tinyformat.h"
 #include "momentum.h"
+#include "util.h"
 #include "utilstrencodings.h"
 
+#include <algorithm>
+
 uint256 CBlockHeader::GetHash() const
 {
     return Hash(BEGIN(nVersion), END(nBirthdayB));
@@ -22,22 +25,25 @@ uint256 CBlock::GetMidHash() const
 
 uint256 CBlock::GetVerifiedHash() const
 {
- 
- 	uint256 midHash = GetMidHash();
- 		    	
-	uint256 r = Hash(BEGIN(nVersion), END(nBirthdayB));
-
- 	if(!bts::momentum_verify( midHash, nBirthdayA, nBirthdayB)){
- 		return uint256("0xffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffeeee");
- 	}
-   
-     return r;
+    static bts::CMomentumCache momentumCache(std::max(GetArg("-maxpowcachesize", bts::DEFAULT_MAX_POW_CACHE_SIZE), (int64_t)0));
+
+    uint256 r = Hash(BEGIN(nVersion), END(nBirthdayB));
+    if (momentumCache.Get(r))
+        return r;
+
+    uint256 midHash = GetMidHash();
+    if(!bts::momentum_verify( midHash, nBirthdayA, nBirthdayB)){
+        return uint256("0xffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffeeee");
+    }
+
+    momentumCache.Set(r);
+    return r;
 }
  
-uint256 CBlock::CalculateBestBirthdayHash() {
+uint256 CBlock::CalculateBestBirthdayHash(int nThreads) {
  				
 	uint256 midHash = GetMidHash();		
-	std::vector< std::pair<uint32_t,uint32_t> > results =bts::momentum_search( midHash );
+	std::vector< std::pair<uint32_t,uint32_t> > results =bts::momentum_search( midHash, nThreads );
 	uint32_t candidateBirthdayA=0;
 	uint32_t candidateBirthdayB=0;
 	uint256 smallestHashSoFar("0xfffffffffffffffffffffffffffffffffffffffffffffffffffffffffffdddd");
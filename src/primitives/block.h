@@ -139,7 +139,7 @@ public:
 	
     uint256 GetVerifiedHash() const;
 
-    uint256 CalculateBestBirthdayHash();
+    uint256 CalculateBestBirthdayHash(int nThreads = 1);
 
     uint256 GetMidHash() const;
     
@@ -6,25 +6,141 @@
 
 #include "eccryptoverify.h"
 
-#ifdef USE_SECP256K1
 #include <secp256k1.h>
-#else
-#include "ecwrapper.h"
-#endif
+
+//! anonymous namespace
+namespace {
+
+class CSecp256k1VerifyInit {
+public:
+    CSecp256k1VerifyInit() {
+        secp256k1_start(SECP256K1_START_VERIFY);
+    }
+    ~CSecp256k1VerifyInit() {
+        secp256k1_stop();
+    }
+};
+static CSecp256k1VerifyInit instance_of_csecp256k1verifyinit;
+
+/** Read a BER length in short or long form, fIndefinite is set for the indefinite form */
+bool ReadSigLength(const unsigned char* sig, size_t nEnd, size_t& nPos, size_t& nLen, bool& fIndefinite)
+{
+    fIndefinite = false;
+    if (nPos >= nEnd)
+        return false;
+    unsigned char c = sig[nPos++];
+    if (c < 0x80) {
+        nLen = c;
+        return true;
+    }
+    size_t nBytes = c & 0x7f;
+    if (nBytes == 0) {
+        fIndefinite = true;
+        nLen = 0;
+        return true;
+    }
+    if (nBytes > nEnd - nPos)
+        return false;
+    nLen = 0;
+    while (nBytes-- > 0) {
+        if (nLen > nEnd)
+            return false;
+        nLen = (nLen << 8) | sig[nPos++];
+    }
+    return true;
+}
+
+/**
+ * Read an INTEGER as a 32 byte big endian number. A negative one is refused:
+ * OpenSSL decodes it as negative, and its verification rejects it.
+ */
+bool ReadSigInteger(const unsigned char* sig, size_t nEnd, size_t& nPos, unsigned char out[32])
+{
+    size_t nLen;
+    bool fIndefinite;
+    if (nPos >= nEnd || sig[nPos++] != 0x02)
+        return false;
+    if (!ReadSigLength(sig, nEnd, nPos, nLen, fIndefinite) || fIndefinite || nLen == 0 || nLen > nEnd - nPos)
+        return false;
+    const unsigned char* p = sig + nPos;
+    nPos += nLen;
+    if (p[0] & 0x80)
+        return false;
+    while (nLen > 0 && p[0] == 0) {
+        p++;
+        nLen--;
+    }
+    if (nLen > 32)
+        return false;
+    memset(out, 0, 32);
+    memcpy(out + 32 - nLen, p, nLen);
+    return true;
+}
+
+void WriteSigInteger(std::vector<unsigned char>& vchDER, const unsigned char in[32])
+{
+    const unsigned char* p = in;
+    size_t nLen = 32;
+    while (nLen > 1 && p[0] == 0) {
+        p++;
+        nLen--;
+    }
+    bool fPad = (p[0] & 0x80) != 0;
+    vchDER.push_back(0x02);
+    vchDER.push_back(nLen + fPad);
+    if (fPad)
+        vchDER.push_back(0x00);
+    vchDER.insert(vchDER.end(), p, p + nLen);
+}
+
+/**
+ * Re-encode a signature as strict DER. Signatures in blocks are not required
+ * to be DER, and were verified by OpenSSL, which decodes them as BER: long
+ * form and indefinite lengths, excess padding and data after the signature
+ * are all accepted. They are accepted here the same way, so libsecp256k1
+ * takes the signatures OpenSSL took. A negative R or S is rejected, as
+ * OpenSSL's verification rejects it.
+ */
+bool NormalizeSignature(const std::vector<unsigned char>& vchSig, std::vector<unsigned char>& vchDER)
+{
+    if (vchSig.empty() || vchSig[0] != 0x30)
+        return false;
+    const unsigned char* sig = &vchSig[0];
+    size_t nPos = 1, nLen, nEnd = vchSig.size();
+    bool fIndefinite;
+    if (!ReadSigLength(sig, nEnd, nPos, nLen, fIndefinite))
+        return false;
+    if (!fIndefinite) {
+        if (nLen > nEnd - nPos)
+            return false;
+        nEnd = nPos + nLen;
+    }
+    unsigned char r[32], s[32];
+    if (!ReadSigInteger(sig, nEnd, nPos, r) || !ReadSigInteger(sig, nEnd, nPos, s))
+        return false;
+    // The contents end with the sequence, or with an end-of-contents marker
+    if (fIndefinite ? (nEnd - nPos < 2 || sig[nPos] != 0 || sig[nPos + 1] != 0) : nPos != nEnd)
+        return false;
+
+    vchDER.clear();
+    vchDER.push_back(0x30);
+    vchDER.push_back(0);
+    WriteSigInteger(vchDER, r);
+    WriteSigInteger(vchDER, s);
+    vchDER[1] = vchDER.size() - 2;
+    return true;
+}
+
+} // anon namespace
 
 bool CPubKey::Verify(const uint256 &hash, const std::vector<unsigned char>& vchSig) const {
     if (!IsValid())
         return false;
-#ifdef USE_SECP256K1
-    if (secp256k1_ecdsa_verify((const unsigned char*)&hash, &vchSig[0], vchSig.size(), begin(), size()) != 1)
+    std::vector<unsigned char> vchDER;
+    if (!NormalizeSignature(vchSig, vchDER))
         return false;
-#else
-    CECKey key;
-    if (!key.SetPubKey(begin(), size()))
+    if (secp256k1_ecdsa_verify((const unsigned char*)&hash, &vchDER[0], vchDER.size(), begin(), size()) != 1)
         return false;
-    if (!key.Verify(hash, vchSig))
-        return false;
-#endif
     return true;
 }
 
@@ -33,52 +149,28 @@ bool CPubKey::RecoverCompact(const uint256 &hash, const std::vector<unsigned cha
         return false;
     int recid = (vchSig[0] - 27) & 3;
     bool fComp = ((vchSig[0] - 27) & 4) != 0;
-#ifdef USE_SECP256K1
     int pubkeylen = 65;
     if (!secp256k1_ecdsa_recover_compact((const unsigned char*)&hash, &vchSig[1], (unsigned char*)begin(), &pubkeylen, fComp, recid))
         return false;
     assert((int)size() == pubkeylen);
-#else
-    CECKey key;
-    if (!key.Recover(hash, &vchSig[1], recid))
-        return false;
-    std::vector<unsigned char> pubkey;
-    key.GetPubKey(pubkey, fComp);
-    Set(pubkey.begin(), pubkey.end());
-#endif
     return true;
 }
 
 bool CPubKey::IsFullyValid() const {
     if (!IsValid())
         return false;
-#ifdef USE_SECP256K1
     if (!secp256k1_ec_pubkey_verify(begin(), size()))
         return false;
-#else
-    CECKey key;
-    if (!key.SetPubKey(begin(), size()))
-        return false;
-#endif
     return true;
 }
 
 bool CPubKey::Decompress() {
     if (!IsValid())
         return false;
-#ifdef USE_SECP256K1
     int clen = size();
-    int ret = secp256k1_ec_pubkey_decompress((unsigned char*)begin(), &clen);
-    assert(ret);
+    if (!secp256k1_ec_pubkey_decompress((unsigned char*)begin(), &clen))
+        return false;
     assert(clen == (int)size());
-#else
-    CECKey key;
-    if (!key.SetPubKey(begin(), size()))
-        return false;
-    std::vector<unsigned char> pubkey;
-    key.GetPubKey(pubkey, false);
-    Set(pubkey.begin(), pubkey.end());
-#endif
     return true;
 }
 
@@ -89,17 +181,8 @@ bool CPubKey::Derive(CPubKey& pubkeyChild, unsigned char ccChild[32], unsigned i
     unsigned char out[64];
     BIP32Hash(cc, nChild, *begin(), begin()+1, out);
     memcpy(ccChild, out+32, 32);
-#ifdef USE_SECP256K1
     pubkeyChild = *this;
     bool ret = secp256k1_ec_pubkey_tweak_add((unsigned char*)pubkeyChild.begin(), pubkeyChild.size(), out);
-#else
-    CECKey key;
-    bool ret = key.SetPubKey(begin(), size());
-    ret &= key.TweakPublic(out);
-    std::vector<unsigned char> pubkey;
-    key.GetPubKey(pubkey, true);
-    pubkeyChild.Set(pubkey.begin(), pubkey.end());
-#endif
     return ret;
 }
 
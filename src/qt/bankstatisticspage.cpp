@@ -37,8 +37,8 @@ void BankStatisticsPage::updateStatistics()
 {
 	Bankmath st;
 	Rawdata my;
+	boost::shared_ptr<const CBankMetrics> metrics = GetBankMetrics();
 	
-	Bidtracker r;
     double mincreditscore =  st.Getmincreditscore();
     double avecreditscore = st.Getavecreditscore();
     double mintrust = st.Getmintrust();
@@ -50,10 +50,10 @@ void BankStatisticsPage::updateStatistics()
     double netinterestrate = st.Getnetinterestrate();
     double trust = st.Gettrust();
     double assetstotal = my.credit();
-    int nHeight = (chainActive.Tip()->nHeight);
-    int64_t totalnumtx = my.totalnumtx();
-    double bcrprice = r.bcrbtc();
-    double btcprice = r.usdbtc();
+    int nHeight = metrics->nHeight;
+    int64_t totalnumtx = metrics->nChainTx;
+    double bcrprice = metrics->market.bcrbtc;
+    double btcprice = metrics->market.usdbtc;
     double gblmoneysupply = my.Getgblmoneysupply();
     double marketcap =  assetstotal - ((bcrprice*my._bcrreserves()) *btcprice);
     double btcstash = my.reserves();
@@ -10,102 +10,143 @@
 #include "coins.h"
 #include "rpcserver.h"
 
-std::string ltcbidsurl = "http://ltc.blockr.io/api/v1/address/balance/Lc7ebfQPz6VJ8qmXYaaFxBYLpDz2XsDu7c";
-std::string bcrreservesurl ="http://chainz.cryptoid.info/bcr/api.dws?q=getbalance&a=5qH4yHaaaRuX1qKCZdUHXNJdesssNQcUct";
-std::string btcbidsurl ="https://blockchain.info/q/addressbalance/16f5dJd4EHRrQwGGRMczA69qbJYs4msBQ5";
-std::string dashbidsurl ="http://chainz.cryptoid.info/dash/api.dws?q=getbalance&a=Xypcx2iE8rCtC3tjw5M8sxpRzn4JuoSaBH";
-std::string ltcreservesurl = "http://ltc.blockr.io/api/v1/address/balance/35QTtUaMeSNbpKK6A4d4zTygR9s53jqNTH";
-std::string btcreservesurl = "https://blockchain.info/q/addressbalance/3AsVTW5W5NL8bx1twwR7TabFAYGKstizjt";
-std::string dashreservesurl = "http://chainz.cryptoid.info/dash/api.dws?q=getbalance&a=7dQpZMWfjKEwNNRCeRG2KkYw98b63PNKGZ"; 
-Bidtracker r;
+/** Bank metrics of the last refresh */
+static CCriticalSection cs_bankmetrics;
+static boost::shared_ptr<const CBankMetrics> pbankmetrics(new CBankMetrics());
 
-double Rawdata::_btcbids()
+boost::shared_ptr<const CBankMetrics> GetBankMetrics()
 {
-	
-double btcbids= r.getbalance(btcbidsurl, 0);	
-	
- return btcbids; 	
+	LOCK(cs_bankmetrics);
+	return pbankmetrics;
 }
 
-double Rawdata::_ltcbids(){
-
-double ltcbids= r.getbalance(ltcbidsurl, 0);
+void UpdateBankMetrics()
+{
+	static CBidFetcher fetcher;
+	// Time of the last refresh attempt, so sources that are down are not
+	// retried on every metrics refresh
+	static int64_t nMarketAttemptTime = 0;
+	CBankMetrics metrics(*GetBankMetrics());
+
+	// Bids and market data are refreshed together, all their requests
+	// sharing the connections of one fetcher
+	if (GetTime() - nMarketAttemptTime >= MARKET_DATA_INTERVAL)
+	{
+		int64_t nStart = GetTimeMillis();
+		nMarketAttemptTime = GetTime();
+		getbids(fetcher);
+		if (FetchMarketData(fetcher, metrics.market))
+			metrics.nMarketTime = GetTime();
+		LogPrint("net", "UpdateBankMetrics : market data refreshed in %dms\n", GetTimeMillis() - nStart);
+	}
+
+	{
+		LOCK(cs_main);
+		metrics.nHeight = chainActive.Height();
+		metrics.nChainTx = chainActive.Tip() ? chainActive.Tip()->nChainTx : 0;
+		CCoinsStats stats;
+		if (pcoinsTip->GetStats(stats))
+			metrics.nMoneySupply = stats.nTotalAmount/COIN;
+	}
+
+	if (pwalletMain)
+	{
+		{
+			LOCK(pwalletMain->cs_wallet);
+			metrics.nWalletTx = pwalletMain->mapWallet.size();
+		}
+		metrics.nWalletBalance = pwalletMain->GetBalance()/COIN;
+		metrics.nWalletCreated = pwalletMain->GetOldestKeyPoolTime();
+	}
 
-return ltcbids;
+	LOCK(cs_bankmetrics);
+	metrics.nVersion = pbankmetrics->nVersion + 1;
+	pbankmetrics.reset(new CBankMetrics(metrics));
 }
 
-double Rawdata::_dashbids(){
+void ThreadBankMetrics()
+{
+	while (true)
+	{
+		UpdateBankMetrics();
+		MilliSleep(BANK_METRICS_INTERVAL * 1000);
+	}
+}
 
-double dashbids= r.getbalance(btcbidsurl, 0);	
+double Rawdata::_btcbids()
+{
+	return GetBankMetrics()->market.btcbids;
+}
 
-return dashbids;	
+double Rawdata::_ltcbids()
+{
+	return GetBankMetrics()->market.ltcbids;
 }
 
-double Rawdata::_bcrreserves(){
-	
-double bcrreserves= r.getbalance(bcrreservesurl, 0);	
+double Rawdata::_dashbids()
+{
+	return GetBankMetrics()->market.dashbids;
+}
 
-return bcrreserves; 	
+double Rawdata::_bcrreserves()
+{
+	return GetBankMetrics()->market.bcrreserves;
 }
 
 double Rawdata::_btcreserves()
-{ 
-
-double btcreserves= r.getbalance(btcreservesurl, 0);	
-
-return btcreserves;	
+{
+	return GetBankMetrics()->market.btcreserves;
 }
 
-double Rawdata::_ltcreserves(){
-	
-double ltcreserves= r.getbalance(ltcreservesurl, 0);
-
-return ltcreserves;
+double Rawdata::_ltcreserves()
+{
+	return GetBankMetrics()->market.ltcreserves;
 }
 
-
-double Rawdata::_dashreserves(){
-	
-double dashreserves= r.getbalance(dashreservesurl, 0);
-
-return dashreserves;
+double Rawdata::_dashreserves()
+{
+	return GetBankMetrics()->market.dashreserves;
 }
 
 double Rawdata::credit(){
 	   
-	double x = _bcrreserves() * r.bcrbtc();
-	double y = _ltcreserves() * r.ltcbtc();
-	double z = _dashreserves() * r.dashbtc();
-	double m =(_btcreserves())/COIN;
-	double l = x + y + z + m;
-	l*=r.usdbtc();
+	boost::shared_ptr<const CBankMetrics> metrics = GetBankMetrics();
+	const CMarketData& m = metrics->market;
+	double x = m.bcrreserves * m.bcrbtc;
+	double y = m.ltcreserves * m.ltcbtc;
+	double z = m.dashreserves * m.dashbtc;
+	double b = m.btcreserves/COIN;
+	double l = x + y + z + b;
+	l*=m.usdbtc;
 
 	return l;
 }
 
 double Rawdata::reserves(){
 	   
-	double x = _bcrreserves() * r.bcrbtc();
-	double y = _ltcreserves() * r.ltcbtc();
-	double z = _dashreserves() * r.dashbtc();
-	double m =(_btcreserves())/COIN;
-	double l = x + y + z + m;
+	boost::shared_ptr<const CBankMetrics> metrics = GetBankMetrics();
+	const CMarketData& m = metrics->market;
+	double x = m.bcrreserves * m.bcrbtc;
+	double y = m.ltcreserves * m.ltcbtc;
+	double z = m.dashreserves * m.dashbtc;
+	double b = m.btcreserves/COIN;
+	double l = x + y + z + b;
 	
 	return l;
 }
 
 double Rawdata::newcredit()
 {
- return ((_btcbids()/COIN) * r.usdbtc()) + ((_ltcbids() * r.ltcbtc())*r.usdbtc()) + ((_dashbids() * r.dashbtc())*r.usdbtc());	
+	boost::shared_ptr<const CBankMetrics> metrics = GetBankMetrics();
+	const CMarketData& m = metrics->market;
+	return ((m.btcbids/COIN) * m.usdbtc) + ((m.ltcbids * m.ltcbtc)*m.usdbtc) + ((m.dashbids * m.dashbtc)*m.usdbtc);
 }
 
 double Rawdata::totalbids(){
 	
-return (_btcbids()/100000000) + (_ltcbids() * r.ltcbtc()) + (_dashbids() * r.dashbtc());
-
-cout<< "BTC"<<_btcbids()/COIN << endl;
-cout<< "LTC"<<_ltcbids() * r.ltcbtc() << endl;
-cout<< "DASH"<<_dashbids() * r.dashbtc() << endl;
+	boost::shared_ptr<const CBankMetrics> metrics = GetBankMetrics();
+	const CMarketData& m = metrics->market;
+	return (m.btcbids/100000000) + (m.ltcbids * m.ltcbtc) + (m.dashbids * m.dashbtc);
 }
 
 double Rawdata::totalcredit(){
@@ -125,7 +166,7 @@ int oneyear = onemonth *12;
 
 int Rawdata::totalnumtx()  //total number of chain transactions
 {
-	int ttnmtx = chainActive.Tip()->nChainTx;
+	int ttnmtx = GetBankMetrics()->nChainTx;
 
 	return ttnmtx;
 } 
@@ -147,7 +188,7 @@ int Rawdata::outgoingtx()  //total number of outgoing transactions
 int Rawdata::getNumTransactions() const //number of wallet transactions
 {
 	//total number of transactions for the account
-	int numTransactions = pwalletMain->mapWallet.size();
+	int numTransactions = GetBankMetrics()->nWalletTx;
 		return numTransactions; 
 }
 
@@ -160,12 +201,15 @@ bool Rawdata::verifynumtx ()
 
 int Rawdata::netheight ()
 {
-	return chainActive.Height();
+	return GetBankMetrics()->nHeight;
 }
 
 double Rawdata::networktxpart() //wallet's network participation
 {
-	double netpart = pwalletMain->mapWallet.size()/chainActive.Tip()->nChainTx;
+	boost::shared_ptr<const CBankMetrics> metrics = GetBankMetrics();
+	if (metrics->nChainTx == 0)
+		return 0;
+	double netpart = metrics->nWalletTx/metrics->nChainTx;
 
 	return netpart;
 	
@@ -173,7 +217,7 @@ double Rawdata::networktxpart() //wallet's network participation
 
 double Rawdata::lifetime() //wallet's lifetime 
 {
-	int creationdate  = pwalletMain->GetOldestKeyPoolTime();
+	int creationdate  = GetBankMetrics()->nWalletCreated;
 	int lifespan = (GetTime() - creationdate);
     
 	return lifespan;
@@ -188,28 +232,19 @@ int Rawdata::gbllifetime() //blockchain lifetime in days
 
 int64_t Rawdata::balance() 
 {
-	int64_t bal = pwalletMain->GetBalance()/COIN;
+	int64_t bal = GetBankMetrics()->nWalletBalance;
 
 	return bal;
 }
 	
 CAmount Rawdata::Getgblmoneysupply()
 {
-		CCoinsStats ss;
-		FlushStateToDisk();
-		
-		if (pcoinsTip->GetStats(ss)) 
-		{
-		CAmount x =ss.nTotalAmount/COIN;
-		return x;
-		}
-		return 0;
-	
+	return GetBankMetrics()->nMoneySupply;
 }
 
 CAmount Rawdata::Getgrantstotal()
 {
-	int blocks = chainActive.Height() - 210000;
+	int blocks = GetBankMetrics()->nHeight - 210000;
 	int totalgr = blocks * 10;
 	return totalgr;  
 }
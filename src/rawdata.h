@@ -13,6 +13,46 @@
 
 using namespace std;
 
+/** Seconds between refreshes of the bank metrics */
+static const int BANK_METRICS_INTERVAL = 60;
+/** Seconds between refreshes of the bids and market data, done on a metrics refresh */
+static const int MARKET_DATA_INTERVAL = 600;
+
+/**
+ * Everything the bank statistics are computed from: the bids and market data
+ * of other chains and exchanges, and totals of the chain and the wallet. All
+ * of it is refreshed by one background thread; readers get the latest
+ * snapshot, which is not modified once published, instead of fetching on
+ * every call.
+ */
+class CBankMetrics
+{
+public:
+    uint64_t nVersion;
+    //! Time of the last successful market data refresh, 0 if there was none
+    int64_t nMarketTime;
+    CMarketData market;
+    int nHeight;
+    int64_t nChainTx;
+    //! Coins in the unspent transaction output set, in whole coins
+    CAmount nMoneySupply;
+    int64_t nWalletTx;
+    //! Wallet balance in whole coins
+    CAmount nWalletBalance;
+    int64_t nWalletCreated;
+
+    CBankMetrics() : nVersion(0), nMarketTime(0), nHeight(0), nChainTx(0), nMoneySupply(0),
+        nWalletTx(0), nWalletBalance(0), nWalletCreated(0) {}
+};
+
+/** Refresh the chain and wallet totals, and the bids and market data when due */
+void UpdateBankMetrics();
+/** Refresh the bank metrics every BANK_METRICS_INTERVAL seconds */
+void ThreadBankMetrics();
+/** The latest bank metrics, never NULL */
+boost::shared_ptr<const CBankMetrics> GetBankMetrics();
+
+/** Bank statistics inputs, read from the latest bank metrics */
 class Rawdata 
 {
   public:
@@ -126,7 +126,7 @@ Value banknode(const Array& params, bool fHelp)
 
     if (fHelp  ||
         (strCommand != "start" && strCommand != "start-alias" && strCommand != "start-many" && strCommand != "stop" && strCommand != "stop-alias" && strCommand != "stop-many" && strCommand != "list" && strCommand != "list-conf" && strCommand != "count"  && strCommand != "enforce"
-            && strCommand != "debug" && strCommand != "current" && strCommand != "winners" && strCommand != "genkey" && strCommand != "connect" && strCommand != "outputs" && strCommand != "vote-many" && strCommand != "vote"))
+            && strCommand != "debug" && strCommand != "current" && strCommand != "winners" && strCommand != "genkey" && strCommand != "connect" && strCommand != "outputs" && strCommand != "vote-many" && strCommand != "vote" && strCommand != "stats"))
         throw runtime_error(
                 "banknode \"command\"... ( \"passphrase\" )\n"
                 "Set of commands to execute banknode related actions\n"
@@ -140,6 +140,7 @@ Value banknode(const Array& params, bool fHelp)
                 "  genkey       - Generate new banknodeprivkey\n"
                 "  enforce      - Enforce banknode payments\n"
                 "  outputs      - Print banknode compatible outputs\n"
+                "  stats        - Print banknode cache statistics\n"
                 "  start        - Start banknode configured in dash.conf\n"
                 "  start-alias  - Start single banknode by assigned alias configured in banknode.conf\n"
                 "  start-many   - Start all banknodes configured in banknode.conf\n"
@@ -482,6 +483,17 @@ Value banknode(const Array& params, bool fHelp)
         }
     }
 
+    if (strCommand == "stats")
+    {
+        uint64_t nHits, nMisses;
+        GetBlockHashStats(nHits, nMisses);
+
+        Object obj;
+        obj.push_back(Pair("blockhash_hits",   nHits));
+        obj.push_back(Pair("blockhash_misses", nMisses));
+        return obj;
+    }
+
     if (strCommand == "create")
     {
 
@@ -4,6 +4,7 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "amount.h"
+#include "bidtracker.h"
 #include "chainparams.h"
 #include "core_io.h"
 #include "init.h"
@@ -679,7 +680,8 @@ Value getblocktemplate(const Array& params, bool fHelp)
     static CBlockTemplate* pblocktemplate;
 
     if (pindexPrev != chainActive.Tip() ||
-        (mempool.GetTransactionsUpdated() != nTransactionsUpdatedLast && GetTime() - nStart > 5))
+        (mempool.GetTransactionsUpdated() != nTransactionsUpdatedLast && GetTime() - nStart > 5) ||
+        getbidtracker()->nVersion != pblocktemplate->nBidsVersion)
     {
         // Clear pindexPrev so future calls make a new block, despite any failures from here on
         pindexPrev = NULL;
@@ -195,9 +195,8 @@ Value getbids(const Array& params, bool fHelp)
     if (fHelp || params.size() != 0)
         throw runtime_error(
             "getbids\n"
-            "Returns an object containing information about existing real-time bids\n"
-            "This should be used for debugging/confirmation purposes only; this is a resource intensive\n"
-            "operation and may slow down wallet operation, especially on slow internet connections.\n"
+            "Returns an object containing information about existing real-time bids,\n"
+            "as aggregated by the last bid refresh.\n"
             "Warning, Result is an object with Pubkey hashes depicting originating address\n"
             "for the corresponding receiving addresses, use \"getblocktemplate\".\n"
             "\nExamples:\n"
@@ -206,22 +205,9 @@ Value getbids(const Array& params, bool fHelp)
         );
 
 	Object oBids;
-	ifstream myfile ((GetDataDir()/ "bidtracker/final.dat").string().c_str());
-
-	std::string line;
-	if (myfile.is_open()){
-		int i=1;
-		while ( myfile.good() ){
-			getline (myfile,line);
-			if (line.empty()) continue;
-            std::vector<std::string> strs;
-            boost::split(strs, line, boost::is_any_of(","));
-			oBids.push_back(Pair((strs[0].c_str()),strs[1].c_str()));
-
-			i++;
-	}
-	}
-	myfile.close();
+	boost::shared_ptr<const CBidSnapshot> bids = getbidtracker();
+	for (std::map<std::string,int>::const_iterator it = bids->mapBids.begin(); it != bids->mapBids.end(); ++it)
+		oBids.push_back(Pair(it->first, strprintf("%d", it->second)));
     return oBids;
 }
 
@@ -107,9 +107,11 @@ void TxToJSON(const CTransaction& tx, const uint256 hashBlock, Object& entry)
 
 Value searchrawtransactions(const Array &params, bool fHelp)
 {
-    if (fHelp || params.size() < 1 || params.size() > 4)
+    if (fHelp || params.size() < 1 || params.size() > 6)
         throw runtime_error(
-            "searchrawtransactions <address> [verbose=1] [skip=0] [count=100]\n");
+            "searchrawtransactions <address> [verbose=1] [skip=0] [count=100] [minheight=0] [maxheight=-1]\n"
+            "\nReturn the transactions involving an address, ordered by height.\n"
+            "A negative skip counts from the most recent transaction; maxheight -1 means no limit.\n");
 
     if (!fAddrIndex)
         throw JSONRPCError(RPC_MISC_ERROR, "Address index not enabled");
@@ -119,12 +121,10 @@ Value searchrawtransactions(const Array &params, bool fHelp)
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid Bitcredit address");
     CTxDestination dest = address.Get();
 
-    std::set<CExtDiskTxPos> setpos;
-    if (!FindTransactionsByDestination(dest, setpos))
-        throw JSONRPCError(RPC_DATABASE_ERROR, "Cannot search for address");
-
     int nSkip = 0;
     int nCount = 100;
+    int nMinHeight = 0;
+    int nMaxHeight = -1;
     bool fVerbose = true;
     if (params.size() > 1)
         fVerbose = (params[1].get_int() != 0);
@@ -132,22 +132,41 @@ Value searchrawtransactions(const Array &params, bool fHelp)
         nSkip = params[2].get_int();
     if (params.size() > 3)
         nCount = params[3].get_int();
+    if (params.size() > 4)
+        nMinHeight = params[4].get_int();
+    if (params.size() > 5)
+        nMaxHeight = params[5].get_int();
 
-    if (nSkip < 0)
-        nSkip += setpos.size();
-    if (nSkip < 0)
-        nSkip = 0;
     if (nCount < 0)
         nCount = 0;
-
-    std::set<CExtDiskTxPos>::const_iterator it = setpos.begin();
-    while (it != setpos.end() && nSkip--) it++;
+    unsigned int nMin = std::max(nMinHeight, 0);
+    unsigned int nMax = nMaxHeight < 0 ? std::numeric_limits<unsigned int>::max() : nMaxHeight;
+
+    std::vector<CExtDiskTxPos> vpos;
+    bool fFromOldest = nSkip >= 0;
+    if (!fFromOldest) {
+        // Page backwards from the most recent entry; with fewer than -nSkip
+        // entries in total, start at the oldest one instead
+        size_t nWant = std::min(nCount, -nSkip);
+        if (!FindTransactionsByDestination(dest, vpos, nMin, nMax, -nSkip - nWant, nWant, true))
+            throw JSONRPCError(RPC_DATABASE_ERROR, "Cannot search for address");
+        std::reverse(vpos.begin(), vpos.end());
+        if (vpos.size() < nWant) {
+            vpos.clear();
+            nSkip = 0;
+            fFromOldest = true;
+        }
+    }
+    if (fFromOldest) {
+        if (!FindTransactionsByDestination(dest, vpos, nMin, nMax, nSkip, nCount, false))
+            throw JSONRPCError(RPC_DATABASE_ERROR, "Cannot search for address");
+    }
 
     Array result;
-    while (it != setpos.end() && nCount--) {
+    BOOST_FOREACH(const CExtDiskTxPos &pos, vpos) {
         CTransaction tx;
         uint256 hashBlock;
-        if (!ReadTransaction(tx, *it, hashBlock))
+        if (!ReadTransaction(tx, pos, hashBlock))
             throw JSONRPCError(RPC_DESERIALIZATION_ERROR, "Cannot read transaction from disk");
         CDataStream ssTx(SER_NETWORK, PROTOCOL_VERSION);
         ssTx << tx;
@@ -160,7 +179,6 @@ Value searchrawtransactions(const Array &params, bool fHelp)
         } else {
             result.push_back(strHex);
         }
-        it++;
     }
     return result;
 }
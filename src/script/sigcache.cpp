@@ -5,86 +5,162 @@
 
 #include "sigcache.h"
 
+#include "crypto/sha256.h"
 #include "pubkey.h"
 #include "random.h"
 #include "uint256.h"
 #include "util.h"
 
-#include <boost/thread.hpp>
-#include <boost/tuple/tuple_comparison.hpp>
+#include <algorithm>
+#include <new>
+#include <stdint.h>
+
+#include <boost/atomic.hpp>
+#include <boost/static_assert.hpp>
 
 namespace {
 
+//! Words of an entry kept in the table; the rest of the digest only picks buckets
+const unsigned int ENTRY_WORDS = 5;
+
+uint32_t EntryWord(const uint256& entry, unsigned int n)
+{
+    const unsigned char* p = entry.begin() + 4 * n;
+    return p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+} // anon namespace
+
 /**
- * Valid signature cache, to avoid doing expensive ECDSA signature checking
- * twice for every transaction (once when accepted into memory pool, and
- * again when accepted into the block chain)
+ * One cache line: a sequence counter that is odd while the bucket is being
+ * written, and three 160-bit entries. An all-zero entry is empty.
  */
-class CSignatureCache
+struct CSignatureCacheBucket
 {
-private:
-     //! sigdata_type is (signature hash, signature, public key):
-    typedef boost::tuple<uint256, std::vector<unsigned char>, CPubKey> sigdata_type;
-    std::set< sigdata_type> setValid;
-    boost::shared_mutex cs_sigcache;
-
-public:
-    bool
-    Get(const uint256 &hash, const std::vector<unsigned char>& vchSig, const CPubKey& pubKey)
-    {
-        boost::shared_lock<boost::shared_mutex> lock(cs_sigcache);
+    boost::atomic<uint32_t> nSeq;
+    boost::atomic<uint32_t> vWord[CSignatureCache::BUCKET_ENTRIES * ENTRY_WORDS];
 
-        sigdata_type k(hash, vchSig, pubKey);
-        std::set<sigdata_type>::iterator mi = setValid.find(k);
-        if (mi != setValid.end())
-            return true;
-        return false;
+    CSignatureCacheBucket() : nSeq(0)
+    {
+        for (unsigned int i = 0; i < CSignatureCache::BUCKET_ENTRIES * ENTRY_WORDS; i++)
+            vWord[i].store(0, boost::memory_order_relaxed);
     }
 
-    void Set(const uint256 &hash, const std::vector<unsigned char>& vchSig, const CPubKey& pubKey)
+    //! Index of the slot holding entry, or -1; reads are not synchronized with writers
+    int Find(const uint256& entry) const
     {
-        // DoS prevention: limit cache size to less than 10MB
-        // (~200 bytes per cache entry times 50,000 entries)
-        // Since there are a maximum of 20,000 signature operations per block
-        // 50,000 is a reasonable default.
-        int64_t nMaxCacheSize = GetArg("-maxsigcachesize", 50000);
-        if (nMaxCacheSize <= 0) return;
-
-        boost::unique_lock<boost::shared_mutex> lock(cs_sigcache);
-
-        while (static_cast<int64_t>(setValid.size()) > nMaxCacheSize)
+        for (unsigned int i = 0; i < CSignatureCache::BUCKET_ENTRIES; i++)
         {
-            // Evict a random entry. Random because that helps
-            // foil would-be DoS attackers who might try to pre-generate
-            // and re-use a set of valid signatures just-slightly-greater
-            // than our cache size.
-            uint256 randomHash = GetRandHash();
-            std::vector<unsigned char> unused;
-            std::set<sigdata_type>::iterator it =
-                setValid.lower_bound(sigdata_type(randomHash, unused, unused));
-            if (it == setValid.end())
-                it = setValid.begin();
-            setValid.erase(*it);
+            unsigned int j = 0;
+            while (j < ENTRY_WORDS && vWord[i * ENTRY_WORDS + j].load(boost::memory_order_relaxed) == EntryWord(entry, j))
+                j++;
+            if (j == ENTRY_WORDS)
+                return i;
         }
+        return -1;
+    }
 
-        sigdata_type k(hash, vchSig, pubKey);
-        setValid.insert(k);
+    bool Contains(const uint256& entry) const
+    {
+        uint32_t nSeqBefore = nSeq.load(boost::memory_order_acquire);
+        if (nSeqBefore & 1)
+            return false;
+        bool fFound = Find(entry) >= 0;
+        boost::atomic_thread_fence(boost::memory_order_acquire);
+        return fFound && nSeq.load(boost::memory_order_relaxed) == nSeqBefore;
+    }
+
+    bool IsEmpty(unsigned int nSlot) const
+    {
+        for (unsigned int j = 0; j < ENTRY_WORDS; j++)
+            if (vWord[nSlot * ENTRY_WORDS + j].load(boost::memory_order_relaxed) != 0)
+                return false;
+        return true;
     }
 };
 
+BOOST_STATIC_ASSERT(sizeof(CSignatureCacheBucket) == 64);
+
+CSignatureCache::CSignatureCache(size_t nBytes) : pchAlloc(NULL), pBuckets(NULL), nBuckets(nBytes / sizeof(CSignatureCacheBucket))
+{
+    nonce = GetRandHash();
+    if (nBuckets == 0)
+        return;
+
+    // Align the table so that no bucket straddles two cache lines
+    pchAlloc = new char[nBuckets * sizeof(CSignatureCacheBucket) + 63];
+    pBuckets = reinterpret_cast<CSignatureCacheBucket*>((reinterpret_cast<uintptr_t>(pchAlloc) + 63) & ~(uintptr_t)63);
+    for (size_t i = 0; i < nBuckets; i++)
+        new (&pBuckets[i]) CSignatureCacheBucket();
+}
+
+CSignatureCache::~CSignatureCache()
+{
+    for (size_t i = 0; i < nBuckets; i++)
+        pBuckets[i].~CSignatureCacheBucket();
+    delete[] pchAlloc;
+}
+
+void CSignatureCache::ComputeEntry(uint256& entry, const uint256& hash, const std::vector<unsigned char>& vchSig, const CPubKey& pubkey) const
+{
+    CSHA256().Write(nonce.begin(), 32).Write(hash.begin(), 32).Write(&pubkey[0], pubkey.size()).Write(vchSig.empty() ? NULL : &vchSig[0], vchSig.size()).Finalize(entry.begin());
+}
+
+bool CSignatureCache::Get(const uint256& entry) const
+{
+    if (nBuckets == 0)
+        return false;
+    return pBuckets[EntryWord(entry, 5) % nBuckets].Contains(entry) ||
+           pBuckets[EntryWord(entry, 6) % nBuckets].Contains(entry);
+}
+
+void CSignatureCache::Set(const uint256& entry)
+{
+    if (nBuckets == 0 || Get(entry))
+        return;
+
+    // Prefer an empty slot in either bucket. Otherwise evict one picked by
+    // the (salted, so unpredictable) digest: that helps foil would-be DoS
+    // attackers who might try to pre-generate and re-use a set of valid
+    // signatures just-slightly-greater than our cache size.
+    CSignatureCacheBucket* vBucket[2] = { &pBuckets[EntryWord(entry, 5) % nBuckets], &pBuckets[EntryWord(entry, 6) % nBuckets] };
+    unsigned int nVictim = EntryWord(entry, 7) % (2 * BUCKET_ENTRIES);
+    for (unsigned int i = 0; i < 2 * BUCKET_ENTRIES; i++)
+    {
+        if (vBucket[i / BUCKET_ENTRIES]->IsEmpty(i % BUCKET_ENTRIES))
+        {
+            nVictim = i;
+            break;
+        }
+    }
+    CSignatureCacheBucket& bucket = *vBucket[nVictim / BUCKET_ENTRIES];
+    unsigned int nSlot = nVictim % BUCKET_ENTRIES;
+
+    // If another thread is writing this bucket, skip caching the entry
+    // rather than wait for it
+    uint32_t nSeqBefore = bucket.nSeq.load(boost::memory_order_relaxed);
+    if ((nSeqBefore & 1) || !bucket.nSeq.compare_exchange_strong(nSeqBefore, nSeqBefore + 1, boost::memory_order_acquire))
+        return;
+    boost::atomic_thread_fence(boost::memory_order_release);
+    for (unsigned int j = 0; j < ENTRY_WORDS; j++)
+        bucket.vWord[nSlot * ENTRY_WORDS + j].store(EntryWord(entry, j), boost::memory_order_relaxed);
+    bucket.nSeq.store(nSeqBefore + 2, boost::memory_order_release);
 }
 
 bool CachingSignatureChecker::VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& pubkey, const uint256& sighash) const
 {
-    static CSignatureCache signatureCache;
+    static CSignatureCache signatureCache(std::max((int64_t)0, std::min(GetArg("-maxsigcachesize", DEFAULT_MAX_SIG_CACHE_SIZE), (int64_t)MAX_MAX_SIG_CACHE_SIZE)) << 20);
+
+    uint256 entry;
+    signatureCache.ComputeEntry(entry, sighash, vchSig, pubkey);
 
-    if (signatureCache.Get(sighash, vchSig, pubkey))
+    if (signatureCache.Get(entry))
         return true;
 
     if (!SignatureChecker::VerifySignature(vchSig, pubkey, sighash))
         return false;
 
     if (store)
-        signatureCache.Set(sighash, vchSig, pubkey);
+        signatureCache.Set(entry);
     return true;
 }
@@ -7,10 +7,57 @@
 #define BITCREDIT_SCRIPT_SIGCACHE_H
 
 #include "script/interpreter.h"
+#include "uint256.h"
 
+#include <stddef.h>
 #include <vector>
 
 class CPubKey;
+struct CSignatureCacheBucket;
+
+/** Default for -maxsigcachesize, in megabytes */
+static const unsigned int DEFAULT_MAX_SIG_CACHE_SIZE = 32;
+/** Upper bound for -maxsigcachesize, in megabytes */
+static const unsigned int MAX_MAX_SIG_CACHE_SIZE = 16384;
+
+/**
+ * Valid signature cache, to avoid doing expensive ECDSA signature checking
+ * twice for every transaction (once when accepted into memory pool, and
+ * again when accepted into the block chain).
+ *
+ * Entries are salted SHA256 digests of (signature hash, signature, public
+ * key), so the cache costs the same per entry whatever the signature, and
+ * an attacker cannot predict where an entry lands. They are kept in a
+ * fixed table of cache-line sized buckets; each bucket holds a few entries
+ * behind a sequence counter, so lookups never take a lock and inserts only
+ * claim the one bucket they write. An entry may live in either of two
+ * buckets; when both are full an existing entry is overwritten.
+ */
+class CSignatureCache
+{
+public:
+    //! Number of entries in one bucket
+    static const unsigned int BUCKET_ENTRIES = 3;
+
+    //! Table using at most nBytes of memory; 0 disables the cache
+    explicit CSignatureCache(size_t nBytes);
+    ~CSignatureCache();
+
+    void ComputeEntry(uint256& entry, const uint256& hash, const std::vector<unsigned char>& vchSig, const CPubKey& pubkey) const;
+    bool Get(const uint256& entry) const;
+    void Set(const uint256& entry);
+
+    size_t GetBucketCount() const { return nBuckets; }
+
+private:
+    uint256 nonce;
+    char* pchAlloc;
+    CSignatureCacheBucket* pBuckets;
+    size_t nBuckets;
+
+    CSignatureCache(const CSignatureCache&);
+    CSignatureCache& operator=(const CSignatureCache&);
+};
 
 class CachingSignatureChecker : public SignatureChecker
 {
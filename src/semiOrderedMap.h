@@ -1,48 +1,117 @@
-#include <math.h>
+#ifndef BITCREDIT_SEMIORDEREDMAP_H
+#define BITCREDIT_SEMIORDEREDMAP_H
 
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Birthday table used by the Momentum proof-of-work search.
+ *
+ * Birthdays are spread over 2^23 buckets of eight slots, so that a bucket fills
+ * exactly one 64-byte cache line. Each slot packs the birthday bits not implied
+ * by the bucket (the tag), the nonce and the epoch of the search that wrote it.
+ * Starting a new search only bumps the epoch; slots of older epochs count as
+ * empty, so the table is allocated once and cleared only when the epoch wraps.
+ */
 class semiOrderedMap
 {
+    public:
+
+        static const int BUCKET_BITS = 23;
+        static const int SLOTS_PER_BUCKET = 8;
+        static const int TAG_BITS = 27; // 50-bit birthday minus the bucket index
+        static const int NONCE_BITS = 26;
+        static const int EPOCH_BITS = 64 - TAG_BITS - NONCE_BITS;
+
     private:
 
-        uint64_t *indexOfBirthdayHashes;
-        uint32_t *indexOfBirthdays;
-        int bucketSizeExponent;
-        int bucketSize;
+        uint64_t *slots;
+        size_t nAllocated;
+        bool fMapped;
+        uint64_t nEpoch;
+
+        semiOrderedMap(const semiOrderedMap&);
+        semiOrderedMap& operator=(const semiOrderedMap&);
 
     public:
 
-        ~semiOrderedMap()
+        semiOrderedMap() : slots(NULL), nAllocated(0), fMapped(false), nEpoch(0) {}
+        ~semiOrderedMap();
+
+        //! Reserve the table, backed by huge pages where the OS provides them
+        void allocate();
+
+        //! Forget all birthdays of the previous search
+        void reset();
+
+        //! Number of slots written by the current search
+        size_t countUsed() const;
+
+        static size_t size() { return (size_t)SLOTS_PER_BUCKET << BUCKET_BITS; }
+
+        //! Start loading the bucket of a birthday that is about to be added
+        void prefetch(uint64_t birthdayHash) const
         {
-            delete [] indexOfBirthdayHashes;
-            delete [] indexOfBirthdays;
+#ifdef __GNUC__
+            __builtin_prefetch(slots + (birthdayHash >> TAG_BITS) * SLOTS_PER_BUCKET, 1);
+#endif
         }
 
-        void allocate(int bSE)
+        /**
+         * Add a birthday for a nonce. Returns true and sets nonceMatch if an
+         * earlier nonce of this search had the same birthday. Birthdays that
+         * land in a full bucket are dropped.
+         */
+        bool checkAdd(uint64_t birthdayHash, uint32_t nonce, uint32_t &nonceMatch)
         {
-            bucketSizeExponent=bSE;
-            bucketSize=pow(2.0,bSE);
-            indexOfBirthdayHashes=new uint64_t[67108864];
-            indexOfBirthdays=new uint32_t[67108864];
-           
+            uint64_t *bucket = slots + (birthdayHash >> TAG_BITS) * SLOTS_PER_BUCKET;
+            uint64_t tag = birthdayHash & ((1ULL << TAG_BITS) - 1);
+            for(int i=0;i<SLOTS_PER_BUCKET;i++)
+            {
+                uint64_t slot=bucket[i];
+                if((slot >> (TAG_BITS + NONCE_BITS)) != nEpoch)
+                {
+                    bucket[i] = (nEpoch << (TAG_BITS + NONCE_BITS)) | ((uint64_t)nonce << TAG_BITS) | tag;
+                    return false;
+                }
+                if((slot & ((1ULL << TAG_BITS) - 1)) == tag)
+                {
+                    nonceMatch = (slot >> TAG_BITS) & ((1ULL << NONCE_BITS) - 1);
+                    return true;
+                }
+            }
+            return false;
         }
-        
-        uint32_t checkAdd(uint64_t birthdayHash, uint32_t nonce)
+
+        /**
+         * checkAdd() for searches that share the table between threads. A slot
+         * is claimed with a compare-and-swap; if another thread wins the race
+         * the slot is examined again, so a birthday written concurrently into
+         * the same slot is still reported as a match.
+         */
+        bool checkAddConcurrent(uint64_t birthdayHash, uint32_t nonce, uint32_t &nonceMatch)
         {
-            uint64_t bucketStart = (birthdayHash >> (24+bucketSizeExponent))*bucketSize;
-            for(int i=0;i<bucketSize;i++) 
+            uint64_t *bucket = slots + (birthdayHash >> TAG_BITS) * SLOTS_PER_BUCKET;
+            uint64_t tag = birthdayHash & ((1ULL << TAG_BITS) - 1);
+            uint64_t entry = (nEpoch << (TAG_BITS + NONCE_BITS)) | ((uint64_t)nonce << TAG_BITS) | tag;
+            for(int i=0;i<SLOTS_PER_BUCKET;)
             {
-                uint64_t bucketValue=indexOfBirthdayHashes[bucketStart+i];
-                if(bucketValue==birthdayHash)
+                uint64_t slot=*(volatile uint64_t*)&bucket[i];
+                if((slot >> (TAG_BITS + NONCE_BITS)) != nEpoch)
                 {
-                    return indexOfBirthdays[bucketStart+i];
+                    if(__sync_bool_compare_and_swap(&bucket[i], slot, entry))
+                        return false;
+                    continue;
                 }
-                else if(bucketValue==0)
+                if((slot & ((1ULL << TAG_BITS) - 1)) == tag)
                 {
-                    indexOfBirthdayHashes[bucketStart+i]=birthdayHash;
-                    indexOfBirthdays[bucketStart+i]=nonce;
-                    return 0;
+                    nonceMatch = (slot >> TAG_BITS) & ((1ULL << NONCE_BITS) - 1);
+                    return true;
                 }
+                i++;
             }
-            return 0;
+            return false;
         }
 };
+
+#endif // BITCREDIT_SEMIORDEREDMAP_H
@@ -208,6 +208,13 @@ public:
         return true;
     }
 
+    void swap(vector_type& vchOther)
+    {
+        // Exchange the whole buffer, including data already read
+        vch.swap(vchOther);
+        nReadPos = 0;
+    }
+
 
     //
     // Stream subset
@@ -0,0 +1,262 @@
+// Copyright (c) 2015 The Bitcredit Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "txdb.h"
+
+#include "chainparams.h"
+#include "key.h"
+#include "main.h"
+#include "random.h"
+#include "script/standard.h"
+#include "streams.h"
+#include "uint256.h"
+
+#include <algorithm>
+#include <limits>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <boost/scoped_ptr.hpp>
+#include <boost/test/unit_test.hpp>
+
+namespace
+{
+const unsigned int MAX_HEIGHT = std::numeric_limits<unsigned int>::max();
+
+CExtDiskTxPos MakePos(unsigned int nHeight, int nFile, unsigned int nPos, unsigned int nTxOffset)
+{
+    CExtDiskTxPos pos;
+    pos.nHeight = nHeight;
+    pos.nFile = nFile;
+    pos.nPos = nPos;
+    pos.nTxOffset = nTxOffset;
+    return pos;
+}
+
+std::string SerializeKey(const CAddrIndexKey& key)
+{
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << key;
+    return ss.str();
+}
+
+/** Order of address index entries: by address, then by position */
+bool KeyLess(const CAddrIndexKey& a, const CAddrIndexKey& b)
+{
+    if (a.nLookupId != b.nLookupId)
+        return a.nLookupId < b.nLookupId;
+    return a.pos < b.pos;
+}
+
+std::vector<CExtDiskTxPos> ReadCursor(uint64_t nLookupId, unsigned int nMinHeight, unsigned int nMaxHeight, bool fReverse)
+{
+    std::vector<CExtDiskTxPos> vpos;
+    boost::scoped_ptr<CAddrIndexCursor> pcursor(pblocktree->GetAddrIndexCursor(nLookupId, nMinHeight, nMaxHeight, fReverse));
+    for (; pcursor->Valid(); pcursor->Next())
+        vpos.push_back(pcursor->GetPos());
+    return vpos;
+}
+
+std::vector<CExtDiskTxPos> SelectHeights(const std::set<CExtDiskTxPos>& setPos, unsigned int nMinHeight, unsigned int nMaxHeight, bool fReverse)
+{
+    std::vector<CExtDiskTxPos> vpos;
+    for (std::set<CExtDiskTxPos>::const_iterator it = setPos.begin(); it != setPos.end(); it++)
+        if (it->nHeight >= nMinHeight && it->nHeight <= nMaxHeight)
+            vpos.push_back(*it);
+    if (fReverse)
+        std::reverse(vpos.begin(), vpos.end());
+    return vpos;
+}
+
+/** Connect a block paying scriptPubKey on top of the active chain */
+CBlockIndex* ConnectBlockPaying(const CScript& scriptPubKey)
+{
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].scriptSig = CScript() << chainActive.Height() + 1 << OP_0;
+    tx.vout.resize(1);
+    tx.vout[0].nValue = COIN;
+    tx.vout[0].scriptPubKey = scriptPubKey;
+
+    CBlock block;
+    block.nVersion = 1;
+    block.hashPrevBlock = chainActive.Tip()->GetBlockHash();
+    block.nTime = chainActive.Tip()->GetMedianTimePast() + 1;
+    block.nBits = chainActive.Tip()->nBits;
+    block.vtx.push_back(tx);
+    block.hashMerkleRoot = block.BuildMerkleTree();
+
+    CValidationState state;
+    BOOST_CHECK(ProcessNewBlock(state, NULL, &block));
+    BOOST_CHECK(chainActive.Tip()->GetBlockHash() == block.GetHash());
+    return chainActive.Tip();
+}
+} // anon namespace
+
+BOOST_AUTO_TEST_SUITE(addrindex_tests)
+
+BOOST_AUTO_TEST_CASE(addrindex_key)
+{
+    // Values around the byte boundaries, where little endian order differs
+    const uint64_t lookupids[] = {0, 1, 0xff, 0x100, 0xffffffffULL, 0x100000000ULL, std::numeric_limits<uint64_t>::max()};
+    const unsigned int values[] = {0, 1, 0xff, 0x100, 0xffff, 0x10000, 0x7fffffff, 0x80000000, MAX_HEIGHT};
+    const int files[] = {0, 1, 0xff, 0x100, std::numeric_limits<int>::max()};
+    const int nLookupIds = sizeof(lookupids) / sizeof(lookupids[0]);
+    const int nValues = sizeof(values) / sizeof(values[0]);
+    const int nFiles = sizeof(files) / sizeof(files[0]);
+
+    std::vector<CAddrIndexKey> vKeys;
+    for (int i = 0; i < 2000; i++) {
+        CExtDiskTxPos pos = MakePos(values[insecure_rand() % nValues], files[insecure_rand() % nFiles],
+                                    values[insecure_rand() % nValues], values[insecure_rand() % nValues]);
+        CAddrIndexKey key(lookupids[insecure_rand() % nLookupIds], pos);
+        vKeys.push_back(key);
+
+        // Fixed width, prefixed and round trips
+        std::string str = SerializeKey(key);
+        BOOST_CHECK(str.size() == CAddrIndexKey::SIZE);
+        BOOST_CHECK_EQUAL(str[0], 'h');
+        CDataStream ss(str.data(), str.data() + str.size(), SER_DISK, CLIENT_VERSION);
+        CAddrIndexKey key2;
+        ss >> key2;
+        BOOST_CHECK(ss.empty());
+        BOOST_CHECK_EQUAL(key2.nLookupId, key.nLookupId);
+        BOOST_CHECK(key2.pos == key.pos);
+    }
+
+    // The bytes sort the way the entries do, which is what LevelDB iterates by
+    std::vector<CAddrIndexKey> vSorted(vKeys);
+    std::stable_sort(vSorted.begin(), vSorted.end(), KeyLess);
+    std::vector<std::string> vStrings;
+    for (unsigned int i = 0; i < vKeys.size(); i++)
+        vStrings.push_back(SerializeKey(vKeys[i]));
+    std::sort(vStrings.begin(), vStrings.end());
+    for (unsigned int i = 0; i < vSorted.size(); i++)
+        BOOST_CHECK(vStrings[i] == SerializeKey(vSorted[i]));
+
+    // Keys of other kinds are refused
+    std::string str = SerializeKey(vKeys[0]);
+    str[0] = 't';
+    CDataStream ss(str.data(), str.data() + str.size(), SER_DISK, CLIENT_VERSION);
+    CAddrIndexKey key;
+    BOOST_CHECK_THROW(ss >> key, std::ios_base::failure);
+}
+
+BOOST_AUTO_TEST_CASE(addrindex_cursor)
+{
+    // Entries of the addresses next to the ones looked up must not be
+    // returned; the last possible address has no keys after it
+    const uint64_t nLookupId = 0x5a5a5a5a00000000ULL;
+    const uint64_t lookupids[] = {nLookupId - 1, nLookupId, nLookupId + 1, std::numeric_limits<uint64_t>::max()};
+    const unsigned int heights[] = {0, 1, 5, 255, 256, 1000, MAX_HEIGHT};
+
+    std::vector<std::pair<uint64_t, CExtDiskTxPos> > vEntries;
+    std::set<CExtDiskTxPos> setPos;
+    for (unsigned int i = 0; i < sizeof(heights) / sizeof(heights[0]); i++) {
+        // Several transactions per height, spread over files and blocks
+        for (unsigned int j = 0; j < 3; j++) {
+            CExtDiskTxPos pos = MakePos(heights[i], j, 0x100 * (3 - j), 81 + j);
+            setPos.insert(pos);
+            for (unsigned int k = 0; k < sizeof(lookupids) / sizeof(lookupids[0]); k++)
+                vEntries.push_back(std::make_pair(lookupids[k], pos));
+        }
+    }
+    BOOST_CHECK(pblocktree->WriteAddrIndex(vEntries));
+
+    const unsigned int bounds[] = {0, 1, 4, 5, 6, 255, 256, 257, 999, 1000, 1001, MAX_HEIGHT - 1, MAX_HEIGHT};
+    const int nBounds = sizeof(bounds) / sizeof(bounds[0]);
+    for (int fReverse = 0; fReverse < 2; fReverse++) {
+        for (int i = 0; i < nBounds; i++) {
+            for (int j = 0; j < nBounds; j++) {
+                std::vector<CExtDiskTxPos> vExpected = SelectHeights(setPos, bounds[i], bounds[j], fReverse);
+                BOOST_CHECK(ReadCursor(nLookupId, bounds[i], bounds[j], fReverse) == vExpected);
+                BOOST_CHECK(ReadCursor(lookupids[3], bounds[i], bounds[j], fReverse) == vExpected);
+            }
+        }
+
+        // Addresses without entries, before and between the others
+        BOOST_CHECK(ReadCursor(0, 0, MAX_HEIGHT, fReverse).empty());
+        BOOST_CHECK(ReadCursor(nLookupId + 2, 0, MAX_HEIGHT, fReverse).empty());
+    }
+}
+
+// Entries of blocks connected since the last flush are not in the database
+// yet; lookups merge them with the written ones
+BOOST_AUTO_TEST_CASE(addrindex_find_pending)
+{
+    const int N = 12;
+    ModifiableParams()->setSkipProofOfWorkCheck(true);
+    fAddrIndex = true;
+
+    CKey key;
+    key.MakeNewKey(true);
+    CKeyID keyid = key.GetPubKey().GetID();
+    CScript scriptPubKey = GetScriptForDestination(keyid);
+
+    // Write out what is pending, so that no periodic flush is due while connecting
+    FlushStateToDisk();
+    std::vector<CBlockIndex*> vIndex;
+    for (int i = 0; i < N; i++) {
+        if (i == N / 2)
+            FlushStateToDisk();
+        vIndex.push_back(ConnectBlockPaying(scriptPubKey));
+    }
+
+    // Only the first half is written
+    std::vector<CExtDiskTxPos> vFlushed = ReadCursor(pblocktree->GetAddrIndexKey(keyid), 0, MAX_HEIGHT, false);
+    BOOST_CHECK_EQUAL(vFlushed.size(), (size_t)N / 2);
+
+    // Every block's coinbase is found, in block order
+    std::vector<CExtDiskTxPos> vAll;
+    BOOST_CHECK(FindTransactionsByDestination(keyid, vAll));
+    BOOST_CHECK_EQUAL(vAll.size(), (size_t)N);
+    for (unsigned int i = 0; i < vAll.size() && i < vIndex.size(); i++) {
+        BOOST_CHECK_EQUAL(vAll[i].nHeight, (unsigned int)vIndex[i]->nHeight);
+        CTransaction tx;
+        uint256 hashBlock;
+        BOOST_CHECK(ReadTransaction(tx, vAll[i], hashBlock));
+        BOOST_CHECK(hashBlock == vIndex[i]->GetBlockHash());
+        BOOST_CHECK(tx.vout[0].scriptPubKey == scriptPubKey);
+    }
+    BOOST_CHECK(std::equal(vFlushed.begin(), vFlushed.end(), vAll.begin()));
+    std::set<CExtDiskTxPos> setAll(vAll.begin(), vAll.end());
+
+    // Height bounds on either side of the flushed entries, in both directions
+    for (int fReverse = 0; fReverse < 2; fReverse++) {
+        for (int i = 0; i <= N; i++) {
+            for (int j = i; j <= N; j++) {
+                unsigned int nMinHeight = vIndex[0]->nHeight + i;
+                unsigned int nMaxHeight = vIndex[0]->nHeight + j - 1;
+                std::vector<CExtDiskTxPos> vpos;
+                BOOST_CHECK(FindTransactionsByDestination(keyid, vpos, nMinHeight, nMaxHeight, 0, std::numeric_limits<size_t>::max(), fReverse));
+                BOOST_CHECK(vpos == SelectHeights(setAll, nMinHeight, nMaxHeight, fReverse));
+            }
+        }
+    }
+
+    // Pages across the flushed and the pending entries
+    for (int fReverse = 0; fReverse < 2; fReverse++) {
+        std::vector<CExtDiskTxPos> vOrdered = SelectHeights(setAll, 0, MAX_HEIGHT, fReverse);
+        for (size_t nSkip = 0; nSkip <= vOrdered.size() + 1; nSkip++) {
+            for (size_t nLimit = 0; nLimit <= vOrdered.size() + 1; nLimit++) {
+                std::vector<CExtDiskTxPos> vpos;
+                BOOST_CHECK(FindTransactionsByDestination(keyid, vpos, 0, MAX_HEIGHT, nSkip, nLimit, fReverse));
+                size_t nBegin = std::min(nSkip, vOrdered.size());
+                size_t nEnd = std::min(nSkip + nLimit, vOrdered.size());
+                BOOST_CHECK(vpos == std::vector<CExtDiskTxPos>(vOrdered.begin() + nBegin, vOrdered.begin() + nEnd));
+            }
+        }
+    }
+
+    // Destinations the index does not cover
+    std::vector<CExtDiskTxPos> vpos;
+    BOOST_CHECK(!FindTransactionsByDestination(CNoDestination(), vpos));
+    fAddrIndex = false;
+    BOOST_CHECK(!FindTransactionsByDestination(keyid, vpos));
+
+    ModifiableParams()->setSkipProofOfWorkCheck(false);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,252 @@
+// Copyright (c) 2015 The Bitcredit Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bidtracker.h"
+#include "util.h"
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include <fstream>
+
+#include <boost/asio.hpp>
+#include <boost/bind.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
+
+using boost::asio::ip::tcp;
+
+/** HTTP server on the loopback interface standing in for the bid sources */
+class CBidSourceServer
+{
+private:
+    boost::asio::io_service io_service;
+    tcp::acceptor acceptor;
+    boost::thread thread;
+    boost::mutex mutex;
+    bool fStop;
+    std::map<std::string, std::string> mapResponses;
+    std::vector<std::string> vPaths;
+
+    void Serve()
+    {
+        while (true)
+        {
+            tcp::socket socket(io_service);
+            boost::system::error_code ec;
+            acceptor.accept(socket, ec);
+            {
+                boost::mutex::scoped_lock lock(mutex);
+                if (fStop)
+                    return;
+            }
+            if (ec)
+                continue;
+
+            boost::asio::streambuf request;
+            boost::asio::read_until(socket, request, "\r\n\r\n", ec);
+            if (ec)
+                continue;
+            std::istream stream(&request);
+            std::string strMethod, strPath;
+            stream >> strMethod >> strPath;
+
+            int nStatus = 404;
+            std::string strBody;
+            {
+                boost::mutex::scoped_lock lock(mutex);
+                vPaths.push_back(strPath);
+                if (mapResponses.count(strPath)) {
+                    nStatus = 200;
+                    strBody = mapResponses[strPath];
+                }
+            }
+            std::string strResponse = strprintf("HTTP/1.1 %d %s\r\nContent-Length: %u\r\nConnection: close\r\n\r\n%s",
+                nStatus, nStatus == 200 ? "OK" : "Not Found", strBody.size(), strBody);
+            boost::asio::write(socket, boost::asio::buffer(strResponse), ec);
+        }
+    }
+
+public:
+    CBidSourceServer() : acceptor(io_service, tcp::endpoint(boost::asio::ip::address_v4::loopback(), 0)), fStop(false)
+    {
+        thread = boost::thread(boost::bind(&CBidSourceServer::Serve, this));
+    }
+
+    ~CBidSourceServer()
+    {
+        {
+            boost::mutex::scoped_lock lock(mutex);
+            fStop = true;
+        }
+        // Wake up the accept
+        tcp::socket socket(io_service);
+        boost::system::error_code ec;
+        socket.connect(acceptor.local_endpoint(), ec);
+        thread.join();
+    }
+
+    void Set(const std::string& strPath, const std::string& strBody)
+    {
+        boost::mutex::scoped_lock lock(mutex);
+        mapResponses[strPath] = strBody;
+    }
+
+    int CountRequests(const std::string& strPath)
+    {
+        boost::mutex::scoped_lock lock(mutex);
+        return std::count(vPaths.begin(), vPaths.end(), strPath);
+    }
+
+    std::string GetURL()
+    {
+        return strprintf("http://127.0.0.1:%d", acceptor.local_endpoint().port());
+    }
+};
+
+/** Responses in the formats of blockchain.info, blockstrap and bittrex */
+static void SetBidSources(CBidSourceServer& server)
+{
+    server.Set("/unspent?active=16f5dJd4EHRrQwGGRMczA69qbJYs4msBQ5",
+        "{\n\t\"unspent_outputs\":[\n\t\n"
+        "\t\t{\n\t\t\t\"tx_hash\":\"01aa\",\n\t\t\t\"tx_hash_big_endian\":\"aa01\",\n\t\t\t\"tx_output_n\": 0,\n"
+        "\t\t\t\"value\": 150000,\n\t\t\t\"value_hex\": \"0249f0\",\n\t\t\t\"confirmations\":10\n\t\t},\n\t\n"
+        "\t\t{\n\t\t\t\"tx_hash\":\"02aa\",\n\t\t\t\"tx_hash_big_endian\":\"aa02\",\n\t\t\t\"tx_output_n\": 1,\n"
+        "\t\t\t\"value\": 50000,\n\t\t\t\"value_hex\": \"00c350\",\n\t\t\t\"confirmations\":7\n\t\t}\n\t]\n}");
+    server.Set("/rawtx/aa01", "{\"hash\":\"aa01\",\"inputs\":[{\"prev_out\":{\"addr\":\"1Bidder\",\"value\":160000,\"n\":0}}]}");
+    server.Set("/rawtx/aa02", "{\"hash\":\"aa02\",\"inputs\":[{\"prev_out\":{\"addr\":\"1Bidder\",\"value\":60000,\"n\":2}}]}");
+
+    server.Set("/v0/ltc/address/unspents/Lc7ebfQPz6VJ8qmXYaaFxBYLpDz2XsDu7c",
+        "{\"status\":\"success\",\"data\":{\"address\":{\"unspents\":[{\"id\":\"bb01\",\"tx_address_pos\":0,\"tx_address_value\":100000,\"confirmations\":12}]}}}");
+    server.Set("/v0/ltc/transaction/id/bb01?showtxn=1&showtxnio=1&",
+        "{\"status\":\"success\",\"data\":{\"transaction\":{\"id\":\"bb01\",\"inputs\":[{\"address\":\"LBidder\"}]}}}");
+    server.Set("/api/v1.1/public/getticker?market=BTC-LTC",
+        "{\"success\":true,\"message\":\"\",\"result\":{\"Bid\":0.5,\"Ask\":0.6,\"Last\":0.55}}");
+
+    server.Set("/v0/drk/address/unspents/Xypcx2iE8rCtC3tjw5M8sxpRzn4JuoSaBH",
+        "{\"status\":\"success\",\"data\":{\"address\":{\"unspents\":[{\"id\":\"cc01\",\"tx_address_pos\":1,\"tx_address_value\":16,\"confirmations\":3}]}}}");
+    server.Set("/v0/drk/transaction/id/cc01?showtxn=1&showtxnio=1&",
+        "{\"status\":\"success\",\"data\":{\"transaction\":{\"id\":\"cc01\",\"inputs\":[{\"address\":\"XBidder\"}]}}}");
+    server.Set("/api/v1.1/public/getticker?market=BTC-DASH",
+        "{\"success\":true,\"message\":\"\",\"result\":{\"Bid\":0.25,\"Ask\":0.3,\"Last\":0.27}}");
+}
+
+BOOST_AUTO_TEST_SUITE(bidtracker_tests)
+
+BOOST_AUTO_TEST_CASE(bidtracker_fetch)
+{
+    CBidSourceServer server;
+    SetBidSources(server);
+    mapArgs["-bidtrackerurl"] = server.GetURL();
+
+    // The fetcher and its connections are reused by the second refresh
+    CBidFetcher fetcher;
+    for (int i = 0; i < 2; i++)
+    {
+        std::map<std::string,int> mapBids;
+        BOOST_CHECK(FetchBids(fetcher, mapBids));
+        BOOST_CHECK_EQUAL(mapBids.size(), 3U);
+        BOOST_CHECK_EQUAL(mapBids["1Bidder"], 200000);
+        BOOST_CHECK_EQUAL(mapBids["LBidder"], 50000);
+        BOOST_CHECK_EQUAL(mapBids["XBidder"], 4);
+    }
+    BOOST_CHECK_EQUAL(server.CountRequests("/rawtx/aa01"), 2);
+    BOOST_CHECK_EQUAL(server.CountRequests("/api/v1.1/public/getticker?market=BTC-DASH"), 2);
+
+    mapArgs.erase("-bidtrackerurl");
+}
+
+BOOST_AUTO_TEST_CASE(bidtracker_unreachable)
+{
+    CBidSourceServer server;
+    SetBidSources(server);
+    server.Set("/v0/drk/address/unspents/Xypcx2iE8rCtC3tjw5M8sxpRzn4JuoSaBH", "");
+    mapArgs["-bidtrackerurl"] = server.GetURL() + "/missing";
+
+    // A listing that cannot be fetched leaves the bids alone
+    CBidFetcher fetcher;
+    std::map<std::string,int> mapBids;
+    mapBids["1Bidder"] = 1;
+    BOOST_CHECK(!FetchBids(fetcher, mapBids));
+    BOOST_CHECK_EQUAL(mapBids.size(), 1U);
+
+    // A listing that cannot be parsed only drops the bids of its chain
+    mapArgs["-bidtrackerurl"] = server.GetURL();
+    BOOST_CHECK(FetchBids(fetcher, mapBids));
+    BOOST_CHECK_EQUAL(mapBids.size(), 2U);
+    BOOST_CHECK_EQUAL(mapBids.count("XBidder"), 0U);
+
+    mapArgs.erase("-bidtrackerurl");
+}
+
+BOOST_AUTO_TEST_CASE(bidtracker_market_data)
+{
+    CBidSourceServer server;
+    server.Set("/q/addressbalance/16f5dJd4EHRrQwGGRMczA69qbJYs4msBQ5", "200000");
+    server.Set("/q/addressbalance/3AsVTW5W5NL8bx1twwR7TabFAYGKstizjt", "150000000");
+    server.Set("/api/v1/address/balance/Lc7ebfQPz6VJ8qmXYaaFxBYLpDz2XsDu7c", "2.5");
+    server.Set("/api/v1/address/balance/35QTtUaMeSNbpKK6A4d4zTygR9s53jqNTH", "{\"status\":\"success\"}");
+    server.Set("/dash/api.dws?q=getbalance&a=Xypcx2iE8rCtC3tjw5M8sxpRzn4JuoSaBH", "4");
+    server.Set("/dash/api.dws?q=getbalance&a=7dQpZMWfjKEwNNRCeRG2KkYw98b63PNKGZ", "12.75");
+    server.Set("/bcr/api.dws?q=getbalance&a=5qH4yHaaaRuX1qKCZdUHXNJdesssNQcUct", "1000");
+    server.Set("/q/24hrprice", "250.75");
+    server.Set("/api/v1.1/public/getticker?market=BTC-LTC",
+        "{\"success\":true,\"message\":\"\",\"result\":{\"Bid\":0.5,\"Ask\":0.6,\"Last\":0.55}}");
+    server.Set("/api/v1.1/public/getticker?market=BTC-DASH",
+        "{\"success\":true,\"message\":\"\",\"result\":{\"Bid\":0.25,\"Ask\":0.3,\"Last\":0.27}}");
+    mapArgs["-bidtrackerurl"] = server.GetURL();
+
+    // The BCR ticker is missing, so its rate keeps the value it had
+    CBidFetcher fetcher;
+    CMarketData data;
+    data.bcrbtc = 0.001;
+    BOOST_CHECK(!FetchMarketData(fetcher, data));
+    BOOST_CHECK_EQUAL(data.btcbids, 200000);
+    BOOST_CHECK_EQUAL(data.btcreserves, 150000000);
+    BOOST_CHECK_EQUAL(data.ltcbids, 2.5);
+    BOOST_CHECK_EQUAL(data.ltcreserves, 0);
+    BOOST_CHECK_EQUAL(data.dashbids, 4);
+    BOOST_CHECK_EQUAL(data.dashreserves, 12.75);
+    BOOST_CHECK_EQUAL(data.bcrreserves, 1000);
+    BOOST_CHECK_EQUAL(data.usdbtc, 250);
+    BOOST_CHECK_EQUAL(data.ltcbtc, 0.5);
+    BOOST_CHECK_EQUAL(data.dashbtc, 0.25);
+    BOOST_CHECK_EQUAL(data.bcrbtc, 0.001);
+
+    server.Set("/api/v1.1/public/getticker?market=BTC-BCR",
+        "{\"success\":true,\"message\":\"\",\"result\":{\"Bid\":0.0002,\"Ask\":0.0003,\"Last\":0.0002}}");
+    BOOST_CHECK(FetchMarketData(fetcher, data));
+    BOOST_CHECK_EQUAL(data.bcrbtc, 0.0002);
+
+    mapArgs.erase("-bidtrackerurl");
+}
+
+BOOST_AUTO_TEST_CASE(bidtracker_snapshot)
+{
+    boost::shared_ptr<const CBidSnapshot> before = getbidtracker();
+    BOOST_REQUIRE(before);
+    size_t nBefore = before->mapBids.size();
+
+    boost::filesystem::path biddir = GetDataDir() / "bidtracker";
+    boost::filesystem::create_directories(biddir);
+    {
+        std::ofstream file((biddir / "final.dat").string().c_str());
+        file << "1Bidder,200000\nLBidder,50000\n";
+    }
+    LoadBids();
+
+    // A new version is published, the one held is left alone
+    boost::shared_ptr<const CBidSnapshot> after = getbidtracker();
+    BOOST_CHECK_EQUAL(after->nVersion, before->nVersion + 1);
+    BOOST_CHECK_EQUAL(after->mapBids.size(), 2U);
+    BOOST_CHECK_EQUAL(after->mapBids.find("1Bidder")->second, 200000);
+    BOOST_CHECK_EQUAL(after->mapBids.find("LBidder")->second, 50000);
+    BOOST_CHECK_EQUAL(before->mapBids.size(), nBefore);
+
+    boost::filesystem::remove_all(biddir);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,103 @@
+// Copyright (c) 2015 The Bitcredit Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "checkqueue.h"
+
+#include <vector>
+
+#include <boost/atomic.hpp>
+#include <boost/bind.hpp>
+#include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
+
+namespace {
+
+boost::atomic<unsigned int> nChecked(0);
+
+/** Check that counts itself and fails when asked to */
+class CTestCheck
+{
+private:
+    bool fOk;
+
+public:
+    CTestCheck() : fOk(true) {}
+    CTestCheck(bool fOkIn) : fOk(fOkIn) {}
+
+    bool operator()()
+    {
+        nChecked++;
+        return fOk;
+    }
+
+    void swap(CTestCheck& check)
+    {
+        std::swap(fOk, check.fOk);
+    }
+};
+
+} // anon namespace
+
+BOOST_AUTO_TEST_SUITE(checkqueue_tests)
+
+BOOST_AUTO_TEST_CASE(checkqueue_workers)
+{
+    CCheckQueue<CTestCheck> queue(128, "Test");
+    boost::thread_group threadGroup;
+    for (int i = 0; i < 4; i++)
+        threadGroup.create_thread(boost::bind(&CCheckQueue<CTestCheck>::Thread, &queue));
+
+    // Every check runs exactly once, however the batches are added
+    for (unsigned int nSession = 0; nSession < 20; nSession++)
+    {
+        nChecked = 0;
+        unsigned int nTotal = 0;
+        {
+            CCheckQueueControl<CTestCheck> control(&queue);
+            for (unsigned int i = 0; i <= nSession * 10; i++)
+            {
+                std::vector<CTestCheck> vChecks(i % 7);
+                nTotal += vChecks.size();
+                control.Add(vChecks);
+            }
+            BOOST_CHECK(control.Wait());
+        }
+        BOOST_CHECK_EQUAL(nChecked, nTotal);
+    }
+
+    // A single failure anywhere fails the session, and the next one starts clean
+    for (unsigned int nFail = 0; nFail < 100; nFail += 9)
+    {
+        CCheckQueueControl<CTestCheck> control(&queue);
+        std::vector<CTestCheck> vChecks;
+        for (unsigned int i = 0; i < 100; i++)
+            vChecks.push_back(CTestCheck(i != nFail));
+        control.Add(vChecks);
+        BOOST_CHECK(!control.Wait());
+    }
+    {
+        CCheckQueueControl<CTestCheck> control(&queue);
+        std::vector<CTestCheck> vChecks(1000);
+        control.Add(vChecks);
+        BOOST_CHECK(control.Wait());
+    }
+
+    threadGroup.interrupt_all();
+    threadGroup.join_all();
+}
+
+BOOST_AUTO_TEST_CASE(checkqueue_no_workers)
+{
+    // The master does all the work itself
+    CCheckQueue<CTestCheck> queue(16, "Test");
+    nChecked = 0;
+    {
+        CCheckQueueControl<CTestCheck> control(&queue);
+        std::vector<CTestCheck> vChecks(100);
+        control.Add(vChecks);
+    }
+    BOOST_CHECK_EQUAL(nChecked, 100U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -17,6 +17,8 @@ class CCoinsViewTest : public CCoinsView
 {
     uint256 hashBestBlock_;
     std::map<uint256, CCoins> map_;
+    std::map<std::string, CAddressBalance> balances_;
+    CCoinsTotals totals_;
 
 public:
     bool GetCoins(const uint256& txid, CCoins& coins) const
@@ -41,7 +43,17 @@ public:
 
     uint256 GetBestBlock() const { return hashBestBlock_; }
 
-    bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock)
+    bool GetAddressBalance(const std::string& address, CAddressBalance& balance) const
+    {
+        std::map<std::string, CAddressBalance>::const_iterator it = balances_.find(address);
+        if (it == balances_.end()) {
+            return false;
+        }
+        balance = it->second;
+        return true;
+    }
+
+    bool BatchWrite(CCoinsMap& mapCoins, CAddressBalanceMap& mapBalances, CCoinsTotals& totals, const uint256& hashBlock)
     {
         for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end(); ) {
             map_[it->first] = it->second.coins;
@@ -52,11 +64,26 @@ public:
             mapCoins.erase(it++);
         }
         mapCoins.clear();
+        for (CAddressBalanceMap::iterator it = mapBalances.begin(); it != mapBalances.end(); it++) {
+            if (it->second.IsNull()) {
+                balances_.erase(it->first);
+            } else {
+                balances_[it->first] = it->second;
+            }
+        }
+        mapBalances.clear();
+        totals_ += totals;
+        totals.SetNull();
         hashBestBlock_ = hashBlock;
         return true;
     }
 
-    bool GetStats(CCoinsStats& stats) const { return false; }
+    bool GetStats(CCoinsStats& stats) const
+    {
+        totals_.GetStats(stats);
+        stats.hashBlock = hashBestBlock_;
+        return true;
+    }
 };
 }
 
@@ -175,4 +202,128 @@ BOOST_AUTO_TEST_CASE(coins_cache_simulation_test)
     BOOST_CHECK(missed_an_entry);
 }
 
+// A smaller simulation of random updates on a stack of caches, keeping the
+// set totals up to date the way ConnectBlock and DisconnectBlock do. The totals
+// seen through the tip must match a scan of the expected set at all times.
+BOOST_AUTO_TEST_CASE(coins_totals_test)
+{
+    bool flushed_to_base = false;
+    std::map<uint256, CCoins> result;
+
+    CCoinsViewTest base;
+    std::vector<CCoinsViewCache*> stack;
+    stack.push_back(new CCoinsViewCache(&base));
+
+    std::vector<uint256> txids;
+    txids.resize(NUM_SIMULATION_ITERATIONS / 80);
+    for (unsigned int i = 0; i < txids.size(); i++) {
+        txids[i] = GetRandHash();
+    }
+
+    for (unsigned int i = 0; i < NUM_SIMULATION_ITERATIONS / 10; i++) {
+        uint256 txid = txids[insecure_rand() % txids.size()];
+        CCoins& coins = result[txid];
+        const CCoins* before = stack.back()->AccessCoins(txid);
+        if (before) {
+            stack.back()->UpdateTotals(txid, *before, -1);
+        }
+        {
+            CCoinsModifier entry = stack.back()->ModifyCoins(txid);
+            if (insecure_rand() % 5 == 0 || coins.IsPruned()) {
+                coins.nVersion = insecure_rand();
+                coins.vout.resize(1 + insecure_rand() % 3);
+                for (unsigned int n = 0; n < coins.vout.size(); n++) {
+                    coins.vout[n].nValue = insecure_rand();
+                }
+                *entry = coins;
+            } else {
+                coins.Clear();
+                entry->Clear();
+            }
+        }
+        const CCoins* after = stack.back()->AccessCoins(txid);
+        if (after) {
+            stack.back()->UpdateTotals(txid, *after, 1);
+        }
+
+        if (insecure_rand() % 100 == 1 || i == NUM_SIMULATION_ITERATIONS / 10 - 1) {
+            CCoinsTotals expected;
+            for (std::map<uint256, CCoins>::iterator it = result.begin(); it != result.end(); it++) {
+                expected.Update(it->first, it->second, 1);
+            }
+            CCoinsStats stats;
+            BOOST_CHECK(stack.back()->GetStats(stats));
+            BOOST_CHECK_EQUAL(stats.nTransactions, (uint64_t)expected.nTransactions);
+            BOOST_CHECK_EQUAL(stats.nTransactionOutputs, (uint64_t)expected.nTransactionOutputs);
+            BOOST_CHECK_EQUAL(stats.nSerializedSize, (uint64_t)expected.nSerializedSize);
+            BOOST_CHECK_EQUAL(stats.nTotalAmount, expected.nTotalAmount);
+            BOOST_CHECK(stats.hashSerialized == expected.hashSerialized);
+        }
+
+        if (insecure_rand() % 10 == 0) {
+            if (insecure_rand() % 2 == 0) {
+                stack.back()->Flush();
+                if (stack.size() == 1) {
+                    flushed_to_base = true;
+                }
+                if (stack.size() > 1) {
+                    delete stack.back();
+                    stack.pop_back();
+                }
+            } else if (stack.size() < 4) {
+                stack.push_back(new CCoinsViewCache(stack.back()));
+            }
+        }
+    }
+
+    while (stack.size() > 0) {
+        delete stack.back();
+        stack.pop_back();
+    }
+
+    BOOST_CHECK(flushed_to_base);
+}
+
+// Apply and undo address balance changes through a stack of caches and make
+// sure entries only reach the base view when flushed, and disappear again once
+// their last reference is undone.
+BOOST_AUTO_TEST_CASE(coins_address_balance_test)
+{
+    CCoinsViewTest base;
+    CCoinsViewCache tip(&base);
+    CAddressBalance balance;
+
+    {
+        CCoinsViewCache block(&tip);
+        CAddressBalance& entry = block.ModifyAddressBalance("addr1");
+        entry.nBalance += 50;
+        entry.nRefs++;
+        BOOST_CHECK(!tip.GetAddressBalance("addr1", balance));
+        BOOST_CHECK_EQUAL(block.GetCacheSize(), 1U);
+        BOOST_CHECK(block.Flush());
+    }
+    BOOST_CHECK(tip.GetAddressBalance("addr1", balance));
+    BOOST_CHECK_EQUAL(balance.nBalance, 50);
+    BOOST_CHECK(!base.GetAddressBalance("addr1", balance));
+    // Pending balance entries count towards the flush threshold
+    BOOST_CHECK_EQUAL(tip.GetCacheSize(), 1U);
+
+    BOOST_CHECK(tip.Flush());
+    BOOST_CHECK_EQUAL(tip.GetCacheSize(), 0U);
+    BOOST_CHECK(base.GetAddressBalance("addr1", balance));
+    BOOST_CHECK_EQUAL(balance.nBalance, 50);
+    BOOST_CHECK_EQUAL(balance.nRefs, 1U);
+
+    {
+        CCoinsViewCache block(&tip);
+        CAddressBalance& entry = block.ModifyAddressBalance("addr1");
+        entry.nBalance -= 50;
+        entry.nRefs--;
+        BOOST_CHECK(!block.GetAddressBalance("addr1", balance));
+        BOOST_CHECK(block.Flush());
+    }
+    BOOST_CHECK(tip.Flush());
+    BOOST_CHECK(!base.GetAddressBalance("addr1", balance));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,169 @@
+// Copyright (c) 2015 The Bitcredit Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "coinsprefetch.h"
+
+#include "uint256.h"
+#include "utiltime.h"
+
+#include <map>
+#include <vector>
+
+#include <boost/atomic.hpp>
+#include <boost/test/unit_test.hpp>
+
+namespace
+{
+/** In-memory view that counts how often it is read */
+class CCoinsViewCounting : public CCoinsView
+{
+    std::map<uint256, CCoins> map_;
+
+public:
+    mutable boost::atomic<unsigned int> nReads;
+
+    CCoinsViewCounting() : nReads(0) {}
+
+    bool GetCoins(const uint256& txid, CCoins& coins) const
+    {
+        nReads++;
+        std::map<uint256, CCoins>::const_iterator it = map_.find(txid);
+        if (it == map_.end())
+            return false;
+        coins = it->second;
+        return true;
+    }
+
+    bool HaveCoins(const uint256& txid) const
+    {
+        CCoins coins;
+        return GetCoins(txid, coins);
+    }
+
+    bool BatchWrite(CCoinsMap& mapCoins, CAddressBalanceMap& mapBalances, CCoinsTotals& totals, const uint256& hashBlock)
+    {
+        for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end(); it++)
+            map_[it->first] = it->second.coins;
+        mapCoins.clear();
+        return true;
+    }
+
+    //! Wait until at least nCount reads have been done
+    void WaitForReads(unsigned int nCount) const
+    {
+        for (int i = 0; i < 5000 && nReads < nCount; i++)
+            MilliSleep(1);
+        BOOST_REQUIRE(nReads >= nCount);
+    }
+};
+
+CCoins MakeCoins(int64_t nValue)
+{
+    CCoins coins;
+    coins.nVersion = 1;
+    coins.nHeight = 1;
+    coins.vout.resize(1);
+    coins.vout[0].nValue = nValue;
+    return coins;
+}
+
+void WriteCoins(CCoinsView& view, const uint256& txid, const CCoins& coins)
+{
+    CCoinsMap mapCoins;
+    CAddressBalanceMap mapBalances;
+    CCoinsTotals totals;
+    mapCoins[txid].coins = coins;
+    mapCoins[txid].flags = CCoinsCacheEntry::DIRTY;
+    view.BatchWrite(mapCoins, mapBalances, totals, uint256());
+}
+
+} // anon namespace
+
+BOOST_AUTO_TEST_SUITE(coinsprefetch_tests)
+
+BOOST_AUTO_TEST_CASE(coinsprefetch_reads)
+{
+    CCoinsViewCounting base;
+    std::vector<uint256> vTxid;
+    for (unsigned int i = 0; i < 50; i++) {
+        vTxid.push_back(uint256(i + 1));
+        // Every other txid exists
+        if (i % 2 == 0)
+            WriteCoins(base, vTxid.back(), MakeCoins(i));
+    }
+    base.nReads = 0;
+
+    CCoinsViewPrefetch view(&base, 4);
+    view.Prefetch(vTxid);
+    // Asking again doesn't read twice
+    view.Prefetch(vTxid);
+    base.WaitForReads(vTxid.size());
+
+    // Every result, found or not, is served from what was read
+    for (unsigned int i = 0; i < vTxid.size(); i++) {
+        CCoins coins;
+        BOOST_CHECK_EQUAL(view.GetCoins(vTxid[i], coins), i % 2 == 0);
+        if (i % 2 == 0)
+            BOOST_CHECK_EQUAL(coins.vout[0].nValue, (int64_t)i);
+    }
+    BOOST_CHECK_EQUAL(base.nReads, vTxid.size());
+
+    // A result is used once; after that the base is read again
+    CCoins coins;
+    BOOST_CHECK(view.GetCoins(vTxid[0], coins));
+    BOOST_CHECK_EQUAL(base.nReads, vTxid.size() + 1);
+
+    std::map<std::string, size_t> mapStats;
+    view.GetInternalStats(mapStats);
+    BOOST_CHECK_EQUAL(mapStats["coinsprefetch.threads"], 4U);
+    BOOST_CHECK_EQUAL(mapStats["coinsprefetch.requested"], vTxid.size());
+    BOOST_CHECK_EQUAL(mapStats["coinsprefetch.hits"], vTxid.size());
+    BOOST_CHECK_EQUAL(mapStats["coinsprefetch.misses"], 1U);
+    BOOST_CHECK_EQUAL(mapStats["coinsprefetch.pending"], 0U);
+}
+
+BOOST_AUTO_TEST_CASE(coinsprefetch_invalidate)
+{
+    CCoinsViewCounting base;
+    uint256 txid(1);
+    WriteCoins(base, txid, MakeCoins(1));
+    base.nReads = 0;
+
+    CCoinsViewPrefetch view(&base, 2);
+    view.Prefetch(std::vector<uint256>(1, txid));
+    base.WaitForReads(1);
+
+    // Writing through the view drops what was read before
+    WriteCoins(view, txid, MakeCoins(2));
+    CCoins coins;
+    BOOST_CHECK(view.GetCoins(txid, coins));
+    BOOST_CHECK_EQUAL(coins.vout[0].nValue, 2);
+
+    std::map<std::string, size_t> mapStats;
+    view.GetInternalStats(mapStats);
+    BOOST_CHECK_EQUAL(mapStats["coinsprefetch.discarded"], 1U);
+    BOOST_CHECK_EQUAL(mapStats["coinsprefetch.hits"], 0U);
+}
+
+BOOST_AUTO_TEST_CASE(coinsprefetch_disabled)
+{
+    CCoinsViewCounting base;
+    uint256 txid(1);
+    WriteCoins(base, txid, MakeCoins(1));
+    base.nReads = 0;
+
+    // Without threads nothing is read ahead, but reads still pass through
+    CCoinsViewPrefetch view(&base, 0);
+    view.Prefetch(std::vector<uint256>(1, txid));
+    BOOST_CHECK_EQUAL(base.nReads, 0U);
+    CCoins coins;
+    BOOST_CHECK(view.GetCoins(txid, coins));
+    BOOST_CHECK_EQUAL(base.nReads, 1U);
+
+    std::map<std::string, size_t> mapStats;
+    view.GetInternalStats(mapStats);
+    BOOST_CHECK_EQUAL(mapStats["coinsprefetch.requested"], 0U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
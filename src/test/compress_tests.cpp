@@ -2,7 +2,10 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include "compressdata.h"
 #include "compressor.h"
+#include "lz4/lz4.h"
+#include "random.h"
 #include "util.h"
 
 #include <stdint.h>
@@ -61,4 +64,89 @@ BOOST_AUTO_TEST_CASE(compress_amounts)
         BOOST_CHECK(TestDecode(i));
 }
 
+BOOST_AUTO_TEST_CASE(compress_data_frames)
+{
+    // Compressible and incompressible data spanning several chunks
+    std::vector<char> vchData;
+    for (unsigned int i = 0; i < 3 * LZ4_FRAME_CHUNK_SIZE + 123; i++)
+        vchData.push_back(i < 2 * LZ4_FRAME_CHUNK_SIZE ? (char)(i % 251) : (char)insecure_rand());
+
+    std::vector<unsigned char> vchFrame, vchOut;
+    BOOST_CHECK(CompressData(&vchData[0], vchData.size(), vchFrame));
+    BOOST_CHECK(vchFrame.size() <= LZ4FrameBound(vchData.size()));
+    BOOST_CHECK(UncompressData(&vchFrame[0], vchFrame.size(), vchOut));
+    BOOST_CHECK(vchOut == std::vector<unsigned char>(vchData.begin(), vchData.end()));
+
+    // Streaming writes of odd sizes produce the same frame
+    std::vector<unsigned char> vchStream;
+    CLZ4FrameWriter writer;
+    writer.Begin(vchStream);
+    for (size_t nPos = 0; nPos < vchData.size(); nPos += 1000)
+        BOOST_CHECK(writer.Write(&vchData[nPos], std::min((size_t)1000, vchData.size() - nPos)));
+    BOOST_CHECK(writer.End());
+    BOOST_CHECK(vchStream == vchFrame);
+
+    // Streaming reads, down to a byte at a time
+    CLZ4FrameReader reader;
+    for (size_t nPiece = 1; nPiece < vchFrame.size(); nPiece = nPiece * 7 + 3)
+    {
+        vchOut.clear();
+        reader.Begin();
+        for (size_t nPos = 0; nPos < vchFrame.size(); nPos += nPiece)
+        {
+            BOOST_CHECK(!reader.IsComplete());
+            BOOST_CHECK(reader.Read(&vchFrame[nPos], std::min(nPiece, vchFrame.size() - nPos), vchOut));
+        }
+        BOOST_CHECK(reader.IsComplete());
+        BOOST_CHECK(vchOut == std::vector<unsigned char>(vchData.begin(), vchData.end()));
+    }
+
+    // Empty data
+    BOOST_CHECK(CompressData(NULL, 0, vchFrame));
+    BOOST_CHECK(UncompressData(&vchFrame[0], vchFrame.size(), vchOut));
+    BOOST_CHECK(vchOut.empty());
+
+    // String wrappers
+    std::string str(10000, 'x');
+    BOOST_CHECK(UncompressData(CompressData(str)) == str);
+}
+
+BOOST_AUTO_TEST_CASE(compress_data_corrupt)
+{
+    std::vector<char> vchData(100000, 'a');
+    std::vector<unsigned char> vchFrame, vchBad, vchOut;
+    BOOST_CHECK(CompressData(&vchData[0], vchData.size(), vchFrame));
+
+    // Truncated
+    BOOST_CHECK(!UncompressData(&vchFrame[0], vchFrame.size() - 1, vchOut));
+    // Trailing data
+    vchBad = vchFrame;
+    vchBad.push_back(0);
+    BOOST_CHECK(!UncompressData(&vchBad[0], vchBad.size(), vchOut));
+    // Original size above the limit
+    BOOST_CHECK(!UncompressData(&vchFrame[0], vchFrame.size(), vchOut, vchData.size() - 1));
+    // Every flipped byte is caught by the chunk lengths, LZ4 or the checksum
+    for (size_t i = 4; i < vchFrame.size(); i++)
+    {
+        vchBad = vchFrame;
+        vchBad[i] ^= 0x20;
+        BOOST_CHECK(!UncompressData(&vchBad[0], vchBad.size(), vchOut));
+        BOOST_CHECK(vchOut.empty());
+    }
+}
+
+BOOST_AUTO_TEST_CASE(compress_data_bare_block)
+{
+    // Bare LZ4 blocks from older peers, with a ratio well beyond 10
+    std::vector<char> vchData(1000000, 'b');
+    std::vector<char> vchBlock(LZ4_compressBound(vchData.size()));
+    vchBlock.resize(LZ4_compress(&vchData[0], &vchBlock[0], vchData.size()));
+    BOOST_CHECK(vchBlock.size() * 10 < vchData.size());
+
+    std::vector<unsigned char> vchOut;
+    BOOST_CHECK(UncompressData((unsigned char*)&vchBlock[0], vchBlock.size(), vchOut));
+    BOOST_CHECK(vchOut == std::vector<unsigned char>(vchData.begin(), vchData.end()));
+    BOOST_CHECK(!UncompressData((unsigned char*)&vchBlock[0], vchBlock.size(), vchOut, vchData.size() - 1));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
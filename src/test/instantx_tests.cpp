@@ -0,0 +1,50 @@
+// Copyright (c) 2015 The Bitcredit Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "instantx.h"
+
+#include "random.h"
+#include "uint256.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(instantx_tests)
+
+// Only votes for the height of the lock count, however many others it gets
+BOOST_AUTO_TEST_CASE(lock_count_signatures)
+{
+    CTransactionLock lock;
+    lock.nBlockHeight = 0;
+    lock.txHash = GetRandHash();
+    BOOST_CHECK_EQUAL(lock.CountSignatures(), -1);
+
+    lock.nBlockHeight = 100;
+    BOOST_CHECK_EQUAL(lock.CountSignatures(), 0);
+
+    CConsensusVote vote;
+    vote.txHash = lock.txHash;
+    for (int i = 0; i < 30; i++) {
+        vote.nBlockHeight = 98 + i % 3;
+        lock.AddSignature(vote);
+    }
+    BOOST_CHECK_EQUAL(lock.vecConsensusVotes.size(), 30U);
+    BOOST_CHECK_EQUAL(lock.CountSignatures(), 10);
+
+    lock.nBlockHeight = 99;
+    BOOST_CHECK_EQUAL(lock.CountSignatures(), 10);
+    lock.nBlockHeight = 101;
+    BOOST_CHECK_EQUAL(lock.CountSignatures(), 0);
+}
+
+BOOST_AUTO_TEST_CASE(vote_unknown_banknode)
+{
+    // Votes from banknodes we do not know are never valid
+    CConsensusVote vote;
+    vote.txHash = GetRandHash();
+    vote.nBlockHeight = 1;
+    vote.vchBankNodeSignature.resize(65);
+    BOOST_CHECK(!vote.SignatureValid());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,98 @@
+// Copyright (c) 2015 The Bitcredit Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "momentum.h"
+
+#include "random.h"
+#include "uint256.h"
+
+#include <string.h>
+#include <vector>
+
+#include <openssl/sha.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(momentum_tests)
+
+// Compare every birthday hash implementation the host supports with
+// OpenSSL's SHA512 over the same momentum messages.
+BOOST_AUTO_TEST_CASE(birthday_hashes_match_sha512)
+{
+    const char* impls[] = {"generic", "avx2", "avx512"};
+    const uint32_t bases[] = {0, 64, 1 << 20, (1 << 26) - 64, 0xffffffc0};
+
+    for (unsigned int n = 0; n < sizeof(impls) / sizeof(impls[0]); n++) {
+        uint64_t out[64];
+        if (!bts::momentum_birthday_hashes(impls[n], uint256(0), 0, out)) {
+            BOOST_TEST_MESSAGE(std::string("skipping unsupported ") + impls[n]);
+            continue;
+        }
+        for (int i = 0; i < 16; i++) {
+            uint256 midHash = (i == 0) ? uint256(0) : GetRandHash();
+            for (unsigned int b = 0; b < sizeof(bases) / sizeof(bases[0]); b++) {
+                uint32_t nBase = bases[b];
+                BOOST_CHECK(bts::momentum_birthday_hashes(impls[n], midHash, nBase, out));
+                for (uint32_t j = 0; j < 8; j++) {
+                    // The message is the nonce index followed by the mid hash
+                    unsigned char msg[4 + sizeof(midHash)];
+                    uint32_t index = nBase + j * 8;
+                    memcpy(msg, &index, sizeof(index));
+                    memcpy(msg + 4, &midHash, sizeof(midHash));
+                    uint64_t expected[8];
+                    SHA512(msg, sizeof(msg), (unsigned char*)expected);
+                    BOOST_CHECK_MESSAGE(memcmp(&out[j * 8], expected, sizeof(expected)) == 0,
+                        std::string(impls[n]) + " differs from SHA512 for " + midHash.ToString());
+                }
+            }
+        }
+    }
+}
+
+// Search and verification must agree on the birthday of every nonce
+BOOST_AUTO_TEST_CASE(birthday_hashes_match_verify)
+{
+    uint256 midHash = GetRandHash();
+    uint64_t out[64];
+    BOOST_CHECK(bts::momentum_birthday_hashes("generic", midHash, 128, out));
+    for (uint32_t k = 0; k < 64; k++)
+        BOOST_CHECK_EQUAL(bts::getBirthdayHash(midHash, 128 + k), out[k] >> 14);
+}
+
+BOOST_AUTO_TEST_CASE(momentum_cache_bounded)
+{
+    const size_t nMax = 100;
+    bts::CMomentumCache cache(nMax);
+    std::vector<uint256> vHashes;
+    for (size_t i = 0; i < nMax; i++) {
+        vHashes.push_back(GetRandHash());
+        BOOST_CHECK(!cache.Get(vHashes.back()));
+        cache.Set(vHashes.back());
+    }
+
+    // Up to the limit, every verified header is a hit and nothing else is
+    BOOST_CHECK_EQUAL(cache.GetSize(), nMax);
+    for (size_t i = 0; i < nMax; i++)
+        BOOST_CHECK(cache.Get(vHashes[i]));
+    BOOST_CHECK(!cache.Get(GetRandHash()));
+
+    // Past it, each insert evicts exactly one earlier entry
+    for (size_t i = 0; i < nMax; i++) {
+        uint256 hash = GetRandHash();
+        cache.Set(hash);
+        BOOST_CHECK(cache.Get(hash));
+        BOOST_CHECK_EQUAL(cache.GetSize(), nMax);
+    }
+    size_t nHits = 0;
+    for (size_t i = 0; i < nMax; i++)
+        nHits += cache.Get(vHashes[i]);
+    BOOST_CHECK(nHits < nMax);
+
+    bts::CMomentumCache disabled(0);
+    disabled.Set(vHashes[0]);
+    BOOST_CHECK(!disabled.Get(vHashes[0]));
+    BOOST_CHECK_EQUAL(disabled.GetSize(), 0U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,89 @@
+// Copyright (c) 2015 The Bitcredit Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "netbuffer.h"
+
+#include <map>
+#include <string>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(netbuffer_tests)
+
+BOOST_AUTO_TEST_CASE(netbuffer_reuse)
+{
+    CNetBufferPool pool;
+    std::map<std::string, size_t> mapStats;
+
+    // Rounded up to the size class
+    CSerializeData vch;
+    pool.Acquire(vch, 100);
+    BOOST_CHECK(vch.empty());
+    BOOST_CHECK_EQUAL(vch.capacity(), CNetBufferPool::CLASS_SIZE[0]);
+    vch.insert(vch.end(), 100, 'x');
+    const char* pchStorage = &vch[0];
+
+    // Given back and handed out again for a request of the same class
+    pool.Release(vch);
+    BOOST_CHECK_EQUAL(vch.capacity(), 0U);
+    pool.Acquire(vch, CNetBufferPool::CLASS_SIZE[0]);
+    BOOST_CHECK(vch.empty());
+    vch.push_back('y');
+    BOOST_CHECK(&vch[0] == pchStorage);
+
+    // But not for a larger one
+    CSerializeData vchLarge;
+    pool.Acquire(vchLarge, CNetBufferPool::CLASS_SIZE[0] + 1);
+    BOOST_CHECK_EQUAL(vchLarge.capacity(), CNetBufferPool::CLASS_SIZE[1]);
+
+    pool.GetStats(mapStats);
+    BOOST_CHECK_EQUAL(mapStats["netbuffer.hits"], 1U);
+    BOOST_CHECK_EQUAL(mapStats["netbuffer.misses"], 2U);
+    BOOST_CHECK_EQUAL(mapStats["netbuffer.hit_rate_pct"], 33U);
+
+    pool.Release(vch);
+    pool.Release(vchLarge);
+    mapStats.clear();
+    pool.GetStats(mapStats);
+    BOOST_CHECK_EQUAL(mapStats["netbuffer.free_bytes"], CNetBufferPool::CLASS_SIZE[0] + CNetBufferPool::CLASS_SIZE[1]);
+
+    pool.Clear();
+    mapStats.clear();
+    pool.GetStats(mapStats);
+    BOOST_CHECK_EQUAL(mapStats["netbuffer.free_bytes"], 0U);
+}
+
+BOOST_AUTO_TEST_CASE(netbuffer_limits)
+{
+    CNetBufferPool pool;
+    std::map<std::string, size_t> mapStats;
+    const unsigned int nLast = CNetBufferPool::NUM_CLASSES - 1;
+
+    // Larger than any class: allocated as requested and not kept
+    CSerializeData vch;
+    size_t nHuge = CNetBufferPool::CLASS_SIZE[nLast] * 3;
+    pool.Acquire(vch, nHuge);
+    BOOST_CHECK(vch.capacity() >= nHuge);
+    pool.Release(vch);
+    BOOST_CHECK_EQUAL(vch.capacity(), 0U);
+
+    // Too small for any class
+    vch.reserve(CNetBufferPool::CLASS_SIZE[0] / 2);
+    pool.Release(vch);
+
+    // Each class keeps a bounded number of buffers
+    for (unsigned int i = 0; i <= CNetBufferPool::CLASS_MAX_FREE[nLast]; i++)
+    {
+        CSerializeData vchFree;
+        vchFree.reserve(CNetBufferPool::CLASS_SIZE[nLast]);
+        pool.Release(vchFree);
+    }
+
+    pool.GetStats(mapStats);
+    BOOST_CHECK_EQUAL(mapStats["netbuffer.oversize"], 1U);
+    BOOST_CHECK_EQUAL(mapStats["netbuffer.dropped"], 3U);
+    BOOST_CHECK_EQUAL(mapStats["netbuffer.free_bytes"], CNetBufferPool::CLASS_MAX_FREE[nLast] * CNetBufferPool::CLASS_SIZE[nLast]);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
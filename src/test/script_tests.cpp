@@ -6,6 +6,7 @@
 #include "data/script_valid.json.h"
 
 #include "core_io.h"
+#include "ecwrapper.h"
 #include "key.h"
 #include "keystore.h"
 #include "main.h"
@@ -31,6 +32,7 @@
 #include <boost/filesystem/path.hpp>
 #include <boost/foreach.hpp>
 #include <boost/test/unit_test.hpp>
+#include <openssl/opensslv.h>
 #include "json/json_spirit_reader_template.h"
 #include "json/json_spirit_utils.h"
 #include "json/json_spirit_writer_template.h"
@@ -95,6 +97,33 @@ CMutableTransaction BuildSpendingTransaction(const CScript& scriptSig, const CMu
     return txSpend;
 }
 
+/** Verifies every signature with OpenSSL as well, and checks that it agrees with libsecp256k1 */
+class OpenSSLComparingChecker : public SignatureChecker
+{
+private:
+    std::string message;
+
+protected:
+    bool VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& pubkey, const uint256& sighash) const
+    {
+        bool fSecp256k1 = SignatureChecker::VerifySignature(vchSig, pubkey, sighash);
+        bool fOpenSSL = false;
+        CECKey key;
+        if (pubkey.IsValid() && key.SetPubKey(pubkey.begin(), pubkey.size()))
+            fOpenSSL = key.Verify(sighash, vchSig);
+#if OPENSSL_VERSION_NUMBER < 0x10100000L
+        BOOST_CHECK_MESSAGE(fSecp256k1 == fOpenSSL, "libsecp256k1 and OpenSSL disagree: " + HexStr(vchSig) + ": " + message);
+#else
+        // OpenSSL 1.1 and later refuse to parse some BER signatures that consensus accepts
+        BOOST_CHECK_MESSAGE(fSecp256k1 || !fOpenSSL, "libsecp256k1 rejects a signature OpenSSL accepts: " + HexStr(vchSig) + ": " + message);
+#endif
+        return fSecp256k1;
+    }
+
+public:
+    OpenSSLComparingChecker(const CTransaction& txToIn, unsigned int nInIn, const std::string& messageIn) : SignatureChecker(txToIn, nInIn), message(messageIn) {}
+};
+
 void DoTest(const CScript& scriptPubKey, const CScript& scriptSig, int flags, bool expect, const std::string& message)
 {
     ScriptError err;
@@ -102,6 +131,8 @@ void DoTest(const CScript& scriptPubKey, const CScript& scriptSig, int flags, bo
     CMutableTransaction tx2 = tx;
     BOOST_CHECK_MESSAGE(VerifyScript(scriptSig, scriptPubKey, flags, SignatureChecker(tx, 0), &err) == expect, message);
     BOOST_CHECK_MESSAGE(expect == (err == SCRIPT_ERR_OK), std::string(ScriptErrorString(err)) + ": " + message);
+    CTransaction txConst(tx);
+    BOOST_CHECK_MESSAGE(VerifyScript(scriptSig, scriptPubKey, flags, OpenSSLComparingChecker(txConst, 0, message)) == expect, message);
 #if defined(HAVE_CONSENSUS_LIB)
     CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
     stream << tx2;
@@ -0,0 +1,92 @@
+// Copyright (c) 2015 The Bitcredit Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "script/sigcache.h"
+
+#include "key.h"
+#include "random.h"
+#include "uint256.h"
+
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(sigcache_tests)
+
+BOOST_AUTO_TEST_CASE(sigcache_entries)
+{
+    CSignatureCache cache(1 << 16);
+    BOOST_CHECK_EQUAL(cache.GetBucketCount(), 1024U);
+
+    CKey key;
+    key.MakeNewKey(true);
+    CPubKey pubkey = key.GetPubKey();
+    uint256 hash = GetRandHash();
+    std::vector<unsigned char> vchSig;
+    BOOST_CHECK(key.Sign(hash, vchSig));
+
+    uint256 entry;
+    cache.ComputeEntry(entry, hash, vchSig, pubkey);
+    BOOST_CHECK(!cache.Get(entry));
+    cache.Set(entry);
+    BOOST_CHECK(cache.Get(entry));
+
+    // Any part of the triple changes the entry
+    uint256 other;
+    cache.ComputeEntry(other, ~hash, vchSig, pubkey);
+    BOOST_CHECK(!cache.Get(other));
+    CKey key2;
+    key2.MakeNewKey(true);
+    cache.ComputeEntry(other, hash, vchSig, key2.GetPubKey());
+    BOOST_CHECK(!cache.Get(other));
+    std::vector<unsigned char> vchSig2(vchSig);
+    vchSig2.push_back(0);
+    cache.ComputeEntry(other, hash, vchSig2, pubkey);
+    BOOST_CHECK(!cache.Get(other));
+
+    // Entries are salted per cache
+    CSignatureCache cache2(1 << 16);
+    cache2.ComputeEntry(other, hash, vchSig, pubkey);
+    BOOST_CHECK(other != entry);
+
+    // A cache without memory keeps nothing
+    CSignatureCache cacheNone(0);
+    BOOST_CHECK_EQUAL(cacheNone.GetBucketCount(), 0U);
+    cacheNone.Set(entry);
+    BOOST_CHECK(!cacheNone.Get(entry));
+}
+
+BOOST_AUTO_TEST_CASE(sigcache_bounded)
+{
+    CSignatureCache cache(1 << 12);
+    const unsigned int nCapacity = cache.GetBucketCount() * CSignatureCache::BUCKET_ENTRIES;
+
+    // Filling the table to half its capacity keeps nearly everything
+    std::vector<uint256> vEntries;
+    for (unsigned int i = 0; i < nCapacity / 2; i++)
+    {
+        vEntries.push_back(GetRandHash());
+        cache.Set(vEntries.back());
+    }
+    unsigned int nFound = 0;
+    for (unsigned int i = 0; i < vEntries.size(); i++)
+        nFound += cache.Get(vEntries[i]);
+    BOOST_CHECK(nFound * 10 >= vEntries.size() * 9);
+
+    // Overfilling it evicts, but never holds more than it has room for,
+    // and the most recent entry is always present
+    for (unsigned int i = 0; i < nCapacity * 4; i++)
+    {
+        vEntries.push_back(GetRandHash());
+        cache.Set(vEntries.back());
+        BOOST_CHECK(cache.Get(vEntries.back()));
+    }
+    nFound = 0;
+    for (unsigned int i = 0; i < vEntries.size(); i++)
+        nFound += cache.Get(vEntries[i]);
+    BOOST_CHECK(nFound <= nCapacity);
+    BOOST_CHECK(nFound >= nCapacity / 2);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
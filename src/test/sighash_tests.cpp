@@ -3,6 +3,8 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "data/sighash.json.h"
+#include "ecwrapper.h"
+#include "key.h"
 #include "main.h"
 #include "random.h"
 #include "serialize.h"
@@ -14,6 +16,7 @@
 #include <iostream>
 
 #include <boost/test/unit_test.hpp>
+#include <openssl/opensslv.h>
 #include "json/json_spirit_reader_template.h"
 #include "json/json_spirit_utils.h"
 #include "json/json_spirit_writer_template.h"
@@ -211,4 +214,159 @@ BOOST_AUTO_TEST_CASE(sighash_from_data)
         BOOST_CHECK_MESSAGE(sh.GetHex() == sigHashHex, strTest);
     }
 }
+
+/** BER encodings of a DER signature that OpenSSL decodes to the same R and S */
+static std::vector<std::vector<unsigned char> > BEREncodings(const std::vector<unsigned char>& vchSig)
+{
+    std::vector<std::vector<unsigned char> > vEncodings;
+    unsigned int nLenR = vchSig[3];
+    std::vector<unsigned char> vchContent(vchSig.begin() + 2, vchSig.end());
+    std::vector<unsigned char> vch;
+
+    // Excess padding of R
+    vch = vchSig;
+    vch.insert(vch.begin() + 4, 0x00);
+    vch[1]++;
+    vch[3]++;
+    vEncodings.push_back(vch);
+
+    // Long form length of the sequence and of S
+    vch = vchSig;
+    vch.insert(vch.begin() + 1, 0x81);
+    vch.insert(vch.begin() + 4 + nLenR + 2, 0x81);
+    vch[2]++;
+    vEncodings.push_back(vch);
+
+    // Indefinite length of the sequence
+    vch.assign(1, 0x30);
+    vch.push_back(0x80);
+    vch.insert(vch.end(), vchContent.begin(), vchContent.end());
+    vch.push_back(0x00);
+    vch.push_back(0x00);
+    vEncodings.push_back(vch);
+
+    // Data after the signature
+    vch = vchSig;
+    vch.push_back(0x01);
+    vEncodings.push_back(vch);
+
+    return vEncodings;
+}
+
+/** Encodings that are no signature */
+static std::vector<std::vector<unsigned char> > BadEncodings(const std::vector<unsigned char>& vchSig)
+{
+    std::vector<std::vector<unsigned char> > vEncodings;
+    unsigned int nLenR = vchSig[3];
+    std::vector<unsigned char> vch;
+
+    // Truncated
+    vch.assign(vchSig.begin(), vchSig.end() - 1);
+    vEncodings.push_back(vch);
+
+    // Data after S inside the sequence
+    vch = vchSig;
+    vch.push_back(0x01);
+    vch[1]++;
+    vEncodings.push_back(vch);
+
+    // Negative R and S: the padding is dropped where there is some, or
+    // else the sign bit is set
+    for (unsigned int nPosInt = 2; nPosInt < vchSig.size(); nPosInt += 2 + vchSig[nPosInt + 1]) {
+        vch = vchSig;
+        if (vch[nPosInt + 2] == 0x00) {
+            vch.erase(vch.begin() + nPosInt + 2);
+            vch[1]--;
+            vch[nPosInt + 1]--;
+        } else {
+            vch[nPosInt + 2] |= 0x80;
+        }
+        vEncodings.push_back(vch);
+    }
+
+    // Wrong type of R
+    vch = vchSig;
+    vch[2] = 0x03;
+    vEncodings.push_back(vch);
+
+    // Zero length S
+    vch.assign(vchSig.begin(), vchSig.begin() + 4 + nLenR);
+    vch.push_back(0x02);
+    vch.push_back(0x00);
+    vch[1] = vch.size() - 2;
+    vEncodings.push_back(vch);
+
+    // Indefinite length without end-of-contents
+    vch = vchSig;
+    vch[1] = 0x80;
+    vEncodings.push_back(vch);
+
+    vEncodings.push_back(std::vector<unsigned char>());
+    return vEncodings;
+}
+
+// Goal: check that libsecp256k1 and OpenSSL agree on signatures of the sighash vectors
+BOOST_AUTO_TEST_CASE(sighash_verify_openssl)
+{
+    Array tests = read_json(std::string(json_tests::sighash, json_tests::sighash + sizeof(json_tests::sighash)));
+
+    CKey key;
+    key.MakeNewKey(true);
+    CPubKey pubkey = key.GetPubKey();
+    CPubKey pubkeyFull = pubkey;
+    BOOST_CHECK(pubkeyFull.Decompress());
+
+    BOOST_FOREACH(Value& tv, tests)
+    {
+        Array test = tv.get_array();
+        std::string strTest = write_string(tv, false);
+        if (test.size() < 5)
+            continue;
+
+        CTransaction tx;
+        CScript scriptCode;
+        int nIn, nHashType;
+        try {
+            CDataStream stream(ParseHex(test[0].get_str()), SER_NETWORK, PROTOCOL_VERSION);
+            stream >> tx;
+            std::vector<unsigned char> raw = ParseHex(test[1].get_str());
+            scriptCode.insert(scriptCode.end(), raw.begin(), raw.end());
+            nIn = test[2].get_int();
+            nHashType = test[3].get_int();
+        } catch (...) {
+            BOOST_ERROR("Bad test, couldn't deserialize data: " << strTest);
+            continue;
+        }
+
+        uint256 sh = SignatureHash(scriptCode, tx, nIn, nHashType);
+        std::vector<unsigned char> vchSig;
+        BOOST_CHECK(key.Sign(sh, vchSig));
+
+        for (int i = 0; i < 2; i++)
+        {
+            const CPubKey& pk = i == 0 ? pubkey : pubkeyFull;
+            CECKey eckey;
+            BOOST_CHECK(eckey.SetPubKey(pk.begin(), pk.size()));
+
+            BOOST_CHECK_MESSAGE(pk.Verify(sh, vchSig), strTest);
+            BOOST_CHECK_MESSAGE(eckey.Verify(sh, vchSig), strTest);
+            BOOST_CHECK_MESSAGE(!pk.Verify(~sh, vchSig), strTest);
+            BOOST_CHECK_MESSAGE(!eckey.Verify(~sh, vchSig), strTest);
+
+            std::vector<std::vector<unsigned char> > vBER = BEREncodings(vchSig);
+            BOOST_FOREACH(const std::vector<unsigned char>& vch, vBER)
+            {
+                BOOST_CHECK_MESSAGE(pk.Verify(sh, vch), HexStr(vch) + ": " + strTest);
+#if OPENSSL_VERSION_NUMBER < 0x10100000L
+                // OpenSSL 1.1 and later refuse to parse some of these
+                BOOST_CHECK_MESSAGE(eckey.Verify(sh, vch), HexStr(vch) + ": " + strTest);
+#endif
+            }
+
+            std::vector<std::vector<unsigned char> > vBad = BadEncodings(vchSig);
+            BOOST_FOREACH(const std::vector<unsigned char>& vch, vBad)
+                BOOST_CHECK_MESSAGE(!pk.Verify(sh, vch) && !eckey.Verify(sh, vch), HexStr(vch) + ": " + strTest);
+        }
+    }
+}
 BOOST_AUTO_TEST_SUITE_END()
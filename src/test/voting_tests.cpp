@@ -0,0 +1,181 @@
+// Copyright (c) 2015 The Bitcredit Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "voting.h"
+
+#include "chain.h"
+#include "chainparams.h"
+#include "key.h"
+#include "main.h"
+#include "script/standard.h"
+#include "uint256.h"
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+namespace
+{
+const int NUM_OFFICES = 6;
+//! Number of blocks ensureGrantDatabaseUptoDate stays behind the block asked for
+const int GRANT_LAG = 5;
+
+/** Persisted state of the grant database */
+struct CGrantState
+{
+    int64_t nHeight;
+    std::map<std::string, int64_t> balances;
+    std::map<std::string, std::map<int64_t, std::string> > preferences[NUM_OFFICES];
+
+    bool operator==(const CGrantState& other) const
+    {
+        if (nHeight != other.nHeight || balances != other.balances)
+            return false;
+        for (int i = 0; i < NUM_OFFICES; i++)
+            if (preferences[i] != other.preferences[i])
+                return false;
+        return true;
+    }
+};
+
+CGrantState ReadGrantState()
+{
+    CGrantState state;
+    BOOST_CHECK(pgrantdb->ReadHeight(state.nHeight));
+    BOOST_CHECK(pgrantdb->LoadState(state.balances, state.preferences, NUM_OFFICES));
+    return state;
+}
+
+/** Blocks paying a fresh address each, stored on disk and put on top of chainActive */
+class CTestChain
+{
+private:
+    std::vector<CBlockIndex*> vIndex;
+    CDiskBlockPos pos;
+
+public:
+    CTestChain() : pos(1000, 0) {}
+
+    ~CTestChain()
+    {
+        chainActive.SetTip(chainActive.Genesis());
+        for (unsigned int i = 0; i < vIndex.size(); i++) {
+            delete vIndex[i]->phashBlock;
+            delete vIndex[i];
+        }
+    }
+
+    CBlockIndex* Connect(CAmount nValue)
+    {
+        CKey key;
+        key.MakeNewKey(true);
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].scriptSig = CScript() << chainActive.Height() + 1 << OP_0;
+        tx.vout.resize(1);
+        tx.vout[0].nValue = nValue;
+        tx.vout[0].scriptPubKey = GetScriptForDestination(key.GetPubKey().GetID());
+
+        CBlock block;
+        block.nVersion = 1;
+        block.hashPrevBlock = chainActive.Tip()->GetBlockHash();
+        block.nTime = chainActive.Tip()->nTime + 1;
+        block.nBits = chainActive.Tip()->nBits;
+        block.vtx.push_back(tx);
+        block.hashMerkleRoot = block.BuildMerkleTree();
+        BOOST_CHECK(WriteBlockToDisk(block, pos));
+
+        CBlockIndex* pindex = new CBlockIndex(block);
+        pindex->phashBlock = new uint256(block.GetHash());
+        pindex->pprev = chainActive.Tip();
+        pindex->nHeight = chainActive.Height() + 1;
+        pindex->nFile = pos.nFile;
+        pindex->nDataPos = pos.nPos;
+        pindex->nStatus |= BLOCK_HAVE_DATA;
+        pos.nPos += ::GetSerializeSize(block, SER_DISK, CLIENT_VERSION);
+        vIndex.push_back(pindex);
+        chainActive.SetTip(pindex);
+        return pindex;
+    }
+};
+} // anon namespace
+
+BOOST_AUTO_TEST_SUITE(voting_tests)
+
+// Connect blocks into the grant database the way the chain does, disconnect
+// them again, and check that each disconnect restores the stored state of
+// the block before and removes the undo records it used. Then check that
+// old undo records are pruned.
+BOOST_AUTO_TEST_CASE(grantdb_connect_disconnect)
+{
+    const int N = 20;
+    ModifiableParams()->setSkipProofOfWorkCheck(true);
+    pgrantdb = new CGrantDB(1 << 20, true);
+    LOCK2(cs_main, grantdb);
+    {
+        CTestChain chain;
+
+        // The first update processes the genesis block
+        BOOST_CHECK(ensureGrantDatabaseUptoDate(chainActive.Height() + GRANT_LAG));
+        std::vector<CGrantState> vStates(1, ReadGrantState());
+        BOOST_CHECK_EQUAL(vStates[0].nHeight, chainActive.Height());
+
+        std::vector<CBlockIndex*> vIndex;
+        for (int i = 1; i <= N; i++) {
+            vIndex.push_back(chain.Connect(i * COIN));
+            BOOST_CHECK(ensureGrantDatabaseUptoDate(chainActive.Height() + GRANT_LAG));
+            vStates.push_back(ReadGrantState());
+            BOOST_CHECK_EQUAL(vStates[i].nHeight, vStates[0].nHeight + i);
+            BOOST_CHECK_EQUAL(vStates[i].balances.size(), vStates[0].balances.size() + i);
+        }
+
+        // Asking again for the same height changes nothing
+        BOOST_CHECK(ensureGrantDatabaseUptoDate(chainActive.Height() + GRANT_LAG));
+        BOOST_CHECK(ReadGrantState() == vStates[N]);
+
+        // Disconnecting a block no update processed changes nothing either
+        BOOST_CHECK(disconnectGrantDatabase(chainActive.Genesis()));
+        BOOST_CHECK(ReadGrantState() == vStates[N]);
+
+        CGrantUndo undo;
+        for (int i = N; i >= 1; i--) {
+            BOOST_CHECK(pgrantdb->ReadUndo(vStates[i].nHeight, undo));
+            BOOST_CHECK(disconnectGrantDatabase(vIndex[i - 1]));
+            chainActive.SetTip(vIndex[i - 1]->pprev);
+            BOOST_CHECK(ReadGrantState() == vStates[i - 1]);
+            BOOST_CHECK(!pgrantdb->ReadUndo(vStates[i].nHeight, undo));
+        }
+        BOOST_CHECK(pgrantdb->ReadUndo(vStates[0].nHeight, undo));
+
+        // Connecting the same blocks again reaches the same states
+        for (int i = 1; i <= N; i++) {
+            chainActive.SetTip(vIndex[i - 1]);
+            BOOST_CHECK(ensureGrantDatabaseUptoDate(chainActive.Height() + GRANT_LAG));
+            BOOST_CHECK(ReadGrantState() == vStates[i]);
+        }
+
+        // Updates that catch up over many blocks at once must not leave
+        // undo records behind: only those of the last GRANT_UNDO_DEPTH
+        // updates are kept
+        int64_t nHeight = vStates[N].nHeight;
+        std::vector<int64_t> vHeights;
+        for (unsigned int i = 0; i < GRANT_UNDO_DEPTH + 500; i++) {
+            nHeight += 1 + i % 7;
+            BOOST_CHECK(ensureGrantDatabaseUptoDate(nHeight + GRANT_LAG));
+            vHeights.push_back(nHeight);
+        }
+        std::set<int64_t> setUndo;
+        BOOST_CHECK(pgrantdb->ReadUndoHeights(setUndo));
+        BOOST_CHECK_EQUAL(setUndo.size(), GRANT_UNDO_DEPTH);
+        BOOST_CHECK(std::set<int64_t>(vHeights.end() - GRANT_UNDO_DEPTH, vHeights.end()) == setUndo);
+    }
+    ModifiableParams()->setSkipProofOfWorkCheck(false);
+    delete pgrantdb;
+    pgrantdb = NULL;
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -21,10 +21,21 @@ void static BatchWriteCoins(CLevelDBBatch &batch, const uint256 &hash, const CCo
         batch.Write(make_pair('c', hash), coins);
 }
 
+void static BatchWriteAddressBalance(CLevelDBBatch &batch, const std::string &address, const CAddressBalance &balance) {
+    if (balance.IsNull())
+        batch.Erase(make_pair('A', address));
+    else
+        batch.Write(make_pair('A', address), balance);
+}
+
 void static BatchWriteHashBestChain(CLevelDBBatch &batch, const uint256 &hash) {
     batch.Write('B', hash);
 }
 
+void static BatchWriteTotals(CLevelDBBatch &batch, const uint256 &hash, const CCoinsTotals &totals) {
+    batch.Write('T', make_pair(hash, totals));
+}
+
 CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe) : db(GetDataDir() / "chainstate", nCacheSize, fMemory, fWipe) {
 }
 
@@ -49,7 +60,11 @@ uint256 CCoinsViewDB::GetBestBlock() const {
     return hashBestChain;
 }
 
-bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
+bool CCoinsViewDB::GetAddressBalance(const std::string &address, CAddressBalance &balance) const {
+    return db.Read(make_pair('A', address), balance);
+}
+
+bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, CAddressBalanceMap &mapBalances, CCoinsTotals &totalsIn, const uint256 &hashBlock) {
     CLevelDBBatch batch;
     size_t count = 0;
     size_t changed = 0;
@@ -62,11 +77,22 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
         CCoinsMap::iterator itOld = it++;
         mapCoins.erase(itOld);
     }
+    for (CAddressBalanceMap::const_iterator it = mapBalances.begin(); it != mapBalances.end(); it++)
+        BatchWriteAddressBalance(batch, it->first, it->second);
     if (hashBlock != uint256(0))
         BatchWriteHashBestChain(batch, hashBlock);
-
-    LogPrint("coindb", "Committing %u changed transactions (out of %u) to coin database...\n", (unsigned int)changed, (unsigned int)count);
-    return db.WriteBatch(batch);
+    // Only take on the new totals once they are on disk
+    CCoinsTotals totalsNew = totals;
+    totalsNew += totalsIn;
+    totalsIn.SetNull();
+    BatchWriteTotals(batch, hashBlock != uint256(0) ? hashBlock : GetBestBlock(), totalsNew);
+
+    LogPrint("coindb", "Committing %u changed transactions (out of %u) and %u address balances to coin database...\n", (unsigned int)changed, (unsigned int)count, (unsigned int)mapBalances.size());
+    mapBalances.clear();
+    if (!db.WriteBatch(batch))
+        return false;
+    totals = totalsNew;
+    return true;
 }
 
 CBlockTreeDB::CBlockTreeDB(size_t nCacheSize, bool fMemory, bool fWipe) : CLevelDBWrapper(GetDataDir() / "blocks" / "index", nCacheSize, fMemory, fWipe) {
@@ -97,16 +123,26 @@ bool CBlockTreeDB::ReadLastBlockFile(int &nFile) {
 }
 
 bool CCoinsViewDB::GetStats(CCoinsStats &stats) const {
-    /* It seems that there are no "const iterators" for LevelDB.  Since we
-       only need read operations on it, use a const-cast to get around
-       that restriction.  */
-    boost::scoped_ptr<leveldb::Iterator> pcursor(const_cast<CLevelDBWrapper*>(&db)->NewIterator());
-    pcursor->SeekToFirst();
-
-    CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
+    totals.GetStats(stats);
     stats.hashBlock = GetBestBlock();
-    ss << stats.hashBlock;
-    CAmount nTotalAmount = 0;
+    return true;
+}
+
+bool CCoinsViewDB::LoadTotals() {
+    uint256 hashBestChain = GetBestBlock();
+    std::pair<uint256, CCoinsTotals> record;
+    if (db.Read('T', record) && record.first == hashBestChain) {
+        totals = record.second;
+        return true;
+    }
+
+    LogPrintf("Computing the unspent transaction output set totals...\n");
+    boost::scoped_ptr<leveldb::Iterator> pcursor(db.NewIterator());
+    CDataStream ssKeySet(SER_DISK, CLIENT_VERSION);
+    ssKeySet << make_pair('c', uint256(0));
+    pcursor->Seek(ssKeySet.str());
+
+    totals.SetNull();
     while (pcursor->Valid()) {
         boost::this_thread::interruption_point();
         try {
@@ -114,39 +150,25 @@ bool CCoinsViewDB::GetStats(CCoinsStats &stats) const {
             CDataStream ssKey(slKey.data(), slKey.data()+slKey.size(), SER_DISK, CLIENT_VERSION);
             char chType;
             ssKey >> chType;
-            if (chType == 'c') {
-                leveldb::Slice slValue = pcursor->value();
-                CDataStream ssValue(slValue.data(), slValue.data()+slValue.size(), SER_DISK, CLIENT_VERSION);
-                CCoins coins;
-                ssValue >> coins;
-                uint256 txhash;
-                ssKey >> txhash;
-                ss << txhash;
-                ss << VARINT(coins.nVersion);
-                ss << (coins.fCoinBase ? 'c' : 'n');
-                ss << VARINT(coins.nHeight);
-                stats.nTransactions++;
-                for (unsigned int i=0; i<coins.vout.size(); i++) {
-                    const CTxOut &out = coins.vout[i];
-                    if (!out.IsNull()) {
-                        stats.nTransactionOutputs++;
-                        ss << VARINT(i+1);
-                        ss << out;
-                        nTotalAmount += out.nValue;
-                    }
-                }
-                stats.nSerializedSize += 32 + slValue.size();
-                ss << VARINT(0);
-            }
+            if (chType != 'c')
+                break;
+            leveldb::Slice slValue = pcursor->value();
+            CDataStream ssValue(slValue.data(), slValue.data()+slValue.size(), SER_DISK, CLIENT_VERSION);
+            CCoins coins;
+            ssValue >> coins;
+            uint256 txhash;
+            ssKey >> txhash;
+            totals.Update(txhash, coins, 1);
             pcursor->Next();
         } catch (const std::exception& e) {
             return error("%s: Deserialize or I/O error - %s", __func__, e.what());
         }
     }
-    stats.nHeight = mapBlockIndex.find(GetBestBlock())->second->nHeight;
-    stats.hashSerialized = ss.GetHash();
-    stats.nTotalAmount = nTotalAmount;
-    return true;
+    LogPrintf("Unspent transaction output set: %d transactions, %d outputs\n", totals.nTransactions, totals.nTransactionOutputs);
+
+    CLevelDBBatch batch;
+    BatchWriteTotals(batch, hashBestChain, totals);
+    return db.WriteBatch(batch);
 }
 
 bool CBlockTreeDB::WriteBatchSync(const std::vector<std::pair<int, const CBlockFileInfo*> >& fileInfo, int nLastFile, const std::vector<const CBlockIndex*>& blockinfo) {
@@ -172,48 +194,76 @@ bool CBlockTreeDB::WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos>
     return WriteBatch(batch);
 }
 
-bool CBlockTreeDB::ReadAddrIndex(uint160 addrid, std::vector<CExtDiskTxPos> &list) {
-    boost::scoped_ptr<leveldb::Iterator> pcursor(NewIterator());
-    uint64_t lookupid;
-    {
-        CHashWriter ss(SER_GETHASH, 0);
-        ss << salt;
-        ss << addrid;
-        lookupid = ss.GetHash().GetLow64();
+uint64_t CBlockTreeDB::GetAddrIndexKey(const uint160 &addrid) const {
+    CHashWriter ss(SER_GETHASH, 0);
+    ss << salt;
+    ss << addrid;
+    return ss.GetHash().GetLow64();
+}
+
+CAddrIndexCursor::CAddrIndexCursor(leveldb::Iterator *pcursorIn, uint64_t nLookupIdIn, unsigned int nMinHeightIn, unsigned int nMaxHeightIn, bool fReverseIn) :
+    pcursor(pcursorIn), nLookupId(nLookupIdIn), nMinHeight(nMinHeightIn), nMaxHeight(nMaxHeightIn), fReverse(fReverseIn), fValid(false)
+{
+    CExtDiskTxPos posSeek;
+    if (fReverse) {
+        // Last possible position at nMaxHeight
+        posSeek.nHeight = nMaxHeight;
+        posSeek.nFile = -1;
+        posSeek.nPos = posSeek.nTxOffset = std::numeric_limits<unsigned int>::max();
+    } else {
+        posSeek.nHeight = nMinHeight;
+        posSeek.nFile = posSeek.nPos = posSeek.nTxOffset = 0;
     }
     CDataStream ssKeySet(SER_DISK, CLIENT_VERSION);
-    ssKeySet << make_pair('a', lookupid);
+    ssKeySet << CAddrIndexKey(nLookupId, posSeek);
     pcursor->Seek(ssKeySet.str());
+    if (fReverse) {
+        if (!pcursor->Valid())
+            pcursor->SeekToLast();
+        else if (pcursor->key() != leveldb::Slice(ssKeySet.str()))
+            pcursor->Prev();
+    }
+    Load();
+}
 
-    while (pcursor->Valid()) {
-        std::pair<std::pair<char, uint64_t>, CExtDiskTxPos> key;
-        leveldb::Slice slKey = pcursor->key();
-        try {
-            CDataStream ssKey(slKey.data(), slKey.data() + slKey.size(), SER_DISK, CLIENT_VERSION);
-            ssKey >> key;
-        } catch(std::exception &e) {
-            break;
-        }
-        if (key.first.first == 'a' && key.first.second == lookupid) {
-            list.push_back(key.second);
-        } else {
-            break;
-        }
-        pcursor->Next();
+void CAddrIndexCursor::Load() {
+    fValid = false;
+    if (!pcursor->Valid())
+        return;
+    leveldb::Slice slKey = pcursor->key();
+    if (slKey.size() != CAddrIndexKey::SIZE || slKey[0] != 'h')
+        return;
+    CAddrIndexKey key;
+    try {
+        CDataStream ssKey(slKey.data(), slKey.data() + slKey.size(), SER_DISK, CLIENT_VERSION);
+        ssKey >> key;
+    } catch(std::exception &e) {
+        return;
     }
-    return true;
+    if (key.nLookupId != nLookupId || key.pos.nHeight < nMinHeight || key.pos.nHeight > nMaxHeight)
+        return;
+    pos = key.pos;
+    fValid = true;
+}
+
+void CAddrIndexCursor::Next() {
+    if (fReverse)
+        pcursor->Prev();
+    else
+        pcursor->Next();
+    Load();
+}
+
+CAddrIndexCursor *CBlockTreeDB::GetAddrIndexCursor(uint64_t lookupid, unsigned int nMinHeight, unsigned int nMaxHeight, bool fReverse) {
+    return new CAddrIndexCursor(NewIterator(), lookupid, nMinHeight, nMaxHeight, fReverse);
 }
 
-bool CBlockTreeDB::AddAddrIndex(const std::vector<std::pair<uint160, CExtDiskTxPos> > &list) {
+bool CBlockTreeDB::WriteAddrIndex(const std::vector<std::pair<uint64_t, CExtDiskTxPos> > &list) {
     unsigned char foo[0];
     CLevelDBBatch batch;
-    for (std::vector<std::pair<uint160, CExtDiskTxPos> >::const_iterator it=list.begin(); it!=list.end(); it++) {
-        CHashWriter ss(SER_GETHASH, 0);
-        ss << salt;
-        ss << it->first;
-        batch.Write(make_pair(make_pair('a', ss.GetHash().GetLow64()), it->second), FLATDATA(foo));
-    }
-    return WriteBatch(batch, true);
+    for (std::vector<std::pair<uint64_t, CExtDiskTxPos> >::const_iterator it=list.begin(); it!=list.end(); it++)
+        batch.Write(CAddrIndexKey(it->first, it->second), FLATDATA(foo));
+    return WriteBatch(batch);
 }
 
 bool CBlockTreeDB::WriteFlag(const std::string &name, bool fValue) {
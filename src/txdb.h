@@ -6,6 +6,7 @@
 #ifndef BITCREDIT_TXDB_H
 #define BITCREDIT_TXDB_H
 
+#include "crypto/common.h"
 #include "leveldbwrapper.h"
 #include "main.h"
 
@@ -14,6 +15,8 @@
 #include <utility>
 #include <vector>
 
+#include <boost/scoped_ptr.hpp>
+
 class CCoins;
 class uint256;
 
@@ -29,6 +32,8 @@ class CCoinsViewDB : public CCoinsView
 {
 protected:
     CLevelDBWrapper db;
+    //! Totals of the set as of the best block, kept on disk along with it
+    CCoinsTotals totals;
 public:
     CCoinsViewDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
 
@@ -36,8 +41,88 @@ public:
     bool SetCoins(const uint256 &txid, const CCoins &coins);
     bool HaveCoins(const uint256 &txid) const;
     uint256 GetBestBlock() const;
-    bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock);
+    bool GetAddressBalance(const std::string &address, CAddressBalance &balance) const;
+    bool BatchWrite(CCoinsMap &mapCoins, CAddressBalanceMap &mapBalances, CCoinsTotals &totals, const uint256 &hashBlock);
     bool GetStats(CCoinsStats &stats) const;
+
+    /**
+     * Load the set totals written with the best block. If there are none, or
+     * they were written for another block (by a version that did not keep
+     * them), compute them once from the whole set and write them.
+     */
+    bool LoadTotals();
+};
+
+/**
+ * Address index key: 'h', the salted address id, then the transaction
+ * position with its height first, all as fixed-width big endian integers.
+ * Entries of an address thus sort by height, can be sought to directly by
+ * height and share a common prefix that LevelDB compresses away.
+ */
+struct CAddrIndexKey
+{
+    static const unsigned int SIZE = 25;
+
+    uint64_t nLookupId;
+    CExtDiskTxPos pos;
+
+    CAddrIndexKey() : nLookupId(0) {}
+    CAddrIndexKey(uint64_t nLookupIdIn, const CExtDiskTxPos &posIn) : nLookupId(nLookupIdIn), pos(posIn) {}
+
+    unsigned int GetSerializeSize(int nType, int nVersion) const {
+        return SIZE;
+    }
+
+    template<typename Stream>
+    void Serialize(Stream &s, int nType, int nVersion) const {
+        unsigned char data[SIZE];
+        data[0] = 'h';
+        WriteBE64(&data[1], nLookupId);
+        WriteBE32(&data[9], pos.nHeight);
+        WriteBE32(&data[13], pos.nFile);
+        WriteBE32(&data[17], pos.nPos);
+        WriteBE32(&data[21], pos.nTxOffset);
+        s.write((const char*)data, SIZE);
+    }
+
+    template<typename Stream>
+    void Unserialize(Stream &s, int nType, int nVersion) {
+        unsigned char data[SIZE];
+        s.read((char*)data, SIZE);
+        if (data[0] != 'h')
+            throw std::ios_base::failure("CAddrIndexKey::Unserialize: not an address index key");
+        nLookupId = ReadBE64(&data[1]);
+        pos.nHeight = ReadBE32(&data[9]);
+        pos.nFile = ReadBE32(&data[13]);
+        pos.nPos = ReadBE32(&data[17]);
+        pos.nTxOffset = ReadBE32(&data[21]);
+    }
+};
+
+/**
+ * Cursor over the address index entries of one address within a height
+ * range, in ascending or (fReverse) descending position order. It reads a
+ * LevelDB snapshot, so it needs no locks while iterating.
+ */
+class CAddrIndexCursor
+{
+private:
+    boost::scoped_ptr<leveldb::Iterator> pcursor;
+    uint64_t nLookupId;
+    unsigned int nMinHeight;
+    unsigned int nMaxHeight;
+    bool fReverse;
+    bool fValid;
+    CExtDiskTxPos pos;
+
+    void Load();
+
+public:
+    CAddrIndexCursor(leveldb::Iterator *pcursorIn, uint64_t nLookupIdIn, unsigned int nMinHeightIn, unsigned int nMaxHeightIn, bool fReverseIn);
+
+    bool Valid() const { return fValid; }
+    const CExtDiskTxPos &GetPos() const { return pos; }
+    void Next();
 };
 
 /** Access to the block database (blocks/index/) */
@@ -57,8 +142,9 @@ public:
     bool ReadReindexing(bool &fReindex);
     bool ReadTxIndex(const uint256 &txid, CDiskTxPos &pos);
     bool WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos> > &list);
-    bool ReadAddrIndex(uint160 addrid, std::vector<CExtDiskTxPos> &list);
-    bool AddAddrIndex(const std::vector<std::pair<uint160, CExtDiskTxPos> > &list);
+    uint64_t GetAddrIndexKey(const uint160 &addrid) const;
+    CAddrIndexCursor *GetAddrIndexCursor(uint64_t lookupid, unsigned int nMinHeight, unsigned int nMaxHeight, bool fReverse);
+    bool WriteAddrIndex(const std::vector<std::pair<uint64_t, CExtDiskTxPos> > &list);
     bool WriteFlag(const std::string &name, bool fValue);
     bool ReadFlag(const std::string &name, bool &fValue);
     bool LoadBlockIndexGuts();
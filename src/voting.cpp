@@ -14,8 +14,11 @@
 #include <boost/algorithm/string/replace.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/filesystem/fstream.hpp>
+#include <boost/scoped_ptr.hpp>
 #include <boost/thread.hpp>
 
+#include <limits>
+
 #include <sys/stat.h>
 #include <stdio.h>
 
@@ -30,8 +33,12 @@ static int numberOfOffices = 5;
 string electedOffices[6];
 
 //= {"cdo","cto","cso","bnk","nsr",cmo, "XFT"};
-//Implement in memory for now - this will cause slow startup as recalculation of all votes takes place every startup. These should be persisted in a database or on disk
-CBlockIndex* gdBlockPointer = NULL;
+//Balances and voting preferences are kept in memory for the elections and persisted incrementally in pgrantdb
+CGrantDB *pgrantdb = NULL;
+static bool fGrantDatabaseLoaded = false;
+static CGrantUndo grantUndo; //Values replaced by the update in progress
+static std::set<int64_t> grantUndoHeights; //Heights of the undo records in pgrantdb
+int64_t grantAwardsHeight = -1; //Block the current grantAwards were calculated for
 int64_t grantDatabaseBlockHeight=-1; //How many blocks processed for grant allocation purposes
 ofstream grantAwardsOutput;
 bool debugVote = false;
@@ -67,101 +74,279 @@ bool isGrantAwardBlock(int64_t nHeight){
 }
 
 
-void serializeGrantDB(string filename){
+CGrantDB::CGrantDB(size_t nCacheSize, bool fMemory, bool fWipe) : CLevelDBWrapper(GetDataDir() / "ratings" / "grantdb", nCacheSize, fMemory, fWipe) {
+}
 
-		LogPrintf(" Serialize Grant Info Database: Current Grant Database Block Height: %ld\n",grantDatabaseBlockHeight);
+bool CGrantDB::ReadHeight(int64_t &nHeight) {
+    return Read('H', nHeight);
+}
 
-		ofstream grantdb;
-		grantdb.open (filename.c_str(), ios::trunc);
-		
-		//grantDatabaseBlockHeight
-		grantdb << grantDatabaseBlockHeight << "\n";
-		
-		//Balances
-		grantdb << balances.size()<< "\n";
-		for(it=balances.begin(); it!=balances.end(); ++it){
-			grantdb << it->first << "\n" << it->second<< "\n";
-		}
-		
-		//votingPreferences
-        for(int i=0;i<numberOfOffices;i++){
-            grantdb << votingPreferences[i].size()<< "\n";
-            for(vpit=votingPreferences[i].begin(); vpit!=votingPreferences[i].end(); ++vpit){
-                grantdb << vpit->first << "\n";
-                grantdb << vpit->second.size() << "\n";
-                for(it2=vpit->second.begin();it2!=vpit->second.end();++it2){
-                    grantdb << it2->first << "\n" << it2->second<< "\n";
-                }
+bool CGrantDB::ReadUndo(int64_t nHeight, CGrantUndo &undo) {
+    return Read(make_pair('u', nHeight), undo);
+}
+
+bool CGrantDB::ReadUndoHeights(std::set<int64_t> &heights) {
+    boost::scoped_ptr<leveldb::Iterator> pcursor(NewIterator());
+    CDataStream ssKeySet(SER_DISK, CLIENT_VERSION);
+    ssKeySet << 'u';
+    pcursor->Seek(ssKeySet.str());
+    for (; pcursor->Valid(); pcursor->Next()) {
+        try {
+            leveldb::Slice slKey = pcursor->key();
+            CDataStream ssKey(slKey.data(), slKey.data()+slKey.size(), SER_DISK, CLIENT_VERSION);
+            char chType;
+            ssKey >> chType;
+            if (chType != 'u')
+                break;
+            int64_t nHeight;
+            ssKey >> nHeight;
+            heights.insert(nHeight);
+        } catch (const std::exception& e) {
+            return error("%s: Deserialize or I/O error - %s", __func__, e.what());
+        }
+    }
+    return true;
+}
+
+bool CGrantDB::LoadState(std::map<std::string,int64_t> &balancesOut, std::map<std::string,std::map<int64_t,std::string> > *votingPreferencesOut, int nOffices) {
+    boost::scoped_ptr<leveldb::Iterator> pcursor(NewIterator());
+    for (pcursor->SeekToFirst(); pcursor->Valid(); pcursor->Next()) {
+        boost::this_thread::interruption_point();
+        try {
+            leveldb::Slice slKey = pcursor->key();
+            CDataStream ssKey(slKey.data(), slKey.data()+slKey.size(), SER_DISK, CLIENT_VERSION);
+            leveldb::Slice slValue = pcursor->value();
+            CDataStream ssValue(slValue.data(), slValue.data()+slValue.size(), SER_DISK, CLIENT_VERSION);
+            char chType;
+            ssKey >> chType;
+            if (chType == 'b') {
+                std::string address;
+                ssKey >> address;
+                ssValue >> balancesOut[address];
+            } else if (chType == 'p') {
+                std::pair<int, std::string> key;
+                ssKey >> key;
+                if (key.first >= 0 && key.first < nOffices)
+                    ssValue >> votingPreferencesOut[key.first][key.second];
             }
+        } catch (const std::exception& e) {
+            return error("%s: Deserialize or I/O error - %s", __func__, e.what());
         }
+    }
+    return true;
+}
+
+//Remember the value an update is about to replace, once per update
+static void recordGrantBalance(const std::string& address){
+	if(grantUndo.balances.count(address))
+		return;
+	std::map<std::string,int64_t>::const_iterator mi = balances.find(address);
+	grantUndo.balances[address] = (mi == balances.end()) ? std::make_pair(false, (int64_t)0) : std::make_pair(true, mi->second);
+}
+
+static void recordGrantPreferences(int office, const std::string& address){
+	std::pair<int, std::string> key(office, address);
+	if(grantUndo.preferences.count(key))
+		return;
+	std::map<std::string,std::map<int64_t,std::string> >::const_iterator mi = votingPreferences[office].find(address);
+	if(mi == votingPreferences[office].end())
+		grantUndo.preferences[key] = std::make_pair(false, std::map<int64_t,std::string>());
+	else
+		grantUndo.preferences[key] = std::make_pair(true, mi->second);
+}
+
+static void writeGrantBalance(CLevelDBBatch& batch, const std::string& address){
+	std::map<std::string,int64_t>::const_iterator mi = balances.find(address);
+	if(mi == balances.end())
+		batch.Erase(make_pair('b', address));
+	else
+		batch.Write(make_pair('b', address), mi->second);
+}
+
+static void writeGrantPreferences(CLevelDBBatch& batch, int office, const std::string& address){
+	std::map<std::string,std::map<int64_t,std::string> >::const_iterator mi = votingPreferences[office].find(address);
+	if(mi == votingPreferences[office].end())
+		batch.Erase(make_pair('p', make_pair(office, address)));
+	else
+		batch.Write(make_pair('p', make_pair(office, address)), mi->second);
+}
+
+//Queue the entries touched by the update in progress together with its undo record
+static void flushGrantDatabase(CLevelDBBatch& batch){
+	for(std::map<std::string, std::pair<bool, int64_t> >::const_iterator mi = grantUndo.balances.begin(); mi != grantUndo.balances.end(); ++mi)
+		writeGrantBalance(batch, mi->first);
+	for(std::map<std::pair<int, std::string>, std::pair<bool, std::map<int64_t, std::string> > >::const_iterator mi = grantUndo.preferences.begin(); mi != grantUndo.preferences.end(); ++mi)
+		writeGrantPreferences(batch, mi->first.first, mi->first.second);
+	batch.Write(make_pair('u', grantDatabaseBlockHeight), grantUndo);
+	grantUndoHeights.insert(grantDatabaseBlockHeight);
+	//Keep the records of the last GRANT_UNDO_DEPTH updates, however far apart they are
+	while(grantUndoHeights.size() > GRANT_UNDO_DEPTH){
+		batch.Erase(make_pair('u', *grantUndoHeights.begin()));
+		grantUndoHeights.erase(grantUndoHeights.begin());
+	}
+	batch.Write('H', grantDatabaseBlockHeight);
+	grantUndo = CGrantUndo();
+}
 
-		grantdb.flush();
-		grantdb.close();
+//Restore the values replaced by the most recent update
+static void rollbackGrantDatabase(const CGrantUndo& undo, CLevelDBBatch& batch){
+	LogPrintf("Rolling back Grant Database from Block # %ld to Block # %ld\n", grantDatabaseBlockHeight, undo.nPrevHeight);
+	for(std::map<std::string, std::pair<bool, int64_t> >::const_iterator mi = undo.balances.begin(); mi != undo.balances.end(); ++mi){
+		if(mi->second.first)
+			balances[mi->first] = mi->second.second;
+		else
+			balances.erase(mi->first);
+		writeGrantBalance(batch, mi->first);
+	}
+	for(std::map<std::pair<int, std::string>, std::pair<bool, std::map<int64_t, std::string> > >::const_iterator mi = undo.preferences.begin(); mi != undo.preferences.end(); ++mi){
+		if(mi->second.first)
+			votingPreferences[mi->first.first][mi->first.second] = mi->second.second;
+		else
+			votingPreferences[mi->first.first].erase(mi->first.second);
+		writeGrantPreferences(batch, mi->first.first, mi->first.second);
+	}
+	batch.Erase(make_pair('u', grantDatabaseBlockHeight));
+	grantUndoHeights.erase(grantDatabaseBlockHeight);
+	grantDatabaseBlockHeight = undo.nPrevHeight;
+	batch.Write('H', grantDatabaseBlockHeight);
+	grantAwardsHeight = -1;
 }
 
-bool deSerializeGrantDB(string filename, int64_t maxWanted){
+//Forget everything so that the database is rebuilt from the genesis block
+static void resetGrantDatabase(CLevelDBBatch& batch){
+	LogPrintf("Resetting Grant Database\n");
+	for(std::map<std::string,int64_t>::const_iterator mi = balances.begin(); mi != balances.end(); ++mi)
+		batch.Erase(make_pair('b', mi->first));
+	for(int i=0;i<numberOfOffices+1;i++){
+		for(vpit=votingPreferences[i].begin(); vpit!=votingPreferences[i].end(); ++vpit)
+			batch.Erase(make_pair('p', make_pair(i, vpit->first)));
+		votingPreferences[i].clear();
+	}
+	for(std::set<int64_t>::const_iterator mi = grantUndoHeights.begin(); mi != grantUndoHeights.end(); ++mi)
+		batch.Erase(make_pair('u', *mi));
+	grantUndoHeights.clear();
+	balances.clear();
+	grantDatabaseBlockHeight = -1;
+	grantAwardsHeight = -1;
+	batch.Write('H', grantDatabaseBlockHeight);
+}
 
-	LogPrintf(" De-Serialize Grant Info Database\n Max Blocks Wanted: %ld\n", maxWanted);
+//Unwind updates beyond maxWanted, or start over if their undo records are gone
+static void unwindGrantDatabase(int64_t maxWanted, CLevelDBBatch& batch){
+	CGrantUndo undo;
+	while(grantDatabaseBlockHeight > maxWanted){
+		if(!pgrantdb->ReadUndo(grantDatabaseBlockHeight, undo)){
+			resetGrantDatabase(batch);
+			return;
+		}
+		rollbackGrantDatabase(undo, batch);
+	}
+}
+
+//Write the changes queued while handling one block, if there were any
+static bool commitGrantDatabase(CLevelDBBatch& batch, int64_t nPrevHeight){
+	//Every queued change moves the grant database height
+	if(grantDatabaseBlockHeight == nPrevHeight)
+		return true;
+	return pgrantdb->WriteBatch(batch, true);
+}
 
+//Import the text database written by earlier versions into pgrantdb
+static bool importLegacyGrantDB(string filename, int64_t maxWanted){
 	std::string line;
 	std::string line2;
 	ifstream myfile;
-	
-	myfile.open (filename.c_str());	
 
-	if (myfile.is_open()){
-		getline (myfile,line);
-		grantDatabaseBlockHeight=atoi64(line.c_str());
-		LogPrintf("Deserialize Grant Info Database Found Height %ld\n",grantDatabaseBlockHeight);
-		
-        if(grantDatabaseBlockHeight>maxWanted){
-            //vote database later than required - don't load
-            grantDatabaseBlockHeight=-1;
-            myfile.close();
-            return false;
-        }
-
-		//Balances
-		balances.clear();
-		getline (myfile,line);
-		int64_t balancesSize=atoi64(line.c_str());
-		for(int i=0;i<balancesSize;i++){
-			getline(myfile, line );
-			getline(myfile, line2 );
-			balances[line]=atoi64(line2.c_str());
-		}
-		
-		//votingPreferences
-        for(int i=0;i<numberOfOffices;i++){
-            votingPreferences[i].clear();
-            getline(myfile,line);
-            int64_t votingPreferencesSize=atoi64(line.c_str());
-            for(int k=0;k<votingPreferencesSize;k++){
-                getline(myfile,line);
-                std::string vpAddress=line;
-                getline(myfile,line);
-                int64_t vpAddressSize=atoi64(line.c_str());
-			
-                for(int j=0;j<vpAddressSize;j++){
-                    getline(myfile,line);
-                    getline(myfile,line2);
-                    votingPreferences[i][vpAddress][atoi64(line.c_str())]=line2;
-                }
-            }
-        }
+	myfile.open (filename.c_str());
+	if (!myfile.is_open())
+		return false;
 
+	getline (myfile,line);
+	int64_t legacyHeight=atoi64(line.c_str());
+	LogPrintf("Importing legacy Grant Info Database at height %ld, max blocks wanted: %ld\n", legacyHeight, maxWanted);
+	if(legacyHeight>maxWanted){
+		//vote database later than required - don't load
 		myfile.close();
-		//Set the pointer to next block to process
-		gdBlockPointer=chainActive.Genesis();
-		for(int i=0;i<grantDatabaseBlockHeight;i++){
-            if(gdBlockPointer == NULL ){
-				LogPrintf("Insufficent number of blocks loaded %s\n",filename.c_str());
-				return false;
+		return false;
+	}
+
+	//Balances
+	getline (myfile,line);
+	int64_t balancesSize=atoi64(line.c_str());
+	for(int i=0;i<balancesSize;i++){
+		getline(myfile, line );
+		getline(myfile, line2 );
+		balances[line]=atoi64(line2.c_str());
+	}
+
+	//votingPreferences
+	for(int i=0;i<numberOfOffices;i++){
+		getline(myfile,line);
+		int64_t votingPreferencesSize=atoi64(line.c_str());
+		for(int k=0;k<votingPreferencesSize;k++){
+			getline(myfile,line);
+			std::string vpAddress=line;
+			getline(myfile,line);
+			int64_t vpAddressSize=atoi64(line.c_str());
+
+			for(int j=0;j<vpAddressSize;j++){
+				getline(myfile,line);
+				getline(myfile,line2);
+				votingPreferences[i][vpAddress][atoi64(line.c_str())]=line2;
 			}
-			gdBlockPointer=chainActive.Tip();
+		}
+	}
+	myfile.close();
+
+	CLevelDBBatch batch;
+	for(std::map<std::string,int64_t>::const_iterator mi = balances.begin(); mi != balances.end(); ++mi)
+		writeGrantBalance(batch, mi->first);
+	for(int i=0;i<numberOfOffices;i++)
+		for(vpit=votingPreferences[i].begin(); vpit!=votingPreferences[i].end(); ++vpit)
+			writeGrantPreferences(batch, i, vpit->first);
+	grantDatabaseBlockHeight = legacyHeight;
+	batch.Write('H', grantDatabaseBlockHeight);
+	return pgrantdb->WriteBatch(batch, true);
+}
+
+//Load the persisted state once per process; afterwards it is only advanced or unwound incrementally
+static bool loadGrantDatabase(int64_t maxWanted){
+	string newCV=GetArg("-custombankprefix","vte");
+	electedOffices[0] = "dof";
+	electedOffices[1] = "tof";
+	electedOffices[2] = "sof";
+	electedOffices[3] = "mof";
+	electedOffices[4] = "bnk";
+	electedOffices[5] = newCV;
+
+	fGrantDatabaseLoaded = true;
+	grantDatabaseBlockHeight = -1;
+	grantUndoHeights.clear();
+	balances.clear();
+	for(int i=0;i<numberOfOffices+1;i++)
+		votingPreferences[i].clear();
+
+	if(!pgrantdb->ReadHeight(grantDatabaseBlockHeight)){
+		grantDatabaseBlockHeight = -1;
+		if(!importLegacyGrantDB((GetDataDir() / "ratings/grantdb.dat").string(), maxWanted)){
+			balances.clear();
+			for(int i=0;i<numberOfOffices+1;i++)
+				votingPreferences[i].clear();
+			grantDatabaseBlockHeight = -1;
 		}
 		return true;
 	}
+	if(!pgrantdb->LoadState(balances, votingPreferences, numberOfOffices+1) || !pgrantdb->ReadUndoHeights(grantUndoHeights))
+		return false;
+	LogPrintf("Loaded Grant Database at height %ld (%u balances)\n", grantDatabaseBlockHeight, balances.size());
+	return true;
+}
+
+//Start an update that processes blocks on top of the chain tip hashTip
+static void beginGrantUpdate(const uint256& hashTip){
+	grantUndo = CGrantUndo();
+	grantUndo.nPrevHeight = grantDatabaseBlockHeight;
+	grantUndo.hashBlock = hashTip;
 }
 
 bool getGrantAwards(int64_t nHeight){
@@ -170,35 +355,51 @@ bool getGrantAwards(int64_t nHeight){
 		LogPrintf("Error - calling getgrantawards for non grant award block, nHeight requested: %ld", nHeight);
 		return false;
 	}
-	return ensureGrantDatabaseUptoDate(nHeight);
+	LOCK(grantdb);
+	if(!ensureGrantDatabaseUptoDate(nHeight))
+		return false;
+	//Awards are not persisted; recalculate them after a restart or rollback
+	if(grantAwardsHeight != nHeight)
+		return getGrantAwardsFromDatabaseForBlock(nHeight);
+	return true;
 }
 
 bool ensureGrantDatabaseUptoDate(int64_t nHeight){
 
 	LogPrintf(" === Grant Database Block Height %ld === \n", grantDatabaseBlockHeight);
-    //This should always be true on startup
-    if(grantDatabaseBlockHeight==-1){
-		string newCV=GetArg("-custombankprefix","vte");
-		electedOffices[0] = "dof";
-		electedOffices[1] = "tof";
-		electedOffices[2] = "sof";
-		electedOffices[3] = "mof";
-		electedOffices[4] = "bnk";
-		electedOffices[5] = newCV;
-    }
 
     //NOTE: requiredgrantdatabaseheight is 5 less than the current block
 	int64_t requiredGrantDatabaseHeight =nHeight-GRANTBLOCKINTERVAL;
 
  	LogPrintf("Checking GDB is updated...Required Height : %ld, requested from: %ld \n",requiredGrantDatabaseHeight, nHeight);
-    //Maybe we don't have to count votes from the start - let's check if there's a recent vote database stored
-    if(grantDatabaseBlockHeight== -1){
-			deSerializeGrantDB((GetDataDir() / "ratings/grantdb.dat" ).string().c_str(), requiredGrantDatabaseHeight );
-	}
-    while(grantDatabaseBlockHeight < requiredGrantDatabaseHeight ){
-        processNextBlockIntoGrantDatabase();
+    if(!fGrantDatabaseLoaded && !loadGrantDatabase(requiredGrantDatabaseHeight))
+		return false;
+
+	//Whatever this block changes reaches the database in a single batch, like the chainstate
+	CLevelDBBatch batch;
+	int64_t nPrevHeight = grantDatabaseBlockHeight;
+	unwindGrantDatabase(requiredGrantDatabaseHeight, batch);
+	if(grantDatabaseBlockHeight < requiredGrantDatabaseHeight){
+		beginGrantUpdate(chainActive.Tip()->GetBlockHash());
+		while(grantDatabaseBlockHeight < requiredGrantDatabaseHeight ){
+			processNextBlockIntoGrantDatabase();
+		}
+		flushGrantDatabase(batch);
 	}
-    return true;
+	return commitGrantDatabase(batch, nPrevHeight);
+}
+
+bool disconnectGrantDatabase(const CBlockIndex *pindex){
+	LOCK(grantdb);
+	if(!fGrantDatabaseLoaded && !loadGrantDatabase(std::numeric_limits<int64_t>::max()))
+		return false;
+	//Roll back every update that processed the block being disconnected, in one batch
+	CLevelDBBatch batch;
+	int64_t nPrevHeight = grantDatabaseBlockHeight;
+	CGrantUndo undo;
+	while(grantDatabaseBlockHeight >= 0 && pgrantdb->ReadUndo(grantDatabaseBlockHeight, undo) && undo.hashBlock == pindex->GetBlockHash())
+		rollbackGrantDatabase(undo, batch);
+	return commitGrantDatabase(batch, nPrevHeight);
 }
 
 int getOfficeNumberFromAddress(string grantVoteAddress){
@@ -231,108 +432,123 @@ void printVotingPrefs(std::string address){
 
 }
 
-void processNextBlockIntoGrantDatabase(){	
-	CBlock block;
-
-	if(gdBlockPointer != NULL){
-		gdBlockPointer = chainActive.Tip();
-	}else{
-		gdBlockPointer = chainActive.Genesis();
+/** Effect of processing one block into the grant database */
+struct CGrantBlockDelta
+{
+	uint256 hashBlock;
+	std::map<std::string,int64_t> balances; //Net balance change per address
+	std::vector<std::pair<std::pair<int,std::string>, std::pair<int64_t,std::string> > > votes; //(office, voter) -> (preference, candidate), in block order
+};
+
+//Spent output from the block's undo data, or looked up on disk when there is none
+static bool getSpentOutput(const CTransaction& tx, unsigned int nIn, const CTxUndo* ptxundo, CTxOut& txOut){
+	if(ptxundo){
+		txOut = ptxundo->vprevout[nIn].txout;
+		return true;
 	}
-/*
- * 	CBlock block;
-    CBlockIndex* pblockindex = chainActive[209980];
-    std::string hex = pblockindex->phashBlock->GetHex();     
-    uint256 hash(hex);
+	CTransaction txOfPrevOutput;
+	uint256 blockHash;
+	if (!GetTransaction(tx.vin[nIn].prevout.hash, txOfPrevOutput, blockHash, true))
+		return false;
+	if (tx.vin[nIn].prevout.n >= txOfPrevOutput.vout.size())
+		return false;
+	txOut = txOfPrevOutput.vout[tx.vin[nIn].prevout.n];
+	return true;
+}
 
-	if(gdBlockPointer != NULL){
-		gdBlockPointer = chainActive.Tip();
-	}else{
-		gdBlockPointer = mapBlockIndex[hash];
+//The same tip is processed several times in a row, so its effect is computed once
+static const CGrantBlockDelta& getGrantBlockDelta(const CBlockIndex* pindex){
+	static CGrantBlockDelta delta;
+	if(delta.hashBlock == pindex->GetBlockHash())
+		return delta;
+	delta = CGrantBlockDelta();
+	delta.hashBlock = pindex->GetBlockHash();
+
+	CBlock block;
+	if(!ReadBlockFromDisk(block, pindex)){
+		LogPrintf("Grant Database could not read block %s\n", delta.hashBlock.ToString());
+		return delta;
 	}
- * further study required
-*/
-	ReadBlockFromDisk(block, gdBlockPointer);
-	
-		std::map<std::string,int64_t > votes;
-		std::map<std::string,int64_t >::iterator votesit;
-		
-    BOOST_FOREACH(const CTransaction& tx, block.vtx){
+	CBlockUndo blockUndo;
+	CDiskBlockPos pos = pindex->GetUndoPos();
+	bool fUndo = pindex->pprev && !pos.IsNull() && blockUndo.ReadFromDisk(pos, pindex->pprev->GetBlockHash()) &&
+		blockUndo.vtxundo.size() + 1 == block.vtx.size();
+
+	std::map<std::string,int64_t > votes;
+	std::map<std::string,int64_t >::iterator votesit;
+
+	for (unsigned int t = 0; t < block.vtx.size(); t++){
+		const CTransaction& tx = block.vtx[t];
 
 		for (unsigned int j = 0; j < tx.vout.size();j++){
 			CTxDestination address;
 			ExtractDestination(tx.vout[j].scriptPubKey, address);
-			string receiveAddress = CBitcreditAddress( address ).ToString().c_str();
+			string receiveAddress = CBitcreditAddress( address ).ToString();
 			int64_t theAmount = tx.vout[ j ].nValue;
-			balances[ receiveAddress ] = balances[ receiveAddress ] + theAmount;
+			delta.balances[ receiveAddress ] += theAmount;
 			if(theAmount == 1000 &&	startsWith(receiveAddress.c_str(), GRANTPREFIX.c_str())){
 				votes[receiveAddress] = theAmount;
 			}
 		}
 
-        for (size_t i = 0; i < tx.vin.size(); i++){
-			if (tx.IsCoinBase())
-				continue; 			
-            const CScript &script = tx.vin[i].scriptSig;
-            opcodetype opcode;
-            std::vector<unsigned char> vch;
-            uint256 prevoutHash, blockHash;
-            string spendAddress;
-            int64_t theAmount;
-            for (CScript::const_iterator pc = script.begin(); script.GetOp(pc, opcode, vch); ){
-                if (opcode == 33){
-                    CPubKey pubKey(vch);
-                    prevoutHash = tx.vin[i].prevout.hash;
-                    CTransaction txOfPrevOutput;
-                    if (!GetTransaction(prevoutHash, txOfPrevOutput, blockHash, true))
-                    {
-                        continue;
-                    }                               
-                    unsigned int nOut = tx.vin[i].prevout.n;
-                    if (nOut >= txOfPrevOutput.vout.size())
-                    {
-                        continue;
-                    }
-                    const CTxOut &txOut = txOfPrevOutput.vout[nOut];
-                    CTxDestination addressRet;
-                    if (!ExtractDestination(txOut.scriptPubKey, addressRet))
-                    {
-                        continue;
-                    }                    
-                    spendAddress = CBitcreditAddress(addressRet).ToString().c_str();
-					theAmount =  txOut.nValue;
-					balances[ spendAddress ] = balances[ spendAddress ] - theAmount;
+		if (tx.IsCoinBase())
+			continue;
+		for (size_t i = 0; i < tx.vin.size(); i++){
+			const CScript &script = tx.vin[i].scriptSig;
+			opcodetype opcode;
+			std::vector<unsigned char> vch;
+			for (CScript::const_iterator pc = script.begin(); script.GetOp(pc, opcode, vch); ){
+				if (opcode != 33)
+					continue;
+				CTxOut txOut;
+				if (!getSpentOutput(tx, i, fUndo ? &blockUndo.vtxundo[t-1] : NULL, txOut))
+					continue;
+				CTxDestination addressRet;
+				if (!ExtractDestination(txOut.scriptPubKey, addressRet))
+					continue;
+				string spendAddress = CBitcreditAddress(addressRet).ToString();
+				delta.balances[ spendAddress ] -= txOut.nValue;
 
 				for( votesit = votes.begin();votesit != votes.end(); ++votesit){
-                    if(fDebug)LogPrintf(" Vote found: %s, %ld\n",votesit->first.c_str(),votesit->second);
+					if(fDebug)LogPrintf(" Vote found: %s, %ld\n",votesit->first.c_str(),votesit->second);
 					string grantVoteAddress = ( votesit->first );
 					int electedOfficeNumber = getOfficeNumberFromAddress(grantVoteAddress);
 
 					if( electedOfficeNumber > -1 ){
-                        votingPreferences[ electedOfficeNumber ][ spendAddress ][ votesit->second ] = grantVoteAddress;
-                    }
+						delta.votes.push_back(std::make_pair(std::make_pair(electedOfficeNumber, spendAddress), std::make_pair(votesit->second, grantVoteAddress)));
+					}
 				}
-                }
-            }
-        }
-    }
+			}
+		}
+	}
+	return delta;
+}
+
+//Add the effect of a block to the update in progress
+static void applyGrantBlockDelta(const CGrantBlockDelta& delta){
+	for(std::map<std::string,int64_t>::const_iterator mi = delta.balances.begin(); mi != delta.balances.end(); ++mi){
+		recordGrantBalance(mi->first);
+		balances[ mi->first ] = balances[ mi->first ] + mi->second;
+	}
+	for(unsigned int i = 0; i < delta.votes.size(); i++){
+		int office = delta.votes[i].first.first;
+		const std::string& voter = delta.votes[i].first.second;
+		recordGrantPreferences(office, voter);
+		votingPreferences[ office ][ voter ][ delta.votes[i].second.first ] = delta.votes[i].second.second;
+	}
 	grantDatabaseBlockHeight++;
+}
+
+void processNextBlockIntoGrantDatabase(){
+	//The genesis block is processed first, the current tip after that
+	const CBlockIndex* pindex = (grantDatabaseBlockHeight == -1) ? chainActive.Genesis() : chainActive.Tip();
+	applyGrantBlockDelta(getGrantBlockDelta(pindex));
 
-	LogPrintf("Block has been processed. Grant Database Block Height is now updated to Block # %ld\n", grantDatabaseBlockHeight);
+	if(fDebug)LogPrintf("Block has been processed. Grant Database Block Height is now updated to Block # %ld\n", grantDatabaseBlockHeight);
 	if (isGrantAwardBlock(grantDatabaseBlockHeight + GRANTBLOCKINTERVAL)) {
 		getGrantAwardsFromDatabaseForBlock( grantDatabaseBlockHeight + GRANTBLOCKINTERVAL );
 
 	}
-
-    boost::filesystem::path biddir = GetDataDir() / "ratings";
-
-    if(!(boost::filesystem::exists(biddir))){
-        if(fDebug)LogPrintf("Grants dir Doesn't Exists\n");
-
-        if (boost::filesystem::create_directory(biddir))
-            if(fDebug)LogPrintf("Grants dir....Successfully Created !\n");
-    }
-	serializeGrantDB( (GetDataDir() / "ratings/grantdb.dat" ).string().c_str() );
 }
 
 void printCandidateSupport(){
@@ -458,6 +674,7 @@ bool getGrantAwardsFromDatabaseForBlock(int64_t nHeight){
 	}
 
 	if(debugVote){grantAwardsOutput.close();}
+	grantAwardsHeight = nHeight;
 	return true;
 }
 
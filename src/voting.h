@@ -2,6 +2,8 @@
 #include "sync.h"
 #include "util.h"
 #include "amount.h"
+#include "leveldbwrapper.h"
+#include "uint256.h"
 
 
 #include <algorithm>
@@ -17,6 +19,54 @@
 
 #include <list>
 using namespace std;
+
+class CBlockIndex;
+
+/**
+ * Values a grant database update replaced, so that it can be rolled back when
+ * the block that fed it is disconnected. A missing entry is stored as (false, ...).
+ */
+class CGrantUndo
+{
+public:
+    int64_t nPrevHeight; //!< grant database height before the update
+    uint256 hashBlock;   //!< chain tip whose transactions were processed by the update
+    std::map<std::string, std::pair<bool, int64_t> > balances;
+    std::map<std::pair<int, std::string>, std::pair<bool, std::map<int64_t, std::string> > > preferences;
+
+    CGrantUndo() : nPrevHeight(-1), hashBlock(0) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        READWRITE(nPrevHeight);
+        READWRITE(hashBlock);
+        READWRITE(balances);
+        READWRITE(preferences);
+    }
+};
+
+/** Number of grant database updates that can be rolled back */
+static const unsigned int GRANT_UNDO_DEPTH = 2000;
+
+/** Access to the grant database (ratings/grantdb/) */
+class CGrantDB : public CLevelDBWrapper
+{
+public:
+    CGrantDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+private:
+    CGrantDB(const CGrantDB&);
+    void operator=(const CGrantDB&);
+public:
+    bool ReadHeight(int64_t &nHeight);
+    bool ReadUndo(int64_t nHeight, CGrantUndo &undo);
+    //! Heights of all stored undo records
+    bool ReadUndoHeights(std::set<int64_t> &heights);
+    bool LoadState(std::map<std::string,int64_t> &balances, std::map<std::string,std::map<int64_t,std::string> > *votingPreferences, int nOffices);
+};
+
+extern CGrantDB *pgrantdb;
 extern CCriticalSection grantdb;
 extern std::map<std::string,int64_t > grantAwards;
 extern std::map<std::string,int64_t>::iterator gait;
@@ -26,6 +76,7 @@ int64_t getGrantDatabaseBlockHeight();
 void processNextBlockIntoGrantDatabase();
 bool getGrantAwardsFromDatabaseForBlock(int64_t nHeight);
 bool ensureGrantDatabaseUptoDate(int64_t nHeight);
+bool disconnectGrantDatabase(const CBlockIndex *pindex);
 bool startsWith(const char *str, const char *pre);
 void getWinnersFromBallots(int64_t nHeight,int officeNumber);
 string electOrEliminate(int64_t droopQuota,  unsigned int requiredCandidates);
@@ -33,4 +84,3 @@ void electCandidate(string topOfThePoll, double gregorySurplusTransferValue,bool
 void eliminateCandidate(string topOfThePoll,bool isLastCandidate);
 void printBallots();
 
-bool deSerializeGrantDB(string filename);